@@ -15,6 +15,7 @@ TEMPLATE = app
 SOURCES += main.cpp \
         MainWindow.cpp \
     ../Core/OctreeSF.cpp \
+    ../Core/LinearOctreeSF.cpp \
     ../Core/OctreeSDF.cpp \
     ../Core/Mesh.cpp \
     ../Core/OgreMath/OgreVector3.cpp \
@@ -39,8 +40,13 @@ HEADERS  += MainWindow.h \
     ../Core/TriangleLookupTable.h \
     ../Core/Triangle.h \
     ../Core/TransformSDF.h \
+    ../Core/ThreadPool.h \
     ../Core/Surfaces.h \
     ../Core/Sphere.h \
+    ../Core/SignBits.h \
+    ../Core/LeafFaceCache.h \
+    ../Core/NodeArena.h \
+    ../Core/OctreeFile.h \
     ../Core/SDFManager.h \
     ../Core/Ray.h \
     ../Core/Profiler.h \
@@ -49,6 +55,7 @@ HEADERS  += MainWindow.h \
     ../Core/OpInvertSDF.h \
     ../Core/OpIntersectionSDF.h \
     ../Core/OctreeSF.h \
+    ../Core/LinearOctreeSF.h \
     ../Core/OctreeSDF.h \
     ../Core/OBJReader.h \
     ../Core/Mesh.h \
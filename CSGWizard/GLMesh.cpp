@@ -1,7 +1,7 @@
 #include "GLMesh.h"
 #include "GLManager.h"
 
-GLMesh::GLMesh(std::shared_ptr<OctreeSF> octree) : m_Octree(octree)
+GLMesh::GLMesh(std::shared_ptr<OctreeSF> octree) : m_Octree(octree), m_VertexBufferSize(0), m_IndexBufferSize(0)
 {
     GLManager::getSingleton().getGLFunctions()->glGenBuffers(1, &m_VertexBuffer);
     GLManager::getSingleton().getGLFunctions()->glGenBuffers(1, &m_IndexBuffer);
@@ -16,21 +16,36 @@ GLMesh::~GLMesh()
 
 void GLMesh::updateMesh()
 {
-    m_Mesh = m_Octree->generateMesh();
+    m_Octree->updateIncrementalMesh(m_IncrementalMesh);
+    m_Mesh = m_IncrementalMesh.mesh;
     /*mesh->vertexBuffer.push_back(Ogre::Vector3(0, 0, 0));
     mesh->vertexBuffer.push_back(Ogre::Vector3(0, 1, 0));
     mesh->vertexBuffer.push_back(Ogre::Vector3(0, 0, 1));
     mesh->indexBuffer.push_back(0);
     mesh->indexBuffer.push_back(1);
     mesh->indexBuffer.push_back(2);*/
+    // grown buffers are uploaded completely, otherwise only the ranges of the remeshed leaves
+    bool uploadAll = m_IncrementalMesh.rebuilt || m_Mesh->vertexBuffer.size() != m_VertexBufferSize || m_Mesh->indexBuffer.size() != m_IndexBufferSize;
     m_VertexBufferSize = (int)m_Mesh->vertexBuffer.size();
     m_IndexBufferSize = (int)m_Mesh->indexBuffer.size();
 
     GLManager::getSingleton().getGLFunctions()->glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
-    GLManager::getSingleton().getGLFunctions()->glBufferData(GL_ARRAY_BUFFER, m_VertexBufferSize * sizeof(Vertex), m_Mesh->vertexBuffer.data(), GL_DYNAMIC_DRAW);
+    if (uploadAll)
+        GLManager::getSingleton().getGLFunctions()->glBufferData(GL_ARRAY_BUFFER, m_VertexBufferSize * sizeof(Vertex), m_Mesh->vertexBuffer.data(), GL_DYNAMIC_DRAW);
+    else
+    {
+        for (auto i = m_IncrementalMesh.changedVertices.begin(); i != m_IncrementalMesh.changedVertices.end(); ++i)
+            GLManager::getSingleton().getGLFunctions()->glBufferSubData(GL_ARRAY_BUFFER, i->first * sizeof(Vertex), i->second * sizeof(Vertex), m_Mesh->vertexBuffer.data() + i->first);
+    }
 
     GLManager::getSingleton().getGLFunctions()->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
-    GLManager::getSingleton().getGLFunctions()->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_IndexBufferSize * sizeof(unsigned int), m_Mesh->indexBuffer.data(), GL_DYNAMIC_DRAW);
+    if (uploadAll)
+        GLManager::getSingleton().getGLFunctions()->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_IndexBufferSize * sizeof(unsigned int), m_Mesh->indexBuffer.data(), GL_DYNAMIC_DRAW);
+    else
+    {
+        for (auto i = m_IncrementalMesh.changedIndices.begin(); i != m_IncrementalMesh.changedIndices.end(); ++i)
+            GLManager::getSingleton().getGLFunctions()->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, i->first * sizeof(unsigned int), i->second * sizeof(unsigned int), m_Mesh->indexBuffer.data() + i->first);
+    }
 }
 
 void GLMesh::render()
@@ -9,6 +9,7 @@ class GLMesh
 {
 protected:
     std::shared_ptr<OctreeSF> m_Octree;
+    OctreeSF::IncrementalMesh m_IncrementalMesh;
     std::shared_ptr<Mesh> m_Mesh;
     GLuint m_VertexBuffer;
     GLuint m_IndexBuffer;
@@ -19,6 +20,7 @@ public:
     GLMesh(std::shared_ptr<OctreeSF> octree);
     ~GLMesh();
 
+    /// Remeshes the leaves changed since the last update and uploads the changed buffer ranges.
     void updateMesh();
 
     void render();
@@ -13,15 +13,35 @@ public:
 	{
 		if (containsPoint(point))
 		{
+			// the closest surface point lies on the nearest face
 			Ogre::Vector3 minVec = point - min;
 			Ogre::Vector3 maxVec = max - point;
 			s.signedDistance = std::min(minVec.minComponent(), maxVec.minComponent());
+			s.closestSurfacePos = point;
+			s.normal = Ogre::Vector3(0, 0, 0);
+			for (int i = 0; i < 3; i++)
+			{
+				if (minVec[i] == s.signedDistance)
+				{
+					s.closestSurfacePos[i] = min[i];
+					s.normal[i] = -1.0f;
+					break;
+				}
+				if (maxVec[i] == s.signedDistance)
+				{
+					s.closestSurfacePos[i] = max[i];
+					s.normal[i] = 1.0f;
+					break;
+				}
+			}
 		}
 		else
 		{
-			s.signedDistance = -std::sqrtf(squaredDistance(point));
+			for (int i = 0; i < 3; i++)
+				s.closestSurfacePos[i] = std::min(std::max(point[i], min[i]), max[i]);
+			s.normal = point - s.closestSurfacePos;
+			s.signedDistance = -s.normal.normalise();
 		}
-		// todo: compute normal
 	}
 
 	virtual bool getSign(const Ogre::Vector3& point) const override
@@ -29,6 +49,51 @@ public:
 		return containsPoint(point);
 	}
 
+	virtual void getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const override
+	{
+		for (int i = 0; i < numPoints; i++)
+			AABBGeometry::getSample(points[i], samples[i]);
+	}
+
+	virtual void getSigns(const Ogre::Vector3* points, int numPoints, bool* signs) const override
+	{
+		for (int i = 0; i < numPoints; i++)
+			signs[i] = containsPoint(points[i]);
+	}
+
+	virtual void getLatticeSamples(const Lattice& lattice, Sample* samples) const override
+	{
+		for (int x = 0; x < lattice.size.x; x++)
+			for (int y = 0; y < lattice.size.y; y++)
+				for (int z = 0; z < lattice.size.z; z++)
+					AABBGeometry::getSample(lattice.getPoint(x, y, z), *samples++);
+	}
+
+	virtual void getLatticeSigns(const Lattice& lattice, bool* signs) const override
+	{
+		// a point is inside if it is inside the slab of every axis
+		std::vector<bool> insideSlab[3];
+		for (int dim = 0; dim < 3; dim++)
+		{
+			insideSlab[dim].resize(lattice.size[dim]);
+			for (int i = 0; i < lattice.size[dim]; i++)
+			{
+				float coord = lattice.getCoord(dim, i);
+				insideSlab[dim][i] = coord >= min[dim] && coord < max[dim];
+			}
+		}
+		for (int x = 0; x < lattice.size.x; x++)
+		{
+			for (int y = 0; y < lattice.size.y; y++)
+			{
+				bool insideXY = insideSlab[0][x] && insideSlab[1][y];
+				for (int z = 0; z < lattice.size.z; z++)
+					signs[z] = insideXY && insideSlab[2][z];
+				signs += lattice.size.z;
+			}
+		}
+	}
+
 	virtual bool intersectsSurface(const AABB& aabb) const override
 	{
 		if (!intersectsAABB(aabb)) return false;
@@ -65,11 +65,62 @@ public:
 		if (s) intersections.push_back(std::make_pair(s, intersection));
 	}
 
+	struct BatchResult : public Ray::BatchResult
+	{
+		/// The leaf surface hit by each ray or nullptr.
+		std::vector<const LeafType*> leaves;
+
+		void resize(size_t numRays)
+		{
+			Ray::BatchResult::resize(numRays);
+			leaves.assign(numRays, nullptr);
+		}
+	};
+
+	/// Closest hits of a batch of rays. Nodes traverse packets of consecutive rays together, so coherent rays should be next to each other.
+	virtual void rayIntersectClosestBatch(const std::vector<Ray>& rays, BatchResult& result) const
+	{
+		// default implementation
+		result.resize(rays.size());
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			Ray::Intersection intersection;
+			intersection.t = std::numeric_limits<float>::infinity();
+			storeBatchHit(result, i, rayIntersectUpdate(intersection, rays[i]), intersection);
+		}
+	}
+
+	/// Any hits closer than maxDist of a batch of rays, packets of consecutive rays are traversed together.
+	virtual void rayIntersectAnyBatch(const std::vector<Ray>& rays, float maxDist, BatchResult& result) const
+	{
+		// default implementation
+		result.resize(rays.size());
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			Ray::Intersection intersection;
+			intersection.t = maxDist;
+			storeBatchHit(result, i, rayIntersectUpdate(intersection, rays[i]), intersection);
+		}
+	}
+
+	static inline void storeBatchHit(BatchResult& result, size_t rayIndex, const LeafType* leaf, const Ray::Intersection& intersection)
+	{
+		if (!leaf) return;
+		result.hit[rayIndex] = 1;
+		result.t[rayIndex] = intersection.t;
+		result.userData[rayIndex] = intersection.userData[0];
+		result.leaves[rayIndex] = leaf;
+	}
+
 	__forceinline Type getType() const { return mType; }
 
 	/// Retrieves the squares distance for this BVH node to the given point.
 	virtual float squaredDistance(const Ogre::Vector3& point) const = 0;
 
+	/// Retrieves a lower bound of the squared distance from point to the closest leaf using only bounding volumes, no exact leaf distances are computed.
+	/// Refinement stops as soon as the bound reaches maxSquaredDistance.
+	virtual float squaredDistanceLowerBound(const Ogre::Vector3& point, float) const { return squaredDistance(point); }
+
 	struct ClosestLeafResult
 	{
 		ClosestLeafResult() : closestDistance(999999.0f) {}
@@ -406,6 +457,77 @@ public:
 		mChildren[1]->rayIntersectAll(ray, intersections);
 	}
 
+	void rayIntersectClosestBatch(const std::vector<Ray>& rays, typename BVH<LeafType>::BatchResult& result) const override
+	{
+		rayIntersectBatch(rays, std::numeric_limits<float>::infinity(), false, result);
+	}
+
+	void rayIntersectAnyBatch(const std::vector<Ray>& rays, float maxDist, typename BVH<LeafType>::BatchResult& result) const override
+	{
+		rayIntersectBatch(rays, maxDist, true, result);
+	}
+
+	void rayIntersectBatch(const std::vector<Ray>& rays, float maxDist, bool anyHit, typename BVH<LeafType>::BatchResult& result) const
+	{
+		result.resize(rays.size());
+		std::vector<unsigned int> order;
+		RayPacket::sortCoherent(rays, order);
+		for (size_t first = 0; first < rays.size(); first += RayPacket::SIZE)
+		{
+			RayPacket packet(rays, &order[first], (int)std::min(rays.size() - first, (size_t)RayPacket::SIZE), maxDist);
+			Ray::Intersection intersections[RayPacket::SIZE];
+			const LeafType* leaves[RayPacket::SIZE];
+			for (int i = 0; i < RayPacket::SIZE; i++)
+			{
+				intersections[i].t = maxDist;
+				leaves[i] = nullptr;
+			}
+			rayIntersectPacket(packet, packet.getMask(), anyHit, intersections, leaves);
+			for (int i = 0; i < packet.size; i++)
+				BVH<LeafType>::storeBatchHit(result, order[first + i], leaves[i], intersections[i]);
+		}
+	}
+
+	/// Traverses the subtree with the rays of the mask, children are visited in the front to back order of the first ray.
+	/// Returns the rays of the mask that still search for a hit, for any hit queries a ray stops at its first hit.
+	unsigned int rayIntersectPacket(RayPacket& packet, unsigned int mask, bool anyHit, Ray::Intersection* intersections, const LeafType** leaves) const
+	{
+		unsigned int activeMask = packet.intersectAABB(mBoundingVolume.getMin(), mBoundingVolume.getMax(), mask);
+		if (!activeMask) return mask;
+		unsigned int remainingMask = mask & ~activeMask;
+		int firstRay = RayPacket::getFirstRay(activeMask);
+		if (RayPacket::isSingleRay(activeMask))
+		{
+			if (const LeafType* leaf = rayIntersectUpdate(intersections[firstRay], *packet.rays[firstRay]))
+			{
+				leaves[firstRay] = leaf;
+				packet.tFar[firstRay] = intersections[firstRay].t;
+				if (anyHit) return remainingMask;
+			}
+			return mask;
+		}
+		int nearChild = packet.rays[firstRay]->sign[mSplitAxis];
+		for (int c = 0; c < 2 && activeMask; c++)
+		{
+			const BVH<LeafType>* child = mChildren[c ? 1 - nearChild : nearChild];
+			if (child->getType() == BVH<LeafType>::NODE)
+			{
+				activeMask = static_cast<const BVHNode*>(child)->rayIntersectPacket(packet, activeMask, anyHit, intersections, leaves);
+				continue;
+			}
+			for (int i = 0; i < packet.size; i++)
+			{
+				if (!(activeMask & (1u << i))) continue;
+				const LeafType* leaf = child->rayIntersectUpdate(intersections[i], *packet.rays[i]);
+				if (!leaf) continue;
+				leaves[i] = leaf;
+				packet.tFar[i] = intersections[i].t;
+				if (anyHit) activeMask &= ~(1u << i);
+			}
+		}
+		return remainingMask | activeMask;
+	}
+
 	//! Finds leaf that is closest to a given point.
 	const LeafType* getClosestLeaf(const Ogre::Vector3& point, ClosestLeafResult& result) const override
 	{
@@ -469,6 +591,16 @@ public:
 		return mBoundingVolume.squaredDistance(point);
 	}
 
+	float squaredDistanceLowerBound(const Ogre::Vector3& point, float maxSquaredDistance) const override
+	{
+		float squaredDist = mBoundingVolume.squaredDistance(point);
+		if (squaredDist >= maxSquaredDistance) return squaredDist;
+		int closer = (mChildren[0]->squaredDistance(point) < mChildren[1]->squaredDistance(point)) ? 0 : 1;
+		float closerDist = mChildren[closer]->squaredDistanceLowerBound(point, maxSquaredDistance);
+		float furtherDist = mChildren[1 - closer]->squaredDistanceLowerBound(point, std::min(maxSquaredDistance, closerDist));
+		return std::min(closerDist, furtherDist);
+	}
+
 	bool intersectsAABB(const AABB& aabb) const override
 	{
 		if (!mBoundingVolume.intersectsAABB(aabb)) return false;
@@ -18,13 +18,15 @@ protected:
 	float m_Roughness;
 	float m_ZRange;
 	float m_Size;
+	float m_MaxHeightStep;
+	float m_LipschitzConstant;
 	AABB m_AABB;
 	AABB m_SurfaceAABB;
 	BVHScene m_TriangleCache;
 
 public:
 	FractalNoisePlaneSDF(float size, float roughness, float zRange)
-		: m_HeightMap(nullptr), m_HeightMapSize(0), m_Size(size), m_Roughness(roughness), m_ZRange(zRange)
+		: m_HeightMap(nullptr), m_HeightMapSize(0), m_Size(size), m_Roughness(roughness), m_ZRange(zRange), m_MaxHeightStep(0.0f), m_LipschitzConstant(1.0f)
 	{
 		float halfSize = m_Size * 0.5f;
 		m_SurfaceAABB.min = Ogre::Vector3(-halfSize, -halfSize, -m_ZRange);
@@ -94,6 +96,21 @@ public:
 		return m_AABB;
 	}
 
+	/// The vertical distance grows at most with the steepest slope of the triangulated height map.
+	float getLipschitzConstant() const override
+	{
+		return m_LipschitzConstant;
+	}
+
+	/// The nearest neighbour height lookup deviates from the triangulated height map by up to two height steps,
+	/// both at the query point and at the closest surface point, so four steps are subtracted from the vertical distance.
+	float getDistanceLowerBound(const Ogre::Vector3& point, float) const override
+	{
+		Sample sample;
+		getSample(point, sample);
+		return std::max(0.0f, std::fabs(sample.signedDistance) - 4.0f * m_MaxHeightStep) / m_LipschitzConstant;
+	}
+
 	virtual void prepareSampling(const AABB& aabb, float cellSize) override
 	{
 		m_CellSize = cellSize;
@@ -121,9 +138,26 @@ public:
 			for (int y = 0; y < m_HeightMapSize; y++)
 				m_HeightMap[x][y] *= multiplier;
 
+		computeLipschitzConstant();
 		generateTriangleCache();
 	}
 
+	void computeLipschitzConstant()
+	{
+		m_MaxHeightStep = 0.0f;
+		for (int x = 0; x < m_HeightMapSize; x++)
+		{
+			for (int y = 0; y < m_HeightMapSize; y++)
+			{
+				if (x + 1 < m_HeightMapSize) m_MaxHeightStep = std::max(m_MaxHeightStep, std::fabs(m_HeightMap[x + 1][y] - m_HeightMap[x][y]));
+				if (y + 1 < m_HeightMapSize) m_MaxHeightStep = std::max(m_MaxHeightStep, std::fabs(m_HeightMap[x][y + 1] - m_HeightMap[x][y]));
+			}
+		}
+		// Each triangle gradient component is bounded by one height step per cell.
+		float maxSlope = std::sqrt(2.0f) * m_MaxHeightStep * m_InverseCellSize;
+		m_LipschitzConstant = std::sqrt(1.0f + maxSlope * maxSlope);
+	}
+
 	void generateTriangleCache()
 	{
 		std::cout << "[FractalNoisePlaneSDF] Generating triangle cache..." << std::endl;
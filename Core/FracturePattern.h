@@ -16,12 +16,13 @@ protected:
 	std::vector<std::shared_ptr<OctreeSDF> > m_PatternPieces;
 public:
 	virtual ~FracturePattern() {}
-	void resamplePieces(const AABB& aabb, const Ogre::Matrix4& matrix)
+	/// Resamples the pattern pieces in the given aabb, uses the thread pool if one is given.
+	void resamplePieces(const AABB& aabb, const Ogre::Matrix4& matrix, ThreadPool* threadPool = nullptr)
 	{
 		for (auto i = m_PatternPieces.begin(); i != m_PatternPieces.end(); ++i)
 		{
 			TransformSDF transformedSDF(*i, matrix);
-			*i = OctreeSDF::sampleSDF(&transformedSDF, aabb, (*i)->getHeight());
+			*i = OctreeSDF::sampleSDF(&transformedSDF, aabb, (*i)->getHeight(), threadPool);
 		}
 		// for (auto iPiece = m_PatternPieces.begin(); iPiece != m_PatternPieces.end(); iPiece++)
 		//	(*iPiece)->generateTriangleCache();
@@ -30,7 +31,7 @@ public:
 	std::vector<std::shared_ptr<OctreeSDF> > fractureSDF(OctreeSDF* sdf, const Ogre::Matrix4& patternTransform)
 	{
 		std::cout << "Resampling pieces..." << std::endl;
-		resamplePieces(sdf->getAABB(), patternTransform);
+		resamplePieces(sdf->getAABB(), patternTransform, sdf->getThreadPool());
 		exportPatternPieces("SphericalPatternMUH");
 		std::cout << "Fracturing..." << std::endl;
 		std::vector<std::shared_ptr<OctreeSDF> > outPieces;
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include "Vector3i.h"
+#include "SolidGeometry.h"
+
+/*
+Shares the boundary values of octree leaves between neighboring leaves during construction.
+A leaf that is built publishes its boundary faces, a neighbor that is built later takes the face they share instead of evaluating it again.
+The guarantee is sharing within a face: the two leaves of a face evaluate its points once. Points on leaf edges and corners are passed on with the faces,
+but leaves that only touch at an edge or corner reuse them only through a face neighbor that was built in between. Without such a neighbor,
+or when the leaves around an edge are built by different tasks at the same time, edge and corner points can be evaluated again.
+A face is shared by at most two leaves and is removed when it is taken, faces without a neighbor leaf are released with the cache.
+The faces are distributed over buckets with separate locks, so the cache can be used by parallel construction.
+*/
+template<class T, int SIZE_1D>
+class LeafFaceCache
+{
+public:
+	static const int SIZE_2D = SIZE_1D * SIZE_1D;
+	static const int SIZE_3D = SIZE_2D * SIZE_1D;
+
+	struct Face
+	{
+		T values[SIZE_2D];
+	};
+
+protected:
+	static const int NUM_BUCKETS = 64;
+
+	struct Bucket
+	{
+		std::mutex mutex;
+		std::unordered_map<Vector3i, Face> faces[3];	// one map per normal direction
+	};
+	Bucket m_Buckets[NUM_BUCKETS];
+
+	Bucket& getBucket(const Vector3i& minPos) { return m_Buckets[std::hash<Vector3i>()(minPos) % NUM_BUCKETS]; }
+
+	/// Position of face f (normal direction f / 2, min or max side) within the leaf lattice, global min corner and index layout.
+	static void getFaceLayout(int f, const Vector3i& leafMinPos, Vector3i& faceMinPos, int& offset, int& stride1, int& stride2)
+	{
+		const int strides[3] = { SIZE_2D, SIZE_1D, 1 };
+		int normalDim = f >> 1;
+		int layer = (f & 1) ? SIZE_1D - 1 : 0;
+		faceMinPos = leafMinPos;
+		faceMinPos[normalDim] += layer;
+		offset = layer * strides[normalDim];
+		stride1 = strides[normalDim == 0 ? 1 : 0];
+		stride2 = strides[normalDim == 2 ? 1 : 2];
+	}
+
+	/// Removes the face with the given min corner and copies its values, returns false if it is not cached.
+	bool take(const Vector3i& minPos, int normalDim, Face& face)
+	{
+		Bucket& bucket = getBucket(minPos);
+		std::lock_guard<std::mutex> lock(bucket.mutex);
+		auto i = bucket.faces[normalDim].find(minPos);
+		if (i == bucket.faces[normalDim].end())
+			return false;
+		face = i->second;
+		bucket.faces[normalDim].erase(i);
+		return true;
+	}
+
+	void put(const Vector3i& minPos, int normalDim, const Face& face)
+	{
+		Bucket& bucket = getBucket(minPos);
+		std::lock_guard<std::mutex> lock(bucket.mutex);
+		bucket.faces[normalDim].insert(std::make_pair(minPos, face));
+	}
+
+public:
+	/// Computes the values of a leaf lattice with SIZE_1D points per dimension and global lattice indices.
+	/// Points that are not shared with an existing neighbor are computed by a single call of evaluate(points, numPoints, values).
+	template<class Evaluate>
+	void getLeafValues(const SolidGeometry::Lattice& lattice, T* values, const Evaluate& evaluate)
+	{
+		bool known[SIZE_3D] = { false };
+		bool reused[6];
+		Face face;
+		for (int f = 0; f < 6; f++)
+		{
+			Vector3i faceMinPos;
+			int offset, stride1, stride2;
+			getFaceLayout(f, lattice.minIndex, faceMinPos, offset, stride1, stride2);
+			reused[f] = take(faceMinPos, f >> 1, face);
+			if (!reused[f])
+				continue;
+			for (int i = 0; i < SIZE_1D; i++)
+			{
+				for (int j = 0; j < SIZE_1D; j++)
+				{
+					int index = offset + i * stride1 + j * stride2;
+					values[index] = face.values[i * SIZE_1D + j];
+					known[index] = true;
+				}
+			}
+		}
+
+		std::vector<Ogre::Vector3> points;
+		std::vector<int> indices;
+		points.reserve(SIZE_3D);
+		indices.reserve(SIZE_3D);
+		for (int x = 0; x < SIZE_1D; x++)
+		{
+			for (int y = 0; y < SIZE_1D; y++)
+			{
+				for (int z = 0; z < SIZE_1D; z++)
+				{
+					int index = x * SIZE_2D + y * SIZE_1D + z;
+					if (known[index])
+						continue;
+					points.push_back(lattice.getPoint(x, y, z));
+					indices.push_back(index);
+				}
+			}
+		}
+		if (!points.empty())
+		{
+			std::unique_ptr<T[]> newValues(new T[points.size()]);
+			evaluate(points.data(), (int)points.size(), newValues.get());
+			for (size_t i = 0; i < points.size(); i++)
+				values[indices[i]] = newValues[i];
+		}
+
+		for (int f = 0; f < 6; f++)
+		{
+			if (reused[f])
+				continue;
+			Vector3i faceMinPos;
+			int offset, stride1, stride2;
+			getFaceLayout(f, lattice.minIndex, faceMinPos, offset, stride1, stride2);
+			for (int i = 0; i < SIZE_1D; i++)
+			{
+				for (int j = 0; j < SIZE_1D; j++)
+					face.values[i * SIZE_1D + j] = values[offset + i * stride1 + j * stride2];
+			}
+			put(faceMinPos, f >> 1, face);
+		}
+	}
+
+	/// Number of faces that are currently cached.
+	size_t size()
+	{
+		size_t counter = 0;
+		for (int i = 0; i < NUM_BUCKETS; i++)
+		{
+			std::lock_guard<std::mutex> lock(m_Buckets[i].mutex);
+			for (int d = 0; d < 3; d++)
+				counter += m_Buckets[i].faces[d].size();
+		}
+		return counter;
+	}
+};
@@ -0,0 +1,448 @@
+#include <algorithm>
+#include "LinearOctreeSF.h"
+#include "Mesh.h"
+#include "Profiler.h"
+
+LinearOctreeSF::LinearOctreeSF(const LinearOctreeSF& other)
+{
+	m_LeafContext.m_RootArea = other.m_LeafContext.m_RootArea;
+	m_LeafContext.m_CellSize = other.m_LeafContext.m_CellSize;
+	m_ThreadPool = other.m_ThreadPool;
+	m_MaxTaskDepth = other.m_MaxTaskDepth;
+	m_LeafContext.m_Arena->reserve(other.m_LeafContext.m_Arena->getStats().bytesUsed);
+	m_Nodes = other.m_Nodes;
+	for (auto i = m_Nodes.begin(); i != m_Nodes.end(); ++i)
+	{
+		if (i->grid)
+			i->grid = (GridNode*)i->grid->clone(*m_LeafContext.m_Arena);
+	}
+}
+
+void LinearOctreeSF::buildNodes(const Area& area, const SolidGeometry& implicitSDF, std::vector<LinearNode>& nodes)
+{
+	bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
+	if (area.m_SizeExpo <= LEAF_EXPO && needsSubdivision)
+	{
+		nodes.push_back(LinearNode(getKey(area.m_MinPos), area, new (*m_LeafContext.m_Arena) GridNode(&m_LeafContext, area, implicitSDF)));
+		return;
+	}
+	if (!needsSubdivision)
+	{
+		nodes.push_back(LinearNode(getKey(area.m_MinPos), area, implicitSDF.getSign(area.toAABB().getCenter())));
+		return;
+	}
+
+	Area subAreas[8];
+	area.getSubAreas(subAreas);
+	if (!m_ThreadPool || getRootArea().m_SizeExpo - area.m_SizeExpo >= m_MaxTaskDepth)
+	{
+		for (int i = 0; i < 8; i++)
+			buildNodes(subAreas[i], implicitSDF, nodes);
+		return;
+	}
+	// children are built into separate arrays and appended in key order
+	std::vector<LinearNode> childNodes[8];
+	ThreadPool::TaskGroup tasks(*m_ThreadPool);
+	for (int i = 1; i < 8; i++)
+		tasks.run([this, &subAreas, &implicitSDF, &childNodes, i]() { buildNodes(subAreas[i], implicitSDF, childNodes[i]); });
+	buildNodes(subAreas[0], implicitSDF, childNodes[0]);
+	tasks.wait();
+	for (int i = 0; i < 8; i++)
+		nodes.insert(nodes.end(), childNodes[i].begin(), childNodes[i].end());
+}
+
+void LinearOctreeSF::getChildRanges(const Area& area, size_t begin, size_t end, size_t bounds[9]) const
+{
+	MortonKey areaKey = getKey(area.m_MinPos);
+	MortonKey childKeySpan = (MortonKey)1 << (3 * (area.m_SizeExpo - 1));
+	bounds[0] = begin;
+	bounds[8] = end;
+	for (int i = 1; i < 8; i++)
+	{
+		MortonKey childKey = areaKey + i * childKeySpan;
+		bounds[i] = std::lower_bound(m_Nodes.begin() + bounds[i - 1], m_Nodes.begin() + end, childKey,
+			[](const LinearNode& node, MortonKey key) { return node.key < key; }) - m_Nodes.begin();
+	}
+}
+
+void LinearOctreeSF::deleteGrids(size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++)
+		delete m_Nodes[i].grid;
+}
+
+void LinearOctreeSF::intersect(const SolidGeometry& implicitSDF, const Area& area, size_t begin, size_t end, std::vector<LinearNode>& outNodes)
+{
+	bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
+	bool isLeaf = (end - begin == 1 && m_Nodes[begin].sizeExpo == area.m_SizeExpo);
+	if (!isLeaf && needsSubdivision)
+	{
+		Area subAreas[8];
+		area.getSubAreas(subAreas);
+		size_t bounds[9];
+		getChildRanges(area, begin, end, bounds);
+		for (int i = 0; i < 8; i++)
+			intersect(implicitSDF, subAreas[i], bounds[i], bounds[i + 1], outNodes);
+		return;
+	}
+	if (!needsSubdivision)
+	{
+		if (implicitSDF.getSign(area.getCornerVecs(0).second))
+		{
+			outNodes.insert(outNodes.end(), m_Nodes.begin() + begin, m_Nodes.begin() + end);
+			return;
+		}
+		deleteGrids(begin, end);
+		outNodes.push_back(LinearNode(getKey(area.m_MinPos), area, implicitSDF.getSign(area.toAABB().getCenter())));
+		return;
+	}
+	const LinearNode& node = m_Nodes[begin];
+	if (!node.grid)
+	{
+		if (!node.sign)
+			outNodes.push_back(node);
+		else buildNodes(area, implicitSDF, outNodes);
+		return;
+	}
+	node.grid->intersect(&m_LeafContext, area, implicitSDF);
+	outNodes.push_back(node);
+}
+
+void LinearOctreeSF::merge(const SolidGeometry& implicitSDF, const Area& area, size_t begin, size_t end, std::vector<LinearNode>& outNodes)
+{
+	bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
+	bool isLeaf = (end - begin == 1 && m_Nodes[begin].sizeExpo == area.m_SizeExpo);
+	if (!isLeaf && needsSubdivision)
+	{
+		Area subAreas[8];
+		area.getSubAreas(subAreas);
+		size_t bounds[9];
+		getChildRanges(area, begin, end, bounds);
+		for (int i = 0; i < 8; i++)
+			merge(implicitSDF, subAreas[i], bounds[i], bounds[i + 1], outNodes);
+		return;
+	}
+	if (!needsSubdivision)
+	{
+		if (!implicitSDF.getSign(area.getCornerVecs(0).second))
+		{
+			outNodes.insert(outNodes.end(), m_Nodes.begin() + begin, m_Nodes.begin() + end);
+			return;
+		}
+		deleteGrids(begin, end);
+		buildNodes(area, implicitSDF, outNodes);
+		return;
+	}
+	const LinearNode& node = m_Nodes[begin];
+	if (!node.grid)
+	{
+		if (node.sign)
+			outNodes.push_back(node);
+		else buildNodes(area, implicitSDF, outNodes);
+		return;
+	}
+	node.grid->merge(&m_LeafContext, area, implicitSDF);
+	outNodes.push_back(node);
+}
+
+LinearOctreeSF::GridNode* LinearOctreeSF::findGridLeaf(const Vector3i& minPos) const
+{
+	int rootSize = 1 << getRootArea().m_SizeExpo;
+	Vector3i rootPos = minPos - getRootArea().m_MinPos;
+	if (rootPos.x < 0 || rootPos.y < 0 || rootPos.z < 0 || rootPos.x >= rootSize || rootPos.y >= rootSize || rootPos.z >= rootSize)
+		return nullptr;
+	MortonKey key = getKey(minPos);
+	auto node = std::upper_bound(m_Nodes.begin(), m_Nodes.end(), key,
+		[](MortonKey key, const LinearNode& node) { return key < node.key; });
+	// the node before the first greater key contains minPos
+	--node;
+	if (node->key != key || !node->grid)
+		return nullptr;
+	return node->grid;
+}
+
+const LinearOctreeSF::LinearNode* LinearOctreeSF::findNode(const Ogre::Vector3& point) const
+{
+	if (!getRootArea().toAABB().containsPoint(point))
+		return nullptr;
+	int rootSize = 1 << getRootArea().m_SizeExpo;
+	Ogre::Vector3 cellPos = (point - getRootArea().m_MinRealPos) / m_LeafContext.m_CellSize;
+	Vector3i cellIndex(std::min((int)cellPos.x, rootSize - 1), std::min((int)cellPos.y, rootSize - 1), std::min((int)cellPos.z, rootSize - 1));
+	MortonKey key = computeMortonKey(cellIndex);
+	auto node = std::upper_bound(m_Nodes.begin(), m_Nodes.end(), key,
+		[](MortonKey key, const LinearNode& node) { return key < node.key; });
+	return &*(--node);
+}
+
+bool LinearOctreeSF::intersectsSurface(const Area& area, size_t begin, size_t end, const AABB& aabb) const
+{
+	if (!area.toAABB().intersectsAABB(aabb))
+		return false;
+	if (end - begin == 1 && m_Nodes[begin].sizeExpo == area.m_SizeExpo)
+		return m_Nodes[begin].grid && m_Nodes[begin].grid->intersectsSurface(area, aabb);
+	Area subAreas[8];
+	area.getSubAreas(subAreas);
+	size_t bounds[9];
+	getChildRanges(area, begin, end, bounds);
+	for (int i = 0; i < 8; i++)
+	{
+		if (intersectsSurface(subAreas[i], bounds[i], bounds[i + 1], aabb))
+			return true;
+	}
+	return false;
+}
+
+bool LinearOctreeSF::intersectsSurface(const AABB& aabb) const
+{
+	return intersectsSurface(getRootArea(), 0, m_Nodes.size(), aabb);
+}
+
+bool LinearOctreeSF::findClosestSurfacePoint(const Area& area, size_t begin, size_t end, const Ogre::Vector3& point, float& closestSquaredDistance, Sample& closest) const
+{
+	if (area.toAABB().squaredDistance(point) >= closestSquaredDistance)
+		return false;
+	if (end - begin == 1 && m_Nodes[begin].sizeExpo == area.m_SizeExpo)
+	{
+		const GridNode* leaf = m_Nodes[begin].grid;
+		if (!leaf)
+			return false;
+		const OctreeSF::SurfaceEdge* edge = leaf->findClosestSurfaceEdge(area, point, closest.closestSurfacePos, closestSquaredDistance);
+		if (!edge)
+			return false;
+		closest.normal = leaf->getOutwardNormal(*edge);
+		return true;
+	}
+	Area subAreas[8];
+	area.getSubAreas(subAreas);
+	size_t bounds[9];
+	getChildRanges(area, begin, end, bounds);
+	// the child on the side of the point first, so the others are mostly pruned
+	Ogre::Vector3 center = area.m_MinRealPos + Ogre::Vector3(area.m_RealSize * 0.5f);
+	int nearestChild = ((point.x >= center.x) << 2) | ((point.y >= center.y) << 1) | (point.z >= center.z);
+	bool found = false;
+	for (int i = 0; i < 8; i++)
+	{
+		int child = nearestChild ^ i;
+		found |= findClosestSurfacePoint(subAreas[child], bounds[child], bounds[child + 1], point, closestSquaredDistance, closest);
+	}
+	return found;
+}
+
+void LinearOctreeSF::getSample(const Ogre::Vector3& point, Sample& sample) const
+{
+	const LinearNode* node = findNode(point);
+	bool sign = node && !node->grid && node->sign;
+	float closestSquaredDistance = std::numeric_limits<float>::max();
+	if (!findClosestSurfacePoint(getRootArea(), 0, m_Nodes.size(), point, closestSquaredDistance, sample))
+	{
+		// the octree has no surface
+		sample.signedDistance = sign ? getRootArea().m_RealSize : -getRootArea().m_RealSize;
+		sample.closestSurfacePos = point;
+		sample.normal = Ogre::Vector3(0, 0, 0);
+		return;
+	}
+	if (node && node->grid && !node->grid->getUniformCellSign(node->grid->m_Area, point, sign))
+		sign = sample.normal.dotProduct(point - sample.closestSurfacePos) < 0.0f;
+	float distance = std::sqrt(closestSquaredDistance);
+	sample.signedDistance = sign ? distance : -distance;
+}
+
+std::shared_ptr<LinearOctreeSF> LinearOctreeSF::sampleSDF(SolidGeometry* otherSDF, int maxDepth)
+{
+	AABB aabb = otherSDF->getAABB();
+	aabb.addEpsilon(0.0001f);
+	return sampleSDF(otherSDF, aabb, maxDepth);
+}
+
+std::shared_ptr<LinearOctreeSF> LinearOctreeSF::sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth)
+{
+	return sampleSDF(otherSDF, aabb, maxDepth, nullptr, 0);
+}
+
+std::shared_ptr<LinearOctreeSF> LinearOctreeSF::sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, ThreadPool* threadPool, int maxTaskDepth)
+{
+	auto ts = Profiler::timestamp();
+	std::shared_ptr<LinearOctreeSF> octree = std::make_shared<LinearOctreeSF>();
+	Ogre::Vector3 aabbSize = aabb.getMax() - aabb.getMin();
+	float cubeSize = std::max(std::max(aabbSize.x, aabbSize.y), aabbSize.z);
+	octree->m_LeafContext.m_CellSize = cubeSize / (1 << maxDepth);
+	otherSDF->prepareSampling(aabb, octree->m_LeafContext.m_CellSize);
+	octree->m_LeafContext.m_RootArea = Area(Vector3i(0, 0, 0), maxDepth, aabb.getMin(), cubeSize);
+	octree->m_ThreadPool = threadPool;
+	octree->m_MaxTaskDepth = maxTaskDepth;
+	OctreeSF::SignFaceCache faceCache;
+	octree->m_LeafContext.m_SignFaceCache = &faceCache;
+	octree->buildNodes(octree->getRootArea(), *otherSDF, octree->m_Nodes);
+	octree->m_LeafContext.m_SignFaceCache = nullptr;
+	Profiler::printJobDuration("LinearOctreeSF::sampleSDF", ts);
+	return octree;
+}
+
+float LinearOctreeSF::getInverseCellSize()
+{
+	return 1.0f / m_LeafContext.m_CellSize;
+}
+
+AABB LinearOctreeSF::getAABB() const
+{
+	return getRootArea().toAABB();
+}
+
+void LinearOctreeSF::generateVerticesAndIndices(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	auto tsTotal = Profiler::timestamp();
+	int numLeaves = countLeaves();
+	vertices.reserve(numLeaves * LEAF_SIZE_2D_INNER * 2);	// reasonable upper bound
+	for (auto i = m_Nodes.begin(); i != m_Nodes.end(); ++i)
+	{
+		if (i->grid)
+			i->grid->generateVerticesDC(vertices);
+	}
+	Profiler::printJobDuration("generateVertices", tsTotal);
+	std::cout << "Generated " << vertices.size() << " vertices." << std::endl;
+
+	// the face and edge neighbors in positive direction are looked up by key
+	static const Vector3i neighborOffsets[6] = { Vector3i(1, 0, 0), Vector3i(0, 1, 0), Vector3i(0, 0, 1), Vector3i(0, 1, 1), Vector3i(1, 0, 1), Vector3i(1, 1, 0) };
+	auto tsNeighbors = Profiler::timestamp();
+	for (auto i = m_Nodes.begin(); i != m_Nodes.end(); ++i)
+	{
+		if (!i->grid)
+			continue;
+		for (int n = 0; n < 6; n++)
+		{
+			GridNode* neighbor = findGridLeaf(i->grid->m_Area.m_MinPos + neighborOffsets[n] * LEAF_SIZE_1D_INNER);
+			if (neighbor)
+				i->grid->cacheNeighbor(neighborOffsets[n], neighbor);
+		}
+	}
+	Profiler::printJobDuration("findNeighbors", tsNeighbors);
+
+	indices.reserve(numLeaves * LEAF_SIZE_2D_INNER * 8);
+	for (auto i = m_Nodes.begin(); i != m_Nodes.end(); ++i)
+	{
+		if (i->grid)
+			i->grid->generateIndicesDC(i->grid->m_Area, indices, vertices);
+	}
+	std::cout << "Generated " << indices.size() << " indices." << std::endl;
+	Profiler::printJobDuration("generateVerticesAndIndices", tsTotal);
+}
+
+std::shared_ptr<Mesh> LinearOctreeSF::generateMesh()
+{
+	auto ts = Profiler::timestamp();
+	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+	generateVerticesAndIndices(mesh->vertexBuffer, mesh->indexBuffer);
+	Profiler::printJobDuration("generateMesh", ts);
+	return mesh;
+}
+
+void LinearOctreeSF::subtract(SolidGeometry* otherSDF)
+{
+	otherSDF->prepareSampling(getRootArea().toAABB(), m_LeafContext.m_CellSize);
+	auto ts = Profiler::timestamp();
+	std::vector<LinearNode> nodes;
+	nodes.reserve(m_Nodes.size());
+	intersect(OpInvertSDF(otherSDF), getRootArea(), 0, m_Nodes.size(), nodes);
+	m_Nodes.swap(nodes);
+	Profiler::printJobDuration("Subtraction", ts);
+}
+
+void LinearOctreeSF::intersect(SolidGeometry* otherSDF)
+{
+	otherSDF->prepareSampling(getRootArea().toAABB(), m_LeafContext.m_CellSize);
+	auto ts = Profiler::timestamp();
+	std::vector<LinearNode> nodes;
+	nodes.reserve(m_Nodes.size());
+	intersect(*otherSDF, getRootArea(), 0, m_Nodes.size(), nodes);
+	m_Nodes.swap(nodes);
+	Profiler::printJobDuration("Intersection", ts);
+}
+
+void LinearOctreeSF::merge(SolidGeometry* otherSDF)
+{
+	resize(otherSDF->getAABB());
+	otherSDF->prepareSampling(getRootArea().toAABB(), m_LeafContext.m_CellSize);
+	std::vector<LinearNode> nodes;
+	nodes.reserve(m_Nodes.size());
+	merge(*otherSDF, getRootArea(), 0, m_Nodes.size(), nodes);
+	m_Nodes.swap(nodes);
+}
+
+void LinearOctreeSF::resize(const AABB& aabb)
+{
+	while (true)
+	{
+		// the old root becomes the child on the side away from the growth direction
+		const Area& rootArea = getRootArea();
+		int oldRootChild = 0;
+		bool grow = false;
+		for (int d = 0; d < 3; d++)
+		{
+			if (aabb.getMin()[d] < rootArea.m_MinRealPos[d])
+			{
+				oldRootChild |= 4 >> d;
+				grow = true;
+			}
+			else if (aabb.getMax()[d] > rootArea.m_MinRealPos[d] + rootArea.m_RealSize)
+				grow = true;
+		}
+		if (!grow)
+			return;
+		// the keys have 21 bits per axis
+		if (rootArea.m_SizeExpo >= 21)
+		{
+			std::cout << "The octree cannot grow to cover the aabb, it has reached the maximum size." << std::endl;
+			return;
+		}
+		Vector3i childOffset((oldRootChild & 4) != 0, (oldRootChild & 2) != 0, (oldRootChild & 1) != 0);
+		Area newRootArea(rootArea.m_MinPos - childOffset * (1 << rootArea.m_SizeExpo), rootArea.m_SizeExpo + 1,
+			rootArea.m_MinRealPos - childOffset.toOgreVec() * rootArea.m_RealSize, rootArea.m_RealSize * 2.0f);
+		MortonKey keyOffset = (MortonKey)oldRootChild << (3 * rootArea.m_SizeExpo);
+		m_LeafContext.m_RootArea = newRootArea;
+		Area subAreas[8];
+		newRootArea.getSubAreas(subAreas);
+		std::vector<LinearNode> nodes;
+		nodes.reserve(m_Nodes.size() + 7);
+		for (int i = 0; i < 8; i++)
+		{
+			if (i != oldRootChild)
+			{
+				nodes.push_back(LinearNode(getKey(subAreas[i].m_MinPos), subAreas[i], false));
+				continue;
+			}
+			for (auto node = m_Nodes.begin(); node != m_Nodes.end(); ++node)
+			{
+				nodes.push_back(*node);
+				nodes.back().key += keyOffset;
+			}
+		}
+		m_Nodes.swap(nodes);
+	}
+}
+
+std::shared_ptr<LinearOctreeSF> LinearOctreeSF::clone()
+{
+	return std::make_shared<LinearOctreeSF>(*this);
+}
+
+int LinearOctreeSF::countLeaves()
+{
+	int counter = 0;
+	for (auto i = m_Nodes.begin(); i != m_Nodes.end(); ++i)
+	{
+		if (i->grid)
+			counter++;
+	}
+	return counter;
+}
+
+int LinearOctreeSF::countMemory()
+{
+	int counter = (int)(m_Nodes.capacity() * sizeof(LinearNode));
+	for (auto i = m_Nodes.begin(); i != m_Nodes.end(); ++i)
+	{
+		if (i->grid)
+			i->grid->countMemory(counter);
+	}
+	return counter;
+}
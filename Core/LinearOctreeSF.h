@@ -0,0 +1,131 @@
+
+#pragma once
+
+#include "OctreeSF.h"
+
+/*
+Linear storage backend for OctreeSF.
+Instead of a tree of virtual nodes, the leaves of the octree (grid leaves and empty regions) are stored in one array sorted by the Morton code of their min corner.
+The leaves tile the root area and inner nodes are implicit: all leaves inside a node form a contiguous key range of the array,
+so traversals are linear scans and neighbors are found by binary search. Grid leaves use the same payload as OctreeSF, so meshes are identical.
+*/
+class LinearOctreeSF : public SampledSolidGeometry
+{
+public:
+	static const int LEAF_EXPO = OctreeSF::LEAF_EXPO;
+	static const int LEAF_SIZE_1D_INNER = OctreeSF::LEAF_SIZE_1D_INNER;
+	static const int LEAF_SIZE_2D_INNER = OctreeSF::LEAF_SIZE_2D_INNER;
+
+	typedef unsigned long long MortonKey;
+
+	/// Interleaves the bits of a cell index, x gets the highest bit of each triple so the key order matches the child order of Area::getSubAreas.
+	static inline MortonKey computeMortonKey(const Vector3i& cellIndex)
+	{
+		return MathMisc::mortonKey((unsigned int)cellIndex.x, (unsigned int)cellIndex.y, (unsigned int)cellIndex.z);
+	}
+
+protected:
+	typedef OctreeSF::GridNode GridNode;
+
+	/// A leaf of the octree, either a grid leaf or an empty region of any size.
+	struct LinearNode
+	{
+		LinearNode() {}
+		LinearNode(MortonKey key, const Area& area, bool sign) : key(key), grid(nullptr), sizeExpo((unsigned char)area.m_SizeExpo), sign(sign) {}
+		LinearNode(MortonKey key, const Area& area, GridNode* grid) : key(key), grid(grid), sizeExpo((unsigned char)area.m_SizeExpo), sign(false) {}
+
+		MortonKey key;
+		GridNode* grid;
+		unsigned char sizeExpo;
+		bool sign;		// sign of an empty region
+	};
+
+	/// Leaves sorted by key.
+	std::vector<LinearNode> m_Nodes;
+
+	/// Provides the lattice, the arena and the face cache for the grid leaf payloads, its pointer tree is not used.
+	OctreeSF m_LeafContext;
+
+	ThreadPool* m_ThreadPool;
+	int m_MaxTaskDepth;
+
+	/// Samples the area and appends its leaves in key order.
+	void buildNodes(const Area& area, const SolidGeometry& implicitSDF, std::vector<LinearNode>& nodes);
+
+	/// Splits the leaves [begin, end) of an inner node into the ranges of its 8 children, child i owns [bounds[i], bounds[i + 1]).
+	void getChildRanges(const Area& area, size_t begin, size_t end, size_t bounds[9]) const;
+
+	void deleteGrids(size_t begin, size_t end);
+
+	/// Intersects the implicit node covering area, which consists of the leaves [begin, end), and appends the result.
+	void intersect(const SolidGeometry& implicitSDF, const Area& area, size_t begin, size_t end, std::vector<LinearNode>& outNodes);
+
+	void merge(const SolidGeometry& implicitSDF, const Area& area, size_t begin, size_t end, std::vector<LinearNode>& outNodes);
+
+	/// Returns the grid leaf with the given min corner or nullptr.
+	GridNode* findGridLeaf(const Vector3i& minPos) const;
+
+	/// Returns the leaf that contains the point or nullptr if the point is outside of the octree.
+	const LinearNode* findNode(const Ogre::Vector3& point) const;
+
+	bool intersectsSurface(const Area& area, size_t begin, size_t end, const AABB& aabb) const;
+
+	/// Searches the hermite samples of the leaves [begin, end) that are closer than the given squared distance, see OctreeSF::findClosestSurfacePoint.
+	bool findClosestSurfacePoint(const Area& area, size_t begin, size_t end, const Ogre::Vector3& point, float& closestSquaredDistance, Sample& closest) const;
+
+	const Area& getRootArea() const { return m_LeafContext.m_RootArea; }
+
+	/// Keys are relative to the min corner of the root, which moves when the octree grows in negative direction.
+	MortonKey getKey(const Vector3i& minPos) const { return computeMortonKey(minPos - getRootArea().m_MinPos); }
+
+public:
+	LinearOctreeSF() : m_ThreadPool(nullptr), m_MaxTaskDepth(0) {}
+	LinearOctreeSF(const LinearOctreeSF& other);
+
+	static std::shared_ptr<LinearOctreeSF> sampleSDF(SolidGeometry* otherSDF, int maxDepth);
+
+	static std::shared_ptr<LinearOctreeSF> sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth);
+
+	/// Samples the sdf in parallel, subtrees up to maxTaskDepth levels below the root are distributed over the thread pool.
+	static std::shared_ptr<LinearOctreeSF> sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, ThreadPool* threadPool, int maxTaskDepth = 3);
+
+	float getInverseCellSize() override;
+
+	AABB getAABB() const override;
+
+	std::shared_ptr<Mesh> generateMesh() override;
+
+	void generateVerticesAndIndices(vector<Vertex>& vertices, vector<unsigned int>& indices);
+
+	virtual bool intersectsSurface(const AABB& aabb) const override;
+
+	/// Approximates the sample by the closest hermite sample of the octree like OctreeSF::getSample, the implicit nodes are key ranges.
+	virtual void getSample(const Ogre::Vector3& point, Sample& sample) const override;
+
+	/// Subtracts the given signed distance field from this octree.
+	void subtract(SolidGeometry* otherSDF);
+
+	/// Intersects the octree with a signed distance field.
+	void intersect(SolidGeometry* otherSDF);
+
+	/// Merges the octree with another signed distance field, the octree grows to cover it.
+	void merge(SolidGeometry* otherSDF);
+
+	/// Grows the octree until it covers the given aabb like OctreeSF::resize. The keys of the old leaves get the child index of the old root
+	/// as their highest bits, so the array stays sorted and only the 7 empty siblings are inserted per doubling.
+	void resize(const AABB& aabb);
+
+	/// Clones the octree and returns the copy.
+	std::shared_ptr<LinearOctreeSF> clone();
+
+	/// Counts the number of nodes in the implicit octree, only leaves are stored.
+	int countNodes() { return (int)m_Nodes.size(); }
+
+	/// Counts the number of grid leaves.
+	int countLeaves();
+
+	/// Counts the number of bytes the octree occupies.
+	int countMemory();
+
+	int getHeight() { return getRootArea().m_SizeExpo; }
+};
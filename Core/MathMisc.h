@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <cmath>
 #include "OgreMath/OgreVector3.h"
 
 using Ogre::Vector3;
@@ -148,4 +149,52 @@ struct MathMisc
 			+ cornerValues[6] * weights[0] * weights[1] * (1 - weights[2])
 			+ cornerValues[7] * weights[0] * weights[1] * weights[2];
 	}
+
+	/// Interleaves the lowest 21 bits of three coordinates to a key along a morton curve, x gets the highest bit of each triple.
+	static inline unsigned long long mortonKey(unsigned int x, unsigned int y, unsigned int z)
+	{
+		return (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+	}
+
+	static inline unsigned long long spreadBits(unsigned int value)
+	{
+		unsigned long long x = value & 0x1FFFFF;
+		x = (x | x << 32) & 0x1F00000000FFFFULL;
+		x = (x | x << 16) & 0x1F0000FF0000FFULL;
+		x = (x | x << 8) & 0x100F00F00F00F00FULL;
+		x = (x | x << 4) & 0x10C30C30C30C30C3ULL;
+		x = (x | x << 2) & 0x1249249249249249ULL;
+		return x;
+	}
+
+	/// Maps a unit vector to the octahedron and stores the two coordinates as 16 bit signed normalized integers.
+	static inline void encodeOctahedral(const Ogre::Vector3& normal, short encoded[2])
+	{
+		float invL1Norm = 1.0f / (std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z) + 1e-20f);
+		float u = normal.x * invL1Norm;
+		float v = normal.y * invL1Norm;
+		if (normal.z < 0)
+		{
+			// fold the lower hemisphere over the diagonals
+			float foldedU = (1.0f - std::fabs(v)) * (u >= 0 ? 1.0f : -1.0f);
+			v = (1.0f - std::fabs(u)) * (v >= 0 ? 1.0f : -1.0f);
+			u = foldedU;
+		}
+		encoded[0] = (short)std::floor(u * 32767.0f + 0.5f);
+		encoded[1] = (short)std::floor(v * 32767.0f + 0.5f);
+	}
+
+	static inline Ogre::Vector3 decodeOctahedral(const short encoded[2])
+	{
+		Ogre::Vector3 normal(encoded[0] / 32767.0f, encoded[1] / 32767.0f, 0);
+		normal.z = 1.0f - std::fabs(normal.x) - std::fabs(normal.y);
+		if (normal.z < 0)
+		{
+			float unfoldedX = (1.0f - std::fabs(normal.y)) * (normal.x >= 0 ? 1.0f : -1.0f);
+			normal.y = (1.0f - std::fabs(normal.x)) * (normal.y >= 0 ? 1.0f : -1.0f);
+			normal.x = unfoldedX;
+		}
+		normal.normalise();
+		return normal;
+	}
 };
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <unordered_set>
+#include <new>
+#include <cstddef>
+#include <algorithm>
+
+/*
+Memory arena owned by an octree, all nodes and leaf payloads of the octree are allocated from it.
+Memory is taken from large chunks with a bump pointer, freed blocks are kept in free lists per 16 byte size class and reused by later allocations of the same size.
+Destroying the arena releases all chunks at once, so an octree can be torn down without visiting its nodes.
+Objects allocated with allocateObject carry a small header that points back to the arena, so they can be freed with freeObject without knowing the arena or the object size.
+All methods are thread safe. The arena is split into shards that each have their own lock, chunk and free lists, a thread allocates from and frees to the shard picked by its id,
+so threads that sample different subtrees in parallel rarely contend for a lock.
+*/
+class NodeArena
+{
+public:
+	struct Stats
+	{
+		/// Number of blocks that are currently allocated.
+		size_t numAllocations;
+
+		/// Number of allocations since the arena was created.
+		size_t totalAllocations;
+
+		size_t numChunks;
+
+		/// Bytes of all chunks and large blocks.
+		size_t bytesReserved;
+
+		/// Bytes of all allocated blocks (rounded up to the size classes), bytesReserved - bytesUsed is free or wasted memory.
+		size_t bytesUsed;
+	};
+
+protected:
+	static const size_t ALIGNMENT = 16;
+	static const size_t HEADER_SIZE = 16;
+	static const size_t MIN_CHUNK_SIZE = 64 * 1024;
+	static const size_t MAX_CHUNK_SIZE = 4 * 1024 * 1024;
+
+	/// Blocks larger than this are not pooled but allocated separately.
+	static const size_t MAX_POOLED_SIZE = 64 * 1024;
+
+	static const int NUM_SHARDS = 16;
+
+	struct ObjectHeader
+	{
+		NodeArena* arena;
+		size_t size;
+	};
+
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+	/// Allocation state of one shard, blocks freed by a thread go to the free lists of its own shard regardless of the shard they came from.
+	/// The statistics of a shard may therefore underflow, only their sum over all shards is meaningful.
+	struct Shard
+	{
+		mutable std::mutex mutex;
+		std::vector<char*> chunks;
+		char* chunkPos;
+		char* chunkEnd;
+		size_t nextChunkSize;
+		/// Created on first use, most octrees only touch a few shards.
+		std::vector<FreeBlock*> freeLists;
+		Stats stats;
+		// keeps the locks of neighboring shards in different cache lines
+		char padding[64];
+
+		Shard() : chunkPos(nullptr), chunkEnd(nullptr), nextChunkSize(MIN_CHUNK_SIZE)
+		{
+			memset(&stats, 0, sizeof(Stats));
+		}
+
+		/// Starts a new chunk, the rest of the current chunk is not used anymore. Requires the lock.
+		void addChunk(size_t chunkSize)
+		{
+			chunkPos = (char*)::operator new(chunkSize);
+			chunkEnd = chunkPos + chunkSize;
+			chunks.push_back(chunkPos);
+			stats.numChunks++;
+			stats.bytesReserved += chunkSize;
+		}
+
+		/// Bump allocates from the current chunk, starts a new chunk if it does not fit. Requires the lock.
+		char* bump(size_t size)
+		{
+			if ((size_t)(chunkEnd - chunkPos) < size)
+			{
+				addChunk(std::max(nextChunkSize, size));
+				if (nextChunkSize < MAX_CHUNK_SIZE)
+					nextChunkSize *= 2;
+			}
+			char* block = chunkPos;
+			chunkPos += size;
+			return block;
+		}
+
+		FreeBlock*& getFreeList(size_t size)
+		{
+			if (freeLists.empty())
+				freeLists.resize(MAX_POOLED_SIZE / ALIGNMENT + 1, nullptr);
+			return freeLists[size / ALIGNMENT];
+		}
+
+		/// Requires the lock, size must be rounded up and pooled.
+		void* allocate(size_t size)
+		{
+			stats.numAllocations++;
+			stats.totalAllocations++;
+			stats.bytesUsed += size;
+			FreeBlock*& freeList = getFreeList(size);
+			if (freeList)
+			{
+				FreeBlock* block = freeList;
+				freeList = block->next;
+				return block;
+			}
+			return bump(size);
+		}
+
+		/// Requires the lock, size must be rounded up and pooled.
+		void deallocate(void* block, size_t size)
+		{
+			stats.numAllocations--;
+			stats.bytesUsed -= size;
+			FreeBlock*& freeList = getFreeList(size);
+			FreeBlock* freeBlock = (FreeBlock*)block;
+			freeBlock->next = freeList;
+			freeList = freeBlock;
+		}
+	};
+
+	Shard m_Shards[NUM_SHARDS];
+
+	/// Blocks that are too large to be pooled, they are rare and share a single lock.
+	mutable std::mutex m_LargeBlockMutex;
+	std::unordered_set<void*> m_LargeBlocks;
+	Stats m_LargeBlockStats;
+
+	static inline size_t roundUp(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+	Shard& getShard() { return m_Shards[std::hash<std::thread::id>()(std::this_thread::get_id()) % NUM_SHARDS]; }
+
+	/// Size must be rounded up.
+	void* allocateRounded(size_t size)
+	{
+		if (size > MAX_POOLED_SIZE)
+		{
+			void* block = ::operator new(size);
+			std::lock_guard<std::mutex> lock(m_LargeBlockMutex);
+			m_LargeBlocks.insert(block);
+			m_LargeBlockStats.numAllocations++;
+			m_LargeBlockStats.totalAllocations++;
+			m_LargeBlockStats.bytesUsed += size;
+			m_LargeBlockStats.bytesReserved += size;
+			return block;
+		}
+		Shard& shard = getShard();
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		return shard.allocate(size);
+	}
+
+public:
+	NodeArena()
+	{
+		static_assert(sizeof(ObjectHeader) <= HEADER_SIZE, "Object header does not fit");
+		memset(&m_LargeBlockStats, 0, sizeof(Stats));
+	}
+
+	/// Releases all memory, objects in the arena are not destructed.
+	~NodeArena()
+	{
+		for (int s = 0; s < NUM_SHARDS; s++)
+		{
+			for (auto i = m_Shards[s].chunks.begin(); i != m_Shards[s].chunks.end(); ++i)
+				::operator delete(*i);
+		}
+		for (auto i = m_LargeBlocks.begin(); i != m_LargeBlocks.end(); ++i)
+			::operator delete(*i);
+	}
+
+	void* allocate(size_t size)
+	{
+		return allocateRounded(roundUp(size));
+	}
+
+	void deallocate(void* block, size_t size)
+	{
+		if (!block)
+			return;
+		size = roundUp(size);
+		if (size > MAX_POOLED_SIZE)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_LargeBlockMutex);
+				m_LargeBlocks.erase(block);
+				m_LargeBlockStats.numAllocations--;
+				m_LargeBlockStats.bytesUsed -= size;
+				m_LargeBlockStats.bytesReserved -= size;
+			}
+			::operator delete(block);
+			return;
+		}
+		Shard& shard = getShard();
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.deallocate(block, size);
+	}
+
+	/// Allocates an object that can be released with freeObject.
+	void* allocateObject(size_t size)
+	{
+		size_t blockSize = roundUp(size) + HEADER_SIZE;
+		ObjectHeader* header = (ObjectHeader*)allocateRounded(blockSize);
+		header->arena = this;
+		header->size = blockSize;
+		return (char*)header + HEADER_SIZE;
+	}
+
+	/// Allocates count objects of the given size that are contiguous in memory, used for the 8 children of an octree node.
+	void allocateObjects(size_t size, int count, void** objects)
+	{
+		size_t blockSize = roundUp(size) + HEADER_SIZE;
+		char* blocks;
+		{
+			Shard& shard = getShard();
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			blocks = shard.bump(blockSize * count);
+			shard.stats.numAllocations += count;
+			shard.stats.totalAllocations += count;
+			shard.stats.bytesUsed += blockSize * count;
+		}
+		for (int i = 0; i < count; i++)
+		{
+			ObjectHeader* header = (ObjectHeader*)(blocks + i * blockSize);
+			header->arena = this;
+			header->size = blockSize;
+			objects[i] = (char*)header + HEADER_SIZE;
+		}
+	}
+
+	/// Returns an object allocated with allocateObject(s) to its arena.
+	static void freeObject(void* object)
+	{
+		if (!object)
+			return;
+		ObjectHeader* header = (ObjectHeader*)((char*)object - HEADER_SIZE);
+		header->arena->deallocate(header, header->size);
+	}
+
+	/// Makes sure that the next allocations of up to numBytes in total from the calling thread are served from a single chunk.
+	void reserve(size_t numBytes)
+	{
+		Shard& shard = getShard();
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		if ((size_t)(shard.chunkEnd - shard.chunkPos) < numBytes)
+			shard.addChunk(roundUp(numBytes));
+	}
+
+	Stats getStats() const
+	{
+		Stats stats;
+		{
+			std::lock_guard<std::mutex> lock(m_LargeBlockMutex);
+			stats = m_LargeBlockStats;
+		}
+		for (int s = 0; s < NUM_SHARDS; s++)
+		{
+			const Shard& shard = m_Shards[s];
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			stats.numAllocations += shard.stats.numAllocations;
+			stats.totalAllocations += shard.stats.totalAllocations;
+			stats.numChunks += shard.stats.numChunks;
+			stats.bytesReserved += shard.stats.bytesReserved;
+			stats.bytesUsed += shard.stats.bytesUsed;
+		}
+		return stats;
+	}
+};
+
+/// Standard allocator that allocates from a NodeArena, falls back to the heap if no arena is given.
+template<class T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<class U>
+	struct rebind { typedef ArenaAllocator<U> other; };
+
+	NodeArena* m_Arena;
+
+	ArenaAllocator() : m_Arena(nullptr) {}
+	ArenaAllocator(NodeArena* arena) : m_Arena(arena) {}
+	template<class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_Arena(other.m_Arena) {}
+
+	T* allocate(size_t n)
+	{
+		if (m_Arena)
+			return (T*)m_Arena->allocate(n * sizeof(T));
+		return (T*)::operator new(n * sizeof(T));
+	}
+
+	void deallocate(T* p, size_t n)
+	{
+		if (m_Arena)
+			m_Arena->deallocate(p, n * sizeof(T));
+		else ::operator delete(p);
+	}
+
+	template<class U>
+	bool operator == (const ArenaAllocator<U>& other) const { return m_Arena == other.m_Arena; }
+	template<class U>
+	bool operator != (const ArenaAllocator<U>& other) const { return m_Arena != other.m_Arena; }
+};
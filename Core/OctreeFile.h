@@ -0,0 +1,267 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+Versioned binary file format of OctreeSF and OctreeSDF.
+A file consists of a header and up to MAX_SECTIONS sections. Each section is a raw array of fixed size elements that starts at a multiple of SECTION_ALIGNMENT,
+so a memory mapped file is read without parsing: the node topology is one type byte per node in depth first order (children in index order),
+leaf payloads are contiguous arrays in the order in which the leaves appear in the topology.
+Files use the byte order and struct layouts of the build that wrote them, the header records the element sizes and files of incompatible builds are rejected.
+*/
+namespace OctreeFile
+{
+	static const unsigned int VERSION = 1;
+	static const int MAX_SECTIONS = 8;
+	static const size_t SECTION_ALIGNMENT = 64;
+
+	enum OctreeType
+	{
+		OCTREE_SF = 1,
+		OCTREE_SDF = 2
+	};
+
+	/// Set in the node type byte of empty nodes that are inside the solid.
+	static const unsigned char NODE_SIGN_BIT = 0x80;
+
+	/// Cell indices of an octree have to fit into an int, a root can grow up to this size.
+	static const int MAX_ROOT_SIZE_EXPO = 30;
+
+	/// Printed by the loaders if the sections do not describe a well formed octree.
+	static const char* const CORRUPT_MESSAGE = "The octree data is corrupt.";
+
+	struct Section
+	{
+		unsigned long long offset;
+		unsigned long long size;
+	};
+
+	struct Header
+	{
+		char magic[4];
+		unsigned int version;
+		unsigned int octreeType;
+		unsigned int leafExpo;
+		/// Octree specific, OctreeSF sets bit 0 if the hermite edges are compact.
+		unsigned int flags;
+		unsigned int numNodes;
+		unsigned int numLeaves;
+		int rootMinPos[3];
+		int rootSizeExpo;
+		float rootMinRealPos[3];
+		float rootRealSize;
+		float cellSize;
+		float maxLeafError;
+		unsigned int elementSizes[MAX_SECTIONS];
+		Section sections[MAX_SECTIONS];
+	};
+
+	static inline void initHeader(Header& header, OctreeType octreeType, int leafExpo)
+	{
+		memset(&header, 0, sizeof(Header));
+		memcpy(header.magic, "SDFO", 4);
+		header.version = VERSION;
+		header.octreeType = octreeType;
+		header.leafExpo = leafExpo;
+	}
+
+	/// Checks that the root area of the header is within the cell index range and that its real size matches the cell size.
+	static inline bool isValidRootArea(const Header& header, int leafExpo)
+	{
+		if (header.rootSizeExpo < leafExpo || header.rootSizeExpo > MAX_ROOT_SIZE_EXPO)
+			return false;
+		if (!std::isfinite(header.cellSize) || header.cellSize <= 0.0f || !std::isfinite(header.rootRealSize))
+			return false;
+		long long rootSize = 1LL << header.rootSizeExpo;
+		for (int d = 0; d < 3; d++)
+		{
+			if (header.rootMinPos[d] < -(1LL << MAX_ROOT_SIZE_EXPO) || header.rootMinPos[d] + rootSize > (1LL << MAX_ROOT_SIZE_EXPO)
+				|| !std::isfinite(header.rootMinRealPos[d]))
+				return false;
+		}
+		float expectedRealSize = header.cellSize * (float)rootSize;
+		return std::fabs(header.rootRealSize - expectedRealSize) <= expectedRealSize * 1e-4f;
+	}
+
+	/// Collects the sections of a file, the section data must stay valid until write is called.
+	class Writer
+	{
+	protected:
+		Header m_Header;
+		const void* m_SectionData[MAX_SECTIONS];
+
+	public:
+		Writer(const Header& header) : m_Header(header)
+		{
+			for (int i = 0; i < MAX_SECTIONS; i++)
+				m_SectionData[i] = nullptr;
+		}
+
+		template<class T>
+		void setSection(int index, const std::vector<T>& elements)
+		{
+			m_SectionData[index] = elements.data();
+			m_Header.elementSizes[index] = sizeof(T);
+			m_Header.sections[index].size = elements.size() * sizeof(T);
+		}
+
+		/// Writes the header and the sections to a stream, returns the number of bytes written or 0 on failure.
+		size_t write(std::ostream& stream)
+		{
+			unsigned long long offset = sizeof(Header);
+			for (int i = 0; i < MAX_SECTIONS; i++)
+			{
+				offset = (offset + SECTION_ALIGNMENT - 1) & ~(unsigned long long)(SECTION_ALIGNMENT - 1);
+				m_Header.sections[i].offset = offset;
+				offset += m_Header.sections[i].size;
+			}
+			stream.write((const char*)&m_Header, sizeof(Header));
+			static const char padding[SECTION_ALIGNMENT] = {};
+			unsigned long long position = sizeof(Header);
+			for (int i = 0; i < MAX_SECTIONS; i++)
+			{
+				stream.write(padding, (std::streamsize)(m_Header.sections[i].offset - position));
+				if (m_Header.sections[i].size)
+					stream.write((const char*)m_SectionData[i], (std::streamsize)m_Header.sections[i].size);
+				position = m_Header.sections[i].offset + m_Header.sections[i].size;
+			}
+			return stream ? (size_t)position : 0;
+		}
+
+		/// Returns the number of bytes written or 0 on failure.
+		size_t write(const std::string& fileName)
+		{
+			std::ofstream file(fileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+			if (!file)
+			{
+				std::cout << "Could not open " << fileName << " for writing." << std::endl;
+				return 0;
+			}
+			return write(file);
+		}
+	};
+
+	/// Validates octree data in memory and gives access to its sections, the data must stay valid while the reader is used.
+	class Reader
+	{
+	protected:
+		const char* m_Data;
+		size_t m_Size;
+
+	public:
+		Reader(const char* data, size_t size) : m_Data(data), m_Size(size) {}
+
+		const char* getData() const { return m_Data; }
+		size_t getSize() const { return m_Size; }
+
+		/// Returns the header if the data is a valid octree of the given type, leaf size and element sizes, otherwise nullptr.
+		const Header* getHeader(OctreeType octreeType, int leafExpo, const unsigned int elementSizes[MAX_SECTIONS]) const
+		{
+			if (!m_Data || m_Size < sizeof(Header) || memcmp(m_Data, "SDFO", 4) != 0)
+			{
+				std::cout << "Not octree data." << std::endl;
+				return nullptr;
+			}
+			const Header* header = (const Header*)m_Data;
+			if (header->version != VERSION)
+			{
+				std::cout << "Unsupported octree data version " << header->version << "." << std::endl;
+				return nullptr;
+			}
+			if (header->octreeType != (unsigned int)octreeType || header->leafExpo != (unsigned int)leafExpo)
+			{
+				std::cout << "The octree data has a different octree type or leaf size." << std::endl;
+				return nullptr;
+			}
+			for (int i = 0; i < MAX_SECTIONS; i++)
+			{
+				const Section& section = header->sections[i];
+				if (section.size && (header->elementSizes[i] != elementSizes[i] || section.offset + section.size > m_Size))
+				{
+					std::cout << "The octree data was written by an incompatible build or is truncated." << std::endl;
+					return nullptr;
+				}
+			}
+			return header;
+		}
+
+		/// Returns the elements of a section, the number of elements is returned in count.
+		template<class T>
+		const T* getSection(const Header* header, int index, size_t& count) const
+		{
+			count = (size_t)(header->sections[index].size / sizeof(T));
+			return (const T*)(m_Data + header->sections[index].offset);
+		}
+	};
+
+	/// Read only memory mapping of a whole file.
+	class MappedFile : public Reader
+	{
+	protected:
+#ifdef _WIN32
+		HANDLE m_File;
+		HANDLE m_Mapping;
+#else
+		int m_File;
+#endif
+
+	public:
+		MappedFile(const std::string& fileName) : Reader(nullptr, 0)
+		{
+#ifdef _WIN32
+			m_Mapping = NULL;
+			m_File = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			LARGE_INTEGER size;
+			if (m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+				return;
+			m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (m_Mapping)
+			{
+				m_Data = (const char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+				m_Size = m_Data ? (size_t)size.QuadPart : 0;
+			}
+#else
+			m_File = open(fileName.c_str(), O_RDONLY);
+			struct stat fileStat;
+			if (m_File < 0 || fstat(m_File, &fileStat) != 0 || fileStat.st_size == 0)
+				return;
+			void* data = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, m_File, 0);
+			if (data != MAP_FAILED)
+			{
+				// the sections are read front to back
+				madvise(data, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+				m_Data = (const char*)data;
+				m_Size = (size_t)fileStat.st_size;
+			}
+#endif
+		}
+
+		~MappedFile()
+		{
+#ifdef _WIN32
+			if (m_Data) UnmapViewOfFile(m_Data);
+			if (m_Mapping) CloseHandle(m_Mapping);
+			if (m_File != INVALID_HANDLE_VALUE) CloseHandle(m_File);
+#else
+			if (m_Data) munmap((void*)m_Data, m_Size);
+			if (m_File >= 0) close(m_File);
+#endif
+		}
+	};
+}
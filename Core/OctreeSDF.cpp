@@ -1,9 +1,12 @@
 
 #include <stack>
+#include <algorithm>
 #include "OctreeSDF.h"
 #include "SolidGeometry.h"
 #include "MarchingCubes.h"
 #include "Mesh.h"
+#include "OctreeFile.h"
+#include "MathMisc.h"
 
 /*OctreeSDF::SharedLeafFace::SharedLeafFace(const Ogre::Vector3& pos, float stepSize, int dim1, int dim2, const SignedDistanceField3D& implicitSDF)
 {
@@ -57,9 +60,10 @@ OctreeSDF::SharedLeafFace* OctreeSDF::lookupOrComputeYZFace(const Vector3i& glob
 Node constructors
 *******************************************************************************************/
 
-OctreeSDF::InnerNode::InnerNode(const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::InnerNode::InnerNode(OctreeSDFT* tree, const Area& area, const SolidGeometry& implicitSDF)
 {
-	m_NodeType = INNER;
+	this->m_NodeType = Node::INNER;
 	/*for (int i = 0; i < 8; i++)
 	{
 		m_CornerSamples[i] = cornerSamples[i];
@@ -68,33 +72,48 @@ OctreeSDF::InnerNode::InnerNode(const Area& area, const SolidGeometry& implicitS
 
 	Area subAreas[8];
 	area.getSubAreas(subAreas);
+	void* childSlots[8];
+	tree->m_Arena->allocateObjects(getChildSlotSize(), 8, childSlots);
+	tree->forEachChild(area, [&](int i)
+	{
+		m_Children[i] = tree->createNode(subAreas[i], implicitSDF, childSlots[i]);
+	});
+}
+
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::InnerNode::~InnerNode()
+{
 	for (int i = 0; i < 8; i++)
 	{
-		m_Children[i] = OctreeSDF::createNode(subAreas[i], implicitSDF);
+		// m_CornerSamples[i]->sample->useCount--;
+		Node::release(m_Children[i]);
 	}
 }
 
-OctreeSDF::InnerNode::~InnerNode()
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::InnerNode::InnerNode(const InnerNode& rhs) : Node(rhs)
 {
 	for (int i = 0; i < 8; i++)
 	{
-		// m_CornerSamples[i]->sample->useCount--;
-		delete m_Children[i];
+		m_Children[i] = rhs.m_Children[i];
+		m_Children[i]->acquire();
 	}
 }
 
-OctreeSDF::InnerNode::InnerNode(const InnerNode& rhs)
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::InnerNode::InnerNode(const InnerNode& rhs, NodeArena& arena)
 {
-	m_NodeType = INNER;
+	this->m_NodeType = Node::INNER;
 	for (int i = 0; i < 8; i++)
 	{
-		m_Children[i] = rhs.m_Children[i]->clone();
+		m_Children[i] = rhs.m_Children[i]->clone(arena);
 	}
 }
 
-OctreeSDF::EmptyNode::EmptyNode(Sample* cornerSamples)
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::EmptyNode::EmptyNode(Sample* cornerSamples)
 {
-	m_NodeType = EMPTY;
+	this->m_NodeType = Node::EMPTY;
 	for (int i = 0; i < 8; i++)
 	{
 		m_CornerSamples[i] = cornerSamples[i];
@@ -102,7 +121,8 @@ OctreeSDF::EmptyNode::EmptyNode(Sample* cornerSamples)
 	}
 }
 
-OctreeSDF::EmptyNode::~EmptyNode()
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::EmptyNode::~EmptyNode()
 {
 	/*for (int i = 0; i < 8; i++)
 	{
@@ -110,10 +130,17 @@ OctreeSDF::EmptyNode::~EmptyNode()
 	}*/
 }
 
-OctreeSDF::GridNode::GridNode(const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::GridNode::GridNode(const Sample* samples)
 {
-	m_NodeType = GRID;
-	float stepSize = area.m_RealSize / LEAF_SIZE_1D_INNER;
+	this->m_NodeType = Node::GRID;
+	std::copy(samples, samples + LEAF_SIZE_3D, m_Samples);
+}
+
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::GridNode::GridNode(OctreeSDFT* tree, const Area& area, const SolidGeometry& implicitSDF)
+{
+	this->m_NodeType = Node::GRID;
 	/*m_Faces[0] = lookupOrComputeYZFace(area.m_MinPos, area.m_MinRealPos, faceStepSize, implicitSDF, sdfValues);
 	m_Faces[1] = lookupOrComputeXZFace(area.m_MinPos, area.m_MinRealPos, faceStepSize, implicitSDF, sdfValues);
 	m_Faces[2] = lookupOrComputeXYFace(area.m_MinPos, area.m_MinRealPos, faceStepSize, implicitSDF, sdfValues);
@@ -123,69 +150,101 @@ OctreeSDF::GridNode::GridNode(const Area& area, const SolidGeometry& implicitSDF
 	for (int i = 0; i < 6; i++)
 		m_Faces[i]->useCount++;*/
 
-	// compute inner grid
-	Ogre::Vector3 currentPos = area.m_MinRealPos;
-	for (unsigned int x = 0; x < LEAF_SIZE_1D; x++)
+	if (area.m_SizeExpo != LEAF_EXPO)
 	{
-		for (unsigned int y = 0; y < LEAF_SIZE_1D; y++)
+		// the root is smaller than a leaf and does not match the global lattice
+		implicitSDF.getLatticeSamples(Lattice(area.m_MinRealPos, area.m_RealSize / LEAF_SIZE_1D_INNER, Vector3i(0), Vector3i(LEAF_SIZE_1D)), m_Samples);
+		return;
+	}
+	// sample positions are computed from global indices, so neighboring leaves share bit-identical boundary samples
+	Lattice lattice(tree->getLatticeOrigin(), tree->m_CellSize, area.m_MinPos, Vector3i(LEAF_SIZE_1D));
+	if (tree->m_SampleFaceCache)
+	{
+		tree->m_SampleFaceCache->getLeafValues(lattice, m_Samples, [&implicitSDF](const Ogre::Vector3* points, int numPoints, Sample* samples)
 		{
-			for (unsigned int z = 0; z < LEAF_SIZE_1D; z++)
-			{
-				implicitSDF.getSample(currentPos, at(x, y, z));
-				// at(x, y, z) = implicitSDF.getSample(currentPos);
-				currentPos.z += stepSize;
-			}
-			currentPos.z = area.m_MinRealPos.z;
-			currentPos.y += stepSize;
-		}
-		currentPos.y = area.m_MinRealPos.y;
-		currentPos.x += stepSize;
+			implicitSDF.getSamples(points, numPoints, samples);
+		});
 	}
+	else implicitSDF.getLatticeSamples(lattice, m_Samples);
 }
 
-OctreeSDF::GridNode::~GridNode()
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::GridNode::~GridNode()
 {
 	/*for (int i = 0; i < 6; i++)
 		m_Faces[i]->useCount--;*/
 }
 
-OctreeSDF::Node* OctreeSDF::createNode(const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::createNode(const Area& area, const SolidGeometry& implicitSDF, void* childSlot)
 {
 	bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
 	if (area.m_SizeExpo <= LEAF_EXPO && needsSubdivision)
-		return new GridNode(area, implicitSDF);
+	{
+		// leaves do not fit into a child slot, the slot goes back to the free list
+		NodeArena::freeObject(childSlot);
+		return new (*m_Arena) GridNode(this, area, implicitSDF);
+	}
+
+	if (!childSlot)
+		childSlot = m_Arena->allocateObject(getChildSlotSize());
+	if (needsSubdivision)
+		return new (childSlot) InnerNode(this, area, implicitSDF);
 
+	// only empty nodes store corner samples
 	Sample cornerSamples[8];
 	for (int i = 0; i < 8; i++)
 		implicitSDF.getSample(area.getCornerVecs(i).second, cornerSamples[i]);
+	return new (childSlot) EmptyNode(cornerSamples);
+}
 
-	if (needsSubdivision)	
-		return new InnerNode(area, implicitSDF);
+template<int LeafExpo>
+size_t OctreeSDFT<LeafExpo>::getChildSlotSize()
+{
+	return std::max(sizeof(InnerNode), sizeof(EmptyNode));
+}
 
-	return new EmptyNode(cornerSamples);
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::forEachChild(const Area& area, const std::function<void(int)>& function)
+{
+	if (!m_ThreadPool || m_RootArea.m_SizeExpo - area.m_SizeExpo >= m_MaxTaskDepth)
+	{
+		for (int i = 0; i < 8; i++)
+			function(i);
+		return;
+	}
+	ThreadPool::TaskGroup tasks(*m_ThreadPool);
+	for (int i = 1; i < 8; i++)
+		tasks.run([&function, i]() { function(i); });
+	function(0);
+	tasks.wait();
 }
 
-void OctreeSDF::InnerNode::countNodes(int& counter) const
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::InnerNode::countNodes(int& counter) const
 {
 	counter++;
 	for (int i = 0; i < 8; i++)
 		m_Children[i]->countNodes(counter);
 }
 
-void OctreeSDF::InnerNode::countLeaves(int& counter) const
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::InnerNode::countLeaves(int& counter) const
 {
 	for (int i = 0; i < 8; i++)
 		m_Children[i]->countLeaves(counter);
 }
 
-void OctreeSDF::InnerNode::countMemory(int& counter) const
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::InnerNode::countMemory(int& counter) const
 {
 	counter += sizeof(*this);
 	for (int i = 0; i < 8; i++)
 		m_Children[i]->countMemory(counter);
 }
 
-void OctreeSDF::GridNode::getCubesToMarch(const Area& area, vector<Cube>& cubes) const
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::GridNode::getCubesToMarch(const Area& area, vector<Cube>& cubes) const
 {
 	/*std::bitset<LEAF_SIZE_3D_INNER> cubesWithSignChange;
 	for (unsigned int x = 0; x < LEAF_SIZE_1D - 1; x++)
@@ -212,7 +271,7 @@ void OctreeSDF::GridNode::getCubesToMarch(const Area& area, vector<Cube>& cubes)
 				cube.cornerSamples[5] = &at(x + 1, y, z + 1);
 				cube.cornerSamples[6] = &at(x + 1, y + 1, z);
 				cube.cornerSamples[7] = &at(x + 1, y + 1, z + 1);
-				if (!OctreeSDF::allSignsAreEqual((const Sample**)cube.cornerSamples))
+				if (!OctreeSDFT::allSignsAreEqual((const Sample**)cube.cornerSamples))
 				{
 					cube.posMin = area.m_MinPos + Vector3i(x, y, z);
 					cubes.push_back(cube);
@@ -229,7 +288,8 @@ static float getInterpolationWeight(float dist1, float dist2)
 	return dist2 / (dist2 - dist1);
 }
 
-void OctreeSDF::GridNode::getSharedVertices(const Area& area, std::vector<Vertex>& vertices, Vector3iHashGrid<unsigned int>& indexMap) const
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::GridNode::getSharedVertices(const Area& area, std::vector<Vertex>& vertices, Vector3iHashGrid<unsigned int>& indexMap) const
 {
 	Vector3i minKey = area.m_MinPos.doubleVec();
 	float stepSize = area.m_RealSize / LEAF_SIZE_1D_INNER;
@@ -323,7 +383,8 @@ void OctreeSDF::GridNode::getSharedVertices(const Area& area, std::vector<Vertex
 	}
 }
 
-void OctreeSDF::InnerNode::getCubesToMarch(const Area& area, vector<Cube>& cubes) const
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::InnerNode::getCubesToMarch(const Area& area, vector<Cube>& cubes) const
 {
 	Area subAreas[8];
 	area.getSubAreas(subAreas);
@@ -331,7 +392,44 @@ void OctreeSDF::InnerNode::getCubesToMarch(const Area& area, vector<Cube>& cubes
 		m_Children[i]->getCubesToMarch(subAreas[i], cubes);
 }
 
-void OctreeSDF::InnerNode::getSharedVertices(const Area& area, std::vector<Vertex>& vertices, Vector3iHashGrid<unsigned int>& indexMap) const
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Sample OctreeSDFT<LeafExpo>::InnerNode::getSample(const Area& area, const Ogre::Vector3& point) const
+{
+	Ogre::Vector3 center = area.m_MinRealPos + Ogre::Vector3(area.m_RealSize * 0.5f);
+	int child = ((point.x >= center.x) << 2) | ((point.y >= center.y) << 1) | (point.z >= center.z);
+	Area subAreas[8];
+	area.getSubAreas(subAreas);
+	return m_Children[child]->getSample(subAreas[child], point);
+}
+
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Sample OctreeSDFT<LeafExpo>::EmptyNode::getSample(const Area& area, const Ogre::Vector3& point) const
+{
+	Ogre::Vector3 weights = (point - area.m_MinRealPos) / area.m_RealSize;
+	for (int d = 0; d < 3; d++)
+		weights[d] = std::min(std::max(weights[d], 0.0f), 1.0f);
+	return MathMisc::trilinearInterpolation(m_CornerSamples, weights);
+}
+
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Sample OctreeSDFT<LeafExpo>::GridNode::getSample(const Area& area, const Ogre::Vector3& point) const
+{
+	Ogre::Vector3 cellPos = (point - area.m_MinRealPos) * ((float)LEAF_SIZE_1D_INNER / area.m_RealSize);
+	int cell[3];
+	Ogre::Vector3 weights;
+	for (int d = 0; d < 3; d++)
+	{
+		cell[d] = std::min(std::max((int)cellPos[d], 0), LEAF_SIZE_1D_INNER - 1);
+		weights[d] = std::min(std::max(cellPos[d] - cell[d], 0.0f), 1.0f);
+	}
+	Sample cornerSamples[8];
+	for (int i = 0; i < 8; i++)
+		cornerSamples[i] = at(cell[0] + ((i & 4) >> 2), cell[1] + ((i & 2) >> 1), cell[2] + (i & 1));
+	return MathMisc::trilinearInterpolation(cornerSamples, weights);
+}
+
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::InnerNode::getSharedVertices(const Area& area, std::vector<Vertex>& vertices, Vector3iHashGrid<unsigned int>& indexMap) const
 {
 	Area subAreas[8];
 	area.getSubAreas(subAreas);
@@ -339,41 +437,48 @@ void OctreeSDF::InnerNode::getSharedVertices(const Area& area, std::vector<Verte
 		m_Children[i]->getSharedVertices(subAreas[i], vertices, indexMap);
 }
 
-void OctreeSDF::InnerNode::invert()
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::InnerNode::invert()
 {
 	for (int i = 0; i < 8; i++)
 		m_Children[i]->invert();
 }
 
-void OctreeSDF::EmptyNode::invert()
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::EmptyNode::invert()
 {
 	for (int i = 0; i < 8; i++)
 		m_CornerSamples[i].signedDistance *= -1.0f;
 }
 
-void OctreeSDF::GridNode::invert()
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::GridNode::invert()
 {
 	for (int i = 0; i < LEAF_SIZE_3D; i++)
 		m_Samples[i].signedDistance *= -1.0f;
 }
 
-OctreeSDF::Node* OctreeSDF::intersect(Node* node, const SolidGeometry& implicitSDF, const Area& area)
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::intersect(Node* node, const SolidGeometry& implicitSDF, const Area& area)
 {
 	bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
 	if (node->getNodeType() == Node::INNER && needsSubdivision)
 	{
+		node = unshareNode(node);
 		InnerNode* innerNode = (InnerNode*)node;
 		Area subAreas[8];
 		area.getSubAreas(subAreas);
-		for (int i = 0; i < 8; i++)
+		forEachChild(area, [&](int i)
+		{
 			innerNode->m_Children[i] = intersect(innerNode->m_Children[i], implicitSDF, subAreas[i]);
-		return node;
+		});
+		return collapseNode(node);
 	}
 	if (!needsSubdivision)
 	{
 		if (implicitSDF.getSample(area.getCornerVecs(0).second).signedDistance >= 0)
 			return node;
-		delete node;
+		Node::release(node);
 		return createNode(area, implicitSDF);
 	}
 	if (node->getNodeType() == Node::EMPTY)
@@ -381,38 +486,43 @@ OctreeSDF::Node* OctreeSDF::intersect(Node* node, const SolidGeometry& implicitS
 		EmptyNode* emptyNode = (EmptyNode*)node;
 		if (emptyNode->m_CornerSamples[0].signedDistance < 0)
 			return node;
-		delete node;
-		return createNode(area, implicitSDF);
+		Node::release(node);
+		return simplifyNode(createNode(area, implicitSDF));
 
 	}
 
+	node = unshareNode(node);
 	GridNode* gridNode = (GridNode*)node;
-	GridNode otherGridNode(area, implicitSDF);
+	GridNode otherGridNode(this, area, implicitSDF);
 	for (int i = 0; i < LEAF_SIZE_3D; i++)
 	{
 		if (otherGridNode.m_Samples[i].signedDistance < gridNode->m_Samples[i].signedDistance)
 			gridNode->m_Samples[i] = otherGridNode.m_Samples[i];
 	}
-	return node;
+	return collapseNode(node);
 }
 
-OctreeSDF::Node* OctreeSDF::subtract(Node* node, const SolidGeometry& implicitSDF, const Area& area)
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::subtract(Node* node, const SolidGeometry& implicitSDF, const Area& area)
 {
 	bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
 	if (node->getNodeType() == Node::INNER && needsSubdivision)
 	{
+		node = unshareNode(node);
 		InnerNode* innerNode = (InnerNode*)node;
 		Area subAreas[8];
 		area.getSubAreas(subAreas);
-		for (int i = 0; i < 8; i++)
+		forEachChild(area, [&](int i)
+		{
 			innerNode->m_Children[i] = subtract(innerNode->m_Children[i], implicitSDF, subAreas[i]);
-		return node;
+		});
+		return collapseNode(node);
 	}
 	if (!needsSubdivision)
 	{
 		if (implicitSDF.getSample(area.getCornerVecs(0).second).signedDistance < 0)
 			return node;
-		delete node;
+		Node::release(node);
 		Node* newNode = createNode(area, implicitSDF);
 		newNode->invert();
 		return newNode;
@@ -422,15 +532,16 @@ OctreeSDF::Node* OctreeSDF::subtract(Node* node, const SolidGeometry& implicitSD
 		EmptyNode* emptyNode = (EmptyNode*)node;
 		if (emptyNode->m_CornerSamples[0].signedDistance < 0)
 			return node;
-		delete node;
-		Node* newNode = createNode(area, implicitSDF);
+		Node::release(node);
+		Node* newNode = simplifyNode(createNode(area, implicitSDF));
 		newNode->invert();
 		return newNode;
 
 	}
 
+	node = unshareNode(node);
 	GridNode* gridNode = (GridNode*)node;
-	GridNode otherGridNode(area, implicitSDF);
+	GridNode otherGridNode(this, area, implicitSDF);
 	for (int i = 0; i < LEAF_SIZE_3D; i++)
 	{
 		if (-otherGridNode.m_Samples[i].signedDistance < gridNode->m_Samples[i].signedDistance)
@@ -439,39 +550,87 @@ OctreeSDF::Node* OctreeSDF::subtract(Node* node, const SolidGeometry& implicitSD
 			gridNode->m_Samples[i].signedDistance *= -1.0f;
 		}
 	}
-	return node;
+	return collapseNode(node);
 }
 
-OctreeSDF::Node* OctreeSDF::intersectAlignedNode(Node* node, Node* otherNode, const Area& area)
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::merge(Node* node, const SolidGeometry& implicitSDF, const Area& area)
+{
+	bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
+	if (node->getNodeType() == Node::INNER && needsSubdivision)
+	{
+		node = unshareNode(node);
+		InnerNode* innerNode = (InnerNode*)node;
+		Area subAreas[8];
+		area.getSubAreas(subAreas);
+		forEachChild(area, [&](int i)
+		{
+			innerNode->m_Children[i] = merge(innerNode->m_Children[i], implicitSDF, subAreas[i]);
+		});
+		return collapseNode(node);
+	}
+	if (!needsSubdivision)
+	{
+		if (implicitSDF.getSample(area.getCornerVecs(0).second).signedDistance < 0)
+			return node;
+		Node::release(node);
+		return createNode(area, implicitSDF);
+	}
+	if (node->getNodeType() == Node::EMPTY)
+	{
+		EmptyNode* emptyNode = (EmptyNode*)node;
+		if (emptyNode->m_CornerSamples[0].signedDistance >= 0)
+			return node;
+		Node::release(node);
+		return simplifyNode(createNode(area, implicitSDF));
+	}
+
+	node = unshareNode(node);
+	GridNode* gridNode = (GridNode*)node;
+	GridNode otherGridNode(this, area, implicitSDF);
+	for (int i = 0; i < LEAF_SIZE_3D; i++)
+	{
+		if (otherGridNode.m_Samples[i].signedDistance > gridNode->m_Samples[i].signedDistance)
+			gridNode->m_Samples[i] = otherGridNode.m_Samples[i];
+	}
+	return collapseNode(node);
+}
+
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::intersectAlignedNode(Node* node, Node* otherNode, const Area& area)
 {
 	if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::INNER)
 	{
+		node = unshareNode(node);
 		InnerNode* innerNode = (InnerNode*)node;
 		InnerNode* otherInnerNode = (InnerNode*)otherNode;
 		Area subAreas[8];
 		area.getSubAreas(subAreas);
-		for (int i = 0; i < 8; i++)
+		forEachChild(area, [&](int i)
+		{
 			innerNode->m_Children[i] = intersectAlignedNode(innerNode->m_Children[i], otherInnerNode->m_Children[i], subAreas[i]);
-		return node;
+		});
+		return collapseNode(node);
 	}
 	if (otherNode->getNodeType() == Node::EMPTY)
 	{
 		EmptyNode* otherEmptyNode = (EmptyNode*)otherNode;
 		if (otherEmptyNode->m_CornerSamples[0].signedDistance >= 0)
 			return node;
-		delete node;
-		return otherNode->clone();
+		Node::release(node);
+		return otherNode->clone(*m_Arena);
 	}
 	if (node->getNodeType() == Node::EMPTY)
 	{
 		EmptyNode* emptyNode = (EmptyNode*)node;
 		if (emptyNode->m_CornerSamples[0].signedDistance < 0)
 			return node;
-		delete node;
-		return otherNode->clone();
+		Node::release(node);
+		return simplifyNode(otherNode->clone(*m_Arena));
 		
 	}
 
+	node = unshareNode(node);
 	GridNode* gridNode = (GridNode*)node;
 	GridNode* otherGridNode = (GridNode*)otherNode;
 	for (int i = 0; i < LEAF_SIZE_3D; i++)
@@ -479,28 +638,32 @@ OctreeSDF::Node* OctreeSDF::intersectAlignedNode(Node* node, Node* otherNode, co
 		if (otherGridNode->m_Samples[i].signedDistance < gridNode->m_Samples[i].signedDistance)
 			gridNode->m_Samples[i] = otherGridNode->m_Samples[i];
 	}
-	return node;
+	return collapseNode(node);
 }
 
-OctreeSDF::Node* OctreeSDF::subtractAlignedNode(Node* node, Node* otherNode, const Area& area)
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::subtractAlignedNode(Node* node, Node* otherNode, const Area& area)
 {
 	if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::INNER)
 	{
+		node = unshareNode(node);
 		InnerNode* innerNode = (InnerNode*)node;
 		InnerNode* otherInnerNode = (InnerNode*)otherNode;
 		Area subAreas[8];
 		area.getSubAreas(subAreas);
-		for (int i = 0; i < 8; i++)
+		forEachChild(area, [&](int i)
+		{
 			innerNode->m_Children[i] = subtractAlignedNode(innerNode->m_Children[i], otherInnerNode->m_Children[i], subAreas[i]);
-		return node;
+		});
+		return collapseNode(node);
 	}
 	if (otherNode->getNodeType() == Node::EMPTY)
 	{
 		EmptyNode* otherEmptyNode = (EmptyNode*)otherNode;
 		if (otherEmptyNode->m_CornerSamples[0].signedDistance < 0)
 			return node;
-		delete node;
-		Node* inverted = otherNode->clone();
+		Node::release(node);
+		Node* inverted = otherNode->clone(*m_Arena);
 		inverted->invert();
 		return inverted;
 	}
@@ -509,13 +672,14 @@ OctreeSDF::Node* OctreeSDF::subtractAlignedNode(Node* node, Node* otherNode, con
 		EmptyNode* emptyNode = (EmptyNode*)node;
 		if (emptyNode->m_CornerSamples[0].signedDistance < 0)
 			return node;
-		delete node;
-		Node* inverted = otherNode->clone();
+		Node::release(node);
+		Node* inverted = simplifyNode(otherNode->clone(*m_Arena));
 		inverted->invert();
 		return inverted;
 		
 	}
 
+	node = unshareNode(node);
 	GridNode* gridNode = (GridNode*)node;
 	GridNode* otherGridNode = (GridNode*)otherNode;
 	for (int i = 0; i < LEAF_SIZE_3D; i++)
@@ -526,39 +690,44 @@ OctreeSDF::Node* OctreeSDF::subtractAlignedNode(Node* node, Node* otherNode, con
 			gridNode->m_Samples[i].signedDistance *= -1.0f;
 		}
 	}
-	return node;
+	return collapseNode(node);
 }
 
-OctreeSDF::Node* OctreeSDF::mergeAlignedNode(Node* node, Node* otherNode, const Area& area)
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::mergeAlignedNode(Node* node, Node* otherNode, const Area& area)
 {
 	if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::INNER)
 	{
+		node = unshareNode(node);
 		InnerNode* innerNode = (InnerNode*)node;
 		InnerNode* otherInnerNode = (InnerNode*)otherNode;
 		Area subAreas[8];
 		area.getSubAreas(subAreas);
-		for (int i = 0; i < 8; i++)
+		forEachChild(area, [&](int i)
+		{
 			innerNode->m_Children[i] = mergeAlignedNode(innerNode->m_Children[i], otherInnerNode->m_Children[i], subAreas[i]);
-		return node;
+		});
+		return collapseNode(node);
 	}
 	if (otherNode->getNodeType() == Node::EMPTY)
 	{
 		EmptyNode* otherEmptyNode = (EmptyNode*)otherNode;
 		if (otherEmptyNode->m_CornerSamples[0].signedDistance < 0)
 			return node;
-		delete node;
-		return otherNode->clone();
+		Node::release(node);
+		return otherNode->clone(*m_Arena);
 	}
 	if (node->getNodeType() == Node::EMPTY)
 	{
 		EmptyNode* emptyNode = (EmptyNode*)node;
 		if (emptyNode->m_CornerSamples[0].signedDistance >= 0)
 			return node;
-		delete node;
-		return otherNode->clone();
+		Node::release(node);
+		return simplifyNode(otherNode->clone(*m_Arena));
 		
 	}
 
+	node = unshareNode(node);
 	GridNode* gridNode = (GridNode*)node;
 	GridNode* otherGridNode = (GridNode*)otherNode;
 	for (int i = 0; i < LEAF_SIZE_3D; i++)
@@ -566,42 +735,79 @@ OctreeSDF::Node* OctreeSDF::mergeAlignedNode(Node* node, Node* otherNode, const
 		if (otherGridNode->m_Samples[i].signedDistance > gridNode->m_Samples[i].signedDistance)
 			gridNode->m_Samples[i] = otherGridNode->m_Samples[i];
 	}
-	return node;
+	return collapseNode(node);
 }
 
-std::shared_ptr<OctreeSDF> OctreeSDF::sampleSDF(SolidGeometry* otherSDF, int maxDepth)
+template<int LeafExpo>
+std::shared_ptr<OctreeSDFT<LeafExpo> > OctreeSDFT<LeafExpo>::sampleSDF(SolidGeometry* otherSDF, int maxDepth)
 {
 	AABB aabb = otherSDF->getAABB();
     aabb.addEpsilon(0.00001f);
 	return sampleSDF(otherSDF, aabb, maxDepth);
 }
 
-std::shared_ptr<OctreeSDF> OctreeSDF::sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth)
+template<int LeafExpo>
+std::shared_ptr<OctreeSDFT<LeafExpo> > OctreeSDFT<LeafExpo>::sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth)
 {
     auto ts = Profiler::timestamp();
-	std::shared_ptr<OctreeSDF> octreeSDF = std::make_shared<OctreeSDF>();
+	std::shared_ptr<OctreeSDFT> octreeSDF = std::make_shared<OctreeSDFT>();
 	Ogre::Vector3 aabbSize = aabb.getMax() - aabb.getMin();
 	float cubeSize = std::max(std::max(aabbSize.x, aabbSize.y), aabbSize.z);
 	octreeSDF->m_CellSize = cubeSize / (1 << maxDepth);
 	otherSDF->prepareSampling(aabb, octreeSDF->m_CellSize);
 	octreeSDF->m_RootArea = Area(Vector3i(0, 0, 0), maxDepth, aabb.getMin(), cubeSize);
-	octreeSDF->m_RootNode = octreeSDF->createNode(octreeSDF->m_RootArea, *otherSDF);
+	octreeSDF->sampleRootNode(*otherSDF);
     Profiler::printJobDuration("OctreeSDF::sampleSDF", ts);
 	return octreeSDF;
 }
 
-float OctreeSDF::getInverseCellSize()
+template<int LeafExpo>
+std::shared_ptr<OctreeSDFT<LeafExpo> > OctreeSDFT<LeafExpo>::sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, ThreadPool* threadPool, int maxTaskDepth)
+{
+	auto ts = Profiler::timestamp();
+	std::shared_ptr<OctreeSDFT> octreeSDF = std::make_shared<OctreeSDFT>();
+	Ogre::Vector3 aabbSize = aabb.getMax() - aabb.getMin();
+	float cubeSize = std::max(std::max(aabbSize.x, aabbSize.y), aabbSize.z);
+	octreeSDF->m_CellSize = cubeSize / (1 << maxDepth);
+	otherSDF->prepareSampling(aabb, octreeSDF->m_CellSize);
+	octreeSDF->m_RootArea = Area(Vector3i(0, 0, 0), maxDepth, aabb.getMin(), cubeSize);
+	octreeSDF->setThreadPool(threadPool, maxTaskDepth);
+	octreeSDF->sampleRootNode(*otherSDF);
+	Profiler::printJobDuration("OctreeSDF::sampleSDF (parallel)", ts);
+	return octreeSDF;
+}
+
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::sampleRootNode(const SolidGeometry& implicitSDF)
+{
+	SampleFaceCache faceCache;
+	m_SampleFaceCache = &faceCache;
+	m_RootNode = createNode(m_RootArea, implicitSDF);
+	m_SampleFaceCache = nullptr;
+}
+
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::setThreadPool(ThreadPool* threadPool, int maxTaskDepth)
+{
+	m_ThreadPool = threadPool;
+	m_MaxTaskDepth = maxTaskDepth;
+}
+
+template<int LeafExpo>
+float OctreeSDFT<LeafExpo>::getInverseCellSize()
 {
 	return (float)(1 << m_RootArea.m_SizeExpo) / m_RootArea.m_RealSize;
 }
 
-AABB OctreeSDF::getAABB() const
+template<int LeafExpo>
+AABB OctreeSDFT<LeafExpo>::getAABB() const
 {
 	return m_RootArea.toAABB();
 }
 
 #include "Profiler.h"
-vector<OctreeSDF::Cube> OctreeSDF::getCubesToMarch()
+template<int LeafExpo>
+vector<SampledSolidGeometry::Cube> OctreeSDFT<LeafExpo>::getCubesToMarch()
 {
 	int numLeaves = countLeaves();
 	/*std::cout << "Reserving " << numLeaves * LEAF_SIZE_2D_INNER << std::endl;
@@ -623,19 +829,100 @@ vector<OctreeSDF::Cube> OctreeSDF::getCubesToMarch()
 	return cubes;
 }
 
-void OctreeSDF::getSample(const Ogre::Vector3& point, Sample& sample) const
+template<int LeafExpo>
+const typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::findLeaf(const Ogre::Vector3& point, Area& area) const
 {
-    sample = m_RootNode->getSample(m_RootArea, point);
+	const Node* node = m_RootNode;
+	area = m_RootArea;
+	while (node->getNodeType() == Node::INNER)
+	{
+		Ogre::Vector3 center = area.m_MinRealPos + Ogre::Vector3(area.m_RealSize * 0.5f);
+		int child = ((point.x >= center.x) << 2) | ((point.y >= center.y) << 1) | (point.z >= center.z);
+		Area subAreas[8];
+		area.getSubAreas(subAreas);
+		area = subAreas[child];
+		node = ((const InnerNode*)node)->m_Children[child];
+	}
+	return node;
+}
+
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::getSampleCached(const Ogre::Vector3& point, const Node*& leaf, Area& leafArea, Sample& sample) const
+{
+	AABB aabb = m_RootArea.toAABB();
+	Ogre::Vector3 clampedPoint = point;
+	clampedPoint.makeCeil(aabb.getMin());
+	clampedPoint.makeFloor(aabb.getMax());
+	if (!leaf || !leafArea.containsPoint(clampedPoint))
+		leaf = findLeaf(clampedPoint, leafArea);
+	sample = leaf->getSample(leafArea, clampedPoint);
+	if (clampedPoint != point)
+		sample.signedDistance -= clampedPoint.distance(point);
+}
+
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::getSample(const Ogre::Vector3& point, Sample& sample) const
+{
+	const Node* leaf = nullptr;
+	Area leafArea;
+	getSampleCached(point, leaf, leafArea, sample);
+}
+
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const
+{
+	// Morton keys of the leaf sized cubes the points lie in, packed with the point index so a plain integer sort suffices.
+	// If both don't fit into 64 bits, the keys lose their finest levels.
+	int leafExpo = std::min(LEAF_EXPO, m_RootArea.m_SizeExpo);
+	int keyBits = (m_RootArea.m_SizeExpo - leafExpo) * 3;
+	int indexBits = 1;
+	while (indexBits < 32 && (1ll << indexBits) < numPoints)
+		indexBits++;
+	int keyShift = std::max(keyBits + indexBits - 64, 0);
+	unsigned long long indexMask = (1ull << indexBits) - 1;
+	AABB aabb = m_RootArea.toAABB();
+	float inverseCubeSize = 1.0f / (m_CellSize * (1 << leafExpo));
+	float maxCube = (float)((1 << (m_RootArea.m_SizeExpo - leafExpo)) - 1);
+	std::vector<unsigned long long> keys(numPoints);
+	for (int i = 0; i < numPoints; i++)
+	{
+		unsigned int cube[3];
+		for (int d = 0; d < 3; d++)
+			cube[d] = (unsigned int)std::min(std::max((points[i][d] - aabb.getMin()[d]) * inverseCubeSize, 0.0f), maxCube);
+		keys[i] = ((MathMisc::mortonKey(cube[0], cube[1], cube[2]) >> keyShift) << indexBits) | (unsigned long long)i;
+	}
+	std::sort(keys.begin(), keys.end());
+	const Node* leaf = nullptr;
+	Area leafArea;
+	for (auto i = keys.begin(); i != keys.end(); ++i)
+	{
+		int index = (int)(*i & indexMask);
+		getSampleCached(points[index], leaf, leafArea, samples[index]);
+	}
 }
 
-bool OctreeSDF::intersectsSurface(const AABB& aabb) const
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::getLatticeSamples(const Lattice& lattice, Sample* samples) const
+{
+	// the lattice order is coherent already
+	const Node* leaf = nullptr;
+	Area leafArea;
+	for (int x = 0; x < lattice.size.x; x++)
+		for (int y = 0; y < lattice.size.y; y++)
+			for (int z = 0; z < lattice.size.z; z++)
+				getSampleCached(lattice.getPoint(x, y, z), leaf, leafArea, *samples++);
+}
+
+template<int LeafExpo>
+bool OctreeSDFT<LeafExpo>::intersectsSurface(const AABB& aabb) const
 {
 	if (m_TriangleCache.getBVH())
 		return m_TriangleCache.getBVH()->intersectsAABB(aabb);
 	return true;
 }
 
-void OctreeSDF::subtract(SolidGeometry* otherSDF)
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::subtract(SolidGeometry* otherSDF)
 {
 	otherSDF->prepareSampling(m_RootArea.toAABB(), m_CellSize);
 	auto ts = Profiler::timestamp();
@@ -643,7 +930,8 @@ void OctreeSDF::subtract(SolidGeometry* otherSDF)
 	Profiler::printJobDuration("Subtraction", ts);
 }
 
-void OctreeSDF::intersect(SolidGeometry* otherSDF)
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::intersect(SolidGeometry* otherSDF)
 {
 	otherSDF->prepareSampling(m_RootArea.toAABB(), m_CellSize);
 	auto ts = Profiler::timestamp();
@@ -651,118 +939,307 @@ void OctreeSDF::intersect(SolidGeometry* otherSDF)
 	Profiler::printJobDuration("Intersection", ts);
 }
 
-void OctreeSDF::intersectAlignedOctree(OctreeSDF* otherOctree)
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::intersectAlignedOctree(OctreeSDFT* otherOctree)
 {
 	m_RootNode = intersectAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea);
 }
 
-void OctreeSDF::subtractAlignedOctree(OctreeSDF* otherOctree)
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::subtractAlignedOctree(OctreeSDFT* otherOctree)
 {
 	m_RootNode = subtractAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea);
 }
 
-void OctreeSDF::mergeAlignedOctree(OctreeSDF* otherOctree)
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::mergeAlignedOctree(OctreeSDFT* otherOctree)
 {
 	m_RootNode = mergeAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea);
 }
 
-void OctreeSDF::resize(const AABB& aabb)
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::resize(const AABB& aabb)
 {
-/*	while (!m_RootArea.toAABB().containsPoint(aabb.min))
-	{	// need to resize octree
-		m_RootArea.m_MinPos = m_RootArea.m_MinPos - Vector3i(1 << m_RootArea.m_SizeExpo, 1 << m_RootArea.m_SizeExpo, 1 << m_RootArea.m_SizeExpo);
-		m_RootArea.m_MinRealPos -= Ogre::Vector3(m_RootArea.m_RealSize, m_RootArea.m_RealSize, m_RootArea.m_RealSize);
-		m_RootArea.m_RealSize *= 2.0f;
-		m_RootArea.m_SizeExpo++;
-		Node* oldRoot = m_RootNode;
-		m_RootNode = allocNode();
-		m_RootNode->m_Children[7] = oldRoot;
-
-		// need to fill in some signed distance values for the new area
-		for (int i = 0; i < 7; i++)
+	while (true)
+	{
+		// the old root becomes the child on the side away from the growth direction
+		int oldRootChild = 0;
+		bool grow = false;
+		for (int d = 0; d < 3; d++)
 		{
-			Vector3i offset = Vector3i((i & 4) != 0, (i & 2) != 0, (i & 1) != 0) * (1 << m_RootArea.m_SizeExpo);
-			m_SDFValues[m_RootArea.m_MinPos + offset] = -m_RootArea.m_RealSize;
+			if (aabb.getMin()[d] < m_RootArea.m_MinRealPos[d])
+			{
+				oldRootChild |= 4 >> d;
+				grow = true;
+			}
+			else if (aabb.getMax()[d] > m_RootArea.m_MinRealPos[d] + m_RootArea.m_RealSize)
+				grow = true;
 		}
-		interpolateLeaf(m_RootArea);
-	}
-	while (!m_RootArea.toAABB().containsPoint(aabb.max))
-	{	// need to resize octree
-		m_RootArea.m_RealSize *= 2.0f;
-		m_RootArea.m_SizeExpo++;
-		Node* oldRoot = m_RootNode;
-		m_RootNode = allocNode();
-		m_RootNode->m_Children[0] = oldRoot;
-
-		// need to fill in some signed distance values for the new area
-		for (int i = 1; i < 8; i++)
+		if (!grow)
+			return;
+		// cell indices have to fit into an int
+		if (m_RootArea.m_SizeExpo >= 29)
 		{
-			Vector3i offset = Vector3i((i & 4) != 0, (i & 2) != 0, (i & 1) != 0) * (1 << m_RootArea.m_SizeExpo);
-			m_SDFValues[m_RootArea.m_MinPos + offset] = -m_RootArea.m_RealSize;
+			std::cout << "The octree cannot grow to cover the aabb, it has reached the maximum size." << std::endl;
+			return;
 		}
-		interpolateLeaf(m_RootArea);
-	}*/
+		AABB oldRootAABB = m_RootArea.toAABB();
+		Vector3i childOffset((oldRootChild & 4) != 0, (oldRootChild & 2) != 0, (oldRootChild & 1) != 0);
+		Area rootArea(m_RootArea.m_MinPos - childOffset * (1 << m_RootArea.m_SizeExpo), m_RootArea.m_SizeExpo + 1,
+			m_RootArea.m_MinRealPos - childOffset.toOgreVec() * m_RootArea.m_RealSize, m_RootArea.m_RealSize * 2.0f);
+		Area subAreas[8];
+		rootArea.getSubAreas(subAreas);
+		InnerNode* rootNode = new (*m_Arena) InnerNode();
+		void* childSlots[8];
+		m_Arena->allocateObjects(getChildSlotSize(), 8, childSlots);
+		for (int i = 0; i < 8; i++)
+		{
+			if (i == oldRootChild)
+			{
+				rootNode->m_Children[i] = m_RootNode;
+				continue;
+			}
+			// the distance to the old root is a lower bound of the distance to the content, corners on its boundary are still strictly outside
+			Sample cornerSamples[8];
+			for (int c = 0; c < 8; c++)
+			{
+				Ogre::Vector3 corner = subAreas[i].getCornerVecs(c).second;
+				Ogre::Vector3 closestPos = corner;
+				closestPos.makeCeil(oldRootAABB.getMin());
+				closestPos.makeFloor(oldRootAABB.getMax());
+				cornerSamples[c] = Sample(-std::max(closestPos.distance(corner), m_CellSize), closestPos);
+			}
+			rootNode->m_Children[i] = new (childSlots[i]) EmptyNode(cornerSamples);
+		}
+		m_RootNode = rootNode;
+		m_RootArea = rootArea;
+	}
 }
 
-void OctreeSDF::merge(SolidGeometry* otherSDF)
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::merge(SolidGeometry* otherSDF)
 {
-	// this is not an optimal resize policy but it should work
-	// it is recommended to avoid resizes anyway
-/*	resize(otherSDF->getAABB());
-
+	resize(otherSDF->getAABB());
 	otherSDF->prepareSampling(m_RootArea.toAABB(), m_CellSize);
-	SignedDistanceGrid newSDF;
-	m_RootNode = merge(m_RootNode, m_RootArea, *otherSDF, newSDF, SignedDistanceGrid());
-	for (auto i = newSDF.begin(); i != newSDF.end(); i++)
-	{
-		for (auto i2 = i->begin(); i2 != i->end(); i2++)
-		{
-			m_SDFValues[i2->first] = i2->second;
-		}
-	}*/
+	auto ts = Profiler::timestamp();
+	m_RootNode = merge(m_RootNode, *otherSDF, m_RootArea);
+	Profiler::printJobDuration("Merge", ts);
 }
 
-OctreeSDF::OctreeSDF(const OctreeSDF& other)
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::OctreeSDFT(const OctreeSDFT& other) : m_Arena(std::make_shared<NodeArena>())
 {
-	m_RootNode = other.m_RootNode->clone();
+	// the copy is bump allocated from a single chunk
+	m_Arena->reserve(other.m_Arena->getStats().bytesUsed);
+	m_RootNode = other.m_RootNode->clone(*m_Arena);
 	m_RootArea = other.m_RootArea;
 	m_CellSize = other.m_CellSize;
 	m_TriangleCache = other.m_TriangleCache;
+	m_ThreadPool = other.m_ThreadPool;
+	m_MaxTaskDepth = other.m_MaxTaskDepth;
+	m_SampleFaceCache = nullptr;
 }
 
-OctreeSDF::~OctreeSDF()
+template<int LeafExpo>
+OctreeSDFT<LeafExpo>::~OctreeSDFT()
 {
-	if (m_RootNode)
-		delete m_RootNode;
+	// all nodes live in m_Arena, which releases its chunks without visiting the nodes,
+	// unless nodes are shared, then their references are released so the other octrees do not copy them anymore
+	if (m_RootNode && (m_Arena.use_count() > 1 || !m_SharedArenas.empty()))
+		Node::release(m_RootNode);
+}
+
+template<int LeafExpo>
+std::shared_ptr<OctreeSDFT<LeafExpo> > OctreeSDFT<LeafExpo>::clone()
+{
+	std::shared_ptr<OctreeSDFT> octreeSDF = std::make_shared<OctreeSDFT>();
+	m_RootNode->acquire();
+	octreeSDF->m_RootNode = m_RootNode;
+	octreeSDF->m_RootArea = m_RootArea;
+	octreeSDF->m_CellSize = m_CellSize;
+	octreeSDF->m_TriangleCache = m_TriangleCache;
+	octreeSDF->m_ThreadPool = m_ThreadPool;
+	octreeSDF->m_MaxTaskDepth = m_MaxTaskDepth;
+	octreeSDF->m_SharedArenas = m_SharedArenas;
+	octreeSDF->m_SharedArenas.push_back(m_Arena);
+	return octreeSDF;
+}
+
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::unshareNode(Node* node)
+{
+	if (!node->isShared())
+		return node;
+	Node* copy;
+	if (node->getNodeType() == Node::INNER)
+		copy = new (*m_Arena) InnerNode(*(InnerNode*)node);
+	else copy = node->clone(*m_Arena);
+	Node::release(node);
+	return copy;
+}
+
+namespace
+{
+	/// Sections of OctreeSDF files, node payloads are stored in the order in which the nodes appear in the node types.
+	enum OctreeSDFSection
+	{
+		SDF_SECTION_NODE_TYPES,
+		SDF_SECTION_CORNER_SAMPLES,		// 8 per empty node
+		SDF_SECTION_LEAF_SAMPLES		// LEAF_SIZE_3D per leaf
+	};
+}
+
+template<int LeafExpo>
+bool OctreeSDFT<LeafExpo>::save(const std::string& fileName)
+{
+	auto ts = Profiler::timestamp();
+	std::vector<unsigned char> nodeTypes;
+	std::vector<Sample> cornerSamples;
+	std::vector<Sample> leafSamples;
+	std::function<void(Node*)> writeNode = [&](Node* node)
+	{
+		nodeTypes.push_back((unsigned char)node->getNodeType());
+		if (node->getNodeType() == Node::INNER)
+		{
+			for (int i = 0; i < 8; i++)
+				writeNode(((InnerNode*)node)->m_Children[i]);
+		}
+		else if (node->getNodeType() == Node::EMPTY)
+		{
+			EmptyNode* emptyNode = (EmptyNode*)node;
+			cornerSamples.insert(cornerSamples.end(), emptyNode->m_CornerSamples, emptyNode->m_CornerSamples + 8);
+		}
+		else
+		{
+			GridNode* leaf = (GridNode*)node;
+			leafSamples.insert(leafSamples.end(), leaf->m_Samples, leaf->m_Samples + LEAF_SIZE_3D);
+		}
+	};
+	writeNode(m_RootNode);
+
+	OctreeFile::Header header;
+	OctreeFile::initHeader(header, OctreeFile::OCTREE_SDF, LEAF_EXPO);
+	header.numNodes = (unsigned int)nodeTypes.size();
+	header.numLeaves = (unsigned int)(leafSamples.size() / LEAF_SIZE_3D);
+	for (int d = 0; d < 3; d++)
+	{
+		header.rootMinPos[d] = m_RootArea.m_MinPos[d];
+		header.rootMinRealPos[d] = m_RootArea.m_MinRealPos[d];
+	}
+	header.rootSizeExpo = m_RootArea.m_SizeExpo;
+	header.rootRealSize = m_RootArea.m_RealSize;
+	header.cellSize = m_CellSize;
+	OctreeFile::Writer writer(header);
+	writer.setSection(SDF_SECTION_NODE_TYPES, nodeTypes);
+	writer.setSection(SDF_SECTION_CORNER_SAMPLES, cornerSamples);
+	writer.setSection(SDF_SECTION_LEAF_SAMPLES, leafSamples);
+	size_t numBytes = writer.write(fileName);
+	Profiler::printJobDuration("OctreeSDF::save", ts);
+	return numBytes > 0;
 }
 
-std::shared_ptr<OctreeSDF> OctreeSDF::clone()
+template<int LeafExpo>
+std::shared_ptr<OctreeSDFT<LeafExpo> > OctreeSDFT<LeafExpo>::load(const std::string& fileName)
 {
-	return std::make_shared<OctreeSDF>(*this);
+	auto ts = Profiler::timestamp();
+	OctreeFile::MappedFile file(fileName);
+	const unsigned int elementSizes[OctreeFile::MAX_SECTIONS] = { sizeof(unsigned char), sizeof(Sample), sizeof(Sample) };
+	const OctreeFile::Header* header = file.getHeader(OctreeFile::OCTREE_SDF, LEAF_EXPO, elementSizes);
+	if (!header)
+		return nullptr;
+	size_t numNodes, numCornerSamples, numLeafSamples;
+	const unsigned char* nodeTypes = file.getSection<unsigned char>(header, SDF_SECTION_NODE_TYPES, numNodes);
+	const Sample* cornerSamples = file.getSection<Sample>(header, SDF_SECTION_CORNER_SAMPLES, numCornerSamples);
+	const Sample* leafSamples = file.getSection<Sample>(header, SDF_SECTION_LEAF_SAMPLES, numLeafSamples);
+	size_t numLeaves = numLeafSamples / LEAF_SIZE_3D;
+	if (numNodes == 0 || numNodes != header->numNodes || numLeaves != header->numLeaves || numLeafSamples % LEAF_SIZE_3D != 0 || numCornerSamples % 8 != 0
+		|| !OctreeFile::isValidRootArea(*header, LEAF_EXPO))
+	{
+		std::cout << OctreeFile::CORRUPT_MESSAGE << std::endl;
+		return nullptr;
+	}
+
+	std::shared_ptr<OctreeSDFT> octreeSDF = std::make_shared<OctreeSDFT>();
+	octreeSDF->m_RootArea = Area(Vector3i(header->rootMinPos[0], header->rootMinPos[1], header->rootMinPos[2]), header->rootSizeExpo,
+		Ogre::Vector3(header->rootMinRealPos[0], header->rootMinRealPos[1], header->rootMinRealPos[2]), header->rootRealSize);
+	octreeSDF->m_CellSize = header->cellSize;
+	// the nodes are bump allocated from a single chunk, the estimate includes the object headers and size class rounding
+	octreeSDF->m_Arena->reserve(numNodes * (getChildSlotSize() + 32) + numLeaves * (sizeof(GridNode) + 32));
+
+	// each node is initialized with one block copy of its samples, only the node topology is decoded
+	size_t nodeIndex = 0;
+	size_t cornerIndex = 0;
+	size_t leafIndex = 0;
+	bool corrupt = false;
+	std::function<Node*(const Area&, void*)> readNode = [&](const Area& area, void* childSlot) -> Node*
+	{
+		unsigned char type = (nodeIndex < numNodes) ? nodeTypes[nodeIndex++] : 0xff;
+		if (type == Node::GRID && leafIndex < numLeaves)
+		{
+			NodeArena::freeObject(childSlot);
+			return new (*octreeSDF->m_Arena) GridNode(leafSamples + LEAF_SIZE_3D * leafIndex++);
+		}
+		if (!childSlot)
+			childSlot = octreeSDF->m_Arena->allocateObject(getChildSlotSize());
+		if (type == Node::INNER && area.m_SizeExpo > LEAF_EXPO)
+		{
+			InnerNode* innerNode = new (childSlot) InnerNode();
+			Area subAreas[8];
+			area.getSubAreas(subAreas);
+			void* childSlots[8];
+			octreeSDF->m_Arena->allocateObjects(getChildSlotSize(), 8, childSlots);
+			for (int i = 0; i < 8; i++)
+				innerNode->m_Children[i] = readNode(subAreas[i], childSlots[i]);
+			return innerNode;
+		}
+		if (type == Node::EMPTY && cornerIndex + 8 <= numCornerSamples)
+		{
+			cornerIndex += 8;
+			return new (childSlot) EmptyNode((Sample*)(cornerSamples + cornerIndex - 8));
+		}
+		// the octree is discarded, the node only keeps the tree well formed until then
+		corrupt = true;
+		Sample placeholders[8];
+		for (int i = 0; i < 8; i++)
+			placeholders[i] = Sample(0.0f);
+		return new (childSlot) EmptyNode(placeholders);
+	};
+	octreeSDF->m_RootNode = readNode(octreeSDF->m_RootArea, nullptr);
+	if (corrupt || nodeIndex != numNodes || leafIndex != numLeaves || cornerIndex != numCornerSamples)
+	{
+		std::cout << OctreeFile::CORRUPT_MESSAGE << std::endl;
+		return nullptr;
+	}
+	Profiler::printJobDuration("OctreeSDF::load", ts);
+	return octreeSDF;
 }
 
-int OctreeSDF::countNodes()
+template<int LeafExpo>
+int OctreeSDFT<LeafExpo>::countNodes()
 {
 	int counter = 0;
 	m_RootNode->countNodes(counter);
 	return counter;
 }
 
-int OctreeSDF::countLeaves()
+template<int LeafExpo>
+int OctreeSDFT<LeafExpo>::countLeaves()
 {
 	int counter = 0;
 	m_RootNode->countLeaves(counter);
 	return counter;
 }
 
-int OctreeSDF::countMemory()
+template<int LeafExpo>
+int OctreeSDFT<LeafExpo>::countMemory()
 {
 	int counter = 0;
 	m_RootNode->countMemory(counter);
 	return counter;
 }
 
-Ogre::Vector3 OctreeSDF::getCenterOfMass(float& totalMass)
+template<int LeafExpo>
+Ogre::Vector3 OctreeSDFT<LeafExpo>::getCenterOfMass(float& totalMass)
 {
 	Ogre::Vector3 centerOfMass(0, 0, 0);
 	totalMass = 0;
@@ -771,25 +1248,99 @@ Ogre::Vector3 OctreeSDF::getCenterOfMass(float& totalMass)
 	return centerOfMass;
 }
 
-Ogre::Vector3 OctreeSDF::getCenterOfMass()
+template<int LeafExpo>
+Ogre::Vector3 OctreeSDFT<LeafExpo>::getCenterOfMass()
 {
 	float mass = 0.0f;
 	return getCenterOfMass(mass);
 }
 
-void OctreeSDF::simplify()
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::collapseNode(Node* node)
 {
-	// int nodeMask;
-	// m_RootNode = simplifyNode(m_RootNode, m_RootArea, nodeMask);
+	Sample cornerSamples[8];
+	if (node->getNodeType() == Node::GRID)
+	{
+		GridNode* gridNode = (GridNode*)node;
+		bool sign = gridNode->m_Samples[0].signedDistance >= 0;
+		for (int i = 1; i < LEAF_SIZE_3D; i++)
+		{
+			if ((gridNode->m_Samples[i].signedDistance >= 0) != sign)
+				return node;
+		}
+		for (int i = 0; i < 8; i++)
+			cornerSamples[i] = gridNode->at(((i & 4) >> 2) * LEAF_SIZE_1D_INNER, ((i & 2) >> 1) * LEAF_SIZE_1D_INNER, (i & 1) * LEAF_SIZE_1D_INNER);
+	}
+	else if (node->getNodeType() == Node::INNER)
+	{
+		InnerNode* innerNode = (InnerNode*)node;
+		for (int i = 0; i < 8; i++)
+		{
+			if (innerNode->m_Children[i]->getNodeType() != Node::EMPTY)
+				return node;
+		}
+		bool sign = ((EmptyNode*)innerNode->m_Children[0])->m_CornerSamples[0].signedDistance >= 0;
+		for (int i = 0; i < 8; i++)
+		{
+			const EmptyNode* child = (EmptyNode*)innerNode->m_Children[i];
+			for (int j = 0; j < 8; j++)
+			{
+				if ((child->m_CornerSamples[j].signedDistance >= 0) != sign)
+					return node;
+			}
+			// the corners of the children at the corners of the node
+			cornerSamples[i] = child->m_CornerSamples[i];
+		}
+	}
+	else return node;
+	Node::release(node);
+	return new (*m_Arena) EmptyNode(cornerSamples);
 }
 
-std::shared_ptr<Mesh> OctreeSDF::generateMesh()
+template<int LeafExpo>
+typename OctreeSDFT<LeafExpo>::Node* OctreeSDFT<LeafExpo>::simplifyNode(Node* node)
+{
+	if (node->getNodeType() == Node::INNER)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			// the children of a shared node are simplified through an own reference, the node is only copied if a child changes
+			Node* child = ((InnerNode*)node)->m_Children[i];
+			bool shared = node->isShared();
+			if (shared)
+				child->acquire();
+			Node* simplifiedChild = simplifyNode(child);
+			if (shared && simplifiedChild == child)
+			{
+				Node::release(child);
+				continue;
+			}
+			if (shared)
+			{
+				node = unshareNode(node);
+				Node::release(((InnerNode*)node)->m_Children[i]);
+			}
+			((InnerNode*)node)->m_Children[i] = simplifiedChild;
+		}
+	}
+	return collapseNode(node);
+}
+
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::simplify()
+{
+	m_RootNode = simplifyNode(m_RootNode);
+}
+
+template<int LeafExpo>
+std::shared_ptr<Mesh> OctreeSDFT<LeafExpo>::generateMesh()
 {
 	std::vector<Cube> cubes = getCubesToMarch();
 	return MarchingCubes::marchSDF(cubes, getInverseCellSize(), getAABB().min);
 }
 
-void OctreeSDF::generateTriangleCache()
+template<int LeafExpo>
+void OctreeSDFT<LeafExpo>::generateTriangleCache()
 {
 	auto mesh = generateMesh();
 	auto transformedMesh = std::make_shared<TransformedMesh>(mesh);
@@ -802,3 +1353,7 @@ void OctreeSDF::generateTriangleCache()
 	m_TriangleCache.generateBVH<AABB>();
 	std::cout << "Finished generating BVH" << std::endl;
 }
+
+template class OctreeSDFT<2>;
+template class OctreeSDFT<3>;
+template class OctreeSDFT<4>;
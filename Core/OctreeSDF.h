@@ -5,33 +5,33 @@
 #include <unordered_map>
 #include <memory>
 #include <vector>
+#include <atomic>
 #include "SolidGeometry.h"
 #include "Vector3i.h"
 #include "AABB.h"
 #include "OpInvertSDF.h"
 #include "Area.h"
 #include "BVHScene.h"
+#include "ThreadPool.h"
+#include "LeafFaceCache.h"
+#include "NodeArena.h"
 // #include "Vector3iHashGridRefCounted.h"
 
-// #define USE_BOOST_POOL
-
-#ifdef USE_BOOST_POOL
-#include "boost/pool/object_pool.hpp"
-#endif
-
 using std::vector;
 
 /*
 Samples a signed distance field in an adaptive way.
 For each node (includes inner nodes and leaves) signed distances are stores for the 8 corners. This allows to interpolate signed distances in the node cell using trilinear interpolation.
 The actual signed distances are stored in a spatial hashmap because octree nodes share corners with other nodes.
+Leaves consist of 2^LeafExpo cells per dimension. The octree is compiled for LeafExpo 2, 3 and 4, larger leaves suit smooth surfaces and smaller leaves suit thin details.
 */
-class OctreeSDF : public SampledSolidGeometry
+template<int LeafExpo>
+class OctreeSDFT : public SampledSolidGeometry
 {
 protected:
 	class GridNode;
 public:
-    static const int LEAF_EXPO = 2;
+    static const int LEAF_EXPO = LeafExpo;
 	static const int LEAF_SIZE_1D = (1 << LEAF_EXPO) + 1;
 	static const int LEAF_SIZE_2D = LEAF_SIZE_1D * LEAF_SIZE_1D;
 	static const int LEAF_SIZE_3D = LEAF_SIZE_2D * LEAF_SIZE_1D;
@@ -78,9 +78,27 @@ protected:
 		};
 	protected:
 		Type m_NodeType;
+
+		/// Number of parents, a node with more than one is shared between clones and is copied before it is changed (see unshareNode).
+		std::atomic<int> m_References;
 	public:
+		Node() : m_References(1) {}
+		Node(const Node& rhs) : m_NodeType(rhs.m_NodeType), m_References(1) {}
 		virtual ~Node() {}
 
+		inline void acquire() { m_References++; }
+		inline bool isShared() const { return m_References > 1; }
+
+		/// Drops a reference, the node is deleted once no parent refers to it.
+		static inline void release(Node* node) { if (--node->m_References == 0) delete node; }
+
+		/// Nodes are allocated in the arena of their octree, either directly or in a preallocated child slot.
+		static void* operator new(size_t size, NodeArena& arena) { return arena.allocateObject(size); }
+		static void* operator new(size_t, void* slot) { return slot; }
+		static void operator delete(void* node) { NodeArena::freeObject(node); }
+		static void operator delete(void* node, NodeArena&) { NodeArena::freeObject(node); }
+		static void operator delete(void* node, void*) { NodeArena::freeObject(node); }
+
 		virtual void countNodes(int& counter) const = 0;
 
         virtual void countLeaves(int&) const {}
@@ -97,17 +115,22 @@ protected:
 
 		virtual void invert() = 0;
 
-		virtual Node* clone() const = 0;
+		/// Deep copies the node into the given arena.
+		virtual Node* clone(NodeArena& arena) const = 0;
 
-		inline Type getNodeType() { return m_NodeType; }
+		inline Type getNodeType() const { return m_NodeType; }
 	};
 
 	class InnerNode : public Node
 	{
 	public:
 		Node* m_Children[8];
-        InnerNode(const Area& area, const SolidGeometry& implicitSDF);
+		/// The children are set by the caller.
+		InnerNode() { this->m_NodeType = Node::INNER; }
+        InnerNode(OctreeSDFT* tree, const Area& area, const SolidGeometry& implicitSDF);
 		~InnerNode();
+		InnerNode(const InnerNode& rhs, NodeArena& arena);
+		/// Shares the children of another inner node.
 		InnerNode(const InnerNode& rhs);
 
 		virtual void countNodes(int& counter) const override;
@@ -122,11 +145,11 @@ protected:
 
 		virtual void invert();
 
-		virtual Node* clone() const override { return new InnerNode(*this); }
+		virtual Node* clone(NodeArena& arena) const override { return new (arena) InnerNode(*this, arena); }
 
 		// virtual void sumPositionsAndMass(const Area& area, Ogre::Vector3& weightedPosSum, float& totalMass) override;
 
-        // virtual Sample getSample(const Area& area, const Ogre::Vector3& point) const override;
+        virtual Sample getSample(const Area& area, const Ogre::Vector3& point) const override;
 	};
 
 	class EmptyNode : public Node
@@ -142,19 +165,22 @@ protected:
 
 		virtual void countMemory(int& memoryCounter) const override { memoryCounter += sizeof(*this); }
 
-		virtual Node* clone() const override { return new EmptyNode(*this); }
+		virtual Node* clone(NodeArena& arena) const override { return new (arena) EmptyNode(*this); }
 
 		virtual void invert();
 
 		// virtual void sumPositionsAndMass(const Area& area, Ogre::Vector3& weightedPosSum, float& totalMass) override;
 
-        // virtual Sample getSample(const Area& area, const Ogre::Vector3& point) const override;
+        /// Trilinear interpolation of the corner samples.
+        virtual Sample getSample(const Area& area, const Ogre::Vector3& point) const override;
 	};
 
 	class GridNode : public Node
 	{
 	public:
-        GridNode(const Area& area, const SolidGeometry& implicitSDF);
+        GridNode(OctreeSDFT* tree, const Area& area, const SolidGeometry& implicitSDF);
+		/// Copies the LEAF_SIZE_3D samples of the leaf.
+		GridNode(const Sample* samples);
 		~GridNode();
 		// SharedLeafFace* m_Faces[6];
 		Sample m_Samples[LEAF_SIZE_3D];
@@ -173,13 +199,14 @@ protected:
 
 		virtual void getSharedVertices(const Area& area, std::vector<Vertex>& vertices, Vector3iHashGrid<unsigned int>& indexMap) const override;
 
-		virtual Node* clone() const override { return new GridNode(*this); }
+		virtual Node* clone(NodeArena& arena) const override { return new (arena) GridNode(*this); }
 
 		virtual void invert();
 
 		// virtual void sumPositionsAndMass(const Area& area, Ogre::Vector3& weightedPosSum, float& totalMass) override;
 
-        // virtual Sample getSample(const Area& area, const Ogre::Vector3& point) const override;
+        /// Trilinear interpolation of the samples of the cell that contains the point.
+        virtual Sample getSample(const Area& area, const Ogre::Vector3& point) const override;
 	};
 
 	Node* m_RootNode;
@@ -191,7 +218,12 @@ protected:
 
 	float m_GridLeafStepSize;
 
-	Node* simplifyNode(Node* node, const Area& area, int& nodeTypeMask);
+	/// Replaces a leaf whose samples all have the same sign or an inner node with 8 empty children of the same sign by an empty node, otherwise returns the node.
+	/// Csg operations call it on their way back up, so changed subtrees collapse bottom up without an extra pass.
+	Node* collapseNode(Node* node);
+
+	/// Collapses a whole subtree bottom up.
+	Node* simplifyNode(Node* node);
 
 	/// Intersects aligned octree nodes.
 	Node* intersectAlignedNode(Node* node, Node* otherNode, const Area& area);
@@ -204,26 +236,86 @@ protected:
 
     Node* subtract(Node* node, const SolidGeometry& implicitSDF, const Area& area);
 
-    static Node* createNode(const Area& area, const SolidGeometry& implicitSDF);
+    Node* merge(Node* node, const SolidGeometry& implicitSDF, const Area& area);
+
+	/// Real position of the cell index 0, the root min corner has negative cell indices once the octree grew towards negative coordinates.
+	inline Ogre::Vector3 getLatticeOrigin() const { return m_RootArea.m_MinRealPos - m_RootArea.m_MinPos.toOgreVec() * m_CellSize; }
+
+    /// Creates the node for an area, inner and empty nodes are constructed in the given child slot if there is one.
+    Node* createNode(const Area& area, const SolidGeometry& implicitSDF, void* childSlot = nullptr);
+
+	/// Size of the child slots, InnerNode allocates the slots of its 8 children as one block.
+	static size_t getChildSlotSize();
+
+	/// Calls function(i) for the 8 children of a node, spawns them as tasks if the node is above the task depth.
+	void forEachChild(const Area& area, const std::function<void(int)>& function);
 
 	BVHScene m_TriangleCache;
+
+	/// Owns the memory of all nodes, clones that still share nodes of the octree keep it alive.
+	std::shared_ptr<NodeArena> m_Arena;
+
+	/// Arenas of the nodes that are shared with the octrees this octree was cloned from.
+	std::vector<std::shared_ptr<NodeArena> > m_SharedArenas;
+
+	/// Returns a node that only this octree refers to. A shared node is released and replaced by a copy,
+	/// the copy of an inner node shares the children, so csg only copies the path to the nodes it changes.
+	Node* unshareNode(Node* node);
+
+	/// Optional pool for parallel construction and CSG, not owned by the octree.
+	ThreadPool* m_ThreadPool;
+
+	/// Nodes less than m_MaxTaskDepth levels below the root process their children as parallel tasks.
+	int m_MaxTaskDepth;
+
+	typedef LeafFaceCache<Sample, LEAF_SIZE_1D> SampleFaceCache;
+
+	/// Boundary samples shared between neighboring leaves, only exists while the octree is sampled.
+	SampleFaceCache* m_SampleFaceCache;
+
+	/// Creates the root node using a face cache, so shared leaf boundaries are only evaluated once.
+	void sampleRootNode(const SolidGeometry& implicitSDF);
+
+	/// Returns the leaf or empty node that contains the point, the point must be inside of the octree.
+	const Node* findLeaf(const Ogre::Vector3& point, Area& area) const;
+
+	/// Samples a point, the leaf of the previous point is reused if it contains the point.
+	void getSampleCached(const Ogre::Vector3& point, const Node*& leaf, Area& leafArea, Sample& sample) const;
 public:
-	~OctreeSDF();
-	OctreeSDF() : m_RootNode(nullptr) {}
-	OctreeSDF(const OctreeSDF& other);
+	~OctreeSDFT();
+	OctreeSDFT() : m_RootNode(nullptr), m_Arena(std::make_shared<NodeArena>()), m_ThreadPool(nullptr), m_MaxTaskDepth(0), m_SampleFaceCache(nullptr) {}
+	OctreeSDFT(const OctreeSDFT& other);
+
+    static std::shared_ptr<OctreeSDFT> sampleSDF(SolidGeometry* otherSDF, int maxDepth);
+
+    static std::shared_ptr<OctreeSDFT> sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth);
+
+	/// Samples the sdf in parallel, subtrees up to maxTaskDepth levels below the root are distributed over the thread pool.
+	static std::shared_ptr<OctreeSDFT> sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, ThreadPool* threadPool, int maxTaskDepth = 3);
 
-    static std::shared_ptr<OctreeSDF> sampleSDF(SolidGeometry* otherSDF, int maxDepth);
+	/// Sets the thread pool used by sampling and CSG operations on the octree, pass nullptr to run serially. Clones share the pool.
+	void setThreadPool(ThreadPool* threadPool, int maxTaskDepth = 3);
 
-    static std::shared_ptr<OctreeSDF> sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth);
+	ThreadPool* getThreadPool() const { return m_ThreadPool; }
 
 	float getInverseCellSize() override;
 
+	/// Allocation counts and memory of the node arena.
+	NodeArena::Stats getAllocationStats() const { return m_Arena->getStats(); }
+
 	AABB getAABB() const override;
 
 	vector<Cube> getCubesToMarch();
 
+    /// Trilinear interpolation of the samples of the leaf that contains the point. Points outside of the octree get the sample of the
+    /// closest point on its boundary, moved away from the inside by the distance to it.
     void getSample(const Ogre::Vector3& point, Sample& sample) const override;
 
+    /// Samples the points in morton order, so consecutive points mostly lie in the same leaf and skip the descent.
+    void getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const override;
+
+    void getLatticeSamples(const Lattice& lattice, Sample* samples) const override;
+
 	/// Builds the triangle cache using marching cubes required for fast intersectsSurface queries.
 	void generateTriangleCache();
 
@@ -236,15 +328,16 @@ public:
     void intersect(SolidGeometry* otherSDF);
 
 	/// Intersects the octree with another aligned octree (underlying grids must match).
-	void intersectAlignedOctree(OctreeSDF* otherOctree);
+	void intersectAlignedOctree(OctreeSDFT* otherOctree);
 
 	/// Subtracts another aligned octree from this octree.
-	void subtractAlignedOctree(OctreeSDF* otherOctree);
+	void subtractAlignedOctree(OctreeSDFT* otherOctree);
 
 	/// Merges another aligned octree into this octree.
-	void mergeAlignedOctree(OctreeSDF* otherOctree);
+	void mergeAlignedOctree(OctreeSDFT* otherOctree);
 
-	/// Resizes the octree so that it covers the given aabb.
+	/// Grows the octree in place until it covers the given aabb. The old root becomes a child of a larger root with empty siblings,
+	/// so the content is kept as it is and cell indices stay valid.
 	void resize(const AABB& aabb);
 
 	/// Merges the octree with another signed distance field.
@@ -253,8 +346,15 @@ public:
 	/// Inverts the sdf represented by the octree.
 	void invert();
 
-	/// Clones the octree and returns the copy.
-	std::shared_ptr<OctreeSDF> clone();
+	/// Clones the octree in constant time, the clone shares all nodes with the octree until csg operations change them.
+	/// Use the copy constructor for a deep copy.
+	std::shared_ptr<OctreeSDFT> clone();
+
+	/// Writes the octree to a binary file (see OctreeFile.h). Returns false on failure.
+	bool save(const std::string& fileName);
+
+	/// Loads an octree written by save from a memory mapped file, returns nullptr if the file is invalid or was written with another leaf size.
+	static std::shared_ptr<OctreeSDFT> load(const std::string& fileName);
 
 	/// Counts the number of nodes in the octree.
 	int countNodes();
@@ -273,8 +373,15 @@ public:
 
 	std::shared_ptr<Mesh> generateMesh() override;
 
-	/// Removes nodes that are not required.
+	/// Collapses leaves without surface and inner nodes whose children are empty nodes of the same sign, csg operations already do this for the nodes they change.
 	void simplify();
 
 	int getHeight() { return m_RootArea.m_SizeExpo;  }
 };
+
+// the leaf sizes that are compiled, see OctreeSDF.cpp
+extern template class OctreeSDFT<2>;
+extern template class OctreeSDFT<3>;
+extern template class OctreeSDFT<4>;
+
+typedef OctreeSDFT<2> OctreeSDF;
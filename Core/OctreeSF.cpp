@@ -1,44 +1,73 @@
 
 #include <stack>
+#include <list>
+#include <sstream>
+#include <cstdio>
+#include <unordered_set>
 #include "OctreeSF.h"
 #include "SolidGeometry.h"
 #include "MarchingCubes.h"
 #include "Mesh.h"
+#include "PlaneGeometry.h"
+#include "OctreeFile.h"
+#include "TriangleLookupTable.h"
 
 /******************************************************************************************
 InnerNode
 *******************************************************************************************/
 
-OctreeSF::InnerNode::InnerNode(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::InnerNode::InnerNode(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF)
 {
-    m_NodeType = INNER;
+    this->m_NodeType = Node::INNER;
 
     Area subAreas[8];
     area.getSubAreas(subAreas);
+    void* childSlots[8];
+    tree->m_Arena->allocateObjects(getChildSlotSize(), 8, childSlots);
+    tree->forEachChild(area, [&](int i)
+    {
+        m_Children[i] = tree->createNode(subAreas[i], implicitSDF, childSlots[i]);
+    });
+}
+
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::InnerNode::~InnerNode()
+{
     for (int i = 0; i < 8; i++)
     {
-        m_Children[i] = tree->createNode(subAreas[i], implicitSDF);
+        Node::release(m_Children[i]);
     }
 }
 
-OctreeSF::InnerNode::~InnerNode()
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::InnerNode::InnerNode(const InnerNode& rhs) : Node(rhs)
 {
     for (int i = 0; i < 8; i++)
     {
-        delete m_Children[i];
+        m_Children[i] = rhs.m_Children[i];
+        m_Children[i]->acquire();
     }
 }
 
-OctreeSF::InnerNode::InnerNode(const InnerNode& rhs)
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::InnerNode::InnerNode(const InnerNode& rhs, NodeArena& arena)
 {
-    m_NodeType = INNER;
+    this->m_NodeType = Node::INNER;
     for (int i = 0; i < 8; i++)
     {
-        m_Children[i] = rhs.m_Children[i]->clone();
+        m_Children[i] = rhs.m_Children[i]->clone(arena);
     }
 }
 
-void OctreeSF::InnerNode::forEachSurfaceNode(const Area& area, const std::function<void(GridNode*, const Area&)>& function)
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::InnerNode::clone(NodeArena& arena) const
+{
+    return new (arena) InnerNode(*this, arena);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::InnerNode::forEachSurfaceNode(const Area& area, const std::function<void(GridNode*, const Area&)>& function)
 {
     Area subAreas[8];
     area.getSubAreas(subAreas);
@@ -46,13 +75,15 @@ void OctreeSF::InnerNode::forEachSurfaceNode(const Area& area, const std::functi
         m_Children[i]->forEachSurfaceNode(subAreas[i], function);
 }
 
-void OctreeSF::InnerNode::forEachSurfaceNode(const std::function<void(GridNode*)>& function)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::InnerNode::forEachSurfaceNode(const std::function<void(GridNode*)>& function)
 {
     for (int i = 0; i < 8; i++)
         m_Children[i]->forEachSurfaceNode(function);
 }
 
-void OctreeSF::InnerNode::forEachSurfaceFaceAndEdge(const std::function<void(const Face&)>& faceFunc, const std::function<void(const Edge&)>& edgeFunc)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::InnerNode::forEachSurfaceFaceAndEdge(const std::function<void(const Face&)>& faceFunc, const std::function<void(const Edge&)>& edgeFunc)
 {
     // there are six edges inside the node
     forEachSurfaceEdge(m_Children[0], m_Children[3], 0, edgeFunc);
@@ -78,16 +109,17 @@ void OctreeSF::InnerNode::forEachSurfaceFaceAndEdge(const std::function<void(con
     }
 }
 
-void OctreeSF::InnerNode::forEachSurfaceFace(Node* n1, Node* n2, unsigned char normalDirection, const std::function<void(const Face&)>& faceFunc, const std::function<void(const Edge&)>& edgeFunc)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::InnerNode::forEachSurfaceFace(Node* n1, Node* n2, unsigned char normalDirection, const std::function<void(const Face&)>& faceFunc, const std::function<void(const Edge&)>& edgeFunc)
 {
-    if (n1->getNodeType() == EMPTY || n2->getNodeType() == EMPTY)
+    if (n1->getNodeType() == Node::EMPTY || n2->getNodeType() == Node::EMPTY)
         return;
-    if (n1->getNodeType() == GRID && n2->getNodeType() == GRID)
+    if (n1->getNodeType() == Node::GRID && n2->getNodeType() == Node::GRID)
     {
         faceFunc(Face((GridNode*)n1, (GridNode*)n2, normalDirection));
         return;
     }
-    if (n1->getNodeType() == INNER && n2->getNodeType() == INNER)
+    if (n1->getNodeType() == Node::INNER && n2->getNodeType() == Node::INNER)
     {
         InnerNode* innerNode1 = (InnerNode*)n1;
         InnerNode* innerNode2 = (InnerNode*)n2;
@@ -116,16 +148,17 @@ void OctreeSF::InnerNode::forEachSurfaceFace(Node* n1, Node* n2, unsigned char n
     }
 }
 
-void OctreeSF::InnerNode::forEachSurfaceEdge(Node* n1, Node* n2, unsigned char direction, const std::function<void(const Edge&)>& function)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::InnerNode::forEachSurfaceEdge(Node* n1, Node* n2, unsigned char direction, const std::function<void(const Edge&)>& function)
 {
-    if (n1->getNodeType() == EMPTY || n2->getNodeType() == EMPTY)
+    if (n1->getNodeType() == Node::EMPTY || n2->getNodeType() == Node::EMPTY)
         return;
-    if (n1->getNodeType() == GRID && n2->getNodeType() == GRID)
+    if (n1->getNodeType() == Node::GRID && n2->getNodeType() == Node::GRID)
     {
         function(Edge((GridNode*)n1, (GridNode*)n2, direction));
         return;
     }
-    if (n1->getNodeType() == INNER && n2->getNodeType() == INNER)
+    if (n1->getNodeType() == Node::INNER && n2->getNodeType() == Node::INNER)
     {
         InnerNode* innerNode1 = (InnerNode*)n1;
         InnerNode* innerNode2 = (InnerNode*)n2;
@@ -145,35 +178,42 @@ void OctreeSF::InnerNode::forEachSurfaceEdge(Node* n1, Node* n2, unsigned char d
     }
 }
 
-void OctreeSF::InnerNode::countNodes(int& counter) const
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::InnerNode::countNodes(int& counter) const
 {
     counter++;
     for (int i = 0; i < 8; i++)
         m_Children[i]->countNodes(counter);
 }
 
-void OctreeSF::InnerNode::countMemory(int& counter) const
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::InnerNode::countMemory(int& counter) const
 {
     counter += sizeof(*this);
     for (int i = 0; i < 8; i++)
         m_Children[i]->countMemory(counter);
 }
 
-bool OctreeSF::InnerNode::rayIntersectUpdate(const Area& area, const Ray& ray, Ray::Intersection& intersection)
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::InnerNode::rayIntersectUpdate(const Area& area, const Ray& ray, Ray::Intersection& intersection)
 {
-    if (!ray.intersectAABB(&area.toAABB().min, 0, intersection.t)) return false;
+    AABB aabb = area.toAABB();
+    if (!ray.intersectAABB(&aabb.min, 0, intersection.t)) return false;
     Area subAreas[8];
     area.getSubAreas(subAreas);
+    // front to back order, children behind the closest hit are culled by their aabb test
+    int flipMask = (ray.sign[0] << 2) | (ray.sign[1] << 1) | ray.sign[2];
     bool foundSomething = false;
     for (int i = 0; i < 8; i++)
     {
-        if (m_Children[i]->rayIntersectUpdate(subAreas[i], ray, intersection))
+        if (m_Children[i ^ flipMask]->rayIntersectUpdate(subAreas[i ^ flipMask], ray, intersection))
             foundSomething = true;
     }
     return foundSomething;
 }
 
-void OctreeSF::InnerNode::invert()
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::InnerNode::invert()
 {
     for (int i = 0; i < 8; i++)
         m_Children[i]->invert();
@@ -183,17 +223,20 @@ void OctreeSF::InnerNode::invert()
 EmptyNode
 *******************************************************************************************/
 
-OctreeSF::EmptyNode::EmptyNode(const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::EmptyNode::EmptyNode(const Area& area, const SolidGeometry& implicitSDF)
 {
-    m_NodeType = EMPTY;
+    this->m_NodeType = Node::EMPTY;
     m_Sign = implicitSDF.getSign(area.toAABB().getCenter());
 }
 
-OctreeSF::EmptyNode::~EmptyNode()
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::EmptyNode::~EmptyNode()
 {
 }
 
-void OctreeSF::EmptyNode::invert()
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::EmptyNode::invert()
 {
     m_Sign = !m_Sign;
 }
@@ -202,114 +245,165 @@ void OctreeSF::EmptyNode::invert()
 GridNode
 *******************************************************************************************/
 
-OctreeSF::Node* OctreeSF::GridNode::clone() const
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::GridNode::GridNode(const GridNode& rhs, NodeArena& arena)
+    : Node(rhs), m_Area(rhs.m_Area), m_Signs(rhs.m_Signs),
+    m_SurfaceEdges(rhs.m_SurfaceEdges.begin(), rhs.m_SurfaceEdges.end(), ArenaAllocator<SurfaceEdge>(&arena)),
+    m_SurfaceCubes(rhs.m_SurfaceCubes.begin(), rhs.m_SurfaceCubes.end(), ArenaAllocator<SurfaceCube>(&arena)),
+    m_CachedNeighbors(rhs.m_CachedNeighbors.begin(), rhs.m_CachedNeighbors.end(), typename NeighborVector::allocator_type(&arena)),
+    m_BoundarySigns(rhs.m_BoundarySigns.begin(), rhs.m_BoundarySigns.end(), ArenaAllocator<bool>(&arena))
 {
-    GridNode* copy = new GridNode(*this);
-    return copy;
 }
 
-void OctreeSF::GridNode::forEachSurfaceNode(const Area& area, const std::function<void(GridNode*, const Area&)>& function)
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::GridNode::clone(NodeArena& arena) const
+{
+    return new (arena) GridNode(*this, arena);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::forEachSurfaceNode(const Area& area, const std::function<void(GridNode*, const Area&)>& function)
 {
     function(this, area);
 }
 
-void OctreeSF::GridNode::forEachSurfaceNode(const std::function<void(GridNode*)>& function)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::forEachSurfaceNode(const std::function<void(GridNode*)>& function)
 {
     function(this);
 }
 
-void OctreeSF::GridNode::computeSigns(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::computeSigns(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF)
 {
-    // compute inner grid
-    int index = 0;
-    for (unsigned int x = 0; x < LEAF_SIZE_1D; x++)
+    bool signs[LEAF_SIZE_3D];
+    SolidGeometry::Lattice lattice = tree->getLeafLattice(area);
+    if (tree->m_SignFaceCache && area.m_SizeExpo == LEAF_EXPO)
     {
-        for (unsigned int y = 0; y < LEAF_SIZE_1D; y++)
+        tree->m_SignFaceCache->getLeafValues(lattice, signs, [&implicitSDF](const Ogre::Vector3* points, int numPoints, bool* outSigns)
         {
-            for (unsigned int z = 0; z < LEAF_SIZE_1D; z++)
-            {
-                Ogre::Vector3 currentPos = tree->getRealPos(area.m_MinPos + Vector3i(x, y, z));
-                m_Signs[index++] = implicitSDF.getSign(currentPos);
-            }
-        }
+            implicitSDF.getSigns(points, numPoints, outSigns);
+        });
     }
+    else implicitSDF.getLatticeSigns(lattice, signs);
+    m_Signs.fromBools(signs);
 }
 
-void OctreeSF::GridNode::computeEdges(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF, bool ignoreEdges[3][LEAF_SIZE_3D])
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::sampleSurfaceEdges(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF, size_t firstEdge)
 {
-    float stepSize = tree->m_CellSize;
-    int index = 0;
-    m_SurfaceEdges.reserve(LEAF_SIZE_2D);
-    for (int x = 0; x < LEAF_SIZE_1D; x++)
+    int numEdges = (int)(m_SurfaceEdges.size() - firstEdge);
+    if (numEdges <= 0)
+        return;
+    int strideExpo = getLeafStrideExpo(area);
+    float halfCellSize = tree->m_CellSize * (1 << strideExpo) * 0.5f;
+    std::vector<Ogre::Vector3> edgeCenters(numEdges);
+    for (int i = 0; i < numEdges; i++)
     {
-        for (int y = 0; y < LEAF_SIZE_1D; y++)
+        const SurfaceEdge& edge = m_SurfaceEdges[firstEdge + i];
+        edgeCenters[i] = tree->getRealPos(area.m_MinPos + fromIndex(edge.edgeIndex1) * (1 << strideExpo));
+        edgeCenters[i][edge.direction] += halfCellSize;
+    }
+    std::vector<Sample> samples(numEdges);
+    implicitSDF.getSamples(edgeCenters.data(), numEdges, samples.data());
+    for (int i = 0; i < numEdges; i++)
+    {
+        m_SurfaceEdges[firstEdge + i].setSample(area, samples[i]);
+    }
+}
+
+// For each direction, the lattice points that are the min corner of an edge inside the leaf.
+// The masks are a class static that is built during static initialization, a function local static would be initialized lazily by the sampling threads.
+template<int LeafExpo>
+struct EdgeMinCornerMasks
+{
+    typedef OctreeSFT<LeafExpo> Octree;
+    typename Octree::LeafSigns masks[3];
+    static const EdgeMinCornerMasks instance;
+    EdgeMinCornerMasks()
+    {
+        for (int d = 0; d < 3; d++)
         {
-            for (int z = 0; z < LEAF_SIZE_1D; z++)
+            masks[d].clear();
+            for (int i = 0; i < Octree::LEAF_SIZE_3D; i++)
             {
-                Vector3i iPos(x, y, z);
-                if (x < LEAF_SIZE_1D_INNER && !ignoreEdges[0][index] && m_Signs[index] != m_Signs[index + LEAF_SIZE_2D])
-                {
-                    Ogre::Vector3 currentPos = tree->getRealPos(area.m_MinPos + iPos);
-                    m_SurfaceEdges.emplace_back();
-                    m_SurfaceEdges.back().init(iPos, 0, currentPos, stepSize, implicitSDF);
-                }
-                if (y < LEAF_SIZE_1D_INNER && !ignoreEdges[1][index] && m_Signs[index] != m_Signs[index + LEAF_SIZE_1D])
-                {
-                    Ogre::Vector3 currentPos = tree->getRealPos(area.m_MinPos + iPos);
-                    m_SurfaceEdges.emplace_back();
-                    m_SurfaceEdges.back().init(iPos, 1, currentPos, stepSize, implicitSDF);
-                }
-                if (z < LEAF_SIZE_1D_INNER && !ignoreEdges[2][index] && m_Signs[index] != m_Signs[index + 1])
-                {
-                    Ogre::Vector3 currentPos = tree->getRealPos(area.m_MinPos + iPos);
-                    m_SurfaceEdges.emplace_back();
-                    m_SurfaceEdges.back().init(iPos, 2, currentPos, stepSize, implicitSDF);
-                }
-                index++;
+                int coords[3] = { i / Octree::LEAF_SIZE_2D, (i % Octree::LEAF_SIZE_2D) / Octree::LEAF_SIZE_1D, i % Octree::LEAF_SIZE_1D };
+                masks[d].set(i, coords[d] < Octree::LEAF_SIZE_1D_INNER);
             }
         }
     }
+};
+
+template<int LeafExpo>
+const EdgeMinCornerMasks<LeafExpo> EdgeMinCornerMasks<LeafExpo>::instance;
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::getSignChangeEdges(LeafSigns edges[3]) const
+{
+    static const int EDGE_OFFSETS[] = { LEAF_SIZE_2D, LEAF_SIZE_1D, 1 };
+    const EdgeMinCornerMasks<LeafExpo>& edgeMasks = EdgeMinCornerMasks<LeafExpo>::instance;
+    for (int d = 0; d < 3; d++)
+    {
+        m_Signs.xorShifted(EDGE_OFFSETS[d], edges[d]);
+        edges[d] &= edgeMasks.masks[d];
+    }
 }
 
-void OctreeSF::GridNode::computeEdges(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::computeEdges(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF, const LeafSigns* ignoreEdges)
 {
-    float stepSize = tree->m_CellSize;
-    int index = 0;
-    m_SurfaceEdges.reserve(LEAF_SIZE_2D);
-    for (int x = 0; x < LEAF_SIZE_1D; x++)
+    size_t firstNewEdge = m_SurfaceEdges.size();
+    LeafSigns edges[3];
+    getSignChangeEdges(edges);
+    LeafSigns edgeMinCorners;
+    edgeMinCorners.clear();
+    for (int d = 0; d < 3; d++)
     {
-        for (int y = 0; y < LEAF_SIZE_1D; y++)
+        if (ignoreEdges)
+            edges[d].clearBits(ignoreEdges[d]);
+        edgeMinCorners |= edges[d];
+    }
+    m_SurfaceEdges.reserve(firstNewEdge + edges[0].count() + edges[1].count() + edges[2].count());
+    edgeMinCorners.forEachSetBit([&](int index)
+    {
+        Vector3i iPos = fromIndex(index);
+        for (unsigned char d = 0; d < 3; d++)
         {
-            for (int z = 0; z < LEAF_SIZE_1D; z++)
+            if (edges[d][index])
             {
-                Vector3i iPos(x, y, z);
-                if (x < LEAF_SIZE_1D_INNER && m_Signs[index] != m_Signs[index + LEAF_SIZE_2D])
-                {
-                    Ogre::Vector3 currentPos = tree->getRealPos(area.m_MinPos + iPos);
-                    m_SurfaceEdges.emplace_back();
-                    m_SurfaceEdges.back().init(iPos, 0, currentPos, stepSize, implicitSDF);
-                }
-                if (y < LEAF_SIZE_1D_INNER && m_Signs[index] != m_Signs[index + LEAF_SIZE_1D])
-                {
-                    Ogre::Vector3 currentPos = tree->getRealPos(area.m_MinPos + iPos);
-                    m_SurfaceEdges.emplace_back();
-                    m_SurfaceEdges.back().init(iPos, 1, currentPos, stepSize, implicitSDF);
-                }
-                if (z < LEAF_SIZE_1D_INNER && m_Signs[index] != m_Signs[index + 1])
-                {
-                    Ogre::Vector3 currentPos = tree->getRealPos(area.m_MinPos + iPos);
-                    m_SurfaceEdges.emplace_back();
-                    m_SurfaceEdges.back().init(iPos, 2, currentPos, stepSize, implicitSDF);
-                }
-                index++;
+                m_SurfaceEdges.emplace_back();
+                m_SurfaceEdges.back().init(iPos, d);
             }
         }
-    }
+    });
+    sampleSurfaceEdges(tree, area, implicitSDF, firstNewEdge);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::computeEdges(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF)
+{
+    computeEdges(tree, area, implicitSDF, nullptr);
+}
+
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::GridNode::GridNode(OctreeSFT* tree, const Area& area)
+    : m_Area(area),
+    m_SurfaceEdges(ArenaAllocator<SurfaceEdge>(tree->m_Arena.get())),
+    m_SurfaceCubes(ArenaAllocator<SurfaceCube>(tree->m_Arena.get())),
+    m_CachedNeighbors(typename NeighborVector::allocator_type(tree->m_Arena.get())),
+    m_BoundarySigns(ArenaAllocator<bool>(tree->m_Arena.get()))
+{
+    this->m_NodeType = Node::GRID;
 }
 
-OctreeSF::GridNode::GridNode(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::GridNode::GridNode(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF)
+    : m_SurfaceEdges(ArenaAllocator<SurfaceEdge>(tree->m_Arena.get())),
+    m_SurfaceCubes(ArenaAllocator<SurfaceCube>(tree->m_Arena.get())),
+    m_CachedNeighbors(typename NeighborVector::allocator_type(tree->m_Arena.get())),
+    m_BoundarySigns(ArenaAllocator<bool>(tree->m_Arena.get()))
 {
-    m_NodeType = GRID;
+    this->m_NodeType = Node::GRID;
 
     m_Area = area;
 
@@ -317,27 +411,42 @@ OctreeSF::GridNode::GridNode(OctreeSF* tree, const Area& area, const SolidGeomet
     computeEdges(tree, area, implicitSDF);
 }
 
-OctreeSF::GridNode::~GridNode()
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::GridNode::~GridNode()
 {
 }
 
-void OctreeSF::GridNode::countMemory(int& memoryCounter) const
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::countMemory(int& memoryCounter) const
 {
     memoryCounter += sizeof(*this);
     memoryCounter += (int)m_SurfaceEdges.capacity() * sizeof(SurfaceEdge);
+    memoryCounter += (int)m_BoundarySigns.capacity() / 8;
 }
 
-void OctreeSF::GridNode::generateVerticesMC(vector<Vertex>& vertices)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::generateVerticesMC(vector<Vertex>& vertices)
 {
 }
 
-void OctreeSF::GridNode::generateIndicesMC(const Area& area, vector<unsigned int>& indices, vector<Vertex>& vertices) const
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::decodeSurfaceEdges(std::vector<Vertex>& edgeVertices, const Vertex* surfaceEdgeMaps[3][LEAF_SIZE_3D]) const
 {
-    const SurfaceEdge* surfaceEdgeMaps[3][LEAF_SIZE_3D];
-    for (auto i = m_SurfaceEdges.begin(); i != m_SurfaceEdges.end(); ++i)
+    edgeVertices.resize(m_SurfaceEdges.size());
+    for (size_t i = 0; i < m_SurfaceEdges.size(); i++)
     {
-        surfaceEdgeMaps[i->direction][i->edgeIndex1] = &(*i);
+        const SurfaceEdge& edge = m_SurfaceEdges[i];
+        edgeVertices[i] = Vertex(edge.getPosition(m_Area), edge.getNormal());
+        surfaceEdgeMaps[edge.direction][edge.edgeIndex1] = &edgeVertices[i];
     }
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::generateIndicesMC(const Area& area, vector<unsigned int>& indices, vector<Vertex>& vertices) const
+{
+    std::vector<Vertex> edgeVertices;
+    const Vertex* surfaceEdgeMaps[3][LEAF_SIZE_3D];
+    decodeSurfaceEdges(edgeVertices, surfaceEdgeMaps);
 
     int index = 0;
     for (int x = 0; x < LEAF_SIZE_1D_INNER; x++)
@@ -355,24 +464,24 @@ void OctreeSF::GridNode::generateIndicesMC(const Area& area, vector<unsigned int
                         const TLT::DirectedEdge& p1 = TLT::getSingleton().directedEdges[i2->p1];
                         const TLT::DirectedEdge& p2 = TLT::getSingleton().directedEdges[i2->p2];
                         const TLT::DirectedEdge& p3 = TLT::getSingleton().directedEdges[i2->p3];
-                        const SurfaceEdge* vert = surfaceEdgeMaps[p1.direction][index
+                        const Vertex* vert = surfaceEdgeMaps[p1.direction][index
                                 + (p1.minCornerIndex & 1)
                                 + ((p1.minCornerIndex & 2) >> 1) * LEAF_SIZE_1D
                                 + ((p1.minCornerIndex & 4) >> 2) * LEAF_SIZE_2D];
                         indices.push_back((int)vertices.size());
-                        vertices.push_back(vert->vertex);
+                        vertices.push_back(*vert);
                         vert = surfaceEdgeMaps[p2.direction][index
                                 + (p2.minCornerIndex & 1)
                                 + ((p2.minCornerIndex & 2) >> 1) * LEAF_SIZE_1D
                                 + ((p2.minCornerIndex & 4) >> 2) * LEAF_SIZE_2D];
                         indices.push_back((int)vertices.size());
-                        vertices.push_back(vert->vertex);
+                        vertices.push_back(*vert);
                         vert = surfaceEdgeMaps[p3.direction][index
                                 + (p3.minCornerIndex & 1)
                                 + ((p3.minCornerIndex & 2) >> 1) * LEAF_SIZE_1D
                                 + ((p3.minCornerIndex & 4) >> 2) * LEAF_SIZE_2D];
                         indices.push_back((int)vertices.size());
-                        vertices.push_back(vert->vertex);
+                        vertices.push_back(*vert);
                     }
                 }
                 index++;
@@ -383,17 +492,16 @@ void OctreeSF::GridNode::generateIndicesMC(const Area& area, vector<unsigned int
     }
 }
 
-void OctreeSF::GridNode::generateVerticesDC(vector<Vertex>& vertices)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::generateVerticesDC(vector<Vertex>& vertices)
 {
     float cubeSize = m_Area.m_RealSize / LEAF_SIZE_1D_INNER;
     m_CachedNeighbors.clear();
     m_SurfaceCubes.clear();
     m_SurfaceCubes.reserve(LEAF_SIZE_2D);
-    const SurfaceEdge* surfaceEdgeMaps[3][LEAF_SIZE_3D];
-    for (auto i = m_SurfaceEdges.begin(); i != m_SurfaceEdges.end(); ++i)
-    {
-        surfaceEdgeMaps[i->direction][i->edgeIndex1] = &(*i);
-    }
+    std::vector<Vertex> edgeVertices;
+    const Vertex* surfaceEdgeMaps[3][LEAF_SIZE_3D];
+    decodeSurfaceEdges(edgeVertices, surfaceEdgeMaps);
     for (int x = 0; x < LEAF_SIZE_1D_INNER; x++)
     {
         for (int y = 0; y < LEAF_SIZE_1D_INNER; y++)
@@ -415,12 +523,12 @@ void OctreeSF::GridNode::generateVerticesDC(vector<Vertex>& vertices)
                     vertices.back().normal = Ogre::Vector3(0, 0, 0);
                     for (auto i = edges.begin(); i != edges.end(); i++)
                     {
-                        const SurfaceEdge* edge = surfaceEdgeMaps[i->direction][index
+                        const Vertex* edge = surfaceEdgeMaps[i->direction][index
                                 + (i->minCornerIndex & 1)
                                 + ((i->minCornerIndex & 2) >> 1) * LEAF_SIZE_1D
                                 + ((i->minCornerIndex & 4) >> 2) * LEAF_SIZE_2D];
-                        centerOfMass += edge->vertex.position;
-                        vertices.back().normal += edge->vertex.normal;
+                        centerOfMass += edge->position;
+                        vertices.back().normal += edge->normal;
                     }
                     vertices.back().normal.normalise();
                     centerOfMass /= (float)edges.size();
@@ -432,12 +540,12 @@ void OctreeSF::GridNode::generateVerticesDC(vector<Vertex>& vertices)
                         // vertices.back().position = (vertices.back().position + centerOfMass) * 0.5f;
                         for (auto i = edges.begin(); i != edges.end(); i++)
                         {
-                            const SurfaceEdge* edge = surfaceEdgeMaps[i->direction][index
+                            const Vertex* edge = surfaceEdgeMaps[i->direction][index
                                     + (i->minCornerIndex & 1)
                                     + ((i->minCornerIndex & 2) >> 1) * LEAF_SIZE_1D
                                     + ((i->minCornerIndex & 4) >> 2) * LEAF_SIZE_2D];
-                            float dist = edge->vertex.normal.dotProduct(edge->vertex.position - vertices.back().position);
-                            vertices.back().position += dist * 0.6f * edge->vertex.normal;
+                            float dist = edge->normal.dotProduct(edge->position - vertices.back().position);
+                            vertices.back().position += dist * 0.6f * edge->normal;
                         }
                     }
                     // MathMisc::projectPointOnAABB(cellMin, cellMax, vertices.back().position);
@@ -447,30 +555,182 @@ void OctreeSF::GridNode::generateVerticesDC(vector<Vertex>& vertices)
     }
 }
 
-void OctreeSF::GridNode::cacheNeighbor(const Vector3i& offset, GridNode* other)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::cacheNeighbor(const Vector3i& offset, GridNode* other)
 {
     // std::cout << "Caching neighbor with offset " << offset << std::endl;
     vAssert(m_Area.m_MinPos + offset * LEAF_SIZE_1D_INNER == other->m_Area.m_MinPos);
     m_CachedNeighbors.push_back(std::make_pair(offset, other));
 }
 
-bool OctreeSF::GridNode::rayIntersectUpdate(const Area& area, const Ray& ray, Ray::Intersection& intersection)
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::GridNode::rayIntersectUpdate(const Area& area, const Ray& ray, Ray::Intersection& intersection)
 {
-    if (!ray.intersectAABB(&area.toAABB().min, 0, intersection.t)) return false;
-    std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
-    // generateVerticesDC(mesh->vertexBuffer);
-    generateIndicesMC(area, mesh->indexBuffer, mesh->vertexBuffer);
-    mesh->computeTriangleNormals();
-    std::shared_ptr<TransformedMesh> transformedMesh = std::make_shared<TransformedMesh>(mesh);
-    transformedMesh->computeCache();
-    BVHScene scene;
-    scene.addMesh(transformedMesh);
-    scene.generateBVH<AABB>();
-    return (scene.getBVH()->rayIntersectUpdate(intersection, ray) != nullptr);
+    // clip the ray to the leaf
+    AABB aabb = area.toAABB();
+    float tEnter = 0.0f;
+    float tExit = intersection.t;
+    for (int d = 0; d < 3; d++)
+    {
+        float t1 = (aabb.min[d] - ray.origin[d]) * ray.directionInv[d];
+        float t2 = (aabb.max[d] - ray.origin[d]) * ray.directionInv[d];
+        tEnter = std::max(tEnter, std::min(t1, t2));
+        tExit = std::min(tExit, std::max(t1, t2));
+    }
+    if (tEnter > tExit || m_SurfaceEdges.empty())
+        return false;
+
+    // 3D DDA through the cells of the lattice. The hermite positions are closest surface points that may leave their edge, so the marching cubes
+    // triangles of a cell can reach into the neighbor cells and the triangles of the 26 neighbors of each traversed cell are tested as well.
+    float cellSize = area.m_RealSize / LEAF_SIZE_1D_INNER;
+    Ogre::Vector3 entryPos = ray.origin + ray.direction * tEnter - area.m_MinRealPos;
+    int cell[3], step[3];
+    float tNext[3], tDelta[3];
+    for (int d = 0; d < 3; d++)
+    {
+        cell[d] = std::min(std::max((int)(entryPos[d] / cellSize), 0), LEAF_SIZE_1D_INNER - 1);
+        step[d] = ray.sign[d] ? -1 : 1;
+        tDelta[d] = std::fabs(cellSize * ray.directionInv[d]);
+        float boundary = area.m_MinRealPos[d] + (cell[d] + (ray.sign[d] ? 0 : 1)) * cellSize;
+        tNext[d] = (ray.direction[d] != 0.0f) ? (boundary - ray.origin[d]) * ray.directionInv[d] : std::numeric_limits<float>::max();
+    }
+    // maps the lattice edges to their hermite data, built once the ray reaches a surface cell
+    unsigned short edgeMap[3][LEAF_SIZE_3D];
+    bool hasEdgeMap = false;
+    std::bitset<LEAF_SIZE_3D> testedCells;
+    bool foundSomething = false;
+    float tCell = tEnter;
+    // a closer hit lies in the neighborhood of a traversed cell, so the traversal ends at the cell of the closest hit
+    while (tCell <= std::min(tExit, intersection.t))
+    {
+        for (int x = std::max(cell[0] - 1, 0); x <= std::min(cell[0] + 1, LEAF_SIZE_1D_INNER - 1); x++)
+        {
+            for (int y = std::max(cell[1] - 1, 0); y <= std::min(cell[1] + 1, LEAF_SIZE_1D_INNER - 1); y++)
+            {
+                for (int z = std::max(cell[2] - 1, 0); z <= std::min(cell[2] + 1, LEAF_SIZE_1D_INNER - 1); z++)
+                {
+                    int index = indexOf(x, y, z);
+                    if (testedCells[index])
+                        continue;
+                    testedCells[index] = true;
+                    unsigned char corners = getCubeBitMask(index, m_Signs);
+                    if (!corners || corners == 255)
+                        continue;
+                    if (!hasEdgeMap)
+                    {
+                        for (size_t i = 0; i < m_SurfaceEdges.size(); i++)
+                            edgeMap[m_SurfaceEdges[i].direction][m_SurfaceEdges[i].edgeIndex1] = (unsigned short)i;
+                        hasEdgeMap = true;
+                    }
+                    const std::vector<Triangle<int> >& tris = TLT::getSingleton().indexTable[corners];
+                    for (auto i = tris.begin(); i != tris.end(); ++i)
+                    {
+                        Ogre::Vector3 positions[3];
+                        const int edges[3] = { i->p1, i->p2, i->p3 };
+                        for (int c = 0; c < 3; c++)
+                        {
+                            const TLT::DirectedEdge& edge = TLT::getSingleton().directedEdges[edges[c]];
+                            int edgeIndex = index + (edge.minCornerIndex & 1) + ((edge.minCornerIndex & 2) >> 1) * LEAF_SIZE_1D + ((edge.minCornerIndex & 4) >> 2) * LEAF_SIZE_2D;
+                            positions[c] = m_SurfaceEdges[edgeMap[edge.direction][edgeIndex]].getPosition(area);
+                        }
+                        if (ray.intersectTriangleUpdate(intersection, positions[0], positions[1], positions[2]))
+                            foundSomething = true;
+                    }
+                }
+            }
+        }
+        // step into the neighbor cell across the nearest cell boundary
+        int axis = (tNext[0] < tNext[1]) ? ((tNext[0] < tNext[2]) ? 0 : 2) : ((tNext[1] < tNext[2]) ? 1 : 2);
+        tCell = tNext[axis];
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= LEAF_SIZE_1D_INNER)
+            break;
+        tNext[axis] += tDelta[axis];
+    }
+    return foundSomething;
 }
 
-#include "TriangleLookupTable.h"
-void OctreeSF::GridNode::generateIndicesDC(const Area& area, vector<unsigned int>& indices, vector<Vertex>&) const
+template<int LeafExpo>
+const typename OctreeSFT<LeafExpo>::SurfaceEdge* OctreeSFT<LeafExpo>::GridNode::findClosestSurfaceEdge(const Area& area, const Ogre::Vector3& point, Ogre::Vector3& position, float& closestSquaredDistance) const
+{
+    const SurfaceEdge* closestEdge = nullptr;
+    for (auto i = m_SurfaceEdges.begin(); i != m_SurfaceEdges.end(); ++i)
+    {
+        Ogre::Vector3 edgePosition = i->getPosition(area);
+        float squaredDistance = edgePosition.squaredDistance(point);
+        if (squaredDistance < closestSquaredDistance)
+        {
+            closestSquaredDistance = squaredDistance;
+            closestEdge = &*i;
+            position = edgePosition;
+        }
+    }
+    return closestEdge;
+}
+
+template<int LeafExpo>
+Ogre::Vector3 OctreeSFT<LeafExpo>::GridNode::getOutwardNormal(const SurfaceEdge& edge) const
+{
+    // the edge leaves the inside in positive direction if its first corner is inside
+    Ogre::Vector3 normal = edge.getNormal();
+    if ((normal[edge.direction] < 0.0f) == m_Signs[edge.edgeIndex1])
+        return -normal;
+    return normal;
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::GridNode::getUniformCellSign(const Area& area, const Ogre::Vector3& point, bool& sign) const
+{
+    float cellSize = area.m_RealSize / LEAF_SIZE_1D_INNER;
+    Ogre::Vector3 cellPos = (point - area.m_MinRealPos) / cellSize;
+    int cell[3];
+    for (int d = 0; d < 3; d++)
+        cell[d] = std::min(std::max((int)cellPos[d], 0), LEAF_SIZE_1D_INNER - 1);
+    unsigned char corners = getCubeBitMask(indexOf(cell[0], cell[1], cell[2]), m_Signs);
+    sign = (corners != 0);
+    return !corners || corners == 255;
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::GridNode::getSign(const Area& area, const Ogre::Vector3& point) const
+{
+    bool sign;
+    if (getUniformCellSign(area, point, sign))
+        return sign;
+    Ogre::Vector3 closestPos;
+    const SurfaceEdge* edge = findClosestSurfaceEdge(area, point, closestPos);
+    return getOutwardNormal(*edge).dotProduct(point - closestPos) < 0.0f;
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::GridNode::intersectsSurface(const Area& area, const AABB& aabb) const
+{
+    if (m_SurfaceEdges.empty())
+        return false;
+    float cellSize = area.m_RealSize / LEAF_SIZE_1D_INNER;
+    int minCell[3], maxCell[3];
+    for (int d = 0; d < 3; d++)
+    {
+        minCell[d] = std::max((int)std::floor((aabb.getMin()[d] - area.m_MinRealPos[d]) / cellSize), 0);
+        maxCell[d] = std::min((int)std::floor((aabb.getMax()[d] - area.m_MinRealPos[d]) / cellSize), LEAF_SIZE_1D_INNER - 1);
+    }
+    for (int x = minCell[0]; x <= maxCell[0]; x++)
+    {
+        for (int y = minCell[1]; y <= maxCell[1]; y++)
+        {
+            for (int z = minCell[2]; z <= maxCell[2]; z++)
+            {
+                unsigned char corners = getCubeBitMask(indexOf(x, y, z), m_Signs);
+                if (corners && corners != 255)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::generateIndicesDC(const Area& area, vector<unsigned int>& indices, vector<Vertex>&) const
 {
     const SurfaceCube* cubes[LEAF_SIZE_3D];
     memset((void*)cubes, 0, LEAF_SIZE_3D * sizeof(SurfaceCube*));
@@ -509,7 +769,7 @@ void OctreeSF::GridNode::generateIndicesDC(const Area& area, vector<unsigned int
                 std::cout << "[OctreeSF::generateIndices] Could not find required neighbor!" << std::endl;
                 continue;
             }
-            vAssert(m_Signs[i->edgeIndex1] != m_Signs[i->edgeIndex2]);
+            vAssert(m_Signs[i->edgeIndex1] != m_Signs[i->getEdgeIndex2()]);
             if (m_Signs[i->edgeIndex1])
             {
                 indices.push_back(v0->vertexIndex[0]);
@@ -532,66 +792,289 @@ void OctreeSF::GridNode::generateIndicesDC(const Area& area, vector<unsigned int
     }
 }
 
+// Adds a triangle unless two of its vertices are the same cell vertex.
+static inline void addNonDegenerateTriangle(vector<unsigned int>& indices, unsigned int v1, unsigned int v2, unsigned int v3)
+{
+    if (v1 == v2 || v2 == v3 || v3 == v1)
+        return;
+    indices.push_back(v1);
+    indices.push_back(v2);
+    indices.push_back(v3);
+}
+
+template<int LeafExpo>
+int OctreeSFT<LeafExpo>::GridNode::generateIndicesAdaptive(const OctreeSFT* tree, vector<unsigned int>& indices) const
+{
+    int strideExpo = getLeafStrideExpo(m_Area);
+    int numMissingNeighbors = 0;
+    for (auto i = m_SurfaceEdges.begin(); i != m_SurfaceEdges.end(); ++i)
+    {
+        int dir1 = (i->direction + 1) % 3;
+        int dir2 = (i->direction + 2) % 3;
+        Vector3i minPos = fromIndex(i->edgeIndex1);
+        const SurfaceCube* cubes[4];
+        if (minPos[dir1] > 0 && minPos[dir2] > 0 && minPos[dir1] < LEAF_SIZE_1D_INNER && minPos[dir2] < LEAF_SIZE_1D_INNER)
+        {
+            // all four cells around the edge are inside the leaf
+            for (int n = 0; n < 4; n++)
+                cubes[n] = findSurfaceCube(i->getNeighborCube(n));
+        }
+        else
+        {
+            // the edge is on the leaf boundary, it is owned by the first of the smallest leaves around it
+            Vector3i edgePos = m_Area.m_MinPos + minPos * (1 << strideExpo);
+            Vector3i cellPos[4];
+            const GridNode* leaves[4];
+            int owner = -1;
+            bool hasFinerNeighbor = false;
+            for (int n = 0; n < 4; n++)
+            {
+                cellPos[n] = edgePos;
+                cellPos[n][dir1] -= n & 1;
+                cellPos[n][dir2] -= (n & 2) >> 1;
+                leaves[n] = tree->findLeaf(cellPos[n]);
+                if (!leaves[n])
+                    continue;
+                if (leaves[n]->m_Area.m_SizeExpo < m_Area.m_SizeExpo)
+                    hasFinerNeighbor = true;
+                else if (owner == -1 && leaves[n]->m_Area.m_SizeExpo == m_Area.m_SizeExpo)
+                    owner = n;
+            }
+            // finer neighbors split the edge and generate the quads of its parts
+            if (hasFinerNeighbor || owner == -1 || leaves[owner] != this)
+                continue;
+            for (int n = 0; n < 4; n++)
+            {
+                cubes[n] = nullptr;
+                if (leaves[n])
+                {
+                    int leafStrideExpo = getLeafStrideExpo(leaves[n]->m_Area);
+                    Vector3i localPos = cellPos[n] - leaves[n]->m_Area.m_MinPos;
+                    cubes[n] = leaves[n]->findSurfaceCube(indexOf(localPos.x >> leafStrideExpo, localPos.y >> leafStrideExpo, localPos.z >> leafStrideExpo));
+                }
+            }
+        }
+        if (cubes[0] == nullptr || cubes[1] == nullptr || cubes[2] == nullptr || cubes[3] == nullptr)
+        {
+            numMissingNeighbors++;
+            continue;
+        }
+        vAssert(m_Signs[i->edgeIndex1] != m_Signs[i->getEdgeIndex2()]);
+        // a coarser neighbor cell covers two of the cells, its quad degenerates to a triangle
+        unsigned int v0 = cubes[0]->vertexIndex[0];
+        unsigned int v1 = cubes[1]->vertexIndex[0];
+        unsigned int v2 = cubes[2]->vertexIndex[0];
+        unsigned int v3 = cubes[3]->vertexIndex[0];
+        if (m_Signs[i->edgeIndex1])
+        {
+            addNonDegenerateTriangle(indices, v0, v1, v3);
+            addNonDegenerateTriangle(indices, v3, v2, v0);
+        }
+        else
+        {
+            addNonDegenerateTriangle(indices, v0, v2, v3);
+            addNonDegenerateTriangle(indices, v3, v1, v0);
+        }
+    }
+    return numMissingNeighbors;
+}
+
+template<int LeafExpo>
+const typename OctreeSFT<LeafExpo>::SurfaceCube* OctreeSFT<LeafExpo>::GridNode::findSurfaceCube(int cubeIndex) const
+{
+    // the surface cubes are generated in index order
+    auto cube = std::lower_bound(m_SurfaceCubes.begin(), m_SurfaceCubes.end(), cubeIndex,
+                                 [](const SurfaceCube& cube, int index) { return cube.cubeIndex < index; });
+    if (cube == m_SurfaceCubes.end() || cube->cubeIndex != cubeIndex)
+        return nullptr;
+    return &(*cube);
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::GridNode::fitPlane(const Area& area, Ogre::Vector3& planePos, Ogre::Vector3& planeNormal) const
+{
+    if (m_SurfaceEdges.empty())
+        return false;
+    planePos = Ogre::Vector3(0, 0, 0);
+    planeNormal = Ogre::Vector3(0, 0, 0);
+    for (auto i = m_SurfaceEdges.begin(); i != m_SurfaceEdges.end(); ++i)
+    {
+        planePos += i->getPosition(area);
+        planeNormal += i->getNormal();
+    }
+    planePos /= (float)m_SurfaceEdges.size();
+    if (planeNormal.normalise() < 1e-6f)
+        return false;
+    // inverted leaves keep their normals, so the orientation is taken from the signs of an edge
+    const SurfaceEdge& edge = m_SurfaceEdges.front();
+    if ((planeNormal[edge.direction] > 0.0f) != m_Signs[edge.edgeIndex1])
+        planeNormal = -planeNormal;
+    return true;
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::GridNode::approximatesSurface(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF, float maxError)
+{
+    Ogre::Vector3 planePos, planeNormal;
+    if (!fitPlane(area, planePos, planeNormal))
+        return false;
+    float cellSize = area.m_RealSize / LEAF_SIZE_1D_INNER;
+
+    // the tangent plane of each surface edge may deviate from the fitted plane by maxError across a cell
+    for (auto i = m_SurfaceEdges.begin(); i != m_SurfaceEdges.end(); ++i)
+    {
+        float offset = std::fabs(planeNormal.dotProduct(i->getPosition(area) - planePos));
+        float tilt = planeNormal.crossProduct(i->getNormal()).length() * cellSize;
+        if (offset + tilt > maxError)
+            return false;
+    }
+
+    // there must not be any other surface in the leaf: lattice points away from the plane have to be on the correct side
+    // and must not be closer to the surface than to the plane or the leaf boundary
+    SolidGeometry::Lattice lattice = tree->getLeafLattice(area);
+    std::vector<Sample> samples(LEAF_SIZE_3D);
+    implicitSDF.getLatticeSamples(lattice, samples.data());
+    int index = 0;
+    for (int x = 0; x < LEAF_SIZE_1D; x++)
+    {
+        for (int y = 0; y < LEAF_SIZE_1D; y++)
+        {
+            for (int z = 0; z < LEAF_SIZE_1D; z++)
+            {
+                float planeDist = planeNormal.dotProduct(lattice.getPoint(x, y, z) - planePos);
+                if (std::fabs(planeDist) > maxError && (planeDist < 0.0f) != m_Signs[index])
+                    return false;
+                int boundaryCells = std::min(std::min(std::min(x, LEAF_SIZE_1D_INNER - x), std::min(y, LEAF_SIZE_1D_INNER - y)), std::min(z, LEAF_SIZE_1D_INNER - z));
+                if (std::fabs(samples[index].signedDistance) < std::min(std::fabs(planeDist), boundaryCells * cellSize) - maxError)
+                    return false;
+                index++;
+            }
+        }
+    }
+
+    // finer neighbors see the finest lattice on the leaf faces, each coarse cell with a sign change on its face needs a vertex for their quads
+    int stride = 1 << getLeafStrideExpo(area);
+    int size = LEAF_SIZE_1D_INNER * stride + 1;
+    m_BoundarySigns.assign(6 * size * size, false);
+    std::unique_ptr<bool[]> faceSigns(new bool[size * size]);
+    for (int d = 0; d < 3; d++)
+    {
+        int dim1 = (d == 0) ? 1 : 0;
+        int dim2 = (d == 2) ? 1 : 2;
+        for (int side = 0; side < 2; side++)
+        {
+            Vector3i minIndex = area.m_MinPos;
+            minIndex[d] += side * (size - 1);
+            Vector3i latticeSize(size, size, size);
+            latticeSize[d] = 1;
+            implicitSDF.getLatticeSigns(SolidGeometry::Lattice(tree->getLatticeOrigin(), tree->m_CellSize, minIndex, latticeSize), faceSigns.get());
+            int faceOffset = (d * 2 + side) * size * size;
+            for (int i = 0; i < size * size; i++)
+                m_BoundarySigns[faceOffset + i] = faceSigns[i];
+
+            Vector3i cubePos(0, 0, 0);
+            cubePos[d] = side * (LEAF_SIZE_1D_INNER - 1);
+            for (int u = 0; u < LEAF_SIZE_1D_INNER; u++)
+            {
+                for (int v = 0; v < LEAF_SIZE_1D_INNER; v++)
+                {
+                    const bool* square = faceSigns.get() + u * stride * size + v * stride;
+                    bool signChange = false;
+                    for (int a = 0; a <= stride && !signChange; a++)
+                    {
+                        for (int b = 0; b <= stride; b++)
+                            signChange |= (square[a * size + b] != square[0]);
+                    }
+                    if (!signChange)
+                        continue;
+                    cubePos[dim1] = u;
+                    cubePos[dim2] = v;
+                    unsigned char corners = getCubeBitMask(indexOf(cubePos), m_Signs);
+                    if (corners == 0 || corners == 255)
+                        return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::GridNode::getBoundarySign(const Vector3i& boundaryPos) const
+{
+    int size = (LEAF_SIZE_1D_INNER << getLeafStrideExpo(m_Area)) + 1;
+    for (int d = 0; d < 3; d++)
+    {
+        int dim1 = (d == 0) ? 1 : 0;
+        int dim2 = (d == 2) ? 1 : 2;
+        for (int side = 0; side < 2; side++)
+        {
+            if (boundaryPos[d] == side * (size - 1))
+                return m_BoundarySigns[(d * 2 + side) * size * size + boundaryPos[dim1] * size + boundaryPos[dim2]];
+        }
+    }
+    vAssert(false);
+    return false;
+}
+
 
-void OctreeSF::GridNode::invert()
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::invert()
 {
-    for (int i = 0; i < LEAF_SIZE_3D; i++)
-        m_Signs[i] = !m_Signs[i];
+    m_Signs.invert();
+    m_BoundarySigns.flip();
 }
 
-unsigned char OctreeSF::GridNode::getCubeBitMask(int index, const bool* signsArray)
+template<int LeafExpo>
+unsigned char OctreeSFT<LeafExpo>::GridNode::getCubeBitMask(int index, const LeafSigns& signs)
 {
     unsigned char corners = 0;
-    corners |= (unsigned char)signsArray[index];
-    corners |= ((unsigned char)signsArray[index + 1] << 1);
-    corners |= ((unsigned char)signsArray[index + LEAF_SIZE_1D] << 2);
-    corners |= ((unsigned char)signsArray[index + LEAF_SIZE_1D + 1] << 3);
-    corners |= ((unsigned char)signsArray[index + LEAF_SIZE_2D] << 4);
-    corners |= ((unsigned char)signsArray[index + LEAF_SIZE_2D + 1] << 5);
-    corners |= ((unsigned char)signsArray[index + LEAF_SIZE_2D + LEAF_SIZE_1D] << 6);
-    corners |= ((unsigned char)signsArray[index + LEAF_SIZE_2D + LEAF_SIZE_1D + 1] << 7);
+    corners |= (unsigned char)signs[index];
+    corners |= ((unsigned char)signs[index + 1] << 1);
+    corners |= ((unsigned char)signs[index + LEAF_SIZE_1D] << 2);
+    corners |= ((unsigned char)signs[index + LEAF_SIZE_1D + 1] << 3);
+    corners |= ((unsigned char)signs[index + LEAF_SIZE_2D] << 4);
+    corners |= ((unsigned char)signs[index + LEAF_SIZE_2D + 1] << 5);
+    corners |= ((unsigned char)signs[index + LEAF_SIZE_2D + LEAF_SIZE_1D] << 6);
+    corners |= ((unsigned char)signs[index + LEAF_SIZE_2D + LEAF_SIZE_1D + 1] << 7);
     return corners;
 }
 
-void OctreeSF::GridNode::merge(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::merge(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF)
 {
     float cellSize = tree->m_CellSize;
     GridNode otherNode;
     otherNode.computeSigns(tree, area, implicitSDF);
-    for (int i = 0; i < LEAF_SIZE_3D; i++)
-        m_Signs[i] = m_Signs[i] || otherNode.m_Signs[i];
+    m_Signs |= otherNode.m_Signs;
     auto thisEdgesCopy = m_SurfaceEdges;
     m_SurfaceEdges.clear();
-    bool addedEdges[3][LEAF_SIZE_3D];
-    memset(addedEdges[0], 0, LEAF_SIZE_3D);
-    memset(addedEdges[1], 0, LEAF_SIZE_3D);
-    memset(addedEdges[2], 0, LEAF_SIZE_3D);
+    LeafSigns addedEdges[3];
+    for (int d = 0; d < 3; d++)
+        addedEdges[d].clear();
     for (auto i = thisEdgesCopy.begin(); i != thisEdgesCopy.end(); i++)
     {
-        if (m_Signs[i->edgeIndex1] != m_Signs[i->edgeIndex2])
+        if (m_Signs[i->edgeIndex1] != m_Signs[i->getEdgeIndex2()])
         {
             m_SurfaceEdges.push_back(*i);
-            addedEdges[i->direction][i->edgeIndex1] = true;
+            addedEdges[i->direction].set(i->edgeIndex1, true);
 
             // sign changes in both nodes
-            if (otherNode.m_Signs[i->edgeIndex1] != otherNode.m_Signs[i->edgeIndex2])
+            if (otherNode.m_Signs[i->edgeIndex1] != otherNode.m_Signs[i->getEdgeIndex2()])
             {
                 Vector3i minPos = fromIndex(i->edgeIndex1);
                 Ogre::Vector3 globalPos = tree->getRealPos(area.m_MinPos + minPos);
                 Ogre::Vector3 insidePos = globalPos;
-                if (otherNode.m_Signs[i->edgeIndex2])
-                    insidePos = tree->getRealPos(area.m_MinPos + fromIndex(i->edgeIndex2));
+                if (otherNode.m_Signs[i->getEdgeIndex2()])
+                    insidePos = tree->getRealPos(area.m_MinPos + fromIndex(i->getEdgeIndex2()));
 
                 globalPos[i->direction] += cellSize * 0.5f;
                 Sample s;
                 implicitSDF.getSample(globalPos, s);
                 Ogre::Vector3 newDiff = s.closestSurfacePos - insidePos;
-                Ogre::Vector3 oldDiff = i->vertex.position - insidePos;
+                Ogre::Vector3 oldDiff = i->getPosition(area) - insidePos;
                 if (newDiff.squaredLength() > oldDiff.squaredLength())
-                {
-                    i->vertex.position = s.closestSurfacePos;
-                    i->vertex.normal = s.normal;
-                }
+                    i->setSample(area, s);
                 /*for (int j = 0; j < 3; j++)
                 {
                     if (newDiff[j] * newDiff[j] > oldDiff[j] * oldDiff[j])
@@ -607,35 +1090,34 @@ void OctreeSF::GridNode::merge(OctreeSF* tree, const Area& area, const SolidGeom
     computeEdges(tree, area, implicitSDF, addedEdges);
 }
 
-void OctreeSF::GridNode::intersect(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::intersect(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF)
 {
     // auto ts = Profiler::timestamp();
     float cellSize = tree->m_CellSize;
     GridNode otherNode;
     otherNode.computeSigns(tree, area, implicitSDF);
-    for (int i = 0; i < LEAF_SIZE_3D; i++)
-        m_Signs[i] = m_Signs[i] && otherNode.m_Signs[i];
+    m_Signs &= otherNode.m_Signs;
     auto thisEdgesCopy = m_SurfaceEdges;
     m_SurfaceEdges.clear();
-    bool addedEdges[3][LEAF_SIZE_3D];
-    memset(addedEdges[0], 0, LEAF_SIZE_3D);
-    memset(addedEdges[1], 0, LEAF_SIZE_3D);
-    memset(addedEdges[2], 0, LEAF_SIZE_3D);
+    LeafSigns addedEdges[3];
+    for (int d = 0; d < 3; d++)
+        addedEdges[d].clear();
     for (auto i = thisEdgesCopy.begin(); i != thisEdgesCopy.end(); i++)
     {
-        if (m_Signs[i->edgeIndex1] != m_Signs[i->edgeIndex2])
+        if (m_Signs[i->edgeIndex1] != m_Signs[i->getEdgeIndex2()])
         {
             m_SurfaceEdges.push_back(*i);
-            addedEdges[i->direction][i->edgeIndex1] = true;
+            addedEdges[i->direction].set(i->edgeIndex1, true);
 
             // sign changes in both nodes
-            if (otherNode.m_Signs[i->edgeIndex1] != otherNode.m_Signs[i->edgeIndex2])
+            if (otherNode.m_Signs[i->edgeIndex1] != otherNode.m_Signs[i->getEdgeIndex2()])
             {
                 Vector3i minPos = fromIndex(i->edgeIndex1);
                 Ogre::Vector3 globalPos = tree->getRealPos(area.m_MinPos + minPos);
                 Ogre::Vector3 insidePos = globalPos;
-                if (otherNode.m_Signs[i->edgeIndex2])
-                    insidePos = tree->getRealPos(area.m_MinPos + fromIndex(i->edgeIndex2));
+                if (otherNode.m_Signs[i->getEdgeIndex2()])
+                    insidePos = tree->getRealPos(area.m_MinPos + fromIndex(i->getEdgeIndex2()));
 
                 Sample s;
                 // Ogre::Vector3 rayDir(0,0,0);
@@ -644,12 +1126,9 @@ void OctreeSF::GridNode::intersect(OctreeSF* tree, const Area& area, const Solid
                 globalPos[i->direction] += cellSize * 0.5f;
                 implicitSDF.getSample(globalPos, s);
                 Ogre::Vector3 newDiff = s.closestSurfacePos - insidePos;
-                Ogre::Vector3 oldDiff = i->vertex.position - insidePos;
+                Ogre::Vector3 oldDiff = i->getPosition(area) - insidePos;
                 if (newDiff.squaredLength() < oldDiff.squaredLength())
-                {
-                    i->vertex.position = s.closestSurfacePos;
-                    i->vertex.normal = s.normal;
-                }
+                    i->setSample(area, s);
                 /*for (int j = 0; j < 3; j++)
                 {
                     if (newDiff[j] * newDiff[j] < oldDiff[j] * oldDiff[j])
@@ -666,144 +1145,708 @@ void OctreeSF::GridNode::intersect(OctreeSF* tree, const Area& area, const Solid
     // Profiler::getSingleton().accumulateJobDuration("GridNode::intersect", ts);
 }
 
-void OctreeSF::GridNode::intersect(GridNode* otherNode)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::GridNode::combineAligned(const GridNode* otherNode, const Area& area, AlignedOperation operation)
 {
-    // TODO
-    /*auto thisEdgesCopy = m_SurfaceEdges;
-    m_SurfaceEdges.clear();
-    std::bitset<LEAF_SIZE_3D> addedEdges[3];
-    static int addedEdgesIndices[3][LEAF_SIZE_3D];
-    for (auto i = thisEdgesCopy.begin(); i != thisEdgesCopy.end(); i++)
+    LeafSigns thisEdges[3], otherEdges[3], edges[3];
+    getSignChangeEdges(thisEdges);
+    otherNode->getSignChangeEdges(otherEdges);
+    LeafSigns otherSigns = otherNode->m_Signs;
+    if (operation == ALIGNED_SUBTRACT)
+        otherSigns.invert();
+    if (operation == ALIGNED_MERGE)
+        m_Signs |= otherSigns;
+    else m_Signs &= otherSigns;
+    getSignChangeEdges(edges);
+
+    if (m_BoundarySigns.size() == otherNode->m_BoundarySigns.size())
     {
-        if (m_Signs[i->edgeIndex1] != m_Signs[i->edgeIndex2])
+        for (size_t i = 0; i < m_BoundarySigns.size(); i++)
         {
-            m_SurfaceEdges.push_back(*i);
-            addedEdges[i->direction][i->edgeIndex1] = true;
-            addedEdgesIndices[i->direction][i->edgeIndex1] = (int)m_SurfaceEdges.size() - 1;
+            bool otherSign = otherNode->m_BoundarySigns[i] != (operation == ALIGNED_SUBTRACT);
+            m_BoundarySigns[i] = (operation == ALIGNED_MERGE) ? (m_BoundarySigns[i] || otherSign) : (m_BoundarySigns[i] && otherSign);
         }
-        else i->deleteSharedVertex();
     }
-    for (auto i = otherNode->m_SurfaceEdges.begin(); i != otherNode->m_SurfaceEdges.end(); i++)
+    else m_BoundarySigns.clear();
+
+    // edges of the other leaf by direction and min corner, only valid where both leaves have a sign change
+    unsigned short otherEdgeMap[3][LEAF_SIZE_3D];
+    for (auto i = otherNode->m_SurfaceEdges.begin(); i != otherNode->m_SurfaceEdges.end(); ++i)
+        otherEdgeMap[i->direction][i->edgeIndex1] = (unsigned short)(i - otherNode->m_SurfaceEdges.begin());
+
+    auto takeOtherEdge = [&](const SurfaceEdge& otherEdge)
     {
-        if (m_Signs[i->edgeIndex1] != m_Signs[i->edgeIndex2])
-        {
-            if (addedEdges[i->direction][i->edgeIndex1])
-            {
-                if (i->sharedVertex->signedDistance < m_SurfaceEdges[addedEdgesIndices[i->direction][i->edgeIndex1]].sharedVertex->signedDistance)
-                {
-                    m_SurfaceEdges[addedEdgesIndices[i->direction][i->edgeIndex1]] = i->clone();
-                }
-            }
-            else m_SurfaceEdges.push_back(i->clone());
-        }
-    }*/
-}
+        m_SurfaceEdges.push_back(otherEdge);
+        if (operation == ALIGNED_SUBTRACT)
+            m_SurfaceEdges.back().flipNormal();
+    };
 
-void OctreeSF::GridNode::merge(GridNode* otherNode)
-{
-    // TODO
-    /*auto thisEdgesCopy = m_SurfaceEdges;
+    auto thisEdgesCopy = m_SurfaceEdges;
     m_SurfaceEdges.clear();
-    std::bitset<LEAF_SIZE_3D> addedEdges[3];
-    static int addedEdgesIndices[3][LEAF_SIZE_3D];
-    for (auto i = thisEdgesCopy.begin(); i != thisEdgesCopy.end(); i++)
+    m_SurfaceEdges.reserve(edges[0].count() + edges[1].count() + edges[2].count());
+    for (auto i = thisEdgesCopy.begin(); i != thisEdgesCopy.end(); ++i)
     {
-        if (m_Signs[i->edgeIndex1] != m_Signs[i->edgeIndex2])
+        if (!edges[i->direction][i->edgeIndex1])
+            continue;
+        if (!otherEdges[i->direction][i->edgeIndex1])
         {
             m_SurfaceEdges.push_back(*i);
-            addedEdges[i->direction][i->edgeIndex1] = true;
-            addedEdgesIndices[i->direction][i->edgeIndex1] = (int)m_SurfaceEdges.size() - 1;
+            continue;
         }
-        else i->deleteSharedVertex();
+        // Both operands cross the edge. Intersections end at the crossing closer to the inside end of the edge, unions at the one farther away.
+        const SurfaceEdge& otherEdge = otherNode->m_SurfaceEdges[otherEdgeMap[i->direction][i->edgeIndex1]];
+        float thisCrossing = i->getPosition(area)[i->direction];
+        float otherCrossing = otherEdge.getPosition(area)[i->direction];
+        bool insideAtMinCorner = m_Signs[i->edgeIndex1];
+        bool takeCloserToMinCorner = (insideAtMinCorner != (operation == ALIGNED_MERGE));
+        if ((otherCrossing < thisCrossing) == takeCloserToMinCorner)
+            takeOtherEdge(otherEdge);
+        else m_SurfaceEdges.push_back(*i);
     }
-    for (auto i = otherNode->m_SurfaceEdges.begin(); i != otherNode->m_SurfaceEdges.end(); i++)
+    for (auto i = otherNode->m_SurfaceEdges.begin(); i != otherNode->m_SurfaceEdges.end(); ++i)
     {
-        if (m_Signs[i->edgeIndex1] != m_Signs[i->edgeIndex2])
-        {
-            if (addedEdges[i->direction][i->edgeIndex1])
-            {
-                if (i->sharedVertex->signedDistance > m_SurfaceEdges[addedEdgesIndices[i->direction][i->edgeIndex1]].sharedVertex->signedDistance)
-                {
-                    m_SurfaceEdges[addedEdgesIndices[i->direction][i->edgeIndex1]] = i->clone();
-                }
-            }
-            else m_SurfaceEdges.push_back(i->clone());
-        }
-    }*/
+        if (edges[i->direction][i->edgeIndex1] && !thisEdges[i->direction][i->edgeIndex1])
+            takeOtherEdge(*i);
+    }
 }
 
 /******************************************************************************************
 OctreeSF
 *******************************************************************************************/
 
-Ogre::Vector3 OctreeSF::getRealPos(const Vector3i& cellIndex) const
+template<int LeafExpo>
+Ogre::Vector3 OctreeSFT<LeafExpo>::getRealPos(const Vector3i& cellIndex) const
 {
-    return m_RootArea.m_MinRealPos + cellIndex.toOgreVec() * m_CellSize;
+    return getLatticeOrigin() + cellIndex.toOgreVec() * m_CellSize;
 }
 
-OctreeSF::Node* OctreeSF::createNode(const Area& area, const SolidGeometry& implicitSDF)
+template<int LeafExpo>
+SolidGeometry::Lattice OctreeSFT<LeafExpo>::getLeafLattice(const Area& area) const
 {
-    bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
-    if (area.m_SizeExpo <= LEAF_EXPO && needsSubdivision)
-        return new GridNodeImpl(this, area, implicitSDF);
-
-    if (needsSubdivision)
-        return new InnerNode(this, area, implicitSDF);
-
-    return new EmptyNode(area, implicitSDF);
+    int strideExpo = getLeafStrideExpo(area);
+    Vector3i minIndex(area.m_MinPos.x >> strideExpo, area.m_MinPos.y >> strideExpo, area.m_MinPos.z >> strideExpo);
+    return SolidGeometry::Lattice(getLatticeOrigin(), m_CellSize * (1 << strideExpo), minIndex, Vector3i(LEAF_SIZE_1D));
 }
 
-OctreeSF::Node* OctreeSF::intersect(Node* node, const SolidGeometry& implicitSDF, const Area& area)
+template<int LeafExpo>
+const typename OctreeSFT<LeafExpo>::GridNode* OctreeSFT<LeafExpo>::findLeaf(const Vector3i& cellIndex) const
 {
-    bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
-    if (node->getNodeType() == Node::INNER && needsSubdivision)
+    for (int d = 0; d < 3; d++)
     {
-        InnerNode* innerNode = (InnerNode*)node;
-        Area subAreas[8];
-        area.getSubAreas(subAreas);
-        for (int i = 0; i < 8; i++)
-            innerNode->m_Children[i] = intersect(innerNode->m_Children[i], implicitSDF, subAreas[i]);
-        return node;
+        if (cellIndex[d] < m_RootArea.m_MinPos[d] || cellIndex[d] >= m_RootArea.m_MaxPos[d])
+            return nullptr;
     }
-    if (!needsSubdivision)
+    const Node* node = m_RootNode;
+    Vector3i minPos = m_RootArea.m_MinPos;
+    int sizeExpo = m_RootArea.m_SizeExpo;
+    while (node->getNodeType() == Node::INNER)
     {
-        if (implicitSDF.getSign(area.getCornerVecs(0).second))
-            return node;
-        delete node;
-        return new EmptyNode(area, implicitSDF);
+        sizeExpo--;
+        int child = 0;
+        for (int d = 0; d < 3; d++)
+        {
+            if (cellIndex[d] >= minPos[d] + (1 << sizeExpo))
+            {
+                child |= 4 >> d;
+                minPos[d] += 1 << sizeExpo;
+            }
+        }
+        node = ((const InnerNode*)node)->m_Children[child];
     }
-    if (node->getNodeType() == Node::EMPTY)
-    {
-        EmptyNode* emptyNode = (EmptyNode*)node;
-        if (!emptyNode->m_Sign)
-            return node;
-        delete node;
-        return createNode(area, implicitSDF);
+    if (node->getNodeType() == Node::GRID)
+        return (const GridNode*)node;
+    return nullptr;
+}
 
-    }
+/*
+Inside a coarse leaf the surface is the fitted plane. The finest lattice points on the leaf faces keep the signs the leaf was sampled with,
+so leaves built from this geometry match the neighbors of the coarse leaf.
+*/
+template<int LeafExpo>
+class OctreeSFT<LeafExpo>::CoarseLeafGeometry : public SolidGeometry
+{
+protected:
+    const OctreeSFT* m_Tree;
+    const GridNode* m_Leaf;
+    Area m_Area;
 
+    /// Number of finest lattice points per dimension of the leaf.
+    int m_Size;
+
+    PlaneGeometry m_Plane;
+
+    static PlaneGeometry fitPlane(const GridNode* leaf, const Area& area)
+    {
+        Ogre::Vector3 planePos, planeNormal;
+        leaf->fitPlane(area, planePos, planeNormal);
+        return PlaneGeometry(planePos, planeNormal);
+    }
+
+    bool isOnBoundary(const Vector3i& boundaryPos) const
+    {
+        bool onFace = false;
+        for (int d = 0; d < 3; d++)
+        {
+            if (boundaryPos[d] < 0 || boundaryPos[d] >= m_Size)
+                return false;
+            onFace |= (boundaryPos[d] == 0 || boundaryPos[d] == m_Size - 1);
+        }
+        return onFace;
+    }
+
+public:
+    CoarseLeafGeometry(const OctreeSFT* tree, const GridNode* leaf, const Area& area)
+        : m_Tree(tree), m_Leaf(leaf), m_Area(area), m_Size((LEAF_SIZE_1D_INNER << getLeafStrideExpo(area)) + 1), m_Plane(fitPlane(leaf, area)) {}
+
+    virtual void getSample(const Ogre::Vector3& point, Sample& sample) const override { m_Plane.getSample(point, sample); }
+
+    virtual bool getSign(const Ogre::Vector3& point) const override { return m_Plane.getSign(point); }
+
+    virtual void getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const override { m_Plane.getSamples(points, numPoints, samples); }
+
+    virtual void getLatticeSamples(const Lattice& lattice, Sample* samples) const override { m_Plane.getLatticeSamples(lattice, samples); }
+
+    virtual void getLatticeSigns(const Lattice& lattice, bool* signs) const override
+    {
+        m_Plane.getLatticeSigns(lattice, signs);
+        int stride = (int)(lattice.stepSize / m_Tree->m_CellSize + 0.5f);
+        for (int x = 0; x < lattice.size.x; x++)
+        {
+            for (int y = 0; y < lattice.size.y; y++)
+            {
+                for (int z = 0; z < lattice.size.z; z++)
+                {
+                    Vector3i boundaryPos = (lattice.minIndex + Vector3i(x, y, z)) * stride - m_Area.m_MinPos;
+                    if (isOnBoundary(boundaryPos))
+                        *signs = m_Leaf->getBoundarySign(boundaryPos);
+                    signs++;
+                }
+            }
+        }
+    }
+
+    virtual bool cubeNeedsSubdivision(const Area& area) const override
+    {
+        AABB aabb = area.toAABB();
+        aabb.addEpsilon(m_Tree->m_CellSize * 0.01f);
+        if (m_Plane.intersectsSurface(aabb))
+            return true;
+        // an empty node has a single sign, which has to match the boundary signs in the area
+        bool sign = m_Plane.getSign(area.toAABB().getCenter());
+        Vector3i minPos = area.m_MinPos - m_Area.m_MinPos;
+        Vector3i maxPos = area.m_MaxPos - m_Area.m_MinPos;
+        for (int d = 0; d < 3; d++)
+        {
+            int dim1 = (d == 0) ? 1 : 0;
+            int dim2 = (d == 2) ? 1 : 2;
+            for (int side = 0; side < 2; side++)
+            {
+                Vector3i boundaryPos;
+                boundaryPos[d] = side * (m_Size - 1);
+                if (boundaryPos[d] < minPos[d] || boundaryPos[d] > maxPos[d])
+                    continue;
+                for (boundaryPos[dim1] = minPos[dim1]; boundaryPos[dim1] <= maxPos[dim1]; boundaryPos[dim1]++)
+                {
+                    for (boundaryPos[dim2] = minPos[dim2]; boundaryPos[dim2] <= maxPos[dim2]; boundaryPos[dim2]++)
+                    {
+                        if (m_Leaf->getBoundarySign(boundaryPos) != sign)
+                            return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    virtual bool intersectsSurface(const AABB& aabb) const override { return m_Plane.intersectsSurface(aabb); }
+
+    virtual AABB getAABB() const override { return m_Area.toAABB(); }
+};
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::refineLeaf(const GridNode* leaf, const Area& area)
+{
+    CoarseLeafGeometry geometry(this, leaf, area);
+    return new (*m_Arena) InnerNode(this, area, geometry);
+}
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::createNode(const Area& area, const SolidGeometry& implicitSDF, void* childSlot, bool lazyChildren)
+{
+    bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
+    if (area.m_SizeExpo <= LEAF_EXPO && needsSubdivision)
+    {
+        // leaves do not fit into a child slot, the slot goes back to the free list
+        NodeArena::freeObject(childSlot);
+        return new (*m_Arena) GridNodeImpl(this, area, implicitSDF);
+    }
+
+    if (needsSubdivision && m_MaxLeafError > 0.0f && area.m_SizeExpo <= LEAF_EXPO + MAX_ADAPTIVE_LEVELS)
+    {
+        // adaptive octrees try to stop refining with a coarse leaf
+        GridNodeImpl* leaf = new (*m_Arena) GridNodeImpl(this, area, implicitSDF);
+        if (leaf->approximatesSurface(this, area, implicitSDF, m_MaxLeafError))
+        {
+            NodeArena::freeObject(childSlot);
+            return leaf;
+        }
+        delete leaf;
+    }
+
+    if (!childSlot)
+        childSlot = m_Arena->allocateObject(getChildSlotSize());
+    if (needsSubdivision && lazyChildren)
+    {
+        InnerNode* innerNode = new (childSlot) InnerNode();
+        void* childSlots[8];
+        m_Arena->allocateObjects(getChildSlotSize(), 8, childSlots);
+        for (int i = 0; i < 8; i++)
+            innerNode->m_Children[i] = new (childSlots[i]) LazyNode(&implicitSDF);
+        return innerNode;
+    }
+    if (needsSubdivision)
+        return new (childSlot) InnerNode(this, area, implicitSDF);
+
+    return new (childSlot) EmptyNode(area, implicitSDF);
+}
+
+template<int LeafExpo>
+size_t OctreeSFT<LeafExpo>::getChildSlotSize()
+{
+    return std::max(std::max(sizeof(InnerNode), sizeof(EmptyNode)), sizeof(LazyNode));
+}
+
+/******************************************************************************************
+Pager
+*******************************************************************************************/
+
+/*
+Pages are the subtrees at m_PageSizeExpo, a page is identified by its position in the grid of pages of the root area.
+Resident pages are kept in least recently used order. Pages are only written out between the steps of paged operations,
+when no recursion holds pointers into the octree.
+*/
+template<int LeafExpo>
+class OctreeSFT<LeafExpo>::Pager
+{
+public:
+    struct Page
+    {
+        Page() : resident(false), dirty(false), onDisk(false), fileOffset(0), fileSize(0), fileCapacity(0) {}
+        bool resident;
+
+        /// The resident page differs from its copy in the backing file.
+        bool dirty;
+
+        /// The backing file holds a valid copy of the page.
+        bool onDisk;
+
+        unsigned long long fileOffset;
+        unsigned long long fileSize;
+
+        /// Size of the file extent of the page, rewritten pages reuse the extent if they fit.
+        unsigned long long fileCapacity;
+
+        std::list<int>::iterator lruPosition;
+    };
+
+    OctreeSFT* m_Tree;
+    std::string m_FileName;
+    std::fstream m_File;
+    int m_PageSizeExpo;
+    int m_PagesPerAxis;
+    size_t m_ResidentBudget;
+    std::vector<Page> m_Pages;
+
+    /// Resident pages, least recently used first.
+    std::list<int> m_LRU;
+
+    unsigned long long m_FileEnd;
+    PagingStats m_Stats;
+
+    Pager(OctreeSFT* tree, const std::string& fileName, int pageLevel, size_t residentBudget)
+        : m_Tree(tree), m_FileName(fileName), m_PageSizeExpo(tree->m_RootArea.m_SizeExpo - pageLevel), m_PagesPerAxis(1 << pageLevel),
+        m_ResidentBudget(residentBudget), m_Pages(1 << (3 * pageLevel)), m_FileEnd(0)
+    {
+        m_File.open(fileName, std::ios_base::binary | std::ios_base::in | std::ios_base::out | std::ios_base::trunc);
+        if (!m_File)
+            std::cout << "Could not open the backing file " << fileName << "." << std::endl;
+    }
+
+    ~Pager()
+    {
+        m_File.close();
+        std::remove(m_FileName.c_str());
+    }
+
+    int getNumPages() const { return (int)m_Pages.size(); }
+
+    bool hasContent(int page) const { return m_Pages[page].resident || m_Pages[page].onDisk; }
+
+    int getPageIndex(const Area& area) const
+    {
+        Vector3i pagePos = area.m_MinPos - m_Tree->m_RootArea.m_MinPos;
+        return ((pagePos.x >> m_PageSizeExpo) * m_PagesPerAxis + (pagePos.y >> m_PageSizeExpo)) * m_PagesPerAxis + (pagePos.z >> m_PageSizeExpo);
+    }
+
+    /// Approximate area of the page, the exact area is computed by findPageSlot.
+    Area getPageArea(int page) const
+    {
+        const Area& rootArea = m_Tree->m_RootArea;
+        Vector3i pagePos(page / (m_PagesPerAxis * m_PagesPerAxis), (page / m_PagesPerAxis) % m_PagesPerAxis, page % m_PagesPerAxis);
+        float pageRealSize = rootArea.m_RealSize / m_PagesPerAxis;
+        return Area(rootArea.m_MinPos + pagePos * (1 << m_PageSizeExpo), m_PageSizeExpo,
+            rootArea.m_MinRealPos + Ogre::Vector3((float)pagePos.x, (float)pagePos.y, (float)pagePos.z) * pageRealSize, pageRealSize);
+    }
+
+    /// Returns the child slot that holds the page, or nullptr if the page lies in a leaf or empty node above the page level.
+    Node** findPageSlot(int page, Area& area) const
+    {
+        Vector3i pageMinPos = getPageArea(page).m_MinPos;
+        Node** slot = &m_Tree->m_RootNode;
+        area = m_Tree->m_RootArea;
+        while (area.m_SizeExpo > m_PageSizeExpo)
+        {
+            if ((*slot)->getNodeType() != Node::INNER)
+                return nullptr;
+            int halfSize = 1 << (area.m_SizeExpo - 1);
+            Vector3i offset = pageMinPos - area.m_MinPos;
+            int child = ((offset.x >= halfSize) << 2) | ((offset.y >= halfSize) << 1) | (offset.z >= halfSize);
+            Area subAreas[8];
+            area.getSubAreas(subAreas);
+            slot = &((InnerNode*)*slot)->m_Children[child];
+            area = subAreas[child];
+        }
+        return slot;
+    }
+
+    void makeResident(int page, bool dirty)
+    {
+        Page& p = m_Pages[page];
+        if (p.resident)
+            m_LRU.splice(m_LRU.end(), m_LRU, p.lruPosition);
+        else
+            p.lruPosition = m_LRU.insert(m_LRU.end(), page);
+        p.resident = true;
+        p.dirty |= dirty;
+    }
+
+    /// Forgets a page that no longer exists in the octree, its file extent is reused if the page is written again.
+    void release(int page)
+    {
+        Page& p = m_Pages[page];
+        if (p.resident)
+            m_LRU.erase(p.lruPosition);
+        p.resident = false;
+        p.dirty = false;
+        p.onDisk = false;
+    }
+
+    /// Counts an access of a paged operation to a page.
+    void access(int page)
+    {
+        if (!m_Pages[page].resident)
+            return;
+        m_Stats.hits++;
+        m_LRU.splice(m_LRU.end(), m_LRU, m_Pages[page].lruPosition);
+    }
+
+    /// Registers the content of a page after a step of a paged operation.
+    void update(int page, bool modified)
+    {
+        Area area;
+        Node** slot = findPageSlot(page, area);
+        Node* node = slot ? *slot : nullptr;
+        if (node && (node->getNodeType() == Node::INNER || node->getNodeType() == Node::GRID))
+            makeResident(page, modified);
+        else if (!isPlaceholder(node, page))
+            release(page);
+    }
+
+    /// Releases the pages that were removed together with a node above the page level.
+    void releaseRemovedPages()
+    {
+        for (int page = 0; page < getNumPages(); page++)
+        {
+            if (!hasContent(page))
+                continue;
+            Area area;
+            Node** slot = findPageSlot(page, area);
+            if (!slot || (m_Pages[page].resident ? (*slot)->getNodeType() == Node::EMPTY : !isPlaceholder(*slot, page)))
+                release(page);
+        }
+    }
+
+    bool isPlaceholder(const Node* node, int page) const
+    {
+        return node && node->getNodeType() == Node::LAZY && ((const LazyNode*)node)->m_Page == page;
+    }
+
+    /// Reads a page from the backing file into the arena of the given octree, returns nullptr if the page could not be read.
+    Node* readPage(int page, OctreeSFT* tree)
+    {
+        const Page& p = m_Pages[page];
+        std::vector<char> buffer((size_t)p.fileSize);
+        m_File.seekg((std::streamoff)p.fileOffset);
+        m_File.read(buffer.data(), (std::streamsize)buffer.size());
+        Node* node = m_File ? tree->readSubtree(OctreeFile::Reader(buffer.data(), buffer.size())) : nullptr;
+        if (!node)
+        {
+            std::cout << "Could not read page " << page << " from " << m_FileName << "." << std::endl;
+            m_File.clear();
+        }
+        return node;
+    }
+
+    /// Replaces a placeholder by its page. If the page cannot be read, the placeholder is returned and the page stays on disk, so a later page in can retry.
+    Node* pageIn(LazyNode* placeholder)
+    {
+        int page = placeholder->m_Page;
+        Node* node = readPage(page, m_Tree);
+        if (!node)
+            return placeholder;
+        bool inverted = placeholder->m_Inverted;
+        delete placeholder;
+        if (inverted)
+            node->invert();
+        makeResident(page, inverted);
+        m_Stats.pageIns++;
+        return node;
+    }
+
+    /// Writes a page to the backing file unless the file holds an up to date copy, and replaces it by a placeholder.
+    void pageOut(int page)
+    {
+        Page& p = m_Pages[page];
+        Area area;
+        Node** slot = findPageSlot(page, area);
+        if (!slot || ((*slot)->getNodeType() != Node::INNER && (*slot)->getNodeType() != Node::GRID))
+        {
+            release(page);
+            return;
+        }
+        if (p.dirty || !p.onDisk)
+        {
+            std::ostringstream stream(std::ios_base::out | std::ios_base::binary);
+            size_t size = m_Tree->writeSubtree(*slot, area, stream);
+            if (size > p.fileCapacity)
+            {
+                p.fileOffset = m_FileEnd;
+                p.fileCapacity = size;
+                m_FileEnd += size;
+            }
+            m_File.seekp((std::streamoff)p.fileOffset);
+            m_File.write(stream.str().data(), (std::streamsize)size);
+            m_File.flush();
+            if (!size || !m_File)
+            {
+                // the page stays resident, its previous copy may have been overwritten
+                std::cout << "Could not write page " << page << " to " << m_FileName << "." << std::endl;
+                m_File.clear();
+                p.onDisk = false;
+                return;
+            }
+            p.fileSize = size;
+        }
+        delete *slot;
+        *slot = new (*m_Tree->m_Arena) LazyNode(page);
+        m_LRU.erase(p.lruPosition);
+        p.resident = false;
+        p.dirty = false;
+        p.onDisk = true;
+        m_Stats.pageOuts++;
+    }
+
+    /// Pages out least recently used pages until the octree fits into the budget.
+    void enforceBudget()
+    {
+        auto it = m_LRU.begin();
+        while (it != m_LRU.end() && m_Tree->m_Arena->getStats().bytesUsed > m_ResidentBudget)
+            pageOut(*it++);
+    }
+};
+
+/// Returns the placeholder itself if it is a page that could not be read, callers leave such nodes untouched.
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::expandLazyNode(LazyNode* node, const Area& area)
+{
+    if (!node->m_SDF)
+        return m_Pager->pageIn(node);
+    const SolidGeometry& implicitSDF = *node->m_SDF;
+    bool inverted = node->m_Inverted;
+    delete node;
+    Node* expandedNode = createNode(area, implicitSDF, nullptr, true);
+    // an inverted placeholder passes the inversion on to its unevaluated children
+    if (inverted)
+        expandedNode->invert();
+    return expandedNode;
+}
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::expandLazyNodes(Node* node, const Area& area, const AABB& region)
+{
+    if (!area.toAABB().intersectsAABB(region))
+        return node;
+    if (node->getNodeType() == Node::LAZY)
+        node = expandLazyNode((LazyNode*)node, area);
+    if (node->getNodeType() == Node::INNER)
+    {
+        InnerNode* innerNode = (InnerNode*)node;
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        for (int i = 0; i < 8; i++)
+            innerNode->m_Children[i] = expandLazyNodes(innerNode->m_Children[i], subAreas[i], region);
+    }
+    return node;
+}
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::rayIntersectLazy(Node* node, const Area& area, const Ray& ray, Ray::Intersection& intersection, bool& hit)
+{
+    AABB aabb = area.toAABB();
+    if (!ray.intersectAABB(&aabb.min, 0, intersection.t))
+        return node;
+    if (m_Pager && area.m_SizeExpo == m_Pager->m_PageSizeExpo && node->getNodeType() != Node::LAZY)
+        m_Pager->access(m_Pager->getPageIndex(area));
+    if (node->getNodeType() == Node::LAZY)
+    {
+        node = expandLazyNode((LazyNode*)node, area);
+        // a page that could not be read is left untouched
+        if (node->getNodeType() == Node::LAZY)
+            return node;
+    }
+    if (node->getNodeType() != Node::INNER)
+    {
+        if (node->rayIntersectUpdate(area, ray, intersection))
+            hit = true;
+        return node;
+    }
+    InnerNode* innerNode = (InnerNode*)node;
+    Area subAreas[8];
+    area.getSubAreas(subAreas);
+    // flipping the child index bits of the negative ray directions yields a front to back order
+    int flipMask = (ray.sign[0] << 2) | (ray.sign[1] << 1) | ray.sign[2];
+    for (int i = 0; i < 8; i++)
+    {
+        int child = i ^ flipMask;
+        innerNode->m_Children[child] = rayIntersectLazy(innerNode->m_Children[child], subAreas[child], ray, intersection, hit);
+    }
+    return node;
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::forEachChild(const Area& area, const std::function<void(int)>& function)
+{
+    if (!m_ThreadPool || m_RootArea.m_SizeExpo - area.m_SizeExpo >= m_MaxTaskDepth)
+    {
+        for (int i = 0; i < 8; i++)
+            function(i);
+        return;
+    }
+    ThreadPool::TaskGroup tasks(*m_ThreadPool);
+    for (int i = 1; i < 8; i++)
+        tasks.run([&function, i]() { function(i); });
+    function(0);
+    tasks.wait();
+}
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::intersect(Node* node, const SolidGeometry& implicitSDF, const Area& area)
+{
+    if (m_PageRegion && !area.toAABB().intersectsAABB(*m_PageRegion))
+        return node;
+    bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
+    // unevaluated nodes are only expanded where the other surface passes through
+    if (needsSubdivision && node->getNodeType() == Node::LAZY)
+    {
+        node = expandLazyNode((LazyNode*)node, area);
+        // a page that could not be read is left untouched
+        if (node->getNodeType() == Node::LAZY)
+            return node;
+    }
+    if (needsSubdivision && node->getNodeType() == Node::GRID && area.m_SizeExpo > LEAF_EXPO)
+    {
+        // the other surface passes through a coarse leaf
+        Node* refinedNode = refineLeaf((GridNodeImpl*)node, area);
+        Node::release(node);
+        node = refinedNode;
+    }
+    if (node->getNodeType() == Node::INNER && needsSubdivision)
+    {
+        node = unshareNode(node);
+        InnerNode* innerNode = (InnerNode*)node;
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        for (int i = 0; i < 8; i++)
+            innerNode->m_Children[i] = intersect(innerNode->m_Children[i], implicitSDF, subAreas[i]);
+        return collapseNode(node, area);
+    }
+    if (!needsSubdivision)
+    {
+        if (implicitSDF.getSign(area.getCornerVecs(0).second))
+            return node;
+        if (node->getNodeType() != Node::EMPTY)
+            markDirty(area);
+        Node::release(node);
+        return new (*m_Arena) EmptyNode(area, implicitSDF);
+    }
+    if (node->getNodeType() == Node::EMPTY)
+    {
+        EmptyNode* emptyNode = (EmptyNode*)node;
+        if (!emptyNode->m_Sign)
+            return node;
+        if (isAbovePageSize(area))
+            return intersect(splitEmptyNode(emptyNode), implicitSDF, area);
+        markDirty(area);
+        Node::release(node);
+        return simplifyNode(createNode(area, implicitSDF), area);
+
+    }
+
+    node = unshareNode(node);
     GridNodeImpl* gridNode = (GridNodeImpl*)node;
     gridNode->intersect(this, area, implicitSDF);
-    return node;
+    markDirty(area);
+    return collapseNode(node, area);
 }
 
-OctreeSF::Node* OctreeSF::merge(Node* node, const SolidGeometry& implicitSDF, const Area& area)
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::merge(Node* node, const SolidGeometry& implicitSDF, const Area& area)
 {
+    if (m_PageRegion && !area.toAABB().intersectsAABB(*m_PageRegion))
+        return node;
     bool needsSubdivision = implicitSDF.cubeNeedsSubdivision(area);
+    // unevaluated nodes are only expanded where the other surface passes through
+    if (needsSubdivision && node->getNodeType() == Node::LAZY)
+    {
+        node = expandLazyNode((LazyNode*)node, area);
+        // a page that could not be read is left untouched
+        if (node->getNodeType() == Node::LAZY)
+            return node;
+    }
+    if (needsSubdivision && node->getNodeType() == Node::GRID && area.m_SizeExpo > LEAF_EXPO)
+    {
+        // the other surface passes through a coarse leaf
+        Node* refinedNode = refineLeaf((GridNodeImpl*)node, area);
+        Node::release(node);
+        node = refinedNode;
+    }
     if (node->getNodeType() == Node::INNER && needsSubdivision)
     {
+        node = unshareNode(node);
         InnerNode* innerNode = (InnerNode*)node;
         Area subAreas[8];
         area.getSubAreas(subAreas);
         for (int i = 0; i < 8; i++)
             innerNode->m_Children[i] = merge(innerNode->m_Children[i], implicitSDF, subAreas[i]);
-        return node;
+        return collapseNode(node, area);
     }
     if (!needsSubdivision)
     {
         if (!implicitSDF.getSign(area.getCornerVecs(0).second))
             return node;
-        delete node;
+        if (node->getNodeType() != Node::EMPTY)
+            markDirty(area);
+        Node::release(node);
         return createNode(area, implicitSDF);
     }
     if (node->getNodeType() == Node::EMPTY)
@@ -811,332 +1854,1778 @@ OctreeSF::Node* OctreeSF::merge(Node* node, const SolidGeometry& implicitSDF, co
         EmptyNode* emptyNode = (EmptyNode*)node;
         if (emptyNode->m_Sign)
             return node;
-        delete node;
-        return createNode(area, implicitSDF);
+        if (isAbovePageSize(area))
+            return merge(splitEmptyNode(emptyNode), implicitSDF, area);
+        markDirty(area);
+        Node::release(node);
+        return simplifyNode(createNode(area, implicitSDF), area);
+    }
+
+    node = unshareNode(node);
+    GridNodeImpl* gridNode = (GridNodeImpl*)node;
+    gridNode->merge(this, area, implicitSDF);
+    markDirty(area);
+    return collapseNode(node, area);
+}
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::intersectAlignedNode(Node* node, Node* otherNode, const Area& area)
+{
+    if (m_PageRegion && !area.toAABB().intersectsAABB(*m_PageRegion))
+        return node;
+    // the other octree was materialized, its remaining placeholders are pages that could not be read
+    if (otherNode->getNodeType() == Node::LAZY)
+    {
+        m_NumSkippedOperandNodes++;
+        return node;
+    }
+    if (node->getNodeType() == Node::LAZY && otherNode->getNodeType() != Node::EMPTY)
+    {
+        node = expandLazyNode((LazyNode*)node, area);
+        // a page that could not be read is left untouched
+        if (node->getNodeType() == Node::LAZY)
+            return node;
+    }
+    // coarse leaves of adaptive octrees are refined if the other node is subdivided
+    if (node->getNodeType() == Node::GRID && otherNode->getNodeType() == Node::INNER)
+    {
+        Node* refinedNode = refineLeaf((GridNodeImpl*)node, area);
+        Node::release(node);
+        node = refinedNode;
+    }
+    if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::GRID)
+    {
+        Node* refinedOtherNode = refineLeaf((GridNodeImpl*)otherNode, area);
+        node = intersectAlignedNode(node, refinedOtherNode, area);
+        delete refinedOtherNode;
+        return node;
+    }
+    if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::INNER)
+    {
+        node = unshareNode(node);
+        InnerNode* innerNode = (InnerNode*)node;
+        InnerNode* otherInnerNode = (InnerNode*)otherNode;
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        for (int i = 0; i < 8; i++)
+            innerNode->m_Children[i] = intersectAlignedNode(innerNode->m_Children[i], otherInnerNode->m_Children[i], subAreas[i]);
+        return collapseNode(node, area);
+    }
+    if (otherNode->getNodeType() == Node::EMPTY)
+    {
+        EmptyNode* otherEmptyNode = (EmptyNode*)otherNode;
+        if (otherEmptyNode->m_Sign)
+            return node;
+        if (node->getNodeType() != Node::EMPTY)
+            markDirty(area);
+        Node::release(node);
+        return otherNode->clone(*m_Arena);
+    }
+    if (node->getNodeType() == Node::EMPTY)
+    {
+        EmptyNode* emptyNode = (EmptyNode*)node;
+        if (!emptyNode->m_Sign)
+            return node;
+        if (isAbovePageSize(area) && otherNode->getNodeType() == Node::INNER)
+            return intersectAlignedNode(splitEmptyNode(emptyNode), otherNode, area);
+        markDirty(area);
+        Node::release(node);
+        return simplifyNode(otherNode->clone(*m_Arena), area);
+
+    }
+
+    node = unshareNode(node);
+    GridNodeImpl* gridNode = (GridNodeImpl*)node;
+    gridNode->intersect((GridNodeImpl*)otherNode, area);
+    markDirty(area);
+    return collapseNode(node, area);
+}
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::subtractAlignedNode(Node* node, Node* otherNode, const Area& area)
+{
+    if (m_PageRegion && !area.toAABB().intersectsAABB(*m_PageRegion))
+        return node;
+    // the other octree was materialized, its remaining placeholders are pages that could not be read
+    if (otherNode->getNodeType() == Node::LAZY)
+    {
+        m_NumSkippedOperandNodes++;
+        return node;
+    }
+    if (node->getNodeType() == Node::LAZY && otherNode->getNodeType() != Node::EMPTY)
+    {
+        node = expandLazyNode((LazyNode*)node, area);
+        // a page that could not be read is left untouched
+        if (node->getNodeType() == Node::LAZY)
+            return node;
+    }
+    // coarse leaves of adaptive octrees are refined if the other node is subdivided
+    if (node->getNodeType() == Node::GRID && otherNode->getNodeType() == Node::INNER)
+    {
+        Node* refinedNode = refineLeaf((GridNodeImpl*)node, area);
+        Node::release(node);
+        node = refinedNode;
+    }
+    if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::GRID)
+    {
+        Node* refinedOtherNode = refineLeaf((GridNodeImpl*)otherNode, area);
+        node = subtractAlignedNode(node, refinedOtherNode, area);
+        delete refinedOtherNode;
+        return node;
+    }
+    if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::INNER)
+    {
+        node = unshareNode(node);
+        InnerNode* innerNode = (InnerNode*)node;
+        InnerNode* otherInnerNode = (InnerNode*)otherNode;
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        for (int i = 0; i < 8; i++)
+            innerNode->m_Children[i] = subtractAlignedNode(innerNode->m_Children[i], otherInnerNode->m_Children[i], subAreas[i]);
+        return collapseNode(node, area);
+    }
+    if (otherNode->getNodeType() == Node::EMPTY)
+    {
+        EmptyNode* otherEmptyNode = (EmptyNode*)otherNode;
+        if (!otherEmptyNode->m_Sign)
+            return node;
+        if (node->getNodeType() != Node::EMPTY)
+            markDirty(area);
+        Node::release(node);
+        Node* inverted = otherNode->clone(*m_Arena);
+        inverted->invert();
+        return inverted;
+    }
+    if (node->getNodeType() == Node::EMPTY)
+    {
+        EmptyNode* emptyNode = (EmptyNode*)node;
+        if (!emptyNode->m_Sign)
+            return node;
+        if (isAbovePageSize(area) && otherNode->getNodeType() == Node::INNER)
+            return subtractAlignedNode(splitEmptyNode(emptyNode), otherNode, area);
+        markDirty(area);
+        Node::release(node);
+        Node* inverted = simplifyNode(otherNode->clone(*m_Arena), area);
+        inverted->invert();
+        return inverted;
+
+    }
+
+    node = unshareNode(node);
+    GridNodeImpl* gridNode = (GridNodeImpl*)node;
+    gridNode->subtract((GridNodeImpl*)otherNode, area);
+    markDirty(area);
+    return collapseNode(node, area);
+}
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::mergeAlignedNode(Node* node, Node* otherNode, const Area& area)
+{
+    if (m_PageRegion && !area.toAABB().intersectsAABB(*m_PageRegion))
+        return node;
+    // the other octree was materialized, its remaining placeholders are pages that could not be read
+    if (otherNode->getNodeType() == Node::LAZY)
+    {
+        m_NumSkippedOperandNodes++;
+        return node;
+    }
+    if (node->getNodeType() == Node::LAZY && otherNode->getNodeType() != Node::EMPTY)
+    {
+        node = expandLazyNode((LazyNode*)node, area);
+        // a page that could not be read is left untouched
+        if (node->getNodeType() == Node::LAZY)
+            return node;
+    }
+    // coarse leaves of adaptive octrees are refined if the other node is subdivided
+    if (node->getNodeType() == Node::GRID && otherNode->getNodeType() == Node::INNER)
+    {
+        Node* refinedNode = refineLeaf((GridNodeImpl*)node, area);
+        Node::release(node);
+        node = refinedNode;
+    }
+    if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::GRID)
+    {
+        Node* refinedOtherNode = refineLeaf((GridNodeImpl*)otherNode, area);
+        node = mergeAlignedNode(node, refinedOtherNode, area);
+        delete refinedOtherNode;
+        return node;
+    }
+    if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::INNER)
+    {
+        node = unshareNode(node);
+        InnerNode* innerNode = (InnerNode*)node;
+        InnerNode* otherInnerNode = (InnerNode*)otherNode;
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        for (int i = 0; i < 8; i++)
+            innerNode->m_Children[i] = mergeAlignedNode(innerNode->m_Children[i], otherInnerNode->m_Children[i], subAreas[i]);
+        return collapseNode(node, area);
+    }
+    if (otherNode->getNodeType() == Node::EMPTY)
+    {
+        EmptyNode* otherEmptyNode = (EmptyNode*)otherNode;
+        if (!otherEmptyNode->m_Sign)
+            return node;
+        if (node->getNodeType() != Node::EMPTY)
+            markDirty(area);
+        Node::release(node);
+        return otherNode->clone(*m_Arena);
+    }
+    if (node->getNodeType() == Node::EMPTY)
+    {
+        EmptyNode* emptyNode = (EmptyNode*)node;
+        if (emptyNode->m_Sign)
+            return node;
+        if (isAbovePageSize(area) && otherNode->getNodeType() == Node::INNER)
+            return mergeAlignedNode(splitEmptyNode(emptyNode), otherNode, area);
+        markDirty(area);
+        Node::release(node);
+        return simplifyNode(otherNode->clone(*m_Arena), area);
+    }
+
+    node = unshareNode(node);
+    GridNodeImpl* gridNode = (GridNodeImpl*)node;
+    gridNode->merge((GridNodeImpl*)otherNode, area);
+    markDirty(area);
+    return collapseNode(node, area);
+}
+
+template<int LeafExpo>
+std::shared_ptr<OctreeSFT<LeafExpo> > OctreeSFT<LeafExpo>::sampleSDF(SolidGeometry* otherSDF, int maxDepth)
+{
+    AABB aabb = otherSDF->getAABB();
+    aabb.addEpsilon(0.0001f);
+    return sampleSDF(otherSDF, aabb, maxDepth);
+}
+
+template<int LeafExpo>
+std::shared_ptr<OctreeSFT<LeafExpo> > OctreeSFT<LeafExpo>::sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth)
+{
+    auto ts = Profiler::timestamp();
+    std::shared_ptr<OctreeSFT> octreeSF = std::make_shared<OctreeSFT>();
+    Ogre::Vector3 aabbSize = aabb.getMax() - aabb.getMin();
+    float cubeSize = std::max(std::max(aabbSize.x, aabbSize.y), aabbSize.z);
+    octreeSF->m_CellSize = cubeSize / (1 << maxDepth);
+    otherSDF->prepareSampling(aabb, octreeSF->m_CellSize);
+    octreeSF->m_RootArea = Area(Vector3i(0, 0, 0), maxDepth, aabb.getMin(), cubeSize);
+    octreeSF->sampleRootNode(*otherSDF);
+    Profiler::printJobDuration("OctreeSF::sampleSDF", ts);
+    return octreeSF;
+}
+
+template<int LeafExpo>
+std::shared_ptr<OctreeSFT<LeafExpo> > OctreeSFT<LeafExpo>::sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, ThreadPool* threadPool, int maxTaskDepth)
+{
+    auto ts = Profiler::timestamp();
+    std::shared_ptr<OctreeSFT> octreeSF = std::make_shared<OctreeSFT>();
+    Ogre::Vector3 aabbSize = aabb.getMax() - aabb.getMin();
+    float cubeSize = std::max(std::max(aabbSize.x, aabbSize.y), aabbSize.z);
+    octreeSF->m_CellSize = cubeSize / (1 << maxDepth);
+    otherSDF->prepareSampling(aabb, octreeSF->m_CellSize);
+    octreeSF->m_RootArea = Area(Vector3i(0, 0, 0), maxDepth, aabb.getMin(), cubeSize);
+    octreeSF->setThreadPool(threadPool, maxTaskDepth);
+    octreeSF->sampleRootNode(*otherSDF);
+    Profiler::printJobDuration("OctreeSF::sampleSDF (parallel)", ts);
+    return octreeSF;
+}
+
+template<int LeafExpo>
+std::shared_ptr<OctreeSFT<LeafExpo> > OctreeSFT<LeafExpo>::sampleSDFAdaptive(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, float maxError, ThreadPool* threadPool, int maxTaskDepth)
+{
+    auto ts = Profiler::timestamp();
+    std::shared_ptr<OctreeSFT> octreeSF = std::make_shared<OctreeSFT>();
+    Ogre::Vector3 aabbSize = aabb.getMax() - aabb.getMin();
+    float cubeSize = std::max(std::max(aabbSize.x, aabbSize.y), aabbSize.z);
+    octreeSF->m_CellSize = cubeSize / (1 << maxDepth);
+    otherSDF->prepareSampling(aabb, octreeSF->m_CellSize);
+    octreeSF->m_RootArea = Area(Vector3i(0, 0, 0), maxDepth, aabb.getMin(), cubeSize);
+    octreeSF->m_MaxLeafError = maxError;
+    octreeSF->setThreadPool(threadPool, maxTaskDepth);
+    octreeSF->sampleRootNode(*otherSDF);
+    Profiler::printJobDuration("OctreeSF::sampleSDFAdaptive", ts);
+    return octreeSF;
+}
+
+template<int LeafExpo>
+std::shared_ptr<OctreeSFT<LeafExpo> > OctreeSFT<LeafExpo>::sampleSDFLazy(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth)
+{
+    std::shared_ptr<OctreeSFT> octreeSF = std::make_shared<OctreeSFT>();
+    Ogre::Vector3 aabbSize = aabb.getMax() - aabb.getMin();
+    float cubeSize = std::max(std::max(aabbSize.x, aabbSize.y), aabbSize.z);
+    octreeSF->m_CellSize = cubeSize / (1 << maxDepth);
+    otherSDF->prepareSampling(aabb, octreeSF->m_CellSize);
+    octreeSF->m_RootArea = Area(Vector3i(0, 0, 0), maxDepth, aabb.getMin(), cubeSize);
+    octreeSF->m_RootNode = new (*octreeSF->m_Arena) LazyNode(otherSDF);
+    octreeSF->m_HasLazyNodes = true;
+    return octreeSF;
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::materialize(const AABB& region)
+{
+    if (m_HasLazyNodes || m_Pager)
+        m_RootNode = expandLazyNodes(m_RootNode, m_RootArea, region);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::materialize()
+{
+    if (m_HasLazyNodes)
+        m_RootNode = expandLazyNodes(m_RootNode, m_RootArea, m_RootArea.toAABB());
+    m_HasLazyNodes = false;
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::sampleRootNode(const SolidGeometry& implicitSDF)
+{
+    SignFaceCache faceCache;
+    m_SignFaceCache = &faceCache;
+    m_RootNode = createNode(m_RootArea, implicitSDF);
+    m_SignFaceCache = nullptr;
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::setThreadPool(ThreadPool* threadPool, int maxTaskDepth)
+{
+    m_ThreadPool = threadPool;
+    m_MaxTaskDepth = maxTaskDepth;
+}
+
+template<int LeafExpo>
+float OctreeSFT<LeafExpo>::getInverseCellSize()
+{
+    return (float)(1 << m_RootArea.m_SizeExpo) / m_RootArea.m_RealSize;
+}
+
+template<int LeafExpo>
+AABB OctreeSFT<LeafExpo>::getAABB() const
+{
+    return m_RootArea.toAABB();
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::generateVerticesAndIndices(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+    materialize();
+    if (m_Pager)
+    {
+        // the resident leaves are counted once, the reservation only needs an estimate
+        int numLeaves = countLeaves();
+        // each page is meshed with its neighbors resident, vertices of leaves on page boundaries are generated for both pages
+        forEachPage(*m_Pager, false, nullptr, [&](int page)
+        {
+            if (!m_Pager->hasContent(page))
+                return;
+            AABB expandedRegion = *m_PageRegion;
+            expandedRegion.addEpsilon(m_CellSize * LEAF_SIZE_1D_INNER);
+            materialize(expandedRegion);
+            generateVerticesAndIndices(vertices, indices, m_PageRegion, numLeaves);
+        });
+    }
+    else generateVerticesAndIndices(vertices, indices, nullptr, countLeaves());
+    std::cout << "Generated " << vertices.size() << " vertices and " << indices.size() << " indices." << std::endl;
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::generateVerticesAndIndices(vector<Vertex>& vertices, vector<unsigned int>& indices, const AABB* region, int numLeaves)
+{
+    auto tsTotal = Profiler::timestamp();
+    // the quads on the region boundary also use the vertices of the neighboring leaves
+    AABB expandedRegion;
+    const AABB* vertexRegion = nullptr;
+    if (region)
+    {
+        expandedRegion = *region;
+        expandedRegion.addEpsilon(m_CellSize * LEAF_SIZE_1D_INNER);
+        vertexRegion = &expandedRegion;
+    }
+    auto inRegion = [](const GridNode* node, const AABB* aabb) { return !aabb || node->m_Area.toAABB().intersectsAABB(*aabb); };
+    // paged meshing runs once per page, only meshing of the whole octree reports its phases
+    bool reportPhases = (region == nullptr);
+    vertices.reserve(numLeaves * LEAF_SIZE_2D_INNER * 2);	// reasonable upper bound
+    (*m_MeshGeneration)++;
+    bool hasCoarseLeaves = false;
+    m_RootNode->forEachSurfaceNode([&](GridNode* node)
+    {
+        if (!inRegion(node, vertexRegion))
+            return;
+        node->generateVerticesDC(vertices);
+        hasCoarseLeaves |= (node->m_Area.m_SizeExpo > LEAF_EXPO);
+    });
+    if (reportPhases)
+        Profiler::printJobDuration("generateVertices", tsTotal);
+
+    if (hasCoarseLeaves)
+    {
+        // leaves of different sizes are not aligned, the cells around boundary edges are looked up in the tree
+        indices.reserve(numLeaves * LEAF_SIZE_2D_INNER * 8);
+        int numMissingNeighbors = 0;
+        m_RootNode->forEachSurfaceNode([&](GridNode* node)
+        {
+            if (inRegion(node, region))
+                numMissingNeighbors += node->generateIndicesAdaptive(this, indices);
+        });
+        if (numMissingNeighbors)
+            std::cout << "[OctreeSF::generateIndicesAdaptive] Could not find required neighbors for " << numMissingNeighbors << " surface edges!" << std::endl;
+        if (reportPhases)
+            Profiler::printJobDuration("generateVerticesAndIndices", tsTotal);
+        return;
+    }
+
+    auto tsFaceTraversal = Profiler::timestamp();
+    cacheSurfaceNeighbors(vertexRegion);
+    if (reportPhases)
+        Profiler::printJobDuration("forEachSurfaceFaceAndEdge", tsFaceTraversal);
+
+    // auto tsIndices = Profiler::timestamp();
+    indices.reserve(numLeaves * LEAF_SIZE_2D_INNER * 8);
+    m_RootNode->forEachSurfaceNode(m_RootArea, [&](GridNode* node, const Area& area)
+    {
+        if (inRegion(node, region))
+            node->generateIndicesDC(area, indices, vertices);
+    });
+    // Profiler::printJobDuration("generateIndices", tsIndices);
+    if (reportPhases)
+        Profiler::printJobDuration("generateVerticesAndIndices", tsTotal);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::cacheSurfaceNeighbors(const AABB* vertexRegion)
+{
+    auto inRegion = [](const GridNode* node, const AABB* aabb) { return !aabb || node->m_Area.toAABB().intersectsAABB(*aabb); };
+    // only leaves with fresh vertices cache their neighbors, the cache is cleared by generateVerticesDC
+    m_RootNode->forEachSurfaceFaceAndEdge(
+                [&](const Face& face) {
+        if (!inRegion(face.n1, vertexRegion))
+            return;
+        Vector3i offset(0, 0, 0);
+        offset[face.normalDirection] = 1;
+        face.n1->cacheNeighbor(offset, face.n2); },
+    [&](const Edge& edge) {
+        if (!inRegion(edge.n1, vertexRegion))
+            return;
+        Vector3i offset(1, 1, 1);
+        offset[edge.direction] = 0;
+        edge.n1->cacheNeighbor(offset, edge.n2); });
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::forEachLeaf(Node* node, const Area& area, const Vector3i& minPos, const Vector3i& maxPos, const std::function<void(GridNode*)>& function)
+{
+    for (int d = 0; d < 3; d++)
+    {
+        if (area.m_MaxPos[d] <= minPos[d] || area.m_MinPos[d] >= maxPos[d])
+            return;
+    }
+    if (node->getNodeType() == Node::GRID)
+        function((GridNode*)node);
+    else if (node->getNodeType() == Node::INNER)
+    {
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        for (int i = 0; i < 8; i++)
+            forEachLeaf(((InnerNode*)node)->m_Children[i], subAreas[i], minPos, maxPos, function);
+    }
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::updateIncrementalMesh(IncrementalMesh& incrementalMesh)
+{
+    auto ts = Profiler::timestamp();
+    materialize();
+    vector<Vertex>& vertices = incrementalMesh.mesh->vertexBuffer;
+    vector<unsigned int>& indices = incrementalMesh.mesh->indexBuffer;
+    incrementalMesh.changedVertices.clear();
+    incrementalMesh.changedIndices.clear();
+
+    // the vertices of a leaf only depend on the leaf, its quads also use the cells of the neighbors in positive directions
+    auto writeVertices = [&](GridNode* leaf)
+    {
+        vector<Vertex> leafVertices;
+        leaf->generateVerticesDC(leafVertices);
+        typename IncrementalMesh::LeafRange& range = incrementalMesh.leafRanges[leaf->m_Area.m_MinPos];
+        incrementalMesh.unusedVertices -= range.vertexCapacity - range.numVertices;
+        if (leafVertices.size() > range.vertexCapacity)
+        {
+            incrementalMesh.unusedVertices += range.vertexCapacity;
+            range.firstVertex = vertices.size();
+            range.vertexCapacity = leafVertices.size();
+            vertices.resize(vertices.size() + leafVertices.size());
+        }
+        range.numVertices = leafVertices.size();
+        incrementalMesh.unusedVertices += range.vertexCapacity - range.numVertices;
+        std::copy(leafVertices.begin(), leafVertices.end(), vertices.begin() + range.firstVertex);
+        for (auto i = leaf->m_SurfaceCubes.begin(); i != leaf->m_SurfaceCubes.end(); ++i)
+            i->vertexIndex[0] += (unsigned int)range.firstVertex;
+        if (range.numVertices)
+            incrementalMesh.changedVertices.push_back(std::make_pair(range.firstVertex, range.numVertices));
+    };
+    auto writeIndices = [&](GridNode* leaf)
+    {
+        vector<unsigned int> leafIndices;
+        leaf->generateIndicesDC(leaf->m_Area, leafIndices, vertices);
+        typename IncrementalMesh::LeafRange& range = incrementalMesh.leafRanges[leaf->m_Area.m_MinPos];
+        if (leafIndices.empty() && !range.numIndices)
+            return;
+        incrementalMesh.unusedIndices -= range.indexCapacity - range.numIndices;
+        if (leafIndices.size() > range.indexCapacity)
+        {
+            std::fill(indices.begin() + range.firstIndex, indices.begin() + range.firstIndex + range.indexCapacity, 0);
+            if (range.indexCapacity)
+                incrementalMesh.changedIndices.push_back(std::make_pair(range.firstIndex, range.indexCapacity));
+            incrementalMesh.unusedIndices += range.indexCapacity;
+            range.firstIndex = indices.size();
+            range.indexCapacity = leafIndices.size();
+            indices.resize(indices.size() + leafIndices.size());
+        }
+        range.numIndices = leafIndices.size();
+        incrementalMesh.unusedIndices += range.indexCapacity - range.numIndices;
+        std::copy(leafIndices.begin(), leafIndices.end(), indices.begin() + range.firstIndex);
+        std::fill(indices.begin() + range.firstIndex + range.numIndices, indices.begin() + range.firstIndex + range.indexCapacity, 0);
+        incrementalMesh.changedIndices.push_back(std::make_pair(range.firstIndex, range.indexCapacity));
+    };
+
+    m_TrackDirtyAreas = true;
+    if (!incrementalMesh.meshGeneration || incrementalMesh.meshGeneration != *m_MeshGeneration || m_MaxLeafError > 0.0f || m_Pager
+        || incrementalMesh.unusedVertices > vertices.size() / 2 || incrementalMesh.unusedIndices > indices.size() / 2)
+    {
+        m_DirtyAreas.clear();
+        incrementalMesh.leafRanges.clear();
+        incrementalMesh.unusedVertices = 0;
+        incrementalMesh.unusedIndices = 0;
+        vertices.clear();
+        indices.clear();
+        if (m_MaxLeafError > 0.0f || m_Pager)
+        {
+            // coarse leaves and pages are not tracked per leaf
+            generateVerticesAndIndices(vertices, indices);
+        }
+        else
+        {
+            (*m_MeshGeneration)++;
+            m_RootNode->forEachSurfaceNode(writeVertices);
+            cacheSurfaceNeighbors(nullptr);
+            m_RootNode->forEachSurfaceNode(writeIndices);
+        }
+        incrementalMesh.meshGeneration = *m_MeshGeneration;
+        incrementalMesh.rebuilt = true;
+        incrementalMesh.changedVertices.assign(1, std::make_pair((size_t)0, vertices.size()));
+        incrementalMesh.changedIndices.assign(1, std::make_pair((size_t)0, indices.size()));
+        Profiler::printJobDuration("updateIncrementalMesh (rebuild)", ts);
+        return;
+    }
+    incrementalMesh.rebuilt = false;
+
+    // new vertices for the leaves in the dirty areas, the ranges of removed leaves are released
+    std::unordered_set<GridNode*> dirtyLeaves;
+    for (auto area = m_DirtyAreas.begin(); area != m_DirtyAreas.end(); ++area)
+        forEachLeaf(m_RootNode, m_RootArea, area->m_MinPos, area->m_MaxPos, [&](GridNode* leaf) { dirtyLeaves.insert(leaf); });
+    std::unordered_set<Vector3i> dirtyPositions;
+    for (auto leaf = dirtyLeaves.begin(); leaf != dirtyLeaves.end(); ++leaf)
+        dirtyPositions.insert((*leaf)->m_Area.m_MinPos);
+    auto releaseRange = [&](const Vector3i& pos)
+    {
+        auto range = incrementalMesh.leafRanges.find(pos);
+        if (range == incrementalMesh.leafRanges.end() || dirtyPositions.find(pos) != dirtyPositions.end())
+            return;
+        std::fill(indices.begin() + range->second.firstIndex, indices.begin() + range->second.firstIndex + range->second.indexCapacity, 0);
+        if (range->second.indexCapacity)
+            incrementalMesh.changedIndices.push_back(std::make_pair(range->second.firstIndex, range->second.indexCapacity));
+        // the whole slot is abandoned, its slack was already counted as unused while the leaf was alive
+        incrementalMesh.unusedVertices -= range->second.vertexCapacity - range->second.numVertices;
+        incrementalMesh.unusedVertices += range->second.vertexCapacity;
+        incrementalMesh.unusedIndices -= range->second.indexCapacity - range->second.numIndices;
+        incrementalMesh.unusedIndices += range->second.indexCapacity;
+        incrementalMesh.leafRanges.erase(range);
+    };
+    for (auto area = m_DirtyAreas.begin(); area != m_DirtyAreas.end(); ++area)
+    {
+        Vector3i pos;
+        for (pos.x = area->m_MinPos.x; pos.x < area->m_MaxPos.x; pos.x += LEAF_SIZE_1D_INNER)
+        {
+            for (pos.y = area->m_MinPos.y; pos.y < area->m_MaxPos.y; pos.y += LEAF_SIZE_1D_INNER)
+            {
+                for (pos.z = area->m_MinPos.z; pos.z < area->m_MaxPos.z; pos.z += LEAF_SIZE_1D_INNER)
+                    releaseRange(pos);
+            }
+        }
+    }
+    for (auto leaf = dirtyLeaves.begin(); leaf != dirtyLeaves.end(); ++leaf)
+        writeVertices(*leaf);
+
+    // new quads for the dirty leaves and the leaves before them in x, y or z, which use their cells
+    std::unordered_set<GridNode*> remeshedLeaves;
+    for (auto area = m_DirtyAreas.begin(); area != m_DirtyAreas.end(); ++area)
+    {
+        Vector3i minPos = area->m_MinPos - Vector3i(LEAF_SIZE_1D_INNER, LEAF_SIZE_1D_INNER, LEAF_SIZE_1D_INNER);
+        forEachLeaf(m_RootNode, m_RootArea, minPos, area->m_MaxPos, [&](GridNode* leaf) { remeshedLeaves.insert(leaf); });
+    }
+    static const Vector3i neighborOffsets[6] = { Vector3i(1, 0, 0), Vector3i(0, 1, 0), Vector3i(0, 0, 1), Vector3i(0, 1, 1), Vector3i(1, 0, 1), Vector3i(1, 1, 0) };
+    for (auto leaf = remeshedLeaves.begin(); leaf != remeshedLeaves.end(); ++leaf)
+    {
+        (*leaf)->m_CachedNeighbors.clear();
+        for (int i = 0; i < 6; i++)
+        {
+            const GridNode* neighbor = findLeaf((*leaf)->m_Area.m_MinPos + neighborOffsets[i] * LEAF_SIZE_1D_INNER);
+            if (neighbor)
+                (*leaf)->cacheNeighbor(neighborOffsets[i], const_cast<GridNode*>(neighbor));
+        }
+        writeIndices(*leaf);
+    }
+    m_DirtyAreas.clear();
+    incrementalMesh.meshGeneration = *m_MeshGeneration;
+    Profiler::printJobDuration("updateIncrementalMesh", ts);
+}
+
+template<int LeafExpo>
+std::shared_ptr<Mesh> OctreeSFT<LeafExpo>::generateMesh()
+{
+    auto ts = Profiler::timestamp();
+    std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+    generateVerticesAndIndices(mesh->vertexBuffer, mesh->indexBuffer);
+    // mesh->computeTriangleNormals();
+    // mesh->computeVertexNormals();
+    Profiler::printJobDuration("generateMesh", ts);
+    return mesh;
+}
+
+template<int LeafExpo>
+std::shared_ptr<Mesh> OctreeSFT<LeafExpo>::generateMesh(const AABB& region)
+{
+    auto ts = Profiler::timestamp();
+    AABB expandedRegion = region;
+    expandedRegion.addEpsilon(m_CellSize * LEAF_SIZE_1D_INNER);
+    materialize(expandedRegion);
+    std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+    generateVerticesAndIndices(mesh->vertexBuffer, mesh->indexBuffer, &region, countLeaves());
+    if (m_Pager)
+        m_Pager->enforceBudget();
+    Profiler::printJobDuration("generateMesh (region)", ts);
+    return mesh;
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::rayIntersectClosest(const Ray& ray, Ray::Intersection& intersection)
+{
+    intersection.t = std::numeric_limits<float>::max();
+    if (m_HasLazyNodes || m_Pager)
+    {
+        bool hit = false;
+        m_RootNode = rayIntersectLazy(m_RootNode, m_RootArea, ray, intersection, hit);
+        if (m_Pager)
+            m_Pager->enforceBudget();
+        return hit;
+    }
+    return m_RootNode->rayIntersectUpdate(m_RootArea, ray, intersection);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::rayIntersectClosestBatch(const std::vector<Ray>& rays, Ray::BatchResult& result)
+{
+    rayIntersectBatch(rays, std::numeric_limits<float>::max(), false, result);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::rayIntersectAnyBatch(const std::vector<Ray>& rays, float maxDist, Ray::BatchResult& result)
+{
+    rayIntersectBatch(rays, maxDist, true, result);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::rayIntersectBatch(const std::vector<Ray>& rays, float maxDist, bool anyHit, Ray::BatchResult& result)
+{
+    result.resize(rays.size());
+    if (m_HasLazyNodes || m_Pager)
+    {
+        // unevaluated and paged out nodes are expanded ray by ray
+        for (size_t i = 0; i < rays.size(); i++)
+        {
+            Ray::Intersection intersection;
+            intersection.t = maxDist;
+            bool hit = false;
+            m_RootNode = rayIntersectLazy(m_RootNode, m_RootArea, rays[i], intersection, hit);
+            if (m_Pager)
+                m_Pager->enforceBudget();
+            if (!hit) continue;
+            result.hit[i] = 1;
+            result.t[i] = intersection.t;
+            result.userData[i] = intersection.userData[0];
+        }
+        return;
+    }
+    std::vector<unsigned int> order;
+    RayPacket::sortCoherent(rays, order);
+    for (size_t first = 0; first < rays.size(); first += RayPacket::SIZE)
+    {
+        RayPacket packet(rays, &order[first], (int)std::min(rays.size() - first, (size_t)RayPacket::SIZE), maxDist);
+        Ray::Intersection intersections[RayPacket::SIZE];
+        unsigned char hits[RayPacket::SIZE] = {};
+        for (int i = 0; i < RayPacket::SIZE; i++)
+            intersections[i].t = maxDist;
+        rayIntersectPacket(m_RootNode, m_RootArea, packet, packet.getMask(), anyHit, intersections, hits);
+        for (int i = 0; i < packet.size; i++)
+        {
+            if (!hits[i]) continue;
+            result.hit[order[first + i]] = 1;
+            result.t[order[first + i]] = intersections[i].t;
+            result.userData[order[first + i]] = intersections[i].userData[0];
+        }
+    }
+}
+
+template<int LeafExpo>
+unsigned int OctreeSFT<LeafExpo>::rayIntersectPacket(Node* node, const Area& area, RayPacket& packet, unsigned int mask, bool anyHit, Ray::Intersection* intersections, unsigned char* hits)
+{
+    if (node->getNodeType() == Node::EMPTY)
+        return mask;
+    AABB aabb = area.toAABB();
+    unsigned int activeMask = packet.intersectAABB(aabb.min, aabb.max, mask);
+    if (!activeMask)
+        return mask;
+    unsigned int remainingMask = mask & ~activeMask;
+    if (node->getNodeType() == Node::INNER && !RayPacket::isSingleRay(activeMask))
+    {
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        const Ray& firstRay = *packet.rays[RayPacket::getFirstRay(activeMask)];
+        int flipMask = (firstRay.sign[0] << 2) | (firstRay.sign[1] << 1) | firstRay.sign[2];
+        for (int i = 0; i < 8 && activeMask; i++)
+            activeMask = rayIntersectPacket(((InnerNode*)node)->m_Children[i ^ flipMask], subAreas[i ^ flipMask], packet, activeMask, anyHit, intersections, hits);
+        return remainingMask | activeMask;
+    }
+    // leaves and single rays are traversed ray by ray
+    for (int i = 0; i < packet.size; i++)
+    {
+        if (!(activeMask & (1u << i)) || !node->rayIntersectUpdate(area, *packet.rays[i], intersections[i]))
+            continue;
+        hits[i] = 1;
+        packet.tFar[i] = intersections[i].t;
+        if (anyHit)
+            activeMask &= ~(1u << i);
+    }
+    return remainingMask | activeMask;
+}
+
+template<int LeafExpo>
+const typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::findNode(const Ogre::Vector3& point, Area& area) const
+{
+    if (!m_RootArea.toAABB().containsPoint(point))
+        return nullptr;
+    const Node* node = m_RootNode;
+    area = m_RootArea;
+    while (node->getNodeType() == Node::INNER)
+    {
+        Ogre::Vector3 center = area.m_MinRealPos + Ogre::Vector3(area.m_RealSize * 0.5f);
+        int child = ((point.x >= center.x) << 2) | ((point.y >= center.y) << 1) | (point.z >= center.z);
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        area = subAreas[child];
+        node = ((const InnerNode*)node)->m_Children[child];
+    }
+    return node;
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::intersectsSurface(const Node* node, const Area& area, const AABB& aabb) const
+{
+    if (!area.toAABB().intersectsAABB(aabb))
+        return false;
+    switch (node->getNodeType())
+    {
+    case Node::INNER:
+    {
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        for (int i = 0; i < 8; i++)
+        {
+            if (intersectsSurface(((const InnerNode*)node)->m_Children[i], subAreas[i], aabb))
+                return true;
+        }
+        return false;
+    }
+    case Node::GRID:
+        return ((const GridNode*)node)->intersectsSurface(area, aabb);
+    case Node::LAZY:
+    {
+        const LazyNode* lazyNode = (const LazyNode*)node;
+        return !lazyNode->m_SDF || lazyNode->m_SDF->intersectsSurface(aabb);
+    }
+    default:
+        return false;
+    }
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::intersectsSurface(const AABB& aabb) const
+{
+    return intersectsSurface(m_RootNode, m_RootArea, aabb);
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::getSign(const Ogre::Vector3& point) const
+{
+    Area area;
+    const Node* node = findNode(point, area);
+    if (!node)
+        return false;
+    switch (node->getNodeType())
+    {
+    case Node::EMPTY:
+        return ((const EmptyNode*)node)->m_Sign;
+    case Node::GRID:
+        return ((const GridNode*)node)->getSign(area, point);
+    default:
+    {
+        const LazyNode* lazyNode = (const LazyNode*)node;
+        vAssert(lazyNode->m_Page < 0);
+        return lazyNode->m_SDF && lazyNode->m_SDF->getSign(point) != lazyNode->m_Inverted;
+    }
+    }
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::findClosestSurfacePoint(const Node* node, const Area& area, const Ogre::Vector3& point, float& closestSquaredDistance, Sample& closest) const
+{
+    if (area.toAABB().squaredDistance(point) >= closestSquaredDistance)
+        return false;
+    switch (node->getNodeType())
+    {
+    case Node::INNER:
+    {
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        // the child on the side of the point first, so the others are mostly pruned
+        Ogre::Vector3 center = area.m_MinRealPos + Ogre::Vector3(area.m_RealSize * 0.5f);
+        int nearestChild = ((point.x >= center.x) << 2) | ((point.y >= center.y) << 1) | (point.z >= center.z);
+        bool found = false;
+        for (int i = 0; i < 8; i++)
+            found |= findClosestSurfacePoint(((const InnerNode*)node)->m_Children[nearestChild ^ i], subAreas[nearestChild ^ i], point, closestSquaredDistance, closest);
+        return found;
+    }
+    case Node::GRID:
+    {
+        const GridNode* leaf = (const GridNode*)node;
+        const SurfaceEdge* edge = leaf->findClosestSurfaceEdge(area, point, closest.closestSurfacePos, closestSquaredDistance);
+        if (!edge)
+            return false;
+        closest.normal = leaf->getOutwardNormal(*edge);
+        return true;
+    }
+    case Node::LAZY:
+    {
+        const LazyNode* lazyNode = (const LazyNode*)node;
+        vAssert(lazyNode->m_Page < 0);
+        if (!lazyNode->m_SDF)
+            return false;
+        Sample sample;
+        lazyNode->m_SDF->getSample(point, sample);
+        if (sample.signedDistance * sample.signedDistance >= closestSquaredDistance)
+            return false;
+        closestSquaredDistance = sample.signedDistance * sample.signedDistance;
+        closest.closestSurfacePos = sample.closestSurfacePos;
+        closest.normal = lazyNode->m_Inverted ? -sample.normal : sample.normal;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::getSample(const Ogre::Vector3& point, Sample& sample) const
+{
+    Area area;
+    const Node* node = findNode(point, area);
+    const LazyNode* lazyNode = (node && node->getNodeType() == Node::LAZY) ? (const LazyNode*)node : nullptr;
+    vAssert(!lazyNode || lazyNode->m_Page < 0);
+    if (lazyNode && lazyNode->m_SDF)
+    {
+        lazyNode->m_SDF->getSample(point, sample);
+        if (lazyNode->m_Inverted)
+        {
+            sample.signedDistance = -sample.signedDistance;
+            sample.normal = -sample.normal;
+        }
+        return;
+    }
+    // the closest hermite sample may be in any leaf, the search is bounded by the closest one found so far
+    float closestSquaredDistance = std::numeric_limits<float>::max();
+    if (!findClosestSurfacePoint(m_RootNode, m_RootArea, point, closestSquaredDistance, sample))
+    {
+        // the octree has no surface
+        bool sign = getSign(point);
+        sample.signedDistance = sign ? m_RootArea.m_RealSize : -m_RootArea.m_RealSize;
+        sample.closestSurfacePos = point;
+        sample.normal = Ogre::Vector3(0, 0, 0);
+        return;
+    }
+    bool sign = false;
+    if (node && node->getNodeType() == Node::EMPTY)
+        sign = ((const EmptyNode*)node)->m_Sign;
+    else if (node && node->getNodeType() == Node::GRID && !((const GridNode*)node)->getUniformCellSign(area, point, sign))
+        sign = sample.normal.dotProduct(point - sample.closestSurfacePos) < 0.0f;
+    float distance = std::sqrt(closestSquaredDistance);
+    sample.signedDistance = sign ? distance : -distance;
+}
+
+template<int LeafExpo>
+float OctreeSFT<LeafExpo>::getDistanceLowerBound(const Ogre::Vector3& point, float maxDistance) const
+{
+    Area area;
+    const Node* node = findNode(point, area);
+    if (!node)
+        return std::sqrt(m_RootArea.toAABB().squaredDistance(point));
+    const LazyNode* lazyNode = (node->getNodeType() == Node::LAZY) ? (const LazyNode*)node : nullptr;
+    vAssert(!lazyNode || lazyNode->m_Page < 0);
+    if (lazyNode)
+        return lazyNode->m_SDF ? lazyNode->m_SDF->getDistanceLowerBound(point, maxDistance) : 0.0f;
+    // the marching cubes triangles of a leaf may reach a cell beyond the sign changes, also into neighboring nodes
+    AABB aabb = area.toAABB();
+    Ogre::Vector3 toMin = point - aabb.getMin(), toMax = aabb.getMax() - point;
+    float boundaryDistance = std::min(std::min(toMin.x, toMin.y), std::min(std::min(toMin.z, toMax.x), std::min(toMax.y, toMax.z)));
+    float distance = boundaryDistance - m_CellSize;
+    if (node->getNodeType() == Node::GRID)
+    {
+        Ogre::Vector3 closestPos;
+        float leafCellSize = area.m_RealSize / LEAF_SIZE_1D_INNER;
+        if (((const GridNode*)node)->findClosestSurfaceEdge(area, point, closestPos))
+            distance = std::min(distance, closestPos.distance(point) - 2.0f * leafCellSize);
+    }
+    return std::max(distance, 0.0f);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::subtract(SolidGeometry* otherSDF)
+{
+    otherSDF->prepareSampling(m_RootArea.toAABB(), m_CellSize);
+    auto ts = Profiler::timestamp();
+    // Profiler::getSingleton().createJob("computeSigns");
+    OpInvertSDF invertedSDF(otherSDF);
+    if (m_Pager)
+        forEachPage(*m_Pager, true, nullptr, [&](int) { m_RootNode = intersect(m_RootNode, invertedSDF, m_RootArea); });
+    else
+        m_RootNode = intersect(m_RootNode, invertedSDF, m_RootArea);
+    // Profiler::getSingleton().printJobDuration("computeSigns");
+    Profiler::printJobDuration("Subtraction", ts);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::intersect(SolidGeometry* otherSDF)
+{
+    otherSDF->prepareSampling(m_RootArea.toAABB(), m_CellSize);
+    auto ts = Profiler::timestamp();
+    if (m_Pager)
+        forEachPage(*m_Pager, true, nullptr, [&](int) { m_RootNode = intersect(m_RootNode, *otherSDF, m_RootArea); });
+    else
+        m_RootNode = intersect(m_RootNode, *otherSDF, m_RootArea);
+    Profiler::printJobDuration("Intersection", ts);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::merge(SolidGeometry* otherSDF)
+{
+    resize(otherSDF->getAABB());
+    otherSDF->prepareSampling(m_RootArea.toAABB(), m_CellSize);
+    // auto ts = Profiler::timestamp();
+    if (m_Pager)
+        forEachPage(*m_Pager, true, nullptr, [&](int) { m_RootNode = merge(m_RootNode, *otherSDF, m_RootArea); });
+    else
+        m_RootNode = merge(m_RootNode, *otherSDF, m_RootArea);
+    // Profiler::printJobDuration("Merge", ts);
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::intersectAlignedOctree(OctreeSFT* otherOctree)
+{
+    otherOctree->materialize();
+    Pager* pager = m_Pager ? m_Pager : otherOctree->m_Pager;
+    if (pager)
+        forEachPage(*pager, true, otherOctree, [&](int) { m_RootNode = intersectAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea); });
+    else
+        m_RootNode = intersectAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea);
+    reportSkippedOperandNodes();
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::subtractAlignedOctree(OctreeSFT* otherOctree)
+{
+    otherOctree->materialize();
+    Pager* pager = m_Pager ? m_Pager : otherOctree->m_Pager;
+    if (pager)
+        forEachPage(*pager, true, otherOctree, [&](int) { m_RootNode = subtractAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea); });
+    else
+        m_RootNode = subtractAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea);
+    reportSkippedOperandNodes();
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::mergeAlignedOctree(OctreeSFT* otherOctree)
+{
+    otherOctree->materialize();
+    Pager* pager = m_Pager ? m_Pager : otherOctree->m_Pager;
+    if (pager)
+        forEachPage(*pager, true, otherOctree, [&](int) { m_RootNode = mergeAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea); });
+    else
+        m_RootNode = mergeAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea);
+    reportSkippedOperandNodes();
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::getLatticeOffset(const OctreeSFT* otherOctree, Vector3i& offset) const
+{
+    if (std::fabs(otherOctree->m_CellSize - m_CellSize) > m_CellSize * 0.0001f)
+        return false;
+    Ogre::Vector3 cellOffset = (getLatticeOrigin() - otherOctree->getLatticeOrigin()) / m_CellSize;
+    for (int d = 0; d < 3; d++)
+    {
+        offset[d] = (int)std::floor(cellOffset[d] + 0.5f);
+        if (std::fabs(cellOffset[d] - offset[d]) > 0.001f)
+            return false;
+    }
+    return true;
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::forEachNode(const Node* node, const Area& area, const Vector3i& minPos, const Vector3i& maxPos, const std::function<void(const Node*, const Area&)>& function) const
+{
+    for (int d = 0; d < 3; d++)
+    {
+        if (area.m_MaxPos[d] < minPos[d] || area.m_MinPos[d] > maxPos[d])
+            return;
+    }
+    if (node->getNodeType() != Node::INNER)
+    {
+        function(node, area);
+        return;
+    }
+    Area subAreas[8];
+    area.getSubAreas(subAreas);
+    for (int i = 0; i < 8; i++)
+        forEachNode(((const InnerNode*)node)->m_Children[i], subAreas[i], minPos, maxPos, function);
+}
+
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::hasPagePlaceholder(const Vector3i& minPos, const Vector3i& maxPos) const
+{
+    if (!m_Pager)
+        return false;
+    bool found = false;
+    forEachNode(m_RootNode, m_RootArea, minPos, maxPos, [&found](const Node* node, const Area&)
+    {
+        found |= (node->getNodeType() == Node::LAZY && ((const LazyNode*)node)->m_Page >= 0);
+    });
+    return found;
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::reportSkippedOperandNodes()
+{
+    if (m_NumSkippedOperandNodes)
+        std::cout << "Skipped " << m_NumSkippedOperandNodes << " nodes of the csg, the pages of the other octree could not be read." << std::endl;
+    m_NumSkippedOperandNodes = 0;
+}
+
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::gatherLeaf(const Vector3i& minPos, OctreeSFT* leafOctree, const Area& leafArea, GridNode& leaf) const
+{
+    Vector3i maxPos = minPos + Vector3i(LEAF_SIZE_1D_INNER);
+    std::vector<std::pair<const Node*, Area> > nodes;
+    forEachNode(m_RootNode, m_RootArea, minPos, maxPos, [&](const Node* node, const Area& area) { nodes.push_back(std::make_pair(node, area)); });
+
+    // signs, consecutive lattice points mostly lie in the same node
+    leaf.m_Signs.clear();
+    size_t lastNode = 0;
+    for (int x = 0; x < LEAF_SIZE_1D; x++)
+    {
+        for (int y = 0; y < LEAF_SIZE_1D; y++)
+        {
+            for (int z = 0; z < LEAF_SIZE_1D; z++)
+            {
+                Vector3i pos = minPos + Vector3i(x, y, z);
+                size_t i = lastNode;
+                for (size_t tries = 0; tries < nodes.size() && !nodes[i].second.containsPoint(pos); tries++)
+                    i = (i + 1) % nodes.size();
+                if (nodes.empty() || !nodes[i].second.containsPoint(pos))
+                    continue;
+                lastNode = i;
+                const Node* node = nodes[i].first;
+                const Area& area = nodes[i].second;
+                bool sign = false;
+                if (node->getNodeType() == Node::EMPTY)
+                    sign = ((const EmptyNode*)node)->m_Sign;
+                else if (node->getNodeType() == Node::GRID && area.m_SizeExpo == LEAF_EXPO)
+                    sign = ((const GridNode*)node)->m_Signs[indexOf(pos - area.m_MinPos)];
+                else sign = getSign(getRealPos(pos));
+                leaf.m_Signs.set(indexOf(x, y, z), sign);
+            }
+        }
     }
 
-    GridNodeImpl* gridNode = (GridNodeImpl*)node;
-    gridNode->merge(this, area, implicitSDF);
-    return node;
+    // the hermite data of edges on the shared lattice is the same in both octrees
+    LeafSigns edges[3], addedEdges[3];
+    leaf.getSignChangeEdges(edges);
+    for (int d = 0; d < 3; d++)
+        addedEdges[d].clear();
+    for (auto i = nodes.begin(); i != nodes.end(); ++i)
+    {
+        if (i->first->getNodeType() != Node::GRID || i->second.m_SizeExpo != LEAF_EXPO)
+            continue;
+        const GridNode* gridNode = (const GridNode*)i->first;
+        for (auto edge = gridNode->m_SurfaceEdges.begin(); edge != gridNode->m_SurfaceEdges.end(); ++edge)
+        {
+            Vector3i localPos = i->second.m_MinPos + fromIndex(edge->edgeIndex1) - minPos;
+            bool inside = true;
+            for (int d = 0; d < 3; d++)
+                inside &= localPos[d] >= 0 && localPos[d] < LEAF_SIZE_1D - (d == edge->direction);
+            if (!inside)
+                continue;
+            int index = indexOf(localPos);
+            if (!edges[edge->direction][index] || addedEdges[edge->direction][index])
+                continue;
+            addedEdges[edge->direction].set(index, true);
+            leaf.m_SurfaceEdges.push_back(*edge);
+            leaf.m_SurfaceEdges.back().edgeIndex1 = index;
+        }
+    }
+    // the other edges belong to coarse or lazy nodes
+    leaf.computeEdges(leafOctree, leafArea, *this, addedEdges);
 }
 
-OctreeSF::Node* OctreeSF::intersectAlignedNode(Node* node, Node* otherNode, const Area& area)
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::combineLatticeNode(Node* node, const Area& area, const OctreeSFT* otherOctree, const Vector3i& offset, typename GridNode::AlignedOperation operation)
 {
-    if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::INNER)
-    {
-        InnerNode* innerNode = (InnerNode*)node;
-        InnerNode* otherInnerNode = (InnerNode*)otherNode;
-        Area subAreas[8];
-        area.getSubAreas(subAreas);
-        for (int i = 0; i < 8; i++)
-            innerNode->m_Children[i] = intersectAlignedNode(innerNode->m_Children[i], otherInnerNode->m_Children[i], subAreas[i]);
+    if (m_PageRegion && !area.toAABB().intersectsAABB(*m_PageRegion))
         return node;
-    }
-    if (otherNode->getNodeType() == Node::EMPTY)
+    bool merge = (operation == GridNode::ALIGNED_MERGE);
+    // surface on the boundary of the area changes shared lattice points
+    AABB aabb = area.toAABB();
+    aabb.addEpsilon(m_CellSize * 0.5f);
+    if (!otherOctree->intersectsSurface(aabb))
     {
-        EmptyNode* otherEmptyNode = (EmptyNode*)otherNode;
-        if (otherEmptyNode->m_Sign)
+        bool otherSign = otherOctree->getSign(area.toAABB().getCenter()) != (operation == GridNode::ALIGNED_SUBTRACT);
+        if (otherSign != merge)
             return node;
-        delete node;
-        return otherNode->clone();
+        if (node->getNodeType() != Node::EMPTY)
+            markDirty(area);
+        Node::release(node);
+        return new (*m_Arena) EmptyNode(otherSign);
     }
-    if (node->getNodeType() == Node::EMPTY)
+    if (node->getNodeType() == Node::LAZY)
     {
-        EmptyNode* emptyNode = (EmptyNode*)node;
-        if (!emptyNode->m_Sign)
+        node = expandLazyNode((LazyNode*)node, area);
+        // a page that could not be read is left untouched
+        if (node->getNodeType() == Node::LAZY)
             return node;
-        delete node;
-        return otherNode->clone();
-
-    }
-
-    GridNodeImpl* gridNode = (GridNodeImpl*)node;
-    GridNodeImpl* otherGridNode = (GridNodeImpl*)otherNode;
-    gridNode->intersect(otherGridNode);
-    return node;
-}
-
-OctreeSF::Node* OctreeSF::subtractAlignedNode(Node* node, Node* otherNode, const Area& area)
-{
-    if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::INNER)
-    {
-        InnerNode* innerNode = (InnerNode*)node;
-        InnerNode* otherInnerNode = (InnerNode*)otherNode;
-        Area subAreas[8];
-        area.getSubAreas(subAreas);
-        for (int i = 0; i < 8; i++)
-            innerNode->m_Children[i] = subtractAlignedNode(innerNode->m_Children[i], otherInnerNode->m_Children[i], subAreas[i]);
-        return node;
     }
-    if (otherNode->getNodeType() == Node::EMPTY)
+    if (node->getNodeType() == Node::GRID && area.m_SizeExpo > LEAF_EXPO)
     {
-        EmptyNode* otherEmptyNode = (EmptyNode*)otherNode;
-        if (!otherEmptyNode->m_Sign)
-            return node;
-        delete node;
-        Node* inverted = otherNode->clone();
-        inverted->invert();
-        return inverted;
+        Node* refinedNode = refineLeaf((GridNodeImpl*)node, area);
+        Node::release(node);
+        node = refinedNode;
     }
     if (node->getNodeType() == Node::EMPTY)
     {
         EmptyNode* emptyNode = (EmptyNode*)node;
-        if (!emptyNode->m_Sign)
+        bool sign = emptyNode->m_Sign;
+        if (sign == merge)
             return node;
-        delete node;
-        Node* inverted = otherNode->clone();
-        inverted->invert();
-        return inverted;
-
+        if (area.m_SizeExpo > LEAF_EXPO)
+            return combineLatticeNode(splitEmptyNode(emptyNode), area, otherOctree, offset, operation);
+        Node::release(node);
+        GridNodeImpl* leaf = new (*m_Arena) GridNodeImpl(this, area);
+        leaf->m_Signs.clear();
+        if (sign)
+            leaf->m_Signs.invert();
+        node = leaf;
     }
-
-    GridNodeImpl* gridNode = (GridNodeImpl*)node;
-    GridNodeImpl* otherGridNode = (GridNodeImpl*)otherNode;
-    otherGridNode->invert();
-    gridNode->intersect(otherGridNode);
-    return node;
-}
-
-OctreeSF::Node* OctreeSF::mergeAlignedNode(Node* node, Node* otherNode, const Area& area)
-{
-    if (node->getNodeType() == Node::INNER && otherNode->getNodeType() == Node::INNER)
+    if (node->getNodeType() == Node::INNER)
     {
+        node = unshareNode(node);
         InnerNode* innerNode = (InnerNode*)node;
-        InnerNode* otherInnerNode = (InnerNode*)otherNode;
         Area subAreas[8];
         area.getSubAreas(subAreas);
         for (int i = 0; i < 8; i++)
-            innerNode->m_Children[i] = mergeAlignedNode(innerNode->m_Children[i], otherInnerNode->m_Children[i], subAreas[i]);
-        return node;
-    }
-    if (otherNode->getNodeType() == Node::EMPTY)
-    {
-        EmptyNode* otherEmptyNode = (EmptyNode*)otherNode;
-        if (!otherEmptyNode->m_Sign)
-            return node;
-        delete node;
-        return otherNode->clone();
+            innerNode->m_Children[i] = combineLatticeNode(innerNode->m_Children[i], subAreas[i], otherOctree, offset, operation);
+        return collapseNode(node, area);
     }
-    if (node->getNodeType() == Node::EMPTY)
+
+    // the leaf is gathered from the signs and the hermite data of the other octree, which a page that could not be read does not provide
+    if (otherOctree->hasPagePlaceholder(area.m_MinPos + offset, area.m_MaxPos + offset))
     {
-        EmptyNode* emptyNode = (EmptyNode*)node;
-        if (emptyNode->m_Sign)
-            return node;
-        delete node;
-        return otherNode->clone();
+        m_NumSkippedOperandNodes++;
+        return node;
     }
-
+    node = unshareNode(node);
     GridNodeImpl* gridNode = (GridNodeImpl*)node;
-    GridNodeImpl* otherGridNode = (GridNodeImpl*)otherNode;
-    gridNode->merge(otherGridNode);
-    return node;
+    GridNodeImpl otherLeaf(this, area);
+    otherOctree->gatherLeaf(area.m_MinPos + offset, this, area, otherLeaf);
+    gridNode->combineAligned(&otherLeaf, area, operation);
+    markDirty(area);
+    return collapseNode(node, area);
 }
 
-std::shared_ptr<OctreeSF> OctreeSF::sampleSDF(SolidGeometry* otherSDF, int maxDepth)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::combineOctree(OctreeSFT* otherOctree, typename GridNode::AlignedOperation operation)
 {
-    AABB aabb = otherSDF->getAABB();
-    aabb.addEpsilon(0.0001f);
-    return sampleSDF(otherSDF, aabb, maxDepth);
+    auto ts = Profiler::timestamp();
+    otherOctree->materialize();
+    if (operation == GridNode::ALIGNED_MERGE)
+        resize(otherOctree->getAABB());
+    Vector3i offset;
+    if (!getLatticeOffset(otherOctree, offset))
+    {
+        // the lattices differ, the other octree is resampled where it overlaps
+        if (otherOctree->m_Pager)
+        {
+            std::cout << "The other octree cannot be resampled, it is paged." << std::endl;
+            return;
+        }
+        if (operation == GridNode::ALIGNED_INTERSECT)
+            intersect((SolidGeometry*)otherOctree);
+        else if (operation == GridNode::ALIGNED_SUBTRACT)
+            subtract((SolidGeometry*)otherOctree);
+        else merge((SolidGeometry*)otherOctree);
+        return;
+    }
+    Pager* pager = m_Pager ? m_Pager : otherOctree->m_Pager;
+    if (pager)
+        forEachPage(*pager, true, otherOctree, [&](int) { m_RootNode = combineLatticeNode(m_RootNode, m_RootArea, otherOctree, offset, operation); });
+    else
+        m_RootNode = combineLatticeNode(m_RootNode, m_RootArea, otherOctree, offset, operation);
+    reportSkippedOperandNodes();
+    Profiler::printJobDuration("Octree csg", ts);
 }
 
-std::shared_ptr<OctreeSF> OctreeSF::sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::intersectOctree(OctreeSFT* otherOctree)
 {
-    auto ts = Profiler::timestamp();
-    std::shared_ptr<OctreeSF> octreeSF = std::make_shared<OctreeSF>();
-    Ogre::Vector3 aabbSize = aabb.getMax() - aabb.getMin();
-    float cubeSize = std::max(std::max(aabbSize.x, aabbSize.y), aabbSize.z);
-    octreeSF->m_CellSize = cubeSize / (1 << maxDepth);
-    otherSDF->prepareSampling(aabb, octreeSF->m_CellSize);
-    octreeSF->m_RootArea = Area(Vector3i(0, 0, 0), maxDepth, aabb.getMin(), cubeSize);
-    octreeSF->m_RootNode = octreeSF->createNode(octreeSF->m_RootArea, *otherSDF);
-    Profiler::printJobDuration("OctreeSF::sampleSDF", ts);
-    return octreeSF;
+    combineOctree(otherOctree, GridNode::ALIGNED_INTERSECT);
 }
 
-float OctreeSF::getInverseCellSize()
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::subtractOctree(OctreeSFT* otherOctree)
 {
-    return (float)(1 << m_RootArea.m_SizeExpo) / m_RootArea.m_RealSize;
+    combineOctree(otherOctree, GridNode::ALIGNED_SUBTRACT);
 }
 
-AABB OctreeSF::getAABB() const
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::mergeOctree(OctreeSFT* otherOctree)
 {
-    return m_RootArea.toAABB();
+    combineOctree(otherOctree, GridNode::ALIGNED_MERGE);
 }
 
-void OctreeSF::generateVerticesAndIndices(vector<Vertex>& vertices, vector<unsigned int>& indices)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::resize(const AABB& aabb)
 {
-    auto tsTotal = Profiler::timestamp();
-    int numLeaves = countLeaves();
-    vertices.reserve(numLeaves * LEAF_SIZE_2D_INNER * 2);	// reasonable upper bound
-    m_RootNode->forEachSurfaceNode([&vertices](GridNode* node) { node->generateVerticesDC(vertices); });
-    Profiler::printJobDuration("generateVertices", tsTotal);
-    std::cout << "Generated " << vertices.size() << " vertices." << std::endl;
-
-    auto tsFaceTraversal = Profiler::timestamp();
-    m_RootNode->forEachSurfaceFaceAndEdge(
-                [](const Node::Face& face) {
-        Vector3i offset(0, 0, 0);
-        offset[face.normalDirection] = 1;
-        face.n1->cacheNeighbor(offset, face.n2); },
-    [](const Node::Edge& edge) {
-        Vector3i offset(1, 1, 1);
-        offset[edge.direction] = 0;
-        edge.n1->cacheNeighbor(offset, edge.n2); });
-    Profiler::printJobDuration("forEachSurfaceFaceAndEdge", tsFaceTraversal);
-
-    // auto tsIndices = Profiler::timestamp();
-    indices.reserve(numLeaves * LEAF_SIZE_2D_INNER * 8);
-    m_RootNode->forEachSurfaceNode(m_RootArea,
-                                   [&indices, &vertices](GridNode* node, const Area& area) { node->generateIndicesDC(area, indices, vertices); });
-    // Profiler::printJobDuration("generateIndices", tsIndices);
-    std::cout << "Generated " << indices.size() << " indices." << std::endl;
-    Profiler::printJobDuration("generateVerticesAndIndices", tsTotal);
+    while (true)
+    {
+        // the old root becomes the child on the side away from the growth direction
+        int oldRootChild = 0;
+        bool grow = false;
+        for (int d = 0; d < 3; d++)
+        {
+            if (aabb.getMin()[d] < m_RootArea.m_MinRealPos[d])
+            {
+                oldRootChild |= 4 >> d;
+                grow = true;
+            }
+            else if (aabb.getMax()[d] > m_RootArea.m_MinRealPos[d] + m_RootArea.m_RealSize)
+                grow = true;
+        }
+        if (!grow)
+            return;
+        // cell indices have to fit into an int
+        if (m_Pager || m_RootArea.m_SizeExpo >= 29)
+        {
+            std::cout << "The octree cannot grow to cover the aabb, " << (m_Pager ? "it is paged." : "it has reached the maximum size.") << std::endl;
+            return;
+        }
+        Vector3i childOffset((oldRootChild & 4) != 0, (oldRootChild & 2) != 0, (oldRootChild & 1) != 0);
+        Area rootArea(m_RootArea.m_MinPos - childOffset * (1 << m_RootArea.m_SizeExpo), m_RootArea.m_SizeExpo + 1,
+            m_RootArea.m_MinRealPos - childOffset.toOgreVec() * m_RootArea.m_RealSize, m_RootArea.m_RealSize * 2.0f);
+        InnerNode* rootNode = new (*m_Arena) InnerNode();
+        void* childSlots[8];
+        m_Arena->allocateObjects(getChildSlotSize(), 8, childSlots);
+        for (int i = 0; i < 8; i++)
+            rootNode->m_Children[i] = (i == oldRootChild) ? m_RootNode : new (childSlots[i]) EmptyNode(false);
+        m_RootNode = rootNode;
+        m_RootArea = rootArea;
+    }
 }
 
-std::shared_ptr<Mesh> OctreeSF::generateMesh()
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::OctreeSFT(const OctreeSFT& other)
+    : m_Arena(std::make_shared<NodeArena>()), m_MeshGeneration(std::make_shared<std::atomic<unsigned int> >(0))
 {
-    auto ts = Profiler::timestamp();
-    std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
-    generateVerticesAndIndices(mesh->vertexBuffer, mesh->indexBuffer);
-    // mesh->computeTriangleNormals();
-    // mesh->computeVertexNormals();
-    Profiler::printJobDuration("generateMesh", ts);
-    return mesh;
+    // the copy is bump allocated from a single chunk
+    m_Arena->reserve(other.m_Arena->getStats().bytesUsed);
+    m_RootNode = other.m_RootNode->clone(*m_Arena);
+    m_RootArea = other.m_RootArea;
+    m_CellSize = other.m_CellSize;
+    m_MaxLeafError = other.m_MaxLeafError;
+    m_HasLazyNodes = other.m_HasLazyNodes;
+    m_ThreadPool = other.m_ThreadPool;
+    m_MaxTaskDepth = other.m_MaxTaskDepth;
+    m_SignFaceCache = nullptr;
+    m_Pager = nullptr;
+    m_PageRegion = nullptr;
+    m_PageSizeExpo = 0;
+    m_NumSkippedOperandNodes = 0;
+    m_TrackDirtyAreas = false;
+    if (other.m_Pager)
+        m_RootNode = copyPages(m_RootNode, *other.m_Pager);
+}
+
+template<int LeafExpo>
+OctreeSFT<LeafExpo>::~OctreeSFT()
+{
+    // all nodes live in m_Arena, which releases its chunks without visiting the nodes,
+    // unless nodes are shared, then their references are released so the other octrees do not copy them anymore
+    if (m_RootNode && (m_Arena.use_count() > 1 || !m_SharedArenas.empty()))
+        Node::release(m_RootNode);
+    delete m_Pager;
+}
+
+template<int LeafExpo>
+std::shared_ptr<OctreeSFT<LeafExpo> > OctreeSFT<LeafExpo>::clone()
+{
+    if (m_HasLazyNodes || m_Pager)
+        return std::make_shared<OctreeSFT>(*this);
+    std::shared_ptr<OctreeSFT> octreeSF = std::make_shared<OctreeSFT>();
+    m_RootNode->acquire();
+    octreeSF->m_RootNode = m_RootNode;
+    octreeSF->m_RootArea = m_RootArea;
+    octreeSF->m_CellSize = m_CellSize;
+    octreeSF->m_MaxLeafError = m_MaxLeafError;
+    octreeSF->m_ThreadPool = m_ThreadPool;
+    octreeSF->m_MaxTaskDepth = m_MaxTaskDepth;
+    octreeSF->m_SharedArenas = m_SharedArenas;
+    octreeSF->m_SharedArenas.push_back(m_Arena);
+    octreeSF->m_MeshGeneration = m_MeshGeneration;
+    return octreeSF;
 }
 
-bool OctreeSF::rayIntersectClosest(const Ray& ray, Ray::Intersection& intersection)
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::unshareNode(Node* node)
 {
-    intersection.t = std::numeric_limits<float>::max();
-    return m_RootNode->rayIntersectUpdate(m_RootArea, ray, intersection);
+    if (!node->isShared())
+        return node;
+    Node* copy;
+    if (node->getNodeType() == Node::INNER)
+        copy = new (*m_Arena) InnerNode(*(InnerNode*)node);
+    else copy = node->clone(*m_Arena);
+    Node::release(node);
+    return copy;
 }
 
-bool OctreeSF::intersectsSurface(const AABB& aabb) const
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::unshareSubtree(Node* node)
 {
-    if (m_TriangleCache.getBVH())
-        return m_TriangleCache.getBVH()->intersectsAABB(aabb);
-    return true;
+    node = unshareNode(node);
+    if (node->getNodeType() == Node::INNER)
+    {
+        InnerNode* innerNode = (InnerNode*)node;
+        for (int i = 0; i < 8; i++)
+            innerNode->m_Children[i] = unshareSubtree(innerNode->m_Children[i]);
+    }
+    return node;
 }
 
-void OctreeSF::subtract(SolidGeometry* otherSDF)
+namespace
 {
-    otherSDF->prepareSampling(m_RootArea.toAABB(), m_CellSize);
-    auto ts = Profiler::timestamp();
-    // Profiler::getSingleton().createJob("computeSigns");
-    m_RootNode = intersect(m_RootNode, OpInvertSDF(otherSDF), m_RootArea);
-    // Profiler::getSingleton().printJobDuration("computeSigns");
-    Profiler::printJobDuration("Subtraction", ts);
+    /// Sections of OctreeSF files, leaf payloads are stored in the order in which the leaves appear in the node types.
+    enum OctreeSFSection
+    {
+        SF_SECTION_NODE_TYPES,
+        SF_SECTION_LEAF_SIGNS,
+        SF_SECTION_EDGE_OFFSETS,            // numLeaves + 1 offsets into the surface edges
+        SF_SECTION_SURFACE_EDGES,
+        SF_SECTION_BOUNDARY_SIGN_OFFSETS,   // numLeaves + 1 bit offsets into the boundary signs
+        SF_SECTION_BOUNDARY_SIGNS
+    };
 }
 
-void OctreeSF::intersect(SolidGeometry* otherSDF)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::serializeNode(const Node* node, SubtreeData& data)
 {
-    otherSDF->prepareSampling(m_RootArea.toAABB(), m_CellSize);
-    auto ts = Profiler::timestamp();
-    m_RootNode = intersect(m_RootNode, *otherSDF, m_RootArea);
-    Profiler::printJobDuration("Intersection", ts);
+    if (node->getNodeType() == Node::LAZY && ((const LazyNode*)node)->m_Page >= 0)
+    {
+        // the page is read into a temporary subtree
+        const LazyNode* placeholder = (const LazyNode*)node;
+        Node* page = m_Pager->readPage(placeholder->m_Page, this);
+        if (!page)
+        {
+            data.incomplete = true;
+            return;
+        }
+        if (placeholder->m_Inverted)
+            page->invert();
+        serializeNode(page, data);
+        delete page;
+        return;
+    }
+    unsigned char type = (unsigned char)node->getNodeType();
+    if (node->getNodeType() == Node::EMPTY && ((const EmptyNode*)node)->m_Sign)
+        type |= OctreeFile::NODE_SIGN_BIT;
+    data.nodeTypes.push_back(type);
+    if (node->getNodeType() == Node::INNER)
+    {
+        for (int i = 0; i < 8; i++)
+            serializeNode(((const InnerNode*)node)->m_Children[i], data);
+    }
+    else if (node->getNodeType() == Node::GRID)
+    {
+        const GridNode* leaf = (const GridNode*)node;
+        data.leafSigns.push_back(leaf->m_Signs);
+        data.surfaceEdges.insert(data.surfaceEdges.end(), leaf->m_SurfaceEdges.begin(), leaf->m_SurfaceEdges.end());
+        data.edgeOffsets.push_back((unsigned int)data.surfaceEdges.size());
+        unsigned long long bitOffset = data.boundarySignOffsets.back();
+        data.boundarySigns.resize((size_t)((bitOffset + leaf->m_BoundarySigns.size() + 63) / 64), 0);
+        for (size_t i = 0; i < leaf->m_BoundarySigns.size(); i++, bitOffset++)
+        {
+            if (leaf->m_BoundarySigns[i])
+                data.boundarySigns[(size_t)(bitOffset >> 6)] |= (BitOps::Word)1 << (bitOffset & 63);
+        }
+        data.boundarySignOffsets.push_back(bitOffset);
+    }
 }
 
-void OctreeSF::merge(SolidGeometry* otherSDF)
+template<int LeafExpo>
+size_t OctreeSFT<LeafExpo>::writeSubtree(const Node* node, const Area& area, std::ostream& stream)
 {
-    otherSDF->prepareSampling(m_RootArea.toAABB(), m_CellSize);
-    // auto ts = Profiler::timestamp();
-    m_RootNode = merge(m_RootNode, *otherSDF, m_RootArea);
-    // Profiler::printJobDuration("Merge", ts);
+    SubtreeData data;
+    serializeNode(node, data);
+    if (data.incomplete)
+        return 0;
+
+    OctreeFile::Header header;
+    OctreeFile::initHeader(header, OctreeFile::OCTREE_SF, LEAF_EXPO);
+#ifdef USE_COMPACT_HERMITE_EDGES
+    header.flags = 1;
+#endif
+    header.numNodes = (unsigned int)data.nodeTypes.size();
+    header.numLeaves = (unsigned int)data.leafSigns.size();
+    for (int d = 0; d < 3; d++)
+    {
+        header.rootMinPos[d] = area.m_MinPos[d];
+        header.rootMinRealPos[d] = area.m_MinRealPos[d];
+    }
+    header.rootSizeExpo = area.m_SizeExpo;
+    header.rootRealSize = area.m_RealSize;
+    header.cellSize = m_CellSize;
+    header.maxLeafError = m_MaxLeafError;
+    OctreeFile::Writer writer(header);
+    writer.setSection(SF_SECTION_NODE_TYPES, data.nodeTypes);
+    writer.setSection(SF_SECTION_LEAF_SIGNS, data.leafSigns);
+    writer.setSection(SF_SECTION_EDGE_OFFSETS, data.edgeOffsets);
+    writer.setSection(SF_SECTION_SURFACE_EDGES, data.surfaceEdges);
+    writer.setSection(SF_SECTION_BOUNDARY_SIGN_OFFSETS, data.boundarySignOffsets);
+    writer.setSection(SF_SECTION_BOUNDARY_SIGNS, data.boundarySigns);
+    return writer.write(stream);
+}
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::readSubtree(const OctreeFile::Reader& reader)
+{
+    const unsigned int elementSizes[OctreeFile::MAX_SECTIONS] = { sizeof(unsigned char), sizeof(LeafSigns), sizeof(unsigned int), sizeof(SurfaceEdge), sizeof(unsigned long long), sizeof(BitOps::Word) };
+    const OctreeFile::Header* header = reader.getHeader(OctreeFile::OCTREE_SF, LEAF_EXPO, elementSizes);
+    if (!header)
+        return nullptr;
+#ifdef USE_COMPACT_HERMITE_EDGES
+    const unsigned int flags = 1;
+#else
+    const unsigned int flags = 0;
+#endif
+    if (header->flags != flags)
+    {
+        std::cout << "The octree data uses another hermite edge encoding." << std::endl;
+        return nullptr;
+    }
+    size_t numNodes, numLeaves, numEdgeOffsets, numEdges, numBoundarySignOffsets, numBoundarySignWords;
+    const unsigned char* nodeTypes = reader.getSection<unsigned char>(header, SF_SECTION_NODE_TYPES, numNodes);
+    const LeafSigns* leafSigns = reader.getSection<LeafSigns>(header, SF_SECTION_LEAF_SIGNS, numLeaves);
+    const unsigned int* edgeOffsets = reader.getSection<unsigned int>(header, SF_SECTION_EDGE_OFFSETS, numEdgeOffsets);
+    const SurfaceEdge* surfaceEdges = reader.getSection<SurfaceEdge>(header, SF_SECTION_SURFACE_EDGES, numEdges);
+    const unsigned long long* boundarySignOffsets = reader.getSection<unsigned long long>(header, SF_SECTION_BOUNDARY_SIGN_OFFSETS, numBoundarySignOffsets);
+    const BitOps::Word* boundarySigns = reader.getSection<BitOps::Word>(header, SF_SECTION_BOUNDARY_SIGNS, numBoundarySignWords);
+    if (numNodes == 0 || numNodes != header->numNodes || numLeaves != header->numLeaves
+        || numEdgeOffsets != numLeaves + 1 || numBoundarySignOffsets != numLeaves + 1
+        || edgeOffsets[numLeaves] != numEdges || boundarySignOffsets[numLeaves] > numBoundarySignWords * 64
+        || !OctreeFile::isValidRootArea(*header, LEAF_EXPO))
+    {
+        std::cout << OctreeFile::CORRUPT_MESSAGE << std::endl;
+        return nullptr;
+    }
+    // the nodes and leaf payloads are bump allocated from a single chunk, the estimate includes the object headers and size class rounding
+    // pages are read into the memory that evicted pages returned to the arena
+    if (!m_Pager)
+        m_Arena->reserve(numNodes * (getChildSlotSize() + 32) + numLeaves * (sizeof(GridNode) + 96)
+        + numEdges * sizeof(SurfaceEdge) + numBoundarySignWords * sizeof(BitOps::Word));
+
+    // the leaf payloads are copied with one block copy per array, only the node topology is decoded
+    size_t nodeIndex = 0;
+    size_t leafIndex = 0;
+    bool corrupt = false;
+    // the leaf code indexes the lattice with the edge indices and the boundary signs without range checks
+    auto isValidLeaf = [&](const Area& area) -> bool
+    {
+        if (leafIndex >= numLeaves || area.m_SizeExpo < LEAF_EXPO || area.m_SizeExpo > LEAF_EXPO + MAX_ADAPTIVE_LEVELS)
+            return false;
+        if (edgeOffsets[leafIndex] > edgeOffsets[leafIndex + 1] || edgeOffsets[leafIndex + 1] > numEdges
+            || boundarySignOffsets[leafIndex] > boundarySignOffsets[leafIndex + 1] || boundarySignOffsets[leafIndex + 1] > boundarySignOffsets[numLeaves])
+            return false;
+        const LeafSigns& signs = leafSigns[leafIndex];
+        if (signs.words[LeafSigns::NUM_WORDS - 1] & ~LeafSigns::getLastWordMask())
+            return false;
+        for (unsigned int i = edgeOffsets[leafIndex]; i < edgeOffsets[leafIndex + 1]; i++)
+        {
+            const SurfaceEdge& edge = surfaceEdges[i];
+            if (edge.direction > 2 || edge.edgeIndex1 >= LEAF_SIZE_3D || edge.getEdgeIndex2() >= LEAF_SIZE_3D
+                || fromIndex(edge.edgeIndex1)[edge.direction] >= LEAF_SIZE_1D_INNER)
+                return false;
+        }
+        // coarse leaves store the finest lattice on their 6 faces, the signs are dropped by operations that cannot keep them
+        unsigned long long numBoundarySigns = boundarySignOffsets[leafIndex + 1] - boundarySignOffsets[leafIndex];
+        unsigned long long boundarySize = (LEAF_SIZE_1D_INNER << getLeafStrideExpo(area)) + 1;
+        return numBoundarySigns == 0 || (area.m_SizeExpo > LEAF_EXPO && numBoundarySigns == 6 * boundarySize * boundarySize);
+    };
+    std::function<Node*(const Area&, void*)> readNode = [&](const Area& area, void* childSlot) -> Node*
+    {
+        unsigned char type = (nodeIndex < numNodes) ? nodeTypes[nodeIndex++] : 0xff;
+        if (type == Node::GRID && isValidLeaf(area))
+        {
+            NodeArena::freeObject(childSlot);
+            GridNode* leaf = new (*m_Arena) GridNode(this, area);
+            leaf->m_Signs = leafSigns[leafIndex];
+            leaf->m_SurfaceEdges.assign(surfaceEdges + edgeOffsets[leafIndex], surfaceEdges + edgeOffsets[leafIndex + 1]);
+            unsigned long long firstBit = boundarySignOffsets[leafIndex];
+            leaf->m_BoundarySigns.resize((size_t)(boundarySignOffsets[leafIndex + 1] - firstBit));
+            for (size_t i = 0; i < leaf->m_BoundarySigns.size(); i++)
+            {
+                unsigned long long bit = firstBit + i;
+                leaf->m_BoundarySigns[i] = ((boundarySigns[(size_t)(bit >> 6)] >> (bit & 63)) & 1) != 0;
+            }
+            leafIndex++;
+            return leaf;
+        }
+        if (!childSlot)
+            childSlot = m_Arena->allocateObject(getChildSlotSize());
+        if (type == Node::INNER && area.m_SizeExpo > LEAF_EXPO)
+        {
+            InnerNode* innerNode = new (childSlot) InnerNode();
+            Area subAreas[8];
+            area.getSubAreas(subAreas);
+            void* childSlots[8];
+            m_Arena->allocateObjects(getChildSlotSize(), 8, childSlots);
+            for (int i = 0; i < 8; i++)
+                innerNode->m_Children[i] = readNode(subAreas[i], childSlots[i]);
+            return innerNode;
+        }
+        if ((type & ~OctreeFile::NODE_SIGN_BIT) != Node::EMPTY)
+            corrupt = true;
+        return new (childSlot) EmptyNode((type & OctreeFile::NODE_SIGN_BIT) != 0);
+    };
+    Area area(Vector3i(header->rootMinPos[0], header->rootMinPos[1], header->rootMinPos[2]), header->rootSizeExpo,
+        Ogre::Vector3(header->rootMinRealPos[0], header->rootMinRealPos[1], header->rootMinRealPos[2]), header->rootRealSize);
+    Node* node = readNode(area, nullptr);
+    if (corrupt || nodeIndex != numNodes || leafIndex != numLeaves)
+    {
+        std::cout << OctreeFile::CORRUPT_MESSAGE << std::endl;
+        delete node;
+        return nullptr;
+    }
+    return node;
 }
 
-void OctreeSF::intersectAlignedOctree(OctreeSF* otherOctree)
+template<int LeafExpo>
+bool OctreeSFT<LeafExpo>::save(const std::string& fileName)
 {
-    m_RootNode = intersectAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea);
+    auto ts = Profiler::timestamp();
+    materialize();
+    std::ofstream file(fileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+    if (!file)
+    {
+        std::cout << "Could not open " << fileName << " for writing." << std::endl;
+        return false;
+    }
+    size_t numBytes = writeSubtree(m_RootNode, m_RootArea, file);
+    Profiler::printJobDuration("OctreeSF::save", ts);
+    return numBytes > 0;
 }
 
-void OctreeSF::subtractAlignedOctree(OctreeSF* otherOctree)
+template<int LeafExpo>
+std::shared_ptr<OctreeSFT<LeafExpo> > OctreeSFT<LeafExpo>::load(const std::string& fileName)
 {
-    m_RootNode = subtractAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea);
+    auto ts = Profiler::timestamp();
+    OctreeFile::MappedFile file(fileName);
+    std::shared_ptr<OctreeSFT> octreeSF = std::make_shared<OctreeSFT>();
+    octreeSF->m_RootNode = octreeSF->readSubtree(file);
+    if (!octreeSF->m_RootNode)
+        return nullptr;
+    const OctreeFile::Header* header = (const OctreeFile::Header*)file.getData();
+    octreeSF->m_RootArea = Area(Vector3i(header->rootMinPos[0], header->rootMinPos[1], header->rootMinPos[2]), header->rootSizeExpo,
+        Ogre::Vector3(header->rootMinRealPos[0], header->rootMinRealPos[1], header->rootMinRealPos[2]), header->rootRealSize);
+    octreeSF->m_CellSize = header->cellSize;
+    octreeSF->m_MaxLeafError = header->maxLeafError;
+    Profiler::printJobDuration("OctreeSF::load", ts);
+    return octreeSF;
 }
 
-void OctreeSF::mergeAlignedOctree(OctreeSF* otherOctree)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::enablePaging(const std::string& backingFileName, int pageLevel, size_t residentBudget)
 {
-    m_RootNode = mergeAlignedNode(m_RootNode, otherOctree->m_RootNode, m_RootArea);
+    if (m_Pager)
+    {
+        std::cout << "The octree is already paged." << std::endl;
+        return;
+    }
+    materialize();
+    // pages are written and replaced in place, nodes shared with clones are copied first
+    m_RootNode = unshareSubtree(m_RootNode);
+    // pages are at least as large as a leaf, the page table has at most 8^6 entries
+    pageLevel = std::max(1, std::min(std::min(pageLevel, m_RootArea.m_SizeExpo - LEAF_EXPO), 6));
+    m_Pager = new Pager(this, backingFileName, pageLevel, residentBudget);
+    for (int page = 0; page < m_Pager->getNumPages(); page++)
+        m_Pager->update(page, true);
+    m_Pager->enforceBudget();
 }
 
-void OctreeSF::resize(const AABB&)
+template<int LeafExpo>
+std::shared_ptr<OctreeSFT<LeafExpo> > OctreeSFT<LeafExpo>::sampleSDFPaged(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, const std::string& backingFileName, int pageLevel, size_t residentBudget)
 {
-    /*	while (!m_RootArea.toAABB().containsPoint(aabb.min))
-    {	// need to resize octree
-    m_RootArea.m_MinPos = m_RootArea.m_MinPos - Vector3i(1 << m_RootArea.m_SizeExpo, 1 << m_RootArea.m_SizeExpo, 1 << m_RootArea.m_SizeExpo);
-    m_RootArea.m_MinRealPos -= Ogre::Vector3(m_RootArea.m_RealSize, m_RootArea.m_RealSize, m_RootArea.m_RealSize);
-    m_RootArea.m_RealSize *= 2.0f;
-    m_RootArea.m_SizeExpo++;
-    Node* oldRoot = m_RootNode;
-    m_RootNode = allocNode();
-    m_RootNode->m_Children[7] = oldRoot;
-
-    // need to fill in some signed distance values for the new area
-    for (int i = 0; i < 7; i++)
+    auto ts = Profiler::timestamp();
+    std::shared_ptr<OctreeSFT> octreeSF = sampleSDFLazy(otherSDF, aabb, maxDepth);
+    octreeSF->m_HasLazyNodes = false;
+    octreeSF->enablePaging(backingFileName, pageLevel, residentBudget);
+    // the unevaluated nodes are expanded one page at a time, a face cache per page shares the leaf boundaries within the page
+    octreeSF->forEachPage(*octreeSF->m_Pager, true, nullptr, [&](int)
     {
-    Vector3i offset = Vector3i((i & 4) != 0, (i & 2) != 0, (i & 1) != 0) * (1 << m_RootArea.m_SizeExpo);
-    m_SDFValues[m_RootArea.m_MinPos + offset] = -m_RootArea.m_RealSize;
-    }
-    interpolateLeaf(m_RootArea);
-    }
-    while (!m_RootArea.toAABB().containsPoint(aabb.max))
-    {	// need to resize octree
-    m_RootArea.m_RealSize *= 2.0f;
-    m_RootArea.m_SizeExpo++;
-    Node* oldRoot = m_RootNode;
-    m_RootNode = allocNode();
-    m_RootNode->m_Children[0] = oldRoot;
+        SignFaceCache faceCache;
+        octreeSF->m_SignFaceCache = &faceCache;
+        octreeSF->m_RootNode = octreeSF->expandLazyNodes(octreeSF->m_RootNode, octreeSF->m_RootArea, *octreeSF->m_PageRegion);
+        octreeSF->m_SignFaceCache = nullptr;
+    });
+    Profiler::printJobDuration("OctreeSF::sampleSDFPaged", ts);
+    return octreeSF;
+}
 
-    // need to fill in some signed distance values for the new area
-    for (int i = 1; i < 8; i++)
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::PagingStats OctreeSFT<LeafExpo>::getPagingStats() const
+{
+    PagingStats stats;
+    if (!m_Pager)
+        return stats;
+    stats = m_Pager->m_Stats;
+    stats.residentPages = m_Pager->m_LRU.size();
+    for (auto& page : m_Pager->m_Pages)
     {
-    Vector3i offset = Vector3i((i & 4) != 0, (i & 2) != 0, (i & 1) != 0) * (1 << m_RootArea.m_SizeExpo);
-    m_SDFValues[m_RootArea.m_MinPos + offset] = -m_RootArea.m_RealSize;
+        if (page.onDisk && !page.resident)
+            stats.pagesOnDisk++;
     }
-    interpolateLeaf(m_RootArea);
-    }*/
+    return stats;
 }
 
-OctreeSF::OctreeSF(const OctreeSF& other)
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::forEachPage(Pager& pager, bool modifiesPages, OctreeSFT* otherOctree, const std::function<void(int page)>& step)
 {
-    m_RootNode = other.m_RootNode->clone();
-    m_RootArea = other.m_RootArea;
-    m_CellSize = other.m_CellSize;
-    m_TriangleCache = other.m_TriangleCache;
+    Pager* otherPager = otherOctree ? otherOctree->m_Pager : nullptr;
+    for (int page = 0; page < pager.getNumPages(); page++)
+    {
+        // the region excludes the nodes of neighboring pages, which only touch the page
+        AABB region = pager.getPageArea(page).toAABB();
+        region.addEpsilon(-0.25f * m_CellSize);
+        if (m_Pager)
+            m_Pager->access(page);
+        if (otherPager)
+        {
+            // leaves gathered from a shifted lattice of the other octree may reach into its neighboring pages
+            AABB otherRegion = pager.getPageArea(page).toAABB();
+            otherRegion.addEpsilon(m_CellSize * (LEAF_SIZE_1D_INNER + 1));
+            otherOctree->materialize(otherRegion);
+        }
+        m_PageRegion = &region;
+        m_PageSizeExpo = pager.m_PageSizeExpo;
+        step(page);
+        m_PageRegion = nullptr;
+        if (m_Pager)
+        {
+            m_Pager->update(page, modifiesPages);
+            m_Pager->enforceBudget();
+        }
+        if (otherPager)
+            otherPager->enforceBudget();
+    }
+    if (m_Pager && modifiesPages)
+        m_Pager->releaseRemovedPages();
 }
 
-OctreeSF::~OctreeSF()
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::splitEmptyNode(EmptyNode* node)
 {
-    if (m_RootNode)
-        delete m_RootNode;
+    bool sign = node->m_Sign;
+    Node::release(node);
+    InnerNode* innerNode = new (*m_Arena) InnerNode();
+    void* childSlots[8];
+    m_Arena->allocateObjects(getChildSlotSize(), 8, childSlots);
+    for (int i = 0; i < 8; i++)
+        innerNode->m_Children[i] = new (childSlots[i]) EmptyNode(sign);
+    return innerNode;
 }
 
-std::shared_ptr<OctreeSF> OctreeSF::clone()
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::copyPages(Node* node, Pager& sourcePager)
 {
-    return std::make_shared<OctreeSF>(*this);
+    if (node->getNodeType() == Node::LAZY && ((LazyNode*)node)->m_Page >= 0)
+    {
+        LazyNode* placeholder = (LazyNode*)node;
+        Node* page = sourcePager.readPage(placeholder->m_Page, this);
+        if (!page)
+        {
+            // the copy is not paged and cannot keep the placeholder, the source octree still has the page on disk
+            std::cout << "The copy of the octree misses page " << placeholder->m_Page << "." << std::endl;
+            delete node;
+            return new (*m_Arena) EmptyNode(false);
+        }
+        if (placeholder->m_Inverted)
+            page->invert();
+        delete node;
+        return page;
+    }
+    if (node->getNodeType() == Node::INNER)
+    {
+        InnerNode* innerNode = (InnerNode*)node;
+        for (int i = 0; i < 8; i++)
+            innerNode->m_Children[i] = copyPages(innerNode->m_Children[i], sourcePager);
+    }
+    return node;
 }
 
-int OctreeSF::countNodes()
+template<int LeafExpo>
+int OctreeSFT<LeafExpo>::countNodes()
 {
     int counter = 0;
     m_RootNode->countNodes(counter);
     return counter;
 }
 
-int OctreeSF::countLeaves()
+template<int LeafExpo>
+int OctreeSFT<LeafExpo>::countLeaves()
 {
     int counter = 0;
     m_RootNode->forEachSurfaceNode([&counter](GridNode*) { counter++;});
     return counter;
 }
 
-int OctreeSF::countMemory()
+template<int LeafExpo>
+int OctreeSFT<LeafExpo>::countMemory()
 {
     int counter = 0;
     m_RootNode->countMemory(counter);
     return counter;
 }
 
-Ogre::Vector3 OctreeSF::getCenterOfMass(float& totalMass)
+template<int LeafExpo>
+Ogre::Vector3 OctreeSFT<LeafExpo>::getCenterOfMass(float& totalMass)
 {
     Ogre::Vector3 centerOfMass(0, 0, 0);
     totalMass = 0;
@@ -1145,28 +3634,98 @@ Ogre::Vector3 OctreeSF::getCenterOfMass(float& totalMass)
     return centerOfMass;
 }
 
-Ogre::Vector3 OctreeSF::getCenterOfMass()
+template<int LeafExpo>
+Ogre::Vector3 OctreeSFT<LeafExpo>::getCenterOfMass()
 {
     float mass = 0.0f;
     return getCenterOfMass(mass);
 }
 
-void OctreeSF::simplify()
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::collapseNode(Node* node, const Area& area)
+{
+    // during paged operations the nodes above the pages are split again by the next page
+    if (isAbovePageSize(area))
+        return node;
+    bool sign;
+    if (node->getNodeType() == Node::GRID)
+    {
+        GridNodeImpl* gridNode = (GridNodeImpl*)node;
+        if (!gridNode->m_SurfaceEdges.empty())
+            return node;
+        sign = gridNode->m_Signs[0];
+        // coarse leaves may still have surface between their lattice points
+        for (auto i = gridNode->m_BoundarySigns.begin(); i != gridNode->m_BoundarySigns.end(); ++i)
+        {
+            if (*i != sign)
+                return node;
+        }
+    }
+    else if (node->getNodeType() == Node::INNER)
+    {
+        InnerNode* innerNode = (InnerNode*)node;
+        for (int i = 0; i < 8; i++)
+        {
+            if (innerNode->m_Children[i]->getNodeType() != Node::EMPTY)
+                return node;
+        }
+        sign = ((EmptyNode*)innerNode->m_Children[0])->m_Sign;
+        for (int i = 1; i < 8; i++)
+        {
+            if (((EmptyNode*)innerNode->m_Children[i])->m_Sign != sign)
+                return node;
+        }
+    }
+    else return node;
+    markDirty(area);
+    Node::release(node);
+    return new (*m_Arena) EmptyNode(sign);
+}
+
+template<int LeafExpo>
+typename OctreeSFT<LeafExpo>::Node* OctreeSFT<LeafExpo>::simplifyNode(Node* node, const Area& area)
 {
-    // int nodeMask;
-    // m_RootNode = simplifyNode(m_RootNode, m_RootArea, nodeMask);
+    if (node->getNodeType() == Node::INNER)
+    {
+        Area subAreas[8];
+        area.getSubAreas(subAreas);
+        for (int i = 0; i < 8; i++)
+        {
+            // the children of a shared node are simplified through an own reference, the node is only copied if a child changes
+            Node* child = ((InnerNode*)node)->m_Children[i];
+            bool shared = node->isShared();
+            if (shared)
+                child->acquire();
+            Node* simplifiedChild = simplifyNode(child, subAreas[i]);
+            if (shared && simplifiedChild == child)
+            {
+                Node::release(child);
+                continue;
+            }
+            if (shared)
+            {
+                node = unshareNode(node);
+                Node::release(((InnerNode*)node)->m_Children[i]);
+            }
+            ((InnerNode*)node)->m_Children[i] = simplifiedChild;
+        }
+    }
+    return collapseNode(node, area);
 }
 
-void OctreeSF::generateTriangleCache()
+template<int LeafExpo>
+void OctreeSFT<LeafExpo>::simplify()
 {
-    auto mesh = generateMesh();
-    auto transformedMesh = std::make_shared<TransformedMesh>(mesh);
-    std::cout << "Computing cache" << std::endl;
-    mesh->computeTriangleNormals();
-    transformedMesh->computeCache();
-    m_TriangleCache.clearMeshes();
-    m_TriangleCache.addMesh(transformedMesh);
-    std::cout << "Generating BVH" << std::endl;
-    m_TriangleCache.generateBVH<AABB>();
-    std::cout << "Finished generating BVH" << std::endl;
+    m_RootNode = simplifyNode(m_RootNode, m_RootArea);
+    // pages inside of collapsed nodes are gone
+    if (m_Pager)
+        m_Pager->releaseRemovedPages();
 }
+
+template class OctreeSFT<2>;
+template class OctreeSFT<3>;
+template class OctreeSFT<4>;
+
+template struct EdgeMinCornerMasks<2>;
+template struct EdgeMinCornerMasks<3>;
+template struct EdgeMinCornerMasks<4>;
@@ -6,22 +6,24 @@
 #include <memory>
 #include <vector>
 #include <bitset>
+#include <atomic>
 #include "SolidGeometry.h"
 #include "Vector3i.h"
 #include "AABB.h"
 #include "OpInvertSDF.h"
 #include "Area.h"
 #include "BVHScene.h"
+#include "ThreadPool.h"
+#include "SignBits.h"
+#include "LeafFaceCache.h"
+#include "NodeArena.h"
+#include "MathMisc.h"
 #include <functional>
 
-// #define USE_BOOST_POOL
-
-#ifdef USE_BOOST_POOL
-#include "boost/pool/object_pool.hpp"
-#endif
-
 using std::vector;
 
+namespace OctreeFile { class Reader; }
+
 /*
 Dual Contouring design
 Proposal 1:
@@ -32,15 +34,24 @@ Grid nodes store no redundant data.
 Samples a signed distance field in an adaptive way.
 For each node (includes inner nodes and leaves) signed distances are stores for the 8 corners. This allows to interpolate signed distances in the node cell using trilinear interpolation.
 The actual signed distances are stored in a spatial hashmap because octree nodes share corners with other nodes.
+Leaves consist of 2^LeafExpo cells per dimension. The octree is compiled for LeafExpo 2, 3 and 4, larger leaves suit smooth surfaces and smaller leaves suit thin details.
+Adaptive octrees (see sampleSDFAdaptive) stop refining above the maximum depth where the surface inside a leaf is planar within a given error,
+such coarse leaves have the same lattice with larger cells. Dual contouring builds the quad of each edge from the smallest cells around it, so the mesh stays crack-free.
+Lazy octrees (see sampleSDFLazy) start as a single unevaluated node that references the source sdf. Nodes are expanded one level at a time when a ray,
+a region query or a csg operation reaches them, so memory and build time are proportional to the part of the octree that is actually used.
+Paged octrees (see enablePaging) keep the subtrees of one level, the pages, within a memory budget. Least recently used pages are written to a backing file
+and replaced by placeholder nodes that are read back like unevaluated nodes. Operations on paged octrees process one page at a time.
 */
-class OctreeSF : public SampledSolidGeometry
+template<int LeafExpo>
+class OctreeSFT : public SampledSolidGeometry
 {
+    friend class LinearOctreeSF;
 protected:
     class GridNode;
 
     typedef GridNode GridNodeImpl;
 public:
-    static const int LEAF_EXPO = 3;
+    static const int LEAF_EXPO = LeafExpo;
 	static const int LEAF_SIZE_1D = (1 << LEAF_EXPO) + 1;
 	static const int LEAF_SIZE_2D = LEAF_SIZE_1D * LEAF_SIZE_1D;
 	static const int LEAF_SIZE_3D = LEAF_SIZE_2D * LEAF_SIZE_1D;
@@ -48,6 +59,12 @@ public:
 	static const int LEAF_SIZE_2D_INNER = LEAF_SIZE_1D_INNER * LEAF_SIZE_1D_INNER;
 	static const int LEAF_SIZE_3D_INNER = LEAF_SIZE_2D_INNER * LEAF_SIZE_1D_INNER;
 
+	/// Coarse leaves of adaptive octrees are at most this many levels above the maximum depth.
+	static const int MAX_ADAPTIVE_LEVELS = 3;
+
+    /// Packed signs of a leaf lattice, bit i belongs to lattice point i.
+    typedef SignBits<LEAF_SIZE_3D> LeafSigns;
+
     struct SurfaceVertex
 	{
 		Vertex vertex;
@@ -64,13 +81,32 @@ protected:
 		{
 			INNER = 0,
 			EMPTY = 1,
-			GRID = 2
+			GRID = 2,
+			LAZY = 3
 		};
 	protected:
 		Type m_NodeType;
+
+		/// Number of parents, a node with more than one is shared between clones and is copied before it is changed (see unshareNode).
+		std::atomic<int> m_References;
 	public:
+		Node() : m_References(1) {}
+		Node(const Node& rhs) : m_NodeType(rhs.m_NodeType), m_References(1) {}
 		virtual ~Node() {}
 
+		inline void acquire() { m_References++; }
+		inline bool isShared() const { return m_References > 1; }
+
+		/// Drops a reference, the node is deleted once no parent refers to it.
+		static inline void release(Node* node) { if (--node->m_References == 0) delete node; }
+
+        /// Nodes are allocated in the arena of their octree, either directly or in a preallocated child slot.
+        static void* operator new(size_t size, NodeArena& arena) { return arena.allocateObject(size); }
+        static void* operator new(size_t, void* slot) { return slot; }
+        static void operator delete(void* node) { NodeArena::freeObject(node); }
+        static void operator delete(void* node, NodeArena&) { NodeArena::freeObject(node); }
+        static void operator delete(void* node, void*) { NodeArena::freeObject(node); }
+
         struct Edge
         {
             GridNode* n1;
@@ -111,20 +147,29 @@ protected:
 
 		virtual void invert() = 0;
 
-		virtual Node* clone() const = 0;
+		/// Deep copies the node into the given arena.
+		virtual Node* clone(NodeArena& arena) const = 0;
 
         virtual bool rayIntersectUpdate(const Area&, const Ray&, Ray::Intersection&) { return false; }
 
-		inline Type getNodeType() { return m_NodeType; }
+		inline Type getNodeType() const { return m_NodeType; }
 	};
 
+	// the node classes derive from a dependent base, so its types are made visible here
+	typedef typename Node::Face Face;
+	typedef typename Node::Edge Edge;
+
 	class InnerNode : public Node
 	{
 	public:
 		Node* m_Children[8];
-        InnerNode(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF);
+        /// The children are set by the caller.
+        InnerNode() { this->m_NodeType = Node::INNER; }
+        InnerNode(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF);
 		~InnerNode();
-		InnerNode(const InnerNode& rhs);
+		InnerNode(const InnerNode& rhs, NodeArena& arena);
+        /// Shares the children of another inner node.
+        InnerNode(const InnerNode& rhs);
 
         virtual void forEachSurfaceNode(const Area& area, const std::function<void(GridNode*, const Area&)>& function) override;
         virtual void forEachSurfaceNode(const std::function<void(GridNode*)>& function) override;
@@ -136,7 +181,7 @@ protected:
 
 		virtual void invert();
 
-		virtual Node* clone() const override { return new InnerNode(*this); }
+		virtual Node* clone(NodeArena& arena) const override;
 
         virtual bool rayIntersectUpdate(const Area& area, const Ray& ray, Ray::Intersection& intersection) override;
 
@@ -150,6 +195,7 @@ protected:
 	{
 	public:
 		// EmptyNode() {}
+        EmptyNode(bool sign) : m_Sign(sign) { this->m_NodeType = Node::EMPTY; }
         EmptyNode(const Area& area, const SolidGeometry& implicitSDF);
 		~EmptyNode();
 
@@ -159,13 +205,38 @@ protected:
 
 		virtual void countMemory(int& memoryCounter) const override { memoryCounter += sizeof(*this); }
 
-		virtual Node* clone() const override { return new EmptyNode(*this); }
+		virtual Node* clone(NodeArena& arena) const override { return new (arena) EmptyNode(*this); }
 
 		virtual void invert();
 
 		// virtual void sumPositionsAndMass(const Area& area, Ogre::Vector3& weightedPosSum, float& totalMass) override;
 	};
 
+	/// Placeholder for a subtree of a lazy octree that has not been sampled yet, the source sdf must outlive the octree.
+	/// Pages of paged octrees that are on disk use the same placeholder without sdf.
+	class LazyNode : public Node
+	{
+	public:
+		LazyNode(const SolidGeometry* implicitSDF) : m_SDF(implicitSDF), m_Page(-1), m_Inverted(false) { this->m_NodeType = Node::LAZY; }
+		LazyNode(int page) : m_SDF(nullptr), m_Page(page), m_Inverted(false) { this->m_NodeType = Node::LAZY; }
+
+		const SolidGeometry* m_SDF;
+
+		/// Index of the page in the pager, -1 for unevaluated sdf nodes.
+		int m_Page;
+
+		/// The subtree is inverted once it is expanded.
+		bool m_Inverted;
+
+		virtual void countNodes(int& counter) const override { counter++; }
+
+		virtual void countMemory(int& memoryCounter) const override { memoryCounter += sizeof(*this); }
+
+		virtual Node* clone(NodeArena& arena) const override { return new (arena) LazyNode(*this); }
+
+		virtual void invert() override { m_Inverted = !m_Inverted; }
+	};
+
     static inline int indexOf(int x, int y, int z) { return x*LEAF_SIZE_2D + y * LEAF_SIZE_1D + z; }
 
     static inline int indexOf(const Vector3i &v) { return indexOf(v.x, v.y, v.z); }
@@ -175,29 +246,87 @@ protected:
     struct SurfaceEdge
     {
         SurfaceEdge() {}
-        inline void init(const Vector3i& localMinPos, unsigned char direction, Ogre::Vector3 globalPos, float edgeLength, const SolidGeometry& sdf)
+        /// Sets up the edge indices, the hermite data is computed for all new edges of a leaf at once (see GridNode::sampleSurfaceEdges).
+        inline void init(const Vector3i& localMinPos, unsigned char direction)
         {
             this->direction = direction;
             edgeIndex1 = indexOf(localMinPos);
-            static const int EDGE_OFFSETS[] = { LEAF_SIZE_2D, LEAF_SIZE_1D, 1 };
-            edgeIndex2 = edgeIndex1 + EDGE_OFFSETS[direction];
-
-            Sample s;
-            globalPos[direction] += edgeLength * 0.5f;
-            sdf.getSample(globalPos, s);
-            // Ogre::Vector3 rayDir(0,0,0);
-            // rayDir[direction] = 1.0f;
-            // sdf.raycastClosest(Ray(globalPos, rayDir), s);
-            vertex.position = s.closestSurfacePos;
-            vertex.normal = s.normal;
         }
 
         SurfaceEdge clone() { SurfaceEdge copy(*this); return copy; }
 
-        Vertex vertex;
-        unsigned short edgeIndex1;
-        unsigned short edgeIndex2;
-        unsigned char direction;
+        unsigned short edgeIndex1 : 14;
+        unsigned short direction : 2;
+#ifdef USE_COMPACT_HERMITE_EDGES
+        /// Intersection of the surface tangent plane with the edge as a fraction of the edge length.
+        unsigned short crossing;
+        short encodedNormal[2];
+#else
+        Ogre::Vector3 position;
+        Ogre::Vector3 normal;
+#endif
+
+        inline unsigned short getEdgeIndex2() const
+        {
+            static const int EDGE_OFFSETS[] = { LEAF_SIZE_2D, LEAF_SIZE_1D, 1 };
+            return edgeIndex1 + EDGE_OFFSETS[direction];
+        }
+
+        /// Stores the closest surface point and normal of the edge, leafArea is the area of the leaf the edge belongs to.
+        inline void setSample(const Area& leafArea, const Sample& sample)
+        {
+#ifdef USE_COMPACT_HERMITE_EDGES
+            float cellSize = leafArea.m_RealSize / LEAF_SIZE_1D_INNER;
+            Ogre::Vector3 edgeCenter = getMinRealPos(leafArea, cellSize);
+            edgeCenter[direction] += cellSize * 0.5f;
+            // the tangent plane crosses the edge line at offset n * (p - c) / n[direction] from the center
+            float offset = (sample.closestSurfacePos - edgeCenter)[direction];
+            if (std::fabs(sample.normal[direction]) > 0.1f)
+                offset = sample.normal.dotProduct(sample.closestSurfacePos - edgeCenter) / sample.normal[direction];
+            float fraction = std::min(std::max(0.5f + offset / cellSize, 0.0f), 1.0f);
+            crossing = (unsigned short)(fraction * 65535.0f + 0.5f);
+            MathMisc::encodeOctahedral(sample.normal, encodedNormal);
+#else
+            position = sample.closestSurfacePos;
+            normal = sample.normal;
+#endif
+        }
+
+        inline Ogre::Vector3 getPosition(const Area& leafArea) const
+        {
+#ifdef USE_COMPACT_HERMITE_EDGES
+            float cellSize = leafArea.m_RealSize / LEAF_SIZE_1D_INNER;
+            Ogre::Vector3 position = getMinRealPos(leafArea, cellSize);
+            position[direction] += crossing * (cellSize / 65535.0f);
+            return position;
+#else
+            return position;
+#endif
+        }
+
+        inline Ogre::Vector3 getNormal() const
+        {
+#ifdef USE_COMPACT_HERMITE_EDGES
+            return MathMisc::decodeOctahedral(encodedNormal);
+#else
+            return normal;
+#endif
+        }
+
+        inline void flipNormal()
+        {
+#ifdef USE_COMPACT_HERMITE_EDGES
+            MathMisc::encodeOctahedral(-MathMisc::decodeOctahedral(encodedNormal), encodedNormal);
+#else
+            normal = -normal;
+#endif
+        }
+
+        inline Ogre::Vector3 getMinRealPos(const Area& leafArea, float cellSize) const
+        {
+            Vector3i minPos = fromIndex(edgeIndex1);
+            return leafArea.m_MinRealPos + Ogre::Vector3((float)minPos.x, (float)minPos.y, (float)minPos.z) * cellSize;
+        }
 
         inline unsigned short getNeighborCube(unsigned char neighborIndex) const
         {
@@ -221,30 +350,60 @@ protected:
     class GridNode : public Node
     {
     public:
-        GridNode() { m_NodeType = GRID; }
-        GridNode(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF);
+        typedef std::vector<SurfaceEdge, ArenaAllocator<SurfaceEdge> > SurfaceEdgeVector;
+        typedef std::vector<SurfaceCube, ArenaAllocator<SurfaceCube> > SurfaceCubeVector;
+        typedef std::vector<std::pair<Vector3i, GridNode*>, ArenaAllocator<std::pair<Vector3i, GridNode*> > > NeighborVector;
+        typedef std::vector<bool, ArenaAllocator<bool> > BoundarySignVector;
+
+        GridNode() { this->m_NodeType = Node::GRID; }
+        /// Creates a leaf without signs and edges, the caller fills in the payload (see load).
+        GridNode(OctreeSFT* tree, const Area& area);
+        GridNode(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF);
+        GridNode(const GridNode& rhs, NodeArena& arena);
         ~GridNode();
 
         Area m_Area;        // remove me!
 
-        bool m_Signs[LEAF_SIZE_3D];
+        LeafSigns m_Signs;
 
-        std::vector<SurfaceEdge> m_SurfaceEdges;
+        // the payload vectors are allocated in the arena of the octree
+        SurfaceEdgeVector m_SurfaceEdges;
 
-        std::vector<SurfaceCube> m_SurfaceCubes;
+        SurfaceCubeVector m_SurfaceCubes;
 
         // stores (offset, neighbor)
-        std::vector<std::pair<Vector3i, GridNode*> > m_CachedNeighbors;
+        NeighborVector m_CachedNeighbors;
+
+        /// Signs of the finest lattice on the 6 faces of a coarse leaf, empty for leaves at the maximum depth.
+        BoundarySignVector m_BoundarySigns;
 
         virtual void forEachSurfaceNode(const Area& area, const std::function<void(GridNode*, const Area&)>& function) override;
         virtual void forEachSurfaceNode(const std::function<void(GridNode*)>& function) override;
 
-        void computeSigns(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF);
-        void computeEdges(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF);
-        void computeEdges(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF, bool ignoreEdges[3][LEAF_SIZE_3D]);
+        void computeSigns(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF);
+        void computeEdges(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF);
+        void computeEdges(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF, const LeafSigns* ignoreEdges);
+
+        /// Finds the lattice edges with a sign change, one bit set per edge min corner for each direction.
+        void getSignChangeEdges(LeafSigns edges[3]) const;
+
+        /// Computes the vertices of all surface edges starting at firstEdge with a single batched sdf query.
+        void sampleSurfaceEdges(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF, size_t firstEdge);
 
         void cacheNeighbor(const Vector3i& offset, GridNode* other);
 
+        /// Fits a plane to the hermite data, the normal points away from the inside. Returns false if there are no surface edges.
+        bool fitPlane(const Area& area, Ogre::Vector3& planePos, Ogre::Vector3& planeNormal) const;
+
+        /// Checks whether the leaf approximates the surface within maxError, in that case the finest boundary signs are stored so the leaf can be refined later.
+        bool approximatesSurface(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF, float maxError);
+
+        /// Sign of a point of the finest lattice on the boundary of a coarse leaf, boundaryPos is relative to the leaf min corner.
+        bool getBoundarySign(const Vector3i& boundaryPos) const;
+
+        /// Returns the surface cube with the given index or nullptr.
+        const SurfaceCube* findSurfaceCube(int cubeIndex) const;
+
         virtual void countNodes(int& counter) const override { counter++; }
 
         virtual void countMemory(int& memoryCounter) const override;
@@ -252,23 +411,64 @@ protected:
         void generateVerticesDC(vector<Vertex>& vertices);
         void generateIndicesDC(const Area& area, vector<unsigned int>& indices, vector<Vertex>& vertices) const;
 
+        /// Generates the quads of the edges this leaf owns in an octree with leaves of different sizes, neighbor cells are looked up in the tree.
+        /// Returns the number of edges skipped because a cell around them has no vertex.
+        int generateIndicesAdaptive(const OctreeSFT* tree, vector<unsigned int>& indices) const;
+
+        /// Decodes the hermite data of all surface edges, surfaceEdgeMaps[direction][edgeIndex1] points to the vertex of an edge.
+        void decodeSurfaceEdges(std::vector<Vertex>& edgeVertices, const Vertex* surfaceEdgeMaps[3][LEAF_SIZE_3D]) const;
+
         void generateVerticesMC(vector<Vertex>& vertices);
         void generateIndicesMC(const Area& area, vector<unsigned int>& indices, vector<Vertex>& vertices) const;
 
-        virtual Node* clone() const override;
+        virtual Node* clone(NodeArena& arena) const override;
 
         virtual void invert();
 
-        void merge(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF);
-        void intersect(OctreeSF* tree, const Area& area, const SolidGeometry& implicitSDF);
+        void merge(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF);
+        void intersect(OctreeSFT* tree, const Area& area, const SolidGeometry& implicitSDF);
 
-        void intersect(GridNode* otherNode);
-        void merge(GridNode* otherNode);
+        enum AlignedOperation
+        {
+            ALIGNED_INTERSECT,
+            ALIGNED_SUBTRACT,
+            ALIGNED_MERGE
+        };
+
+        /// Csg with a leaf of another octree that covers the same area. The signs are combined bitwise, every remaining surface edge takes the hermite data
+        /// of the operand that has the sign change, if both have one the crossing that bounds the result wins.
+        void combineAligned(const GridNode* otherNode, const Area& area, AlignedOperation operation);
 
-        static inline unsigned char getCubeBitMask(int index, const bool* signsArray);
+        void intersect(const GridNode* otherNode, const Area& area) { combineAligned(otherNode, area, ALIGNED_INTERSECT); }
+        void subtract(const GridNode* otherNode, const Area& area) { combineAligned(otherNode, area, ALIGNED_SUBTRACT); }
+        void merge(const GridNode* otherNode, const Area& area) { combineAligned(otherNode, area, ALIGNED_MERGE); }
+
+        static inline unsigned char getCubeBitMask(int index, const LeafSigns& signs);
 
         virtual bool rayIntersectUpdate(const Area& area, const Ray& ray, Ray::Intersection& intersection) override;
 
+        /// Returns the surface edge whose hermite position is closest to the point, or nullptr if the leaf has no surface edges.
+        const SurfaceEdge* findClosestSurfaceEdge(const Area& area, const Ogre::Vector3& point, Ogre::Vector3& position) const
+        {
+            float closestSquaredDistance = std::numeric_limits<float>::max();
+            return findClosestSurfaceEdge(area, point, position, closestSquaredDistance);
+        }
+
+        /// Only considers edges closer than the given squared distance, which is updated if one is found.
+        const SurfaceEdge* findClosestSurfaceEdge(const Area& area, const Ogre::Vector3& point, Ogre::Vector3& position, float& closestSquaredDistance) const;
+
+        /// The hermite normal oriented away from the inside by the signs of the edge, inverted leaves keep the normals of their source.
+        Ogre::Vector3 getOutwardNormal(const SurfaceEdge& edge) const;
+
+        /// Returns true and the sign if the corners of the cell that contains the point have the same sign.
+        bool getUniformCellSign(const Area& area, const Ogre::Vector3& point, bool& sign) const;
+
+        /// The signs of the cell that contains the point decide, if they differ the tangent plane of the closest hermite sample decides.
+        bool getSign(const Area& area, const Ogre::Vector3& point) const;
+
+        /// Checks whether any cell that overlaps the aabb has a sign change.
+        bool intersectsSurface(const Area& area, const AABB& aabb) const;
+
         // virtual void sumPositionsAndMass(const Area& area, Ogre::Vector3& weightedPosSum, float& totalMass) override;
     };
 
@@ -281,7 +481,12 @@ protected:
 
 	float m_GridLeafStepSize;
 
-	Node* simplifyNode(Node* node, const Area& area, int& nodeTypeMask);
+	/// Replaces a leaf without surface edges or an inner node with 8 empty children of the same sign by an empty node, otherwise returns the node.
+	/// Csg operations call it on their way back up, so changed subtrees collapse bottom up without an extra pass.
+	Node* collapseNode(Node* node, const Area& area);
+
+	/// Collapses a whole subtree bottom up.
+	Node* simplifyNode(Node* node, const Area& area);
 
 	/// Intersects aligned octree nodes.
 	Node* intersectAlignedNode(Node* node, Node* otherNode, const Area& area);
@@ -290,35 +495,273 @@ protected:
 
 	Node* mergeAlignedNode(Node* node, Node* otherNode, const Area& area);
 
+	/// Combines nodes with an octree whose lattice coincides with the lattice of this octree, offset maps cells of this octree to cells of the other one.
+	Node* combineLatticeNode(Node* node, const Area& area, const OctreeSFT* otherOctree, const Vector3i& offset, typename GridNode::AlignedOperation operation);
+
+	/// Returns the offset from cells of this octree to cells of the other octree, or false if the lattices do not coincide.
+	bool getLatticeOffset(const OctreeSFT* otherOctree, Vector3i& offset) const;
+
+	/// Calls the function for each node of the subtree that contains lattice points of the box [minPos, maxPos], lazy nodes are not expanded.
+	void forEachNode(const Node* node, const Area& area, const Vector3i& minPos, const Vector3i& maxPos, const std::function<void(const Node*, const Area&)>& function) const;
+
+	/// Fills a leaf of another octree with the same cell size from the lattice of this octree, minPos is the min corner of the leaf in cells of this octree.
+	/// Signs and hermite data are copied from the finest leaves, the remaining nodes are sampled.
+	void gatherLeaf(const Vector3i& minPos, OctreeSFT* leafOctree, const Area& leafArea, GridNode& leaf) const;
+
+	void combineOctree(OctreeSFT* otherOctree, typename GridNode::AlignedOperation operation);
+
     Node* intersect(Node* node, const SolidGeometry& implicitSDF, const Area& area);
 
     Node* merge(Node* node, const SolidGeometry& implicitSDF, const Area& area);
 
-    Node* createNode(const Area& area, const SolidGeometry& implicitSDF);
+    /// Creates the node for an area, inner and empty nodes are constructed in the given child slot if there is one.
+    /// With lazyChildren, an inner node gets unevaluated children instead of sampling its subtree.
+    Node* createNode(const Area& area, const SolidGeometry& implicitSDF, void* childSlot = nullptr, bool lazyChildren = false);
+
+    /// Replaces an unevaluated node by the node sampled from its sdf, the children of an inner node stay unevaluated.
+    Node* expandLazyNode(LazyNode* node, const Area& area);
+
+    /// Expands all unevaluated nodes that intersect the region.
+    Node* expandLazyNodes(Node* node, const Area& area, const AABB& region);
+
+    /// Ray traversal that expands the unevaluated nodes the ray reaches, children are visited front to back so nodes behind the closest hit stay unevaluated.
+    Node* rayIntersectLazy(Node* node, const Area& area, const Ray& ray, Ray::Intersection& intersection, bool& hit);
+
+    void rayIntersectBatch(const std::vector<Ray>& rays, float maxDist, bool anyHit, Ray::BatchResult& result);
+
+    /// Traverses the subtree with the rays of the mask, children are visited in the front to back order of the first ray.
+    /// Returns the rays of the mask that still search for a hit, for any hit queries a ray stops at its first hit.
+    unsigned int rayIntersectPacket(Node* node, const Area& area, RayPacket& packet, unsigned int mask, bool anyHit, Ray::Intersection* intersections, unsigned char* hits);
+
+    /// True if the octree was sampled lazily and may still contain unevaluated nodes.
+    bool m_HasLazyNodes;
+
+    /// Meshes the leaves that intersect region, or all leaves if region is nullptr. numLeaves is the leaf count the buffers are reserved for.
+    void generateVerticesAndIndices(vector<Vertex>& vertices, vector<unsigned int>& indices, const AABB* region, int numLeaves);
+
+    /// Size of the child slots, InnerNode allocates the slots of its 8 children as one block.
+    static size_t getChildSlotSize();
+
+    /// Calls function(i) for the 8 children of a node, spawns them as tasks if the node is above the task depth.
+    void forEachChild(const Area& area, const std::function<void(int)>& function);
 
     inline Ogre::Vector3 getRealPos(const Vector3i& cellIndex) const;
 
-	BVHScene m_TriangleCache;
+    /// Real position of the cell index 0, the root min corner has negative cell indices once the octree grew towards negative coordinates.
+    inline Ogre::Vector3 getLatticeOrigin() const { return m_RootArea.m_MinRealPos - m_RootArea.m_MinPos.toOgreVec() * m_CellSize; }
+
+    /// Log2 of the number of finest cells per leaf cell, only coarse leaves of adaptive octrees have a stride above 0.
+    static inline int getLeafStrideExpo(const Area& area) { return area.m_SizeExpo - LEAF_EXPO; }
+
+    /// The lattice of a leaf, points of coarse leaves coincide with points of the finest lattice.
+    SolidGeometry::Lattice getLeafLattice(const Area& area) const;
+
+    /// Maximum geometric error of coarse leaves, 0 if the octree is not adaptive.
+    float m_MaxLeafError;
+
+    /// Reconstructs the sdf inside a coarse leaf from its fitted plane and boundary signs.
+    class CoarseLeafGeometry;
+
+    /// Builds an inner node that replaces a coarse leaf, the leaf is not deleted.
+    Node* refineLeaf(const GridNode* leaf, const Area& area);
+
+    /// Returns the leaf that contains the finest cell with the given index or nullptr if the cell is in an empty node.
+    const GridNode* findLeaf(const Vector3i& cellIndex) const;
+
+    /// Returns the empty node, leaf or unevaluated node that contains the point, or nullptr if the point is outside of the octree.
+    const Node* findNode(const Ogre::Vector3& point, Area& area) const;
+
+    bool intersectsSurface(const Node* node, const Area& area, const AABB& aabb) const;
+
+    /// Searches the hermite samples of the subtree that are closer than the given squared distance, which is updated with the closest one.
+    /// Unevaluated nodes contribute the closest surface point of their source sdf. Returns false if nothing closer was found.
+    bool findClosestSurfacePoint(const Node* node, const Area& area, const Ogre::Vector3& point, float& closestSquaredDistance, Sample& closest) const;
+
+    /// Owns the memory of all nodes and leaf payloads, clones that still share nodes of the octree keep it alive.
+    std::shared_ptr<NodeArena> m_Arena;
+
+    /// Arenas of the nodes that are shared with the octrees this octree was cloned from.
+    std::vector<std::shared_ptr<NodeArena> > m_SharedArenas;
+
+    /// Returns a node that only this octree refers to. A shared node is released and replaced by a copy,
+    /// the copy of an inner node shares the children, so csg only copies the path to the nodes it changes.
+    Node* unshareNode(Node* node);
+
+    /// Unshares all nodes of a subtree, for operations that change every node.
+    Node* unshareSubtree(Node* node);
+
+    /// Optional pool for parallel construction, not owned by the octree.
+    ThreadPool* m_ThreadPool;
+
+    /// Nodes less than m_MaxTaskDepth levels below the root process their children as parallel tasks.
+    int m_MaxTaskDepth;
+
+    typedef LeafFaceCache<bool, LEAF_SIZE_1D> SignFaceCache;
+
+    /// Boundary signs shared between neighboring leaves, only exists while the octree is sampled.
+    SignFaceCache* m_SignFaceCache;
+
+    /// Creates the root node using a face cache, so shared leaf boundaries are only evaluated once.
+    void sampleRootNode(const SolidGeometry& implicitSDF);
+
+    /// The arrays of a serialized subtree (see OctreeFile.h), leaf payloads are stored in the order in which the leaves appear in the node types.
+    struct SubtreeData
+    {
+        SubtreeData() : edgeOffsets(1, 0), boundarySignOffsets(1, 0), incomplete(false) {}
+        std::vector<unsigned char> nodeTypes;
+        std::vector<LeafSigns> leafSigns;
+        std::vector<unsigned int> edgeOffsets;
+        std::vector<SurfaceEdge> surfaceEdges;
+        std::vector<unsigned long long> boundarySignOffsets;
+        std::vector<BitOps::Word> boundarySigns;
+        /// Set if a page could not be read from the backing file, the data must not be written.
+        bool incomplete;
+    };
+
+    /// Appends a subtree in depth first order, pages on disk are read from the backing file.
+    void serializeNode(const Node* node, SubtreeData& data);
+
+    /// Writes a subtree that covers the given area as octree data, returns the number of bytes written or 0 on failure.
+    size_t writeSubtree(const Node* node, const Area& area, std::ostream& stream);
+
+    /// Builds the subtree stored in octree data in the arena of this octree, returns nullptr if the data is invalid.
+    Node* readSubtree(const OctreeFile::Reader& reader);
+
+    /// Writes least recently used pages to a backing file, see enablePaging.
+    class Pager;
+    Pager* m_Pager;
+
+    /// Region of the page that is processed by a paged operation, csg operations skip the nodes outside of it.
+    const AABB* m_PageRegion;
+
+    /// Size of the pages of the paged operation, empty nodes above are split instead of being resampled as a whole.
+    int m_PageSizeExpo;
+
+    /// Runs a step for each page of the pager, each step processes the nodes that intersect the region of the page.
+    /// Pages of otherOctree that intersect the region are read before the step, the budgets of both octrees are enforced after it.
+    void forEachPage(Pager& pager, bool modifiesPages, OctreeSFT* otherOctree, const std::function<void(int page)>& step);
+
+    /// Nodes that an octree csg left unchanged because the page of the other octree they overlap could not be read.
+    int m_NumSkippedOperandNodes;
+
+    /// Prints and resets m_NumSkippedOperandNodes after an octree csg.
+    void reportSkippedOperandNodes();
+
+    /// True if the other octree has a paged out placeholder that contains lattice points of the box [minPos, maxPos].
+    bool hasPagePlaceholder(const Vector3i& minPos, const Vector3i& maxPos) const;
+
+    /// True if a paged operation has to split nodes of the area to process one page at a time.
+    inline bool isAbovePageSize(const Area& area) const { return m_PageRegion && area.m_SizeExpo > m_PageSizeExpo; }
+
+    /// Replaces an empty node by an inner node with 8 empty children of the same sign.
+    Node* splitEmptyNode(EmptyNode* node);
+
+    /// Replaces the paged out nodes of a copied subtree by the pages of the original octree.
+    Node* copyPages(Node* node, Pager& sourcePager);
+
+    /// Areas of the nodes that csg operations changed since the last incremental mesh update, only recorded once an incremental mesh exists.
+    std::vector<Area> m_DirtyAreas;
+    bool m_TrackDirtyAreas;
+
+    /// Incremented whenever the surface cubes of the leaves are generated for a mesh, an incremental mesh is rebuilt if another mesh was generated in between.
+    /// The counter is shared with clones, meshing a clone writes into the leaves it shares with this octree.
+    std::shared_ptr<std::atomic<unsigned int> > m_MeshGeneration;
+
+    inline void markDirty(const Area& area) { if (m_TrackDirtyAreas) m_DirtyAreas.push_back(area); }
+
+    /// Calls the function for each leaf that overlaps the box [minPos, maxPos) in cell coordinates.
+    void forEachLeaf(Node* node, const Area& area, const Vector3i& minPos, const Vector3i& maxPos, const std::function<void(GridNode*)>& function);
+
+    /// Lets each leaf that overlaps vertexRegion cache its neighbors in positive directions, whose cells it needs to generate its quads.
+    void cacheSurfaceNeighbors(const AABB* vertexRegion);
 public:
-	~OctreeSF();
-	OctreeSF() : m_RootNode(nullptr) {}
-	OctreeSF(const OctreeSF& other);
+	~OctreeSFT();
+	OctreeSFT() : m_RootNode(nullptr), m_HasLazyNodes(false), m_MaxLeafError(0.0f), m_Arena(std::make_shared<NodeArena>()), m_ThreadPool(nullptr), m_MaxTaskDepth(0), m_SignFaceCache(nullptr), m_Pager(nullptr), m_PageRegion(nullptr), m_PageSizeExpo(0),
+		m_NumSkippedOperandNodes(0), m_TrackDirtyAreas(false), m_MeshGeneration(std::make_shared<std::atomic<unsigned int> >(0)) {}
+	OctreeSFT(const OctreeSFT& other);
+
+    static std::shared_ptr<OctreeSFT> sampleSDF(SolidGeometry* otherSDF, int maxDepth);
+
+    static std::shared_ptr<OctreeSFT> sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth);
 
-    static std::shared_ptr<OctreeSF> sampleSDF(SolidGeometry* otherSDF, int maxDepth);
+    /// Samples the sdf in parallel, subtrees up to maxTaskDepth levels below the root are distributed over the thread pool.
+    static std::shared_ptr<OctreeSFT> sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, ThreadPool* threadPool, int maxTaskDepth = 3);
 
-    static std::shared_ptr<OctreeSF> sampleSDF(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth);
+    /// Samples the sdf adaptively, leaves stop refining once their surface is planar within maxError. Later csg operations refine coarse leaves where needed.
+    static std::shared_ptr<OctreeSFT> sampleSDFAdaptive(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, float maxError, ThreadPool* threadPool = nullptr, int maxTaskDepth = 3);
+
+    /// Creates a lazy octree, nothing is sampled until a query touches it. The sdf is referenced by the octree and must outlive it.
+    static std::shared_ptr<OctreeSFT> sampleSDFLazy(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth);
+
+    /// Expands the unevaluated nodes of a lazy octree and reads the pages of a paged octree that intersect the region.
+    void materialize(const AABB& region);
+
+    /// Expands all unevaluated nodes of a lazy octree, pages of paged octrees stay on disk.
+    void materialize();
+
+    /// Counters of a paged octree, see enablePaging.
+    struct PagingStats
+    {
+        PagingStats() : pageIns(0), pageOuts(0), hits(0), residentPages(0), pagesOnDisk(0) {}
+
+        /// Pages that were read from the backing file.
+        size_t pageIns;
+
+        /// Pages that were written to the backing file and released.
+        size_t pageOuts;
+
+        /// Accesses to pages that were resident.
+        size_t hits;
+
+        size_t residentPages;
+
+        size_t pagesOnDisk;
+
+        float getHitRate() const { return (hits + pageIns) ? (float)hits / (hits + pageIns) : 1.0f; }
+    };
+
+    /// Pages the subtrees pageLevel levels below the root out to a backing file once the octree uses more than residentBudget bytes, least recently used pages first.
+    /// Csg operations, generateMesh, ray queries and save read the pages back as they need them. Lazy octrees are materialized first, copies are not paged.
+    /// The budget should hold at least 27 pages, meshing a page needs its neighbors. The backing file is removed with the octree.
+    void enablePaging(const std::string& backingFileName, int pageLevel, size_t residentBudget);
+
+    /// Samples the sdf into a paged octree one page at a time, so the octree never uses much more than residentBudget bytes.
+    static std::shared_ptr<OctreeSFT> sampleSDFPaged(SolidGeometry* otherSDF, const AABB& aabb, int maxDepth, const std::string& backingFileName, int pageLevel, size_t residentBudget);
+
+    /// Page ins, page outs and hits of a paged octree.
+    PagingStats getPagingStats() const;
+
+    /// Maximum geometric error of coarse leaves, 0 if the octree is not adaptive.
+    float getMaxLeafError() const { return m_MaxLeafError; }
+
+    /// Sets the thread pool used for parallel operations on the octree, pass nullptr to run serially.
+    void setThreadPool(ThreadPool* threadPool, int maxTaskDepth = 3);
 
 	float getInverseCellSize() override;
 
+    /// Allocation counts and memory of the node arena.
+    NodeArena::Stats getAllocationStats() const { return m_Arena->getStats(); }
+
 	AABB getAABB() const override;
 
 	std::shared_ptr<Mesh> generateMesh() override;
 
-	/// Builds the triangle cache using marching cubes required for fast intersectsSurface queries.
-	void generateTriangleCache();
+	/// Generates the mesh of the leaves that intersect region, lazy octrees only expand the region and its neighboring leaves.
+	std::shared_ptr<Mesh> generateMesh(const AABB& region);
 
+	/// The queries of the SolidGeometry interface work on the nodes and the hermite data, so octrees can be resampled and used as csg operands.
+	/// They do not expand lazy nodes, unevaluated subtrees are answered by their source sdf. Paged octrees cannot be used as query sources:
+	/// paged out subtrees are not loaded, so the queries assert if they reach one, and the octree csg refuses to resample a paged octree.
 	virtual bool intersectsSurface(const AABB &) const override;
 
+	virtual bool getSign(const Ogre::Vector3& point) const override;
+
+	/// Approximates the sample by the closest hermite sample of the octree, the leaves around the point are searched until no closer one can exist.
+	/// The distance is accurate up to the spacing of the hermite samples, the normal is the one of the closest sample.
+	virtual void getSample(const Ogre::Vector3& point, Sample& sample) const override;
+
+	virtual float getDistanceLowerBound(const Ogre::Vector3& point, float maxDistance) const override;
+
 	/// Subtracts the given signed distance field from this octree.
     void subtract(SolidGeometry* otherSDF);
 
@@ -326,15 +769,26 @@ public:
     void intersect(SolidGeometry* otherSDF);
 
 	/// Intersects the octree with another aligned octree (underlying grids must match).
-	void intersectAlignedOctree(OctreeSF* otherOctree);
+	void intersectAlignedOctree(OctreeSFT* otherOctree);
 
 	/// Subtracts another aligned octree from this octree.
-	void subtractAlignedOctree(OctreeSF* otherOctree);
+	void subtractAlignedOctree(OctreeSFT* otherOctree);
 
 	/// Merges another aligned octree into this octree.
-	void mergeAlignedOctree(OctreeSF* otherOctree);
+	void mergeAlignedOctree(OctreeSFT* otherOctree);
 
-	/// Resizes the octree so that it covers the given aabb.
+	/// Intersects the octree with an octree of any placement and depth. If the lattices coincide, leaves are combined like aligned leaves,
+	/// otherwise the other octree is resampled with its SolidGeometry queries. Both only traverse the nodes where the other surface passes through.
+	void intersectOctree(OctreeSFT* otherOctree);
+
+	/// Subtracts an octree of any placement and depth from this octree.
+	void subtractOctree(OctreeSFT* otherOctree);
+
+	/// Merges an octree of any placement and depth into this octree.
+	void mergeOctree(OctreeSFT* otherOctree);
+
+	/// Grows the octree in place until it covers the given aabb. The old root becomes a child of a larger root with empty siblings,
+	/// so the content is kept as it is and cell indices stay valid. Paged octrees cannot be resized.
 	void resize(const AABB& aabb);
 
 	/// Merges the octree with another signed distance field.
@@ -343,8 +797,16 @@ public:
 	/// Inverts the sdf represented by the octree.
 	void invert();
 
-	/// Clones the octree and returns the copy.
-	std::shared_ptr<OctreeSF> clone();
+	/// Clones the octree in constant time, the clone shares all nodes with the octree until csg operations change them.
+	/// Lazy and paged octrees are copied, because they replace nodes in place. Use the copy constructor for a deep copy.
+	/// Octrees that share leaves must not be meshed concurrently, meshing writes the surface cubes into the leaves.
+	std::shared_ptr<OctreeSFT> clone();
+
+	/// Writes the octree to a binary file (see OctreeFile.h), lazy octrees are materialized first. Returns false on failure.
+	bool save(const std::string& fileName);
+
+	/// Loads an octree written by save from a memory mapped file, returns nullptr if the file is invalid or was written with another leaf size.
+	static std::shared_ptr<OctreeSFT> load(const std::string& fileName);
 
 	/// Counts the number of nodes in the octree.
 	int countNodes();
@@ -361,15 +823,65 @@ public:
 	/// Computes the center of mass.
 	Ogre::Vector3 getCenterOfMass();
 
-	/// Removes nodes that are not required.
+	/// Collapses leaves without surface and inner nodes whose children are empty nodes of the same sign, csg operations already do this for the nodes they change.
 	void simplify();
 
 	int getHeight() { return m_RootArea.m_SizeExpo; }
 
     void generateVerticesAndIndices(vector<Vertex>& vertices, vector<unsigned int>& indices);
 
+    /// Mesh that follows the edits of an octree, see updateIncrementalMesh.
+    /// Each leaf owns a range of the vertex buffer and a range of the index buffer, unused parts of index ranges hold degenerate triangles.
+    struct IncrementalMesh
+    {
+        IncrementalMesh() : mesh(std::make_shared<Mesh>()), rebuilt(false), meshGeneration(0), unusedVertices(0), unusedIndices(0) {}
+
+        std::shared_ptr<Mesh> mesh;
+
+        /// True if the last update rebuilt the whole mesh, otherwise only the changed ranges were written.
+        bool rebuilt;
+
+        /// Vertex and index ranges written by the last update as (first, count).
+        std::vector<std::pair<size_t, size_t> > changedVertices;
+        std::vector<std::pair<size_t, size_t> > changedIndices;
+
+        struct LeafRange
+        {
+            LeafRange() : firstVertex(0), numVertices(0), vertexCapacity(0), firstIndex(0), numIndices(0), indexCapacity(0) {}
+            size_t firstVertex;
+            size_t numVertices;
+            size_t vertexCapacity;
+            size_t firstIndex;
+            size_t numIndices;
+            size_t indexCapacity;
+        };
+
+        /// Ranges of the leaves by leaf min position.
+        std::unordered_map<Vector3i, LeafRange> leafRanges;
+
+        unsigned int meshGeneration;
+
+        /// Vertices and indices that belong to no leaf, the mesh is rebuilt once they make up half of the buffers.
+        size_t unusedVertices;
+        size_t unusedIndices;
+    };
+
+    /// Builds the mesh on the first call, later calls only regenerate the leaves that csg operations changed since the last call and the leaves next to them.
+    /// Adaptive and paged octrees and meshes that were generated by other calls in between are rebuilt completely. Supports one incremental mesh per octree.
+    void updateIncrementalMesh(IncrementalMesh& incrementalMesh);
+
     bool rayIntersectClosest(const Ray& ray, Ray::Intersection& intersection);
 
-	// NIY by this data structure...
-    virtual void getSample(const Ogre::Vector3&, Sample&) const override {}
+    /// Closest hits of a batch of rays. Packets of consecutive rays traverse the octree together, so coherent rays should be next to each other.
+    void rayIntersectClosestBatch(const std::vector<Ray>& rays, Ray::BatchResult& result);
+
+    /// Any hits closer than maxDist of a batch of rays.
+    void rayIntersectAnyBatch(const std::vector<Ray>& rays, float maxDist, Ray::BatchResult& result);
 };
+
+// the leaf sizes that are compiled, see OctreeSF.cpp
+extern template class OctreeSFT<2>;
+extern template class OctreeSFT<3>;
+extern template class OctreeSFT<4>;
+
+typedef OctreeSFT<3> OctreeSF;
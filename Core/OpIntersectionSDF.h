@@ -3,6 +3,7 @@
 
 #include "OgreMath/OgreVector3.h"
 #include <vector>
+#include <functional>
 #include "SolidGeometry.h"
 #include "AABB.h"
 
@@ -36,6 +37,65 @@ public:
 		}
 	}
 
+	/// Inside the intersection if inside all sdfs, does not need full samples.
+	virtual bool getSign(const Ogre::Vector3& point) const override
+	{
+		for (auto i = m_SDFs.begin(); i != m_SDFs.end(); ++i)
+		{
+			if (!(*i)->getSign(point)) return false;
+		}
+		return true;
+	}
+
+	virtual void getSamples(const Ogre::Vector3* points, int numPoints, Sample* minSamples) const override
+	{
+		combineSamples(numPoints, minSamples, [points, numPoints](SolidGeometry* sdf, Sample* samples) { sdf->getSamples(points, numPoints, samples); });
+	}
+
+	virtual void getSigns(const Ogre::Vector3* points, int numPoints, bool* signs) const override
+	{
+		combineSigns(numPoints, signs, [points, numPoints](SolidGeometry* sdf, bool* sdfSigns) { sdf->getSigns(points, numPoints, sdfSigns); });
+	}
+
+	virtual void getLatticeSamples(const Lattice& lattice, Sample* minSamples) const override
+	{
+		combineSamples(lattice.getNumPoints(), minSamples, [&lattice](SolidGeometry* sdf, Sample* samples) { sdf->getLatticeSamples(lattice, samples); });
+	}
+
+	virtual void getLatticeSigns(const Lattice& lattice, bool* signs) const override
+	{
+		combineSigns(lattice.getNumPoints(), signs, [&lattice](SolidGeometry* sdf, bool* sdfSigns) { sdf->getLatticeSigns(lattice, sdfSigns); });
+	}
+
+	/// Evaluates a batch of points for all sdfs and keeps the minimum sample per point.
+	void combineSamples(int numPoints, Sample* minSamples, const std::function<void(SolidGeometry*, Sample*)>& evaluate) const
+	{
+		for (int i = 0; i < numPoints; i++)
+			minSamples[i].signedDistance = std::numeric_limits<float>::max();
+		std::vector<Sample> samples(numPoints);
+		for (auto i = m_SDFs.begin(); i != m_SDFs.end(); ++i)
+		{
+			evaluate(*i, samples.data());
+			for (int j = 0; j < numPoints; j++)
+			{
+				if (samples[j].signedDistance < minSamples[j].signedDistance)
+					minSamples[j] = samples[j];
+			}
+		}
+	}
+
+	void combineSigns(int numPoints, bool* signs, const std::function<void(SolidGeometry*, bool*)>& evaluate) const
+	{
+		std::fill(signs, signs + numPoints, true);
+		std::unique_ptr<bool[]> sdfSigns(new bool[numPoints]);
+		for (auto i = m_SDFs.begin(); i != m_SDFs.end(); ++i)
+		{
+			evaluate(*i, sdfSigns.get());
+			for (int j = 0; j < numPoints; j++)
+				signs[j] = signs[j] && sdfSigns[j];
+		}
+	}
+
 	bool intersectsSurface(const AABB& aabb) const override
 	{
 		for (auto i = m_SDFs.begin(); i != m_SDFs.end(); ++i)
@@ -50,6 +110,23 @@ public:
 		return m_AABB;
 	}
 
+	float getLipschitzConstant() const override
+	{
+		float lipschitzConstant = 1.0f;
+		for (auto i = m_SDFs.begin(); i != m_SDFs.end(); ++i)
+			lipschitzConstant = std::max(lipschitzConstant, (*i)->getLipschitzConstant());
+		return lipschitzConstant;
+	}
+
+	/// The surface is a subset of the union of all sdf surfaces, so the closest of them bounds the distance.
+	float getDistanceLowerBound(const Ogre::Vector3& point, float maxDistance) const override
+	{
+		float lowerBound = std::numeric_limits<float>::max();
+		for (auto i = m_SDFs.begin(); i != m_SDFs.end(); ++i)
+			lowerBound = std::min(lowerBound, (*i)->getDistanceLowerBound(point, maxDistance));
+		return lowerBound;
+	}
+
 	void prepareSampling(const AABB& aabb, float cellSize) override
 	{
 		for (auto i = m_SDFs.begin(); i != m_SDFs.end(); ++i)
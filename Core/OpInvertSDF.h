@@ -20,6 +20,50 @@ public:
         sample.normal *= -1.0f;
 	}
 
+    virtual bool getSign(const Ogre::Vector3& point) const override
+    {
+        return !m_SDF->getSign(point);
+    }
+
+    virtual void getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const override
+    {
+        m_SDF->getSamples(points, numPoints, samples);
+        invertSamples(numPoints, samples);
+    }
+
+    virtual void getSigns(const Ogre::Vector3* points, int numPoints, bool* signs) const override
+    {
+        m_SDF->getSigns(points, numPoints, signs);
+        invertSigns(numPoints, signs);
+    }
+
+    virtual void getLatticeSamples(const Lattice& lattice, Sample* samples) const override
+    {
+        m_SDF->getLatticeSamples(lattice, samples);
+        invertSamples(lattice.getNumPoints(), samples);
+    }
+
+    virtual void getLatticeSigns(const Lattice& lattice, bool* signs) const override
+    {
+        m_SDF->getLatticeSigns(lattice, signs);
+        invertSigns(lattice.getNumPoints(), signs);
+    }
+
+    static void invertSamples(int numSamples, Sample* samples)
+    {
+        for (int i = 0; i < numSamples; i++)
+        {
+            samples[i].signedDistance *= -1.0f;
+            samples[i].normal *= -1.0f;
+        }
+    }
+
+    static void invertSigns(int numSigns, bool* signs)
+    {
+        for (int i = 0; i < numSigns; i++)
+            signs[i] = !signs[i];
+    }
+
     virtual bool raycastClosest(const Ray& ray, Sample& sample) const override
     {
         if (!m_SDF->raycastClosest(ray, sample))
@@ -39,6 +83,16 @@ public:
 		return m_SDF->getAABB();
 	}
 
+	float getLipschitzConstant() const override
+	{
+		return m_SDF->getLipschitzConstant();
+	}
+
+	float getDistanceLowerBound(const Ogre::Vector3& point, float maxDistance) const override
+	{
+		return m_SDF->getDistanceLowerBound(point, maxDistance);
+	}
+
 	void prepareSampling(const AABB& aabb, float cellSize) override
 	{
 		m_SDF->prepareSampling(aabb, cellSize);
@@ -29,6 +29,49 @@ public:
         return m_Normal.dotProduct(m_Pos - point) > 0;
     }
 
+    virtual void getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const override
+    {
+        for (int i = 0; i < numPoints; i++)
+            PlaneGeometry::getSample(points[i], samples[i]);
+    }
+
+    virtual void getSigns(const Ogre::Vector3* points, int numPoints, bool* signs) const override
+    {
+        for (int i = 0; i < numPoints; i++)
+            signs[i] = m_Normal.dotProduct(m_Pos - points[i]) > 0;
+    }
+
+    virtual void getLatticeSamples(const Lattice& lattice, Sample* samples) const override
+    {
+        for (int x = 0; x < lattice.size.x; x++)
+            for (int y = 0; y < lattice.size.y; y++)
+                for (int z = 0; z < lattice.size.z; z++)
+                    PlaneGeometry::getSample(lattice.getPoint(x, y, z), *samples++);
+    }
+
+    virtual void getLatticeSigns(const Lattice& lattice, bool* signs) const override
+    {
+        // the plane distance is a sum of per axis terms
+        std::vector<float> dists[3];
+        for (int dim = 0; dim < 3; dim++)
+        {
+            dists[dim].resize(lattice.size[dim]);
+            for (int i = 0; i < lattice.size[dim]; i++)
+                dists[dim][i] = m_Normal[dim] * (m_Pos[dim] - lattice.getCoord(dim, i));
+        }
+        const float* dz = dists[2].data();
+        for (int x = 0; x < lattice.size.x; x++)
+        {
+            for (int y = 0; y < lattice.size.y; y++)
+            {
+                float dxy = dists[0][x] + dists[1][y];
+                for (int z = 0; z < lattice.size.z; z++)
+                    signs[z] = (dxy + dz[z]) > 0;
+                signs += lattice.size.z;
+            }
+        }
+    }
+
     virtual bool intersectsSurface(const AABB& aabb) const override
     {
         unsigned char mask = 0;
@@ -21,6 +21,9 @@
 
 // #define USE_BOOST_THREADING
 
+/// Stores the hermite data of OctreeSF surface edges quantized to 8 bytes per edge (edge crossing and octahedral normal) instead of full precision.
+// #define USE_COMPACT_HERMITE_EDGES
+
 #if ENABLE_ASSERTIONS
 #define vAssert(condition) {if (!(condition)) { std::cout << "assertion failed: " << #condition << " in " << __FILE__ << ", line " << __LINE__ << "." << std::endl; __debugbreak(); }}
 #else
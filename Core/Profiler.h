@@ -33,6 +33,12 @@ public:
         return std::chrono::high_resolution_clock::now();
 	}
 
+	/// Returns the seconds that passed since the given timestamp.
+	static float getSeconds(const Timestamp& timeStampJobStart)
+	{
+		return toSeconds(getDuration(timeStampJobStart));
+	}
+
 	static void printJobDuration(std::string jobName, Timestamp timeStampJobStart)
 	{
         std::cout << jobName << " - Done (took " << toSeconds(getDuration(timeStampJobStart)) << " seconds)" << std::endl;
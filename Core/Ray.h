@@ -2,9 +2,12 @@
 #pragma once
 
 #include <algorithm>
+#include <vector>
+#include <limits>
 #include "OgreMath/OgreVector3.h"
 #include "OgreMath/OgreMatrix3.h"
 #include "Triangle.h"
+#include "MathMisc.h"
 
 class SceneRenderer;
 
@@ -34,6 +37,21 @@ public:
 		Ogre::Vector3 userData[1];
 	};
 
+	/// Results of a batch of ray queries as structure of arrays indexed like the rays, t and userData are only set for rays that hit.
+	struct BatchResult
+	{
+		std::vector<unsigned char> hit;
+		std::vector<float> t;
+		std::vector<Ogre::Vector3> userData;
+
+		void resize(size_t numRays)
+		{
+			hit.assign(numRays, 0);
+			t.assign(numRays, std::numeric_limits<float>::infinity());
+			userData.resize(numRays);
+		}
+	};
+
 	/// Tests the ray against intersection with a sphere given by a position and a radius.
     inline bool intersectSphere(Intersection &intersection, const Ogre::Vector3 &sphereCenter, float squaredSphereRadius, float tNear = 0.0f, float tFar = 100000.0f) const
 	{
@@ -164,6 +182,29 @@ public:
 		return ((intersection.userData[0].x >= epsilon) && (intersection.userData[0].y >= epsilon) && (intersection.userData[0].z >= epsilon));
 	}
 
+	/// Two sided Moeller-Trumbore test against a triangle given by its corners, updates the intersection if it is closer than the closest intersection.
+    inline bool intersectTriangleUpdate(Intersection &intersection, const Ogre::Vector3& p1, const Ogre::Vector3& p2, const Ogre::Vector3& p3) const
+	{
+		Ogre::Vector3 edge1 = p2 - p1;
+		Ogre::Vector3 edge2 = p3 - p1;
+		Ogre::Vector3 p = direction.crossProduct(edge2);
+		float det = edge1.dotProduct(p);
+		if (det == 0.0f) return false;
+		float invDet = 1.0f / det;
+		Ogre::Vector3 s = origin - p1;
+		float u = s.dotProduct(p) * invDet;
+		static const float epsilon = -0.0001f;
+		if (u < epsilon || u > 1.0f - epsilon) return false;
+		Ogre::Vector3 q = s.crossProduct(edge1);
+		float v = direction.dotProduct(q) * invDet;
+		if (v < epsilon || u + v > 1.0f - epsilon) return false;
+		float t = edge2.dotProduct(q) * invDet;
+		if (t < 0.0f || t >= intersection.t) return false;
+		intersection.t = t;
+		intersection.userData[0] = Ogre::Vector3(1.0f - u - v, u, v);
+		return true;
+	}
+
 	/// Tests the ray against intersection with a triangle and checks whether the intersection is closer than the closest intersection.
     inline bool intersectTriangleUpdate(Intersection &intersection, const TriangleCached& triData) const
 	{
@@ -183,3 +224,118 @@ public:
 		return false;
 	}
 };
+
+/// Up to SIZE rays in structure of arrays layout, the slab tests of the whole packet against a box are branch free loops that the compiler vectorizes.
+/// Each ray of a packet is a bit in the masks of active rays.
+struct RayPacket
+{
+	static const int SIZE = 8;
+
+	const Ray* rays[SIZE];
+	int size;
+	float origin[3][SIZE];
+	float directionInv[3][SIZE];
+	/// Boxes farther than tFar are culled, the queries set it to the closest hit so far.
+	float tFar[SIZE];
+
+	/// Packs the rays with the given indices.
+	RayPacket(const std::vector<Ray>& allRays, const unsigned int* indices, int size, float maxDist) : size(size)
+	{
+		for (int i = 0; i < SIZE; i++)
+		{
+			// unused lanes repeat the first ray, they are never in the mask
+			rays[i] = &allRays[indices[i < size ? i : 0]];
+			for (int d = 0; d < 3; d++)
+			{
+				origin[d][i] = rays[i]->origin[d];
+				directionInv[d][i] = rays[i]->directionInv[d];
+			}
+			tFar[i] = maxDist;
+		}
+	}
+
+	inline unsigned int getMask() const { return (1u << size) - 1; }
+
+	/// Returns the rays of the mask that intersect the box between 0 and their tFar.
+	inline unsigned int intersectAABB(const Ogre::Vector3& min, const Ogre::Vector3& max, unsigned int mask) const
+	{
+		float tNear[SIZE], tExit[SIZE];
+		for (int i = 0; i < SIZE; i++)
+		{
+			tNear[i] = 0.0f;
+			tExit[i] = tFar[i];
+		}
+		for (int d = 0; d < 3; d++)
+		{
+			for (int i = 0; i < SIZE; i++)
+			{
+				float t1 = (min[d] - origin[d][i]) * directionInv[d][i];
+				float t2 = (max[d] - origin[d][i]) * directionInv[d][i];
+				tNear[i] = std::max(tNear[i], std::min(t1, t2));
+				tExit[i] = std::min(tExit[i], std::max(t1, t2));
+			}
+		}
+		unsigned int hitMask = 0;
+		for (int i = 0; i < SIZE; i++)
+			hitMask |= (unsigned int)(tNear[i] <= tExit[i]) << i;
+		return hitMask & mask;
+	}
+
+	/// Returns the index of the first ray of a non empty mask.
+	static inline int getFirstRay(unsigned int mask)
+	{
+		int i = 0;
+		while (!(mask & (1u << i))) i++;
+		return i;
+	}
+
+	/// True if the mask contains exactly one ray, such packets are cheaper to traverse as a single ray.
+	static inline bool isSingleRay(unsigned int mask) { return !(mask & (mask - 1)); }
+
+	/// Orders the rays so consecutive rays are coherent: sorted by direction octant, then along morton curves of the direction and the origin.
+	/// Batches that are mostly coherent already (like camera rays in tiles) keep their order, sorting them costs more than it saves.
+	static void sortCoherent(const std::vector<Ray>& rays, std::vector<unsigned int>& order)
+	{
+		order.resize(rays.size());
+		size_t numCoherent = 0;
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			order[i] = (unsigned int)i;
+			if (i && rays[i].direction.dotProduct(rays[i - 1].direction) > 0.99f * rays[i].direction.length() * rays[i - 1].direction.length()
+				&& rays[i].origin.squaredDistance(rays[i - 1].origin) < 1e-4f * rays[i].direction.squaredLength())
+				numCoherent++;
+		}
+		if (numCoherent * 4 >= rays.size() * 3)
+			return;
+
+		Ogre::Vector3 originMin(std::numeric_limits<float>::max()), originMax(-std::numeric_limits<float>::max());
+		for (auto i = rays.begin(); i != rays.end(); ++i)
+		{
+			originMin.makeFloor(i->origin);
+			originMax.makeCeil(i->origin);
+		}
+		Ogre::Vector3 originScale;
+		for (int d = 0; d < 3; d++)
+			originScale[d] = 1023.0f / std::max(originMax[d] - originMin[d], 1e-6f);
+		std::vector<std::pair<unsigned long long, unsigned int> > keys(rays.size());
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			const Ray& ray = rays[i];
+			unsigned long long octant = (ray.sign[0] << 2) | (ray.sign[1] << 1) | ray.sign[2];
+			unsigned int direction[3], origin[3];
+			float directionLength = ray.direction.length();
+			for (int d = 0; d < 3; d++)
+			{
+				direction[d] = (unsigned int)((ray.direction[d] / directionLength * 0.5f + 0.5f) * 1023.0f);
+				origin[d] = (unsigned int)((ray.origin[d] - originMin[d]) * originScale[d]);
+			}
+			unsigned long long directionKey = MathMisc::mortonKey(direction[0], direction[1], direction[2]);
+			unsigned long long originKey = MathMisc::mortonKey(origin[0], origin[1], origin[2]);
+			// the 15 high direction bits first, then the 30 origin bits
+			keys[i] = std::make_pair((octant << 45) | ((directionKey >> 15) << 30) | originKey, (unsigned int)i);
+		}
+		std::sort(keys.begin(), keys.end());
+		for (size_t i = 0; i < rays.size(); i++)
+			order[i] = keys[i].second;
+	}
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// Bit scan helpers for 64 bit words.
+struct BitOps
+{
+	typedef unsigned long long Word;
+
+	/// Index of the lowest set bit, word must not be zero.
+	static inline int countTrailingZeros(Word word)
+	{
+#if defined(_MSC_VER) && defined(_WIN64)
+		unsigned long index;
+		_BitScanForward64(&index, word);
+		return (int)index;
+#elif defined(_MSC_VER)
+		// Win32 has no 64 bit intrinsics, scan the low and high half separately
+		unsigned long index;
+		if (_BitScanForward(&index, (unsigned long)word))
+			return (int)index;
+		_BitScanForward(&index, (unsigned long)(word >> 32));
+		return (int)index + 32;
+#else
+		return __builtin_ctzll(word);
+#endif
+	}
+
+	static inline int popCount(Word word)
+	{
+#if defined(_MSC_VER) && defined(_WIN64)
+		return (int)__popcnt64(word);
+#elif defined(_MSC_VER)
+		return (int)(__popcnt((unsigned int)word) + __popcnt((unsigned int)(word >> 32)));
+#else
+		return __builtin_popcountll(word);
+#endif
+	}
+};
+
+/*
+Fixed size array of packed bits, used for the signs of a leaf lattice (one bit instead of one bool per lattice point).
+Bit i is stored in word i / 64 at position i % 64. The unused bits of the last word are kept zero, so whole words can be compared and counted.
+*/
+template<int NUM_BITS>
+class SignBits
+{
+public:
+	typedef BitOps::Word Word;
+	static const int NUM_WORDS = (NUM_BITS + 63) / 64;
+
+	Word words[NUM_WORDS];
+
+	inline bool get(int i) const { return ((words[i >> 6] >> (i & 63)) & 1) != 0; }
+
+	inline bool operator [] (int i) const { return get(i); }
+
+	inline void set(int i, bool value)
+	{
+		Word mask = (Word)1 << (i & 63);
+		words[i >> 6] = (words[i >> 6] & ~mask) | ((Word)value << (i & 63));
+	}
+
+	void clear() { memset(words, 0, sizeof(words)); }
+
+	/// Packs an array of NUM_BITS bools.
+	void fromBools(const bool* values)
+	{
+		clear();
+		for (int i = 0; i < NUM_BITS; i++)
+			words[i >> 6] |= (Word)values[i] << (i & 63);
+	}
+
+	void invert()
+	{
+		for (int i = 0; i < NUM_WORDS; i++)
+			words[i] = ~words[i];
+		words[NUM_WORDS - 1] &= getLastWordMask();
+	}
+
+	inline SignBits& operator &= (const SignBits& rhs)
+	{
+		for (int i = 0; i < NUM_WORDS; i++)
+			words[i] &= rhs.words[i];
+		return *this;
+	}
+
+	inline SignBits& operator |= (const SignBits& rhs)
+	{
+		for (int i = 0; i < NUM_WORDS; i++)
+			words[i] |= rhs.words[i];
+		return *this;
+	}
+
+	/// Clears all bits that are set in rhs.
+	inline void clearBits(const SignBits& rhs)
+	{
+		for (int i = 0; i < NUM_WORDS; i++)
+			words[i] &= ~rhs.words[i];
+	}
+
+	inline bool operator == (const SignBits& rhs) const { return memcmp(words, rhs.words, sizeof(words)) == 0; }
+
+	/// Sets bit i of result to get(i) != get(i + offset), bits beyond the array are treated as zero.
+	void xorShifted(int offset, SignBits& result) const
+	{
+		int wordOffset = offset >> 6;
+		int bitOffset = offset & 63;
+		for (int i = 0; i < NUM_WORDS; i++)
+		{
+			Word shifted = 0;
+			if (i + wordOffset < NUM_WORDS)
+				shifted = words[i + wordOffset] >> bitOffset;
+			if (bitOffset && i + wordOffset + 1 < NUM_WORDS)
+				shifted |= words[i + wordOffset + 1] << (64 - bitOffset);
+			result.words[i] = words[i] ^ shifted;
+		}
+	}
+
+	int count() const
+	{
+		int counter = 0;
+		for (int i = 0; i < NUM_WORDS; i++)
+			counter += BitOps::popCount(words[i]);
+		return counter;
+	}
+
+	/// Calls function(i) for every set bit in ascending order.
+	template<class Function>
+	inline void forEachSetBit(const Function& function) const
+	{
+		for (int i = 0; i < NUM_WORDS; i++)
+		{
+			Word word = words[i];
+			while (word)
+			{
+				function((i << 6) + BitOps::countTrailingZeros(word));
+				word &= word - 1;
+			}
+		}
+	}
+
+	static Word getLastWordMask() { return (NUM_BITS & 63) ? ((Word)1 << (NUM_BITS & 63)) - 1 : ~(Word)0; }
+};
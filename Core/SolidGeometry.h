@@ -19,6 +19,21 @@ typedef unsigned int MaterialID;
 class SolidGeometry
 {
 public:
+	/// Decides how cubeNeedsSubdivision rejects cubes that can not contain surface.
+	enum CullingMode
+	{
+		/// Tests the cube against the surface with intersectsSurface.
+		CULL_INTERSECTS_SURFACE,
+		/// Rejects the cube if a lower bound of the distance from its center to the surface exceeds its half diagonal (one distance evaluation).
+		CULL_DISTANCE_BOUND
+	};
+
+protected:
+	CullingMode m_CullingMode;
+
+public:
+	SolidGeometry() : m_CullingMode(CULL_INTERSECTS_SURFACE) {}
+
 	// If you want to store additional data in the signed distance grid, this is the right place to add it.
 	struct Sample
 	{
@@ -49,6 +64,26 @@ public:
 		}
 	};
 
+	/// Regular grid of points origin + (minIndex + (x, y, z)) * stepSize with 0 <= (x, y, z) < size, ordered like a leaf grid (z varies fastest).
+	struct Lattice
+	{
+		Lattice() {}
+		Lattice(const Ogre::Vector3& origin, float stepSize, const Vector3i& minIndex, const Vector3i& size)
+			: origin(origin), stepSize(stepSize), minIndex(minIndex), size(size) {}
+
+		Ogre::Vector3 origin;
+		float stepSize;
+		Vector3i minIndex;
+		Vector3i size;
+
+		inline int getNumPoints() const { return size.x * size.y * size.z; }
+
+		/// Coordinate of the lattice plane with the given index along one axis.
+		inline float getCoord(int dim, int i) const { return origin[dim] + (Ogre::Real)(minIndex[dim] + i) * stepSize; }
+
+		inline Ogre::Vector3 getPoint(int x, int y, int z) const { return origin + (minIndex + Vector3i(x, y, z)).toOgreVec() * stepSize; }
+	};
+
 	// Convenient helper methods for subclasses.
 	static bool allSignsAreEqual(const float* signedDistances)
 	{
@@ -91,11 +126,66 @@ public:
     virtual bool getSign(const Ogre::Vector3& point) const { return getSample(point).signedDistance >= 0.0f; }
 
     /// Implementations may override this to provide high speed implementations for cubic aabbs.
-    virtual bool cubeNeedsSubdivision(const Area& area) const { return intersectsSurface(area.toAABB()); }
+    virtual bool cubeNeedsSubdivision(const Area& area) const
+    {
+        if (m_CullingMode == CULL_DISTANCE_BOUND)
+        {
+            float halfSize = area.m_RealSize * 0.5f;
+            float halfDiagonal = std::sqrt(3.0f) * halfSize;
+            Ogre::Vector3 center = area.m_MinRealPos + Ogre::Vector3(halfSize, halfSize, halfSize);
+            return getDistanceLowerBound(center, halfDiagonal) <= halfDiagonal;
+        }
+        return intersectsSurface(area.toAABB());
+    }
+
+    void setCullingMode(CullingMode cullingMode) { m_CullingMode = cullingMode; }
+    CullingMode getCullingMode() const { return m_CullingMode; }
+
+    /// Upper bound of the gradient magnitude of the signed distance, 1 for exact distance fields.
+    virtual float getLipschitzConstant() const { return 1.0f; }
+
+    /// Retrieves a lower bound of the distance from point to the surface.
+    /// Implementations may stop refining the bound as soon as it exceeds maxDistance, in that case any value > maxDistance may be returned.
+    virtual float getDistanceLowerBound(const Ogre::Vector3& point, float) const
+    {
+        return std::fabs(getSample(point).signedDistance) / getLipschitzConstant();
+    }
 
     /// Called before the first call to getSample. Usually not required, only used by TriangleMeshSDF_Robust so far which builds a grid.
     virtual void prepareSampling(const AABB&, float) {}
 
+    /// Retrieves the samples for an array of points. Implementations may override this to avoid a virtual call per point.
+    virtual void getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const
+    {
+        for (int i = 0; i < numPoints; i++)
+            getSample(points[i], samples[i]);
+    }
+
+    /// Retrieves the signs for an array of points.
+    virtual void getSigns(const Ogre::Vector3* points, int numPoints, bool* signs) const
+    {
+        for (int i = 0; i < numPoints; i++)
+            signs[i] = getSign(points[i]);
+    }
+
+    /// Retrieves the samples for all points of a lattice.
+    virtual void getLatticeSamples(const Lattice& lattice, Sample* samples) const
+    {
+        for (int x = 0; x < lattice.size.x; x++)
+            for (int y = 0; y < lattice.size.y; y++)
+                for (int z = 0; z < lattice.size.z; z++)
+                    getSample(lattice.getPoint(x, y, z), *samples++);
+    }
+
+    /// Retrieves the signs for all points of a lattice.
+    virtual void getLatticeSigns(const Lattice& lattice, bool* signs) const
+    {
+        for (int x = 0; x < lattice.size.x; x++)
+            for (int y = 0; y < lattice.size.y; y++)
+                for (int z = 0; z < lattice.size.z; z++)
+                    *signs++ = getSign(lattice.getPoint(x, y, z));
+    }
+
     Sample getSample(const Ogre::Vector3& point) const { Sample s; getSample(point, s); return s; }
 };
 
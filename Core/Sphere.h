@@ -73,6 +73,52 @@ public:
         return (radiusSquared - center.squaredDistance(point) > 0);
 	}
 
+	virtual void getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const override
+	{
+		for (int i = 0; i < numPoints; i++)
+			SphereGeometry::getSample(points[i], samples[i]);
+	}
+
+	virtual void getSigns(const Ogre::Vector3* points, int numPoints, bool* signs) const override
+	{
+		for (int i = 0; i < numPoints; i++)
+			signs[i] = (radiusSquared - center.squaredDistance(points[i]) > 0);
+	}
+
+	virtual void getLatticeSamples(const Lattice& lattice, Sample* samples) const override
+	{
+		for (int x = 0; x < lattice.size.x; x++)
+			for (int y = 0; y < lattice.size.y; y++)
+				for (int z = 0; z < lattice.size.z; z++)
+					SphereGeometry::getSample(lattice.getPoint(x, y, z), *samples++);
+	}
+
+	virtual void getLatticeSigns(const Lattice& lattice, bool* signs) const override
+	{
+		// the squared distance to the center is a sum of per axis terms
+		std::vector<float> squaredDists[3];
+		for (int dim = 0; dim < 3; dim++)
+		{
+			squaredDists[dim].resize(lattice.size[dim]);
+			for (int i = 0; i < lattice.size[dim]; i++)
+			{
+				float diff = center[dim] - lattice.getCoord(dim, i);
+				squaredDists[dim][i] = diff * diff;
+			}
+		}
+		const float* dz = squaredDists[2].data();
+		for (int x = 0; x < lattice.size.x; x++)
+		{
+			for (int y = 0; y < lattice.size.y; y++)
+			{
+				float dxy = squaredDists[0][x] + squaredDists[1][y];
+				for (int z = 0; z < lattice.size.z; z++)
+					signs[z] = (radiusSquared - (dxy + dz[z]) > 0);
+				signs += lattice.size.z;
+			}
+		}
+	}
+
 	virtual bool intersectsSurface(const AABB& aabb) const override
 	{
 		if (!intersectsAABB(aabb))
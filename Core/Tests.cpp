@@ -3,6 +3,7 @@
 #include <fstream>
 #include <ctime>
 #include <limits>
+#include <random>
 #include "Profiler.h"
 #include "OBJReader.h"
 #include "UniformGridSDF.h"
@@ -23,7 +24,9 @@
 #include "FracturePattern.h"
 #include "AABBGeometry.h"
 #include "OctreeSF.h"
+#include "LinearOctreeSF.h"
 #include "VoronoiFragments.h"
+#include "ThreadPool.h"
 
 using std::vector;
 using Ogre::Vector3;
@@ -232,6 +235,138 @@ void splitBuddha2()
 	SDFManager::exportSampledSDFAsMesh("signedDistanceTestOctreeAligned_BuddhaSplit2", part2);
 }
 
+void benchmarkAlignedCSG()
+{
+	auto part1 = OctreeSF::sampleSDF(SDFManager::createSDFFromMesh("buddha2.obj").get(), 9);
+	auto part2 = part1->clone();
+	auto part3 = part1->clone();
+	auto fractalNoiseSDF = SDFManager::createFractalNoiseSDF(2.0f, 1.0f, 0.1f);
+	auto fractalNoiseOctree = OctreeSF::sampleSDF(fractalNoiseSDF.get(), part1->getAABB(), 9);
+	auto ts = Profiler::timestamp();
+	part1->intersect(fractalNoiseSDF.get());
+	Profiler::printJobDuration("Buddha intersection with the noise sdf", ts);
+	ts = Profiler::timestamp();
+	part2->intersectAlignedOctree(fractalNoiseOctree.get());
+	Profiler::printJobDuration("Buddha intersection with the aligned noise octree", ts);
+	ts = Profiler::timestamp();
+	part3->subtractAlignedOctree(fractalNoiseOctree.get());
+	Profiler::printJobDuration("Buddha subtraction of the aligned noise octree", ts);
+	std::cout << "Intersected parts have " << part1->countLeaves() << " and " << part2->countLeaves() << " leaves." << std::endl;
+	SDFManager::exportSampledSDFAsMesh("BuddhaAlignedSplit1", part2);
+	SDFManager::exportSampledSDFAsMesh("BuddhaAlignedSplit2", part3);
+}
+
+void testCSGSimplification()
+{
+	SphereGeometry sphereGeometry(Ogre::Vector3(0, 0, 0), 0.5f);
+	auto sphere = OctreeSF::sampleSDF(&sphereGeometry, 8);
+	std::cout << "Sphere has " << sphere->countNodes() << " nodes and occupies " << sphere->countMemory() / 1000 << " kb." << std::endl;
+	// a thin fragment, csg collapses the removed subtrees on the way
+	VoronoiFragments fragments(VoronoiFragments::generateFragmentPointsUniform(sphere->getAABB(), 50));
+	fragments.setFragment(1);
+	sphere->intersect(&fragments);
+	std::cout << "Fragment has " << sphere->countNodes() << " nodes and occupies " << sphere->countMemory() / 1000 << " kb." << std::endl;
+	int numNodes = sphere->countNodes();
+	sphere->simplify();
+	std::cout << "simplify removed " << numNodes - sphere->countNodes() << " more nodes." << std::endl;
+}
+
+void benchmarkOctreeCSG()
+{
+	auto part1 = OctreeSF::sampleSDF(SDFManager::createSDFFromMesh("buddha2.obj").get(), 9);
+	auto part2 = part1->clone();
+	auto part3 = part1->clone();
+	auto fractalNoiseSDF = SDFManager::createFractalNoiseSDF(2.0f, 1.0f, 0.1f);
+	// shifted by whole cells the lattices coincide, at another depth they do not
+	AABB aabb = part1->getAABB();
+	Ogre::Vector3 shift = Ogre::Vector3(37, -21, 5) * ((aabb.getMax().x - aabb.getMin().x) / (1 << 9));
+	auto shiftedNoiseOctree = OctreeSF::sampleSDF(fractalNoiseSDF.get(), AABB(aabb.getMin() + shift, aabb.getMax() + shift), 9);
+	auto coarseNoiseOctree = OctreeSF::sampleSDF(fractalNoiseSDF.get(), aabb, 8);
+	auto ts = Profiler::timestamp();
+	part1->intersect(shiftedNoiseOctree.get());
+	Profiler::printJobDuration("Buddha intersection with the resampled noise octree", ts);
+	ts = Profiler::timestamp();
+	part2->intersectOctree(shiftedNoiseOctree.get());
+	Profiler::printJobDuration("Buddha intersection with the shifted noise octree", ts);
+	ts = Profiler::timestamp();
+	part3->intersectOctree(coarseNoiseOctree.get());
+	Profiler::printJobDuration("Buddha intersection with the coarser noise octree", ts);
+	std::cout << "Intersected parts have " << part1->countLeaves() << ", " << part2->countLeaves() << " and " << part3->countLeaves() << " leaves." << std::endl;
+	SDFManager::exportSampledSDFAsMesh("BuddhaShiftedSplit", part2);
+}
+
+void testResize()
+{
+	SphereGeometry sphereGeometry(Ogre::Vector3(0, 0, 0), 0.5f);
+	auto octree = OctreeSF::sampleSDF(&sphereGeometry, 7);
+	int numLeaves = octree->countLeaves();
+	// the sphere reaches beyond the root in negative x and positive y, merge grows the octree instead of clipping it
+	SphereGeometry boundarySphere(Ogre::Vector3(-0.5f, 0.4f, 0), 0.3f);
+	auto ts = Profiler::timestamp();
+	octree->merge(&boundarySphere);
+	Profiler::printJobDuration("Merge beyond the root", ts);
+	AABB aabb = octree->getAABB();
+	std::cout << "The octree grew to " << aabb.getMin() << " - " << aabb.getMax() << " and has " << octree->countLeaves() << " leaves, "
+		<< octree->countLeaves() - numLeaves << " more than the sphere." << std::endl;
+	SDFManager::exportSampledSDFAsMesh("GrownSphere", octree);
+
+	auto linearOctree = LinearOctreeSF::sampleSDF(&sphereGeometry, 7);
+	linearOctree->merge(&boundarySphere);
+	aabb = linearOctree->getAABB();
+	std::cout << "The linear octree grew to " << aabb.getMin() << " - " << aabb.getMax() << " and has " << linearOctree->countLeaves() << " leaves." << std::endl;
+	SDFManager::exportSampledSDFAsMesh("GrownLinearSphere", linearOctree);
+}
+
+void testParallelSampling()
+{
+	auto meshSDF = SDFManager::createSDFFromMesh("buddha2.obj");
+	AABB aabb = meshSDF->getAABB();
+	aabb.addEpsilon(0.0001f);
+	auto ts = Profiler::timestamp();
+	auto serial = OctreeSF::sampleSDF(meshSDF.get(), aabb, 9);
+	float serialTime = Profiler::getSeconds(ts);
+	auto serialMesh = serial->generateMesh();
+	int numThreads[] = { 1, 2, 4, 8, 16, 32 };
+	for (int i = 0; i < 6; i++)
+	{
+		ThreadPool threadPool(numThreads[i]);
+		ts = Profiler::timestamp();
+		auto parallel = OctreeSF::sampleSDF(meshSDF.get(), aabb, 9, &threadPool, 4);
+		float parallelTime = Profiler::getSeconds(ts);
+		auto parallelMesh = parallel->generateMesh();
+		bool sameTree = parallel->countNodes() == serial->countNodes() && parallel->countLeaves() == serial->countLeaves()
+			&& parallelMesh->vertexBuffer.size() == serialMesh->vertexBuffer.size() && parallelMesh->indexBuffer.size() == serialMesh->indexBuffer.size();
+		std::cout << numThreads[i] << " threads: " << parallelTime << " seconds, speedup " << serialTime / parallelTime << (sameTree ? "" : " (tree differs from serial!)") << std::endl;
+	}
+}
+
+/// Transform wrapper without the sign-only path, every sign query runs a full sample of the wrapped sdf.
+class SampleOnlyTransformSDF : public TransformSDF
+{
+public:
+	SampleOnlyTransformSDF(std::shared_ptr<SolidGeometry> sdf, const Ogre::Matrix4& transform) : TransformSDF(sdf, transform) {}
+	bool getSign(const Ogre::Vector3& point) const override { return SolidGeometry::getSign(point); }
+	void getSigns(const Ogre::Vector3* points, int numPoints, bool* signs) const override { SolidGeometry::getSigns(points, numPoints, signs); }
+	void getLatticeSigns(const Lattice& lattice, bool* signs) const override { SolidGeometry::getLatticeSigns(lattice, signs); }
+};
+
+void testTransformedSignPath()
+{
+	auto bunny = SDFManager::createSDFFromMesh("bunny.capped.obj");
+	Ogre::Matrix4 transform(Ogre::Quaternion(Ogre::Radian(Ogre::Math::PI*0.25f), Ogre::Vector3(1, 0, 0)));
+	SampleOnlyTransformSDF sampleOnlySDF(bunny, transform);
+	TransformSDF transformedSDF(bunny, transform);
+	auto ts = Profiler::timestamp();
+	auto reference = OctreeSF::sampleSDF(&sampleOnlySDF, 8);
+	float sampleOnlyTime = Profiler::getSeconds(ts);
+	ts = Profiler::timestamp();
+	auto octree = OctreeSF::sampleSDF(&transformedSDF, 8);
+	float signOnlyTime = Profiler::getSeconds(ts);
+	std::cout << "Transformed bunny: " << sampleOnlyTime << " seconds with full samples, " << signOnlyTime << " seconds with sign queries (speedup " << sampleOnlyTime / signOnlyTime << ")" << std::endl;
+	std::cout << "Leaves: " << reference->countLeaves() << " vs. " << octree->countLeaves() << std::endl;
+	SDFManager::exportSampledSDFAsMesh("TransformedBunnySignPath", octree);
+}
+
 void testFractalNoisePlane()
 {
 	Ogre::Quaternion rotation(Ogre::Radian(Ogre::Math::PI*0.1f), Ogre::Vector3(1, 0, 0));
@@ -290,6 +425,531 @@ void testSphericalFracturePattern()
 	}
 }
 
+void testParallelFracture()
+{
+	auto meshSDF = SDFManager::createSDFFromMesh("buddha2.obj");
+	AABB aabb = meshSDF->getAABB();
+	aabb.addEpsilon(0.00001f);
+	Ogre::Matrix4 mat;
+	mat.makeTransform(Ogre::Vector3(0, 0, 0), Ogre::Vector3(0.2f, 0.2f, 0.2f), Ogre::Quaternion::IDENTITY);
+	SphericalFracturePattern pattern(8, 2);
+	int numThreads[] = { 1, 2, 4, 8, 16, 32 };
+	for (int i = 0; i < 6; i++)
+	{
+		ThreadPool threadPool(numThreads[i]);
+		auto ts = Profiler::timestamp();
+		auto buddha = OctreeSDF::sampleSDF(meshSDF.get(), aabb, 8, &threadPool);
+		SphericalFracturePattern threadPattern(pattern);
+		auto pieces = threadPattern.fractureSDF(buddha.get(), mat);
+		std::cout << numThreads[i] << " threads: sampling and fracturing into " << pieces.size() << " pieces took " << Profiler::getSeconds(ts) << " seconds" << std::endl;
+	}
+}
+
+/// Identity transform that counts the points at which the wrapped sdf is evaluated.
+class CountingSDF : public TransformSDF
+{
+public:
+	mutable std::atomic<long long> m_NumEvaluations;
+	CountingSDF(std::shared_ptr<SolidGeometry> sdf) : TransformSDF(sdf, Ogre::Matrix4::IDENTITY), m_NumEvaluations(0) {}
+	void getSample(const Ogre::Vector3& point, Sample& sample) const override { m_NumEvaluations++; TransformSDF::getSample(point, sample); }
+	bool getSign(const Ogre::Vector3& point) const override { m_NumEvaluations++; return TransformSDF::getSign(point); }
+	void getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const override { m_NumEvaluations += numPoints; TransformSDF::getSamples(points, numPoints, samples); }
+	void getSigns(const Ogre::Vector3* points, int numPoints, bool* signs) const override { m_NumEvaluations += numPoints; TransformSDF::getSigns(points, numPoints, signs); }
+	void getLatticeSamples(const Lattice& lattice, Sample* samples) const override { m_NumEvaluations += lattice.getNumPoints(); TransformSDF::getLatticeSamples(lattice, samples); }
+	void getLatticeSigns(const Lattice& lattice, bool* signs) const override { m_NumEvaluations += lattice.getNumPoints(); TransformSDF::getLatticeSigns(lattice, signs); }
+};
+
+template<class Sampler>
+void testSharedLeafFaces(const std::string& name, int depth)
+{
+	CountingSDF countingSDF(SDFManager::createSDFFromMesh(name + ".obj"));
+	auto octree = Sampler::sampleSDF(&countingSDF, depth);
+	long long unsharedLattices = (long long)octree->countLeaves() * Sampler::LEAF_SIZE_3D;
+	std::cout << name << ": " << countingSDF.m_NumEvaluations << " sdf evaluations, the unshared leaf lattices alone take " << unsharedLattices
+		<< " (" << 100.0 * (double)countingSDF.m_NumEvaluations / (double)unsharedLattices << "%)" << std::endl;
+}
+
+void printAllocationStats(const std::string& name, const NodeArena::Stats& stats)
+{
+	std::cout << name << ": " << stats.numAllocations << " allocations (" << stats.totalAllocations << " in total), " << stats.numChunks << " chunks, "
+		<< stats.bytesUsed / (1024 * 1024) << " MB used of " << stats.bytesReserved / (1024 * 1024) << " MB reserved" << std::endl;
+}
+
+void testNodeArena()
+{
+	auto octree = OctreeSF::sampleSDF(SDFManager::createSDFFromMesh("buddha2.obj").get(), 9);
+	printAllocationStats("buddha2", octree->getAllocationStats());
+	auto ts = Profiler::timestamp();
+	auto copy = octree->clone();
+	std::cout << "Clone took " << Profiler::getSeconds(ts) << " seconds" << std::endl;
+	printAllocationStats("clone", copy->getAllocationStats());
+	ts = Profiler::timestamp();
+	copy.reset();
+	octree.reset();
+	std::cout << "Destroying both octrees took " << Profiler::getSeconds(ts) << " seconds" << std::endl;
+}
+
+void testCompactHermiteEdges()
+{
+#ifdef USE_COMPACT_HERMITE_EDGES
+	std::string format = "compact";
+#else
+	std::string format = "full precision";
+#endif
+	SphereGeometry sphere(Ogre::Vector3(0.05f, 0.02f, -0.03f), 0.7f);
+	auto octree = OctreeSF::sampleSDF(&sphere, AABB(Ogre::Vector3(-1, -1, -1), Ogre::Vector3(1, 1, 1)), 8);
+	auto mesh = octree->generateMesh();
+	float cellSize = 2.0f / (1 << 8);
+	double errorSum = 0, maxError = 0;
+	for (auto i = mesh->vertexBuffer.begin(); i != mesh->vertexBuffer.end(); ++i)
+	{
+		double error = std::abs(i->position.distance(Ogre::Vector3(0.05f, 0.02f, -0.03f)) - 0.7f) / cellSize;
+		errorSum += error;
+		maxError = std::max(maxError, error);
+	}
+	std::cout << format << " hermite edges: " << octree->countMemory() / octree->countLeaves() << " bytes per leaf, mesh error " << errorSum / mesh->vertexBuffer.size()
+		<< " cells on average, " << maxError << " cells at most" << std::endl;
+}
+
+template<class Octree>
+void benchmarkLeafSize(const std::string& name, SolidGeometry* sdf, int depth)
+{
+	auto ts = Profiler::timestamp();
+	auto octree = Octree::sampleSDF(sdf, depth);
+	double sampleTime = Profiler::getSeconds(ts);
+	ts = Profiler::timestamp();
+	auto mesh = octree->generateMesh();
+	double meshTime = Profiler::getSeconds(ts);
+	std::cout << name << ", leaf size " << (1 << Octree::LEAF_EXPO) << "^3: sampling " << sampleTime << "s, meshing " << meshTime << "s, " << octree->countLeaves() << " leaves, "
+		<< octree->countMemory() / 1024 << " KB, " << mesh->vertexBuffer.size() << " vertices" << std::endl;
+}
+
+void testLeafSizes()
+{
+	const std::string models[] = { "bunny.capped", "buddha2" };
+	for (int i = 0; i < 2; i++)
+	{
+		auto sdf = SDFManager::createSDFFromMesh(models[i] + ".obj");
+		benchmarkLeafSize<OctreeSFT<2> >("OctreeSF " + models[i], sdf.get(), 9);
+		benchmarkLeafSize<OctreeSFT<3> >("OctreeSF " + models[i], sdf.get(), 9);
+		benchmarkLeafSize<OctreeSFT<4> >("OctreeSF " + models[i], sdf.get(), 9);
+		benchmarkLeafSize<OctreeSDFT<2> >("OctreeSDF " + models[i], sdf.get(), 8);
+		benchmarkLeafSize<OctreeSDFT<3> >("OctreeSDF " + models[i], sdf.get(), 8);
+		benchmarkLeafSize<OctreeSDFT<4> >("OctreeSDF " + models[i], sdf.get(), 8);
+	}
+}
+
+template<class Octree>
+void benchmarkOctreeBackend(const std::string& name, SolidGeometry* sdf, int depth)
+{
+	auto ts = Profiler::timestamp();
+	auto octree = Octree::sampleSDF(sdf, depth);
+	double sampleTime = Profiler::getSeconds(ts);
+	ts = Profiler::timestamp();
+	int numLeaves = 0;
+	for (int i = 0; i < 100; i++)
+		numLeaves += octree->countLeaves();
+	double traversalTime = Profiler::getSeconds(ts) / 100;
+	ts = Profiler::timestamp();
+	auto mesh = octree->generateMesh();
+	double meshTime = Profiler::getSeconds(ts);
+	ts = Profiler::timestamp();
+	AABB aabb = octree->getAABB();
+	SphereGeometry sphere(aabb.getCenter(), (aabb.getMax() - aabb.getMin()).length() * 0.25f);
+	octree->subtract(&sphere);
+	double subtractTime = Profiler::getSeconds(ts);
+	std::cout << name << ": sampling " << sampleTime << "s, leaf traversal " << traversalTime << "s, meshing " << meshTime << "s, subtraction " << subtractTime
+		<< "s, " << octree->countNodes() << " nodes, " << octree->countMemory() / 1024 << " KB" << std::endl;
+}
+
+void testLinearOctree()
+{
+	auto sdf = SDFManager::createSDFFromMesh("buddha2.obj");
+	benchmarkOctreeBackend<OctreeSF>("OctreeSF", sdf.get(), 9);
+	benchmarkOctreeBackend<LinearOctreeSF>("LinearOctreeSF", sdf.get(), 9);
+}
+
+void benchmarkAdaptiveLeaves(const std::string& name, SolidGeometry* sdf, const AABB& aabb, int depth, float maxError)
+{
+	auto octree = OctreeSF::sampleSDF(sdf, aabb, depth);
+	auto mesh = octree->generateMesh();
+	auto adaptiveOctree = OctreeSF::sampleSDFAdaptive(sdf, aabb, depth, maxError);
+	auto adaptiveMesh = adaptiveOctree->generateMesh();
+	float adaptiveError = 0;
+	for (auto i = adaptiveMesh->vertexBuffer.begin(); i != adaptiveMesh->vertexBuffer.end(); ++i)
+		adaptiveError = std::max(adaptiveError, std::abs(sdf->getSample(i->position).signedDistance));
+	std::cout << name << ": " << octree->countLeaves() << " leaves and " << mesh->indexBuffer.size() / 3 << " triangles, adaptive " << adaptiveOctree->countLeaves()
+		<< " leaves and " << adaptiveMesh->indexBuffer.size() / 3 << " triangles, max vertex error " << adaptiveError << std::endl;
+}
+
+void testAdaptiveLeaves()
+{
+	// a block with a raised boss, then with a spherical pocket milled into the boss
+	AABB aabb(Ogre::Vector3(-1, -1, -1), Ogre::Vector3(1, 1, 1));
+	AABBGeometry base(Ogre::Vector3(-0.71f, -0.53f, -0.31f), Ogre::Vector3(0.67f, 0.09f, 0.43f));
+	AABBGeometry boss(Ogre::Vector3(-0.23f, 0.05f, -0.17f), Ogre::Vector3(0.29f, 0.61f, 0.27f));
+	OpUnionSDF part(std::vector<SolidGeometry*>{ &base, &boss });
+	benchmarkAdaptiveLeaves("block", &part, aabb, 9, 0.001f);
+	SphereGeometry pocket(Ogre::Vector3(0.37f, 0.6f, 0.05f), 0.24f);
+	OpInvertSDF invertedPocket(&pocket);
+	OpIntersectionSDF milledPart(std::vector<SolidGeometry*>{ &part, &invertedPocket });
+	benchmarkAdaptiveLeaves("milled part", &milledPart, aabb, 9, 0.001f);
+}
+
+void benchmarkCullingMode(const std::string& name, SolidGeometry* sdf, int depth)
+{
+	const SolidGeometry::CullingMode modes[] = { SolidGeometry::CULL_INTERSECTS_SURFACE, SolidGeometry::CULL_DISTANCE_BOUND };
+	const std::string modeNames[] = { "intersectsSurface", "distance bound" };
+	for (int i = 0; i < 2; i++)
+	{
+		sdf->setCullingMode(modes[i]);
+		auto ts = Profiler::timestamp();
+		auto octree = OctreeSF::sampleSDF(sdf, depth);
+		double sampleTime = Profiler::getSeconds(ts);
+		auto mesh = octree->generateMesh();
+		std::cout << name << ", " << modeNames[i] << " culling: sampling " << sampleTime << "s, " << octree->countNodes() << " nodes, " << octree->countLeaves() << " leaves, "
+			<< mesh->indexBuffer.size() / 3 << " triangles" << std::endl;
+	}
+	sdf->setCullingMode(SolidGeometry::CULL_INTERSECTS_SURFACE);
+}
+
+void testCullingModes()
+{
+	auto bunny = SDFManager::createSDFFromMesh("bunny.capped.obj");
+	benchmarkCullingMode("bunny", bunny.get(), 9);
+	Ogre::Quaternion rotation(Ogre::Radian(Ogre::Math::PI*0.1f), Ogre::Vector3(1, 0, 0));
+	auto fractalNoiseSDF = SDFManager::createFractalNoiseSDF(2.0f, 1.0f, 0.15f, rotation);
+	benchmarkCullingMode("fractal noise", fractalNoiseSDF.get(), 8);
+	SphereGeometry sphere(Ogre::Vector3(0, 0, 0), 0.8f);
+	benchmarkCullingMode("sphere", &sphere, 9);
+}
+
+void testLazyOctree()
+{
+	auto sdf = SDFManager::createSDFFromMesh("buddha2.obj");
+	AABB aabb = sdf->getAABB();
+	aabb.addEpsilon(0.0001f);
+	auto ts = Profiler::timestamp();
+	auto octree = OctreeSF::sampleSDF(sdf.get(), aabb, 10);
+	double eagerTime = Profiler::getSeconds(ts);
+	std::cout << "Eager octree: " << eagerTime << "s, " << octree->countNodes() << " nodes, " << octree->countMemory() / 1024 << " KB" << std::endl;
+
+	// mesh a small region around the center and cast a ray through it
+	Ogre::Vector3 center = aabb.getCenter();
+	Ogre::Vector3 regionSize = (aabb.getMax() - aabb.getMin()) * 0.05f;
+	AABB region(center - regionSize, center + regionSize);
+	Ray ray(Ogre::Vector3(center.x, center.y, aabb.getMin().z), Ogre::Vector3(0, 0, 1));
+	ts = Profiler::timestamp();
+	auto lazyOctree = OctreeSF::sampleSDFLazy(sdf.get(), aabb, 10);
+	auto mesh = lazyOctree->generateMesh(region);
+	Ray::Intersection intersection;
+	bool hit = lazyOctree->rayIntersectClosest(ray, intersection);
+	double lazyTime = Profiler::getSeconds(ts);
+	std::cout << "Lazy octree, region mesh and ray: " << lazyTime << "s, " << lazyOctree->countNodes() << " nodes, " << lazyOctree->countMemory() / 1024 << " KB, "
+		<< mesh->indexBuffer.size() / 3 << " triangles, ray " << (hit ? "hit" : "missed") << " at t = " << intersection.t << std::endl;
+	SDFManager::exportSampledSDFAsMesh("LazyOctree", lazyOctree);
+}
+
+template<class Octree>
+void benchmarkSaveLoad(const std::string& name, SolidGeometry* sdf, int depth)
+{
+	auto octree = Octree::sampleSDF(sdf, depth);
+	std::string fileName = name + ".sdfo";
+	auto ts = Profiler::timestamp();
+	bool saved = octree->save(fileName);
+	double saveTime = Profiler::getSeconds(ts);
+	ts = Profiler::timestamp();
+	auto loadedOctree = Octree::load(fileName);
+	double loadTime = Profiler::getSeconds(ts);
+	if (!saved || !loadedOctree)
+	{
+		std::cout << name << ": save/load failed" << std::endl;
+		return;
+	}
+	std::ifstream file(fileName, std::ios_base::binary | std::ios_base::ate);
+	double megaBytes = (double)file.tellg() / (1024 * 1024);
+	std::cout << name << ": " << octree->countNodes() << " nodes, " << megaBytes << " MB, save " << megaBytes / saveTime << " MB/s, load " << megaBytes / loadTime << " MB/s, "
+		<< (loadedOctree->countNodes() == octree->countNodes() ? "same" : "different") << " node count after loading" << std::endl;
+	SDFManager::exportSampledSDFAsMesh(name + "Loaded", loadedOctree);
+}
+
+void testOctreeFiles()
+{
+	auto sdf = SDFManager::createSDFFromMesh("buddha2.obj");
+	benchmarkSaveLoad<OctreeSF>("BuddhaSF", sdf.get(), 9);
+	benchmarkSaveLoad<OctreeSDF>("BuddhaSDF", sdf.get(), 9);
+}
+
+void printPagingStats(const std::string& name, const OctreeSF::PagingStats& stats)
+{
+	std::cout << name << ": " << stats.pageIns << " page ins, " << stats.pageOuts << " page outs, hit rate " << stats.getHitRate() * 100.0f << "%, "
+		<< stats.residentPages << " pages resident, " << stats.pagesOnDisk << " pages on disk" << std::endl;
+}
+
+void testPagedOctree()
+{
+	auto sdf = SDFManager::createSDFFromMesh("buddha2.obj");
+	AABB aabb = sdf->getAABB();
+	aabb.addEpsilon(0.0001f);
+	// 512 pages of 128^3 cells within 64 MB
+	const size_t residentBudget = 64 * 1024 * 1024;
+	auto ts = Profiler::timestamp();
+	auto octree = OctreeSF::sampleSDFPaged(sdf.get(), aabb, 10, "BuddhaPages.bin", 3, residentBudget);
+	std::cout << "Paged sampling: " << Profiler::getSeconds(ts) << "s" << std::endl;
+	printPagingStats("Paged sampling", octree->getPagingStats());
+
+	Ogre::Vector3 center = aabb.getCenter();
+	Ogre::Vector3 size = aabb.getMax() - aabb.getMin();
+	SphereGeometry sphere(center + size * 0.25f, size.x * 0.2f);
+	octree->subtract(&sphere);
+	printPagingStats("Paged subtraction", octree->getPagingStats());
+
+	ts = Profiler::timestamp();
+	auto mesh = octree->generateMesh();
+	std::cout << "Paged meshing: " << Profiler::getSeconds(ts) << "s, " << mesh->indexBuffer.size() / 3 << " triangles" << std::endl;
+	printPagingStats("Paged meshing", octree->getPagingStats());
+}
+
+void testUnreadablePages()
+{
+	// 64 pages of 32^3 cells, most of them are paged out right away
+	AABB aabb(Ogre::Vector3(-1.1f, -1.1f, -1.1f), Ogre::Vector3(1.1f, 1.1f, 1.1f));
+	SphereGeometry pagedSphere(Ogre::Vector3(0, 0, 0), 1.0f);
+	auto paged = OctreeSF::sampleSDFPaged(&pagedSphere, aabb, 7, "TruncatedPages.bin", 2, 1024 * 1024);
+	printPagingStats("Paged sampling", paged->getPagingStats());
+
+	// the pages on disk can no longer be read
+	{
+		std::ofstream truncatedFile("TruncatedPages.bin", std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+	}
+
+	// both operations leave the nodes whose operand pages are missing unchanged instead of reading the placeholders
+	SphereGeometry sphere(Ogre::Vector3(0.5f, 0, 0), 0.8f);
+	auto aligned = OctreeSF::sampleSDF(&sphere, aabb, 7);
+	// shifted by whole cells, so the lattices coincide but the leaves do not
+	Ogre::Vector3 shift(3.0f * (aabb.getMax().x - aabb.getMin().x) / (1 << 7));
+	auto shifted = OctreeSF::sampleSDF(&sphere, AABB(aabb.getMin() + shift, aabb.getMax() + shift), 7);
+	int alignedNodes = aligned->countNodes(), shiftedNodes = shifted->countNodes();
+	aligned->intersectAlignedOctree(paged.get());
+	shifted->intersectOctree(paged.get());
+	std::cout << "Csg with unreadable pages: aligned " << alignedNodes << " -> " << aligned->countNodes() << " nodes, shifted " << shiftedNodes << " -> " << shifted->countNodes() << " nodes" << std::endl;
+	printPagingStats("Csg with unreadable pages", paged->getPagingStats());
+	SDFManager::exportSampledSDFAsMesh("UnreadablePagesAligned", aligned);
+	SDFManager::exportSampledSDFAsMesh("UnreadablePagesShifted", shifted);
+}
+
+void testIncrementalMesh()
+{
+	auto sdf = SDFManager::createSDFFromMesh("buddha2.obj");
+	auto octree = OctreeSF::sampleSDF(sdf.get(), 9);
+	OctreeSF::IncrementalMesh incrementalMesh;
+	auto ts = Profiler::timestamp();
+	octree->updateIncrementalMesh(incrementalMesh);
+	std::cout << "Initial mesh: " << Profiler::getSeconds(ts) << "s, " << incrementalMesh.mesh->indexBuffer.size() / 3 << " triangles" << std::endl;
+
+	// small edits like the sphere tools of the CSG wizard
+	Ogre::Vector3 center = sdf->getAABB().getCenter();
+	double fullTime = 0, incrementalTime = 0;
+	for (int i = 0; i < 10; i++)
+	{
+		SphereGeometry sphere(center + Ogre::Vector3(0.01f * i, 0, 0), 0.02f);
+		if (i % 2)
+			octree->merge(&sphere);
+		else
+			octree->subtract(&sphere);
+		ts = Profiler::timestamp();
+		octree->updateIncrementalMesh(incrementalMesh);
+		incrementalTime += Profiler::getSeconds(ts);
+		auto copy = octree->clone();
+		ts = Profiler::timestamp();
+		copy->generateMesh();
+		fullTime += Profiler::getSeconds(ts);
+	}
+	std::cout << "Remeshing after an edit: full " << fullTime / 10 << "s, incremental " << incrementalTime / 10 << "s" << std::endl;
+	SDFManager::exportSampledSDFAsMesh("IncrementalMesh", octree);
+}
+
+void benchmarkRaycasts()
+{
+	auto sdf = SDFManager::createSDFFromMesh("buddha2.obj");
+	AABB aabb = sdf->getAABB();
+	auto octree = OctreeSF::sampleSDF(sdf.get(), 9);
+
+	// rays from a sphere around the model towards random points near its center
+	Ogre::Vector3 center = aabb.getCenter();
+	float radius = (aabb.getMax() - aabb.getMin()).length();
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+	const int numRays = 100000;
+	std::vector<Ray> rays;
+	rays.reserve(numRays);
+	for (int i = 0; i < numRays; i++)
+	{
+		Ogre::Vector3 direction(distribution(rng), distribution(rng), distribution(rng));
+		direction.normalise();
+		Ogre::Vector3 target = center + Ogre::Vector3(distribution(rng), distribution(rng), distribution(rng)) * radius * 0.1f;
+		rays.push_back(Ray(target - direction * radius, direction));
+	}
+	int hits = 0;
+	auto ts = Profiler::timestamp();
+	for (auto i = rays.begin(); i != rays.end(); ++i)
+	{
+		Ray::Intersection intersection;
+		if (octree->rayIntersectClosest(*i, intersection))
+			hits++;
+	}
+	double seconds = Profiler::getSeconds(ts);
+	std::cout << "Raycasts: " << numRays / seconds << " rays per second, " << hits << " of " << numRays << " rays hit" << std::endl;
+
+	Ray::BatchResult result;
+	ts = Profiler::timestamp();
+	octree->rayIntersectClosestBatch(rays, result);
+	seconds = Profiler::getSeconds(ts);
+	std::cout << "Batched raycasts: " << numRays / seconds << " rays per second, " << std::count(result.hit.begin(), result.hit.end(), 1) << " of " << numRays << " rays hit" << std::endl;
+}
+
+void testOctreeResampling()
+{
+	auto buddha = OctreeSF::sampleSDF(SDFManager::createSDFFromMesh("buddha2.obj").get(), 8);
+	Ogre::Matrix4 transform(Ogre::Quaternion(Ogre::Radian(Ogre::Math::PI*0.25f), Ogre::Vector3(1, 0, 0)));
+	TransformSDF transformedBuddha(buddha, transform);
+	auto ts = Profiler::timestamp();
+	auto rotatedBuddha = OctreeSF::sampleSDF(&transformedBuddha, 8);
+	Profiler::printJobDuration("Buddha octree resampling", ts);
+
+	// the rotated octree as csg operand
+	SphereGeometry sphereGeometry(buddha->getAABB().getCenter(), 0.3f);
+	auto sphere = OctreeSF::sampleSDF(&sphereGeometry, buddha->getAABB(), 8);
+	ts = Profiler::timestamp();
+	sphere->subtract(rotatedBuddha.get());
+	Profiler::printJobDuration("Subtraction of an octree", ts);
+	SDFManager::exportSampledSDFAsMesh("RotatedBuddha", rotatedBuddha);
+	SDFManager::exportSampledSDFAsMesh("SphereMinusRotatedBuddha", sphere);
+}
+
+void printSampleAccuracy(const std::string& name, const SolidGeometry& octree, const SolidGeometry& reference, const AABB& aabb, float cellSize)
+{
+	// random points around the surface, including empty nodes next to it
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	float maxDistanceError = 0.0f;
+	float minNormalDot = 1.0f;
+	int numPoints = 0;
+	while (numPoints < 100000)
+	{
+		Ogre::Vector3 point = aabb.getMin() + (aabb.getMax() - aabb.getMin()) * Ogre::Vector3(distribution(rng), distribution(rng), distribution(rng));
+		SolidGeometry::Sample referenceSample, sample;
+		reference.getSample(point, referenceSample);
+		if (std::fabs(referenceSample.signedDistance) > 8.0f * cellSize)
+			continue;
+		octree.getSample(point, sample);
+		maxDistanceError = std::max(maxDistanceError, std::fabs(sample.signedDistance - referenceSample.signedDistance));
+		minNormalDot = std::min(minNormalDot, sample.normal.dotProduct(referenceSample.normal));
+		numPoints++;
+	}
+	std::cout << name << ": max. distance error " << maxDistanceError / cellSize << " cells, min. normal dot product " << minNormalDot << std::endl;
+}
+
+void testSampleAccuracy()
+{
+	SphereGeometry sphereGeometry(Ogre::Vector3(0, 0, 0), 1.0f);
+	AABB aabb(Ogre::Vector3(-1.2f, -1.2f, -1.2f), Ogre::Vector3(1.2f, 1.2f, 1.2f));
+	auto octree = OctreeSF::sampleSDF(&sphereGeometry, aabb, 7);
+	printSampleAccuracy("OctreeSF", *octree, sphereGeometry, aabb, 1.0f / octree->getInverseCellSize());
+	auto linearOctree = LinearOctreeSF::sampleSDF(&sphereGeometry, aabb, 7);
+	printSampleAccuracy("LinearOctreeSF", *linearOctree, sphereGeometry, aabb, 1.0f / linearOctree->getInverseCellSize());
+}
+
+void benchmarkOctreeSDFQueries()
+{
+	auto sdf = SDFManager::createSDFFromMesh("buddha2.obj");
+	AABB aabb = sdf->getAABB();
+	auto octree = OctreeSDF::sampleSDF(sdf.get(), 9);
+
+	// random points close to the surface, where queries reach the deepest leaves
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	float maxDistance = (aabb.getMax() - aabb.getMin()).length() * 0.01f;
+	const int numPoints = 1000000;
+	std::vector<Ogre::Vector3> points;
+	points.reserve(numPoints);
+	while ((int)points.size() < numPoints)
+	{
+		Ogre::Vector3 point = aabb.getMin() + (aabb.getMax() - aabb.getMin()) * Ogre::Vector3(distribution(rng), distribution(rng), distribution(rng));
+		SolidGeometry::Sample sample;
+		octree->getSample(point, sample);
+		if (std::fabs(sample.signedDistance) < maxDistance)
+			points.push_back(point);
+	}
+	std::vector<SolidGeometry::Sample> samples(numPoints);
+	auto ts = Profiler::timestamp();
+	for (int i = 0; i < numPoints; i++)
+		octree->getSample(points[i], samples[i]);
+	std::cout << "Point queries: " << numPoints / Profiler::getSeconds(ts) << " points per second" << std::endl;
+
+	std::vector<SolidGeometry::Sample> batchedSamples(numPoints);
+	ts = Profiler::timestamp();
+	octree->getSamples(points.data(), numPoints, batchedSamples.data());
+	std::cout << "Batched point queries: " << numPoints / Profiler::getSeconds(ts) << " points per second" << std::endl;
+	float maxError = 0.0f;
+	for (int i = 0; i < numPoints; i++)
+		maxError = std::max(maxError, std::fabs(samples[i].signedDistance - batchedSamples[i].signedDistance));
+	std::cout << "Max. deviation of batched queries: " << maxError << std::endl;
+}
+
+/// The cuts of FracturePattern::splitRecursiveRandom, the pieces are either clones that share nodes or deep copies.
+/// Adds the time spent copying and the memory allocated by the copies to cloneSeconds and clonedBytes.
+void fractureRecursive(int maxSplitDepth, std::shared_ptr<OctreeSDF> sdf, bool shareNodes, std::vector<std::shared_ptr<OctreeSDF> >& outPieces, float& cloneSeconds, size_t& clonedBytes)
+{
+	if (maxSplitDepth <= 0) return;
+	Ogre::Vector3 planeNormal = Ogre::Vector3(Ogre::Math::RangeRandom(-1.0f, 1.0f), Ogre::Math::RangeRandom(-1.0f, 1.0f), Ogre::Math::RangeRandom(-1.0f, 1.0f));
+	planeNormal.normalise();
+	Ogre::Quaternion planeOrientation = Ogre::Vector3(0, 0, 1).getRotationTo(planeNormal);
+	float planeSize = (sdf->getAABB().getMax() - sdf->getAABB().getMin()).x + 0.1f;
+	auto fractalNoiseSDF = SDFManager::createFractalNoiseSDF(planeSize, 1.0f, 0.1f, planeOrientation, sdf->getCenterOfMass());
+	auto ts = Profiler::timestamp();
+	auto newPiece = shareNodes ? sdf->clone() : std::make_shared<OctreeSDF>(*sdf);
+	cloneSeconds += Profiler::getSeconds(ts);
+	clonedBytes += newPiece->getAllocationStats().bytesUsed;
+	newPiece->intersect(fractalNoiseSDF.get());
+	newPiece->simplify();
+	sdf->subtract(fractalNoiseSDF.get());
+	sdf->simplify();
+	outPieces.push_back(newPiece);
+	fractureRecursive(maxSplitDepth - 1, sdf, shareNodes, outPieces, cloneSeconds, clonedBytes);
+	fractureRecursive(maxSplitDepth - 1, newPiece, shareNodes, outPieces, cloneSeconds, clonedBytes);
+}
+
+void benchmarkSharedClones()
+{
+	// a procedural solid of overlapping spheres, roughly the shape of a bunny
+	SphereGeometry body(Ogre::Vector3(0, 0, 0), 0.5f);
+	SphereGeometry head(Ogre::Vector3(0.45f, 0.35f, 0), 0.28f);
+	SphereGeometry leftEar(Ogre::Vector3(0.5f, 0.7f, -0.1f), 0.12f);
+	SphereGeometry rightEar(Ogre::Vector3(0.5f, 0.7f, 0.1f), 0.12f);
+	OpUnionSDF blob(std::vector<SolidGeometry*>{ &body, &head, &leftEar, &rightEar });
+	auto sampledBlob = OctreeSDF::sampleSDF(&blob, 8);
+	bool shareNodes[] = { false, true };
+	for (int i = 0; i < 2; i++)
+	{
+		auto model = std::make_shared<OctreeSDF>(*sampledBlob);
+		std::vector<std::shared_ptr<OctreeSDF> > pieces;
+		float cloneSeconds = 0.0f;
+		size_t clonedBytes = 0;
+		// both runs cut along the same random planes
+		srand(4711);
+		auto ts = Profiler::timestamp();
+		fractureRecursive(4, model, shareNodes[i], pieces, cloneSeconds, clonedBytes);
+		float seconds = Profiler::getSeconds(ts);
+		// every piece allocates from its own arena, a shared node is counted once in the arena of the piece that created it
+		size_t bytesUsed = model->getAllocationStats().bytesUsed;
+		for (auto iPiece = pieces.begin(); iPiece != pieces.end(); iPiece++)
+			bytesUsed += (*iPiece)->getAllocationStats().bytesUsed;
+		std::cout << (shareNodes[i] ? "Shared" : "Copied") << " clones: fracturing into " << pieces.size() + 1 << " pieces took " << seconds << " seconds, "
+			<< cloneSeconds << " of them cloning. The clones allocated " << clonedBytes / (1024 * 1024) << " MB, the pieces use " << bytesUsed / (1024 * 1024) << " MB" << std::endl;
+	}
+}
+
 void exampleInsideOutsideTest()
 {
 	// input: Vertex and index buffer (here I just put some nonsense in it)
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <exception>
+
+// VS2013 does not support thread_local, its __declspec(thread) works for the POD slots of the pool.
+#ifdef _MSC_VER
+#define THREAD_POOL_TLS __declspec(thread)
+#else
+#define THREAD_POOL_TLS thread_local
+#endif
+
+/*
+Work-stealing thread pool for recursive, fork-join style jobs like octree construction.
+Each thread owns a task deque. New tasks are pushed to the back of the deque of the spawning thread and popped from the back again (depth first, good locality),
+idle threads steal from the front of other deques, which usually holds the biggest pending subtrees.
+A thread that waits for a TaskGroup keeps executing tasks, so nested task groups can not deadlock and a pool with n threads only spawns n - 1 workers.
+*/
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	class TaskGroup
+	{
+	protected:
+		ThreadPool& m_Pool;
+		std::atomic<int> m_NumPending;
+
+		/// First exception thrown by a task of the group, rethrown by wait().
+		std::mutex m_ExceptionMutex;
+		std::exception_ptr m_Exception;
+
+		friend class ThreadPool;
+
+		void waitPending()
+		{
+			while (m_NumPending > 0)
+			{
+				if (!m_Pool.tryRunTask())
+					std::this_thread::yield();
+			}
+		}
+
+		void setException(std::exception_ptr exception)
+		{
+			std::lock_guard<std::mutex> lock(m_ExceptionMutex);
+			if (!m_Exception)
+				m_Exception = exception;
+		}
+	public:
+		TaskGroup(ThreadPool& pool) : m_Pool(pool), m_NumPending(0) {}
+
+		/// Waits for the pending tasks, an exception that was not collected with wait() is dropped.
+		~TaskGroup() { waitPending(); }
+
+		/// Spawns a task, it may be executed by any thread of the pool.
+		void run(const Task& task)
+		{
+			m_NumPending++;
+			m_Pool.push(task, this);
+		}
+
+		/// Blocks until all tasks of the group are finished, executes pending tasks in the meantime.
+		/// Rethrows the first exception that was thrown by a task of the group.
+		void wait()
+		{
+			waitPending();
+			std::exception_ptr exception;
+			{
+				std::lock_guard<std::mutex> lock(m_ExceptionMutex);
+				std::swap(exception, m_Exception);
+			}
+			if (exception)
+				std::rethrow_exception(exception);
+		}
+	};
+
+protected:
+	struct QueuedTask
+	{
+		QueuedTask() : group(nullptr) {}
+		QueuedTask(const Task& task, TaskGroup* group) : task(task), group(group) {}
+		Task task;
+		TaskGroup* group;
+	};
+
+	struct TaskQueue
+	{
+		std::mutex mutex;
+		std::deque<QueuedTask> tasks;
+	};
+
+	// Queue 0 is shared by all threads that do not belong to the pool.
+	std::vector<std::unique_ptr<TaskQueue> > m_Queues;
+	std::vector<std::thread> m_Workers;
+
+	std::atomic<int> m_NumQueued;
+	std::atomic<bool> m_Stop;
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WakeUp;
+
+	static ThreadPool*& currentPool() { static THREAD_POOL_TLS ThreadPool* pool = nullptr; return pool; }
+	static int& currentQueueIndex() { static THREAD_POOL_TLS int index = 0; return index; }
+
+	int getQueueIndex() const { return currentPool() == this ? currentQueueIndex() : 0; }
+
+	void push(const Task& task, TaskGroup* group)
+	{
+		TaskQueue& queue = *m_Queues[getQueueIndex()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.emplace_back(task, group);
+		}
+		m_NumQueued++;
+		if (!m_Workers.empty())
+		{
+			std::lock_guard<std::mutex> lock(m_SleepMutex);
+			m_WakeUp.notify_one();
+		}
+	}
+
+	bool popOwn(int queueIndex, QueuedTask& outTask)
+	{
+		TaskQueue& queue = *m_Queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) return false;
+		outTask = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	bool steal(int thiefIndex, QueuedTask& outTask)
+	{
+		int numQueues = (int)m_Queues.size();
+		for (int i = 1; i < numQueues; i++)
+		{
+			TaskQueue& queue = *m_Queues[(thiefIndex + i) % numQueues];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty()) continue;
+			outTask = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+		return false;
+	}
+
+	void workerLoop(int queueIndex)
+	{
+		currentPool() = this;
+		currentQueueIndex() = queueIndex;
+		while (!m_Stop)
+		{
+			if (tryRunTask()) continue;
+			std::unique_lock<std::mutex> lock(m_SleepMutex);
+			m_WakeUp.wait(lock, [this]() { return m_NumQueued > 0 || m_Stop; });
+		}
+	}
+
+public:
+	/// Creates a pool that runs tasks on numThreads threads including the waiting thread.
+	ThreadPool(int numThreads = (int)std::thread::hardware_concurrency()) : m_NumQueued(0), m_Stop(false)
+	{
+		if (numThreads < 1) numThreads = 1;
+		for (int i = 0; i < numThreads; i++)
+			m_Queues.emplace_back(new TaskQueue());
+		for (int i = 1; i < numThreads; i++)
+			m_Workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_SleepMutex);
+			m_Stop = true;
+			m_WakeUp.notify_all();
+		}
+		for (auto i = m_Workers.begin(); i != m_Workers.end(); ++i)
+			i->join();
+	}
+
+	int getNumThreads() const { return (int)m_Queues.size(); }
+
+	/// Executes a single pending task, returns false if there was nothing to do.
+	bool tryRunTask()
+	{
+		if (m_NumQueued == 0) return false;
+		int queueIndex = getQueueIndex();
+		QueuedTask task;
+		if (!popOwn(queueIndex, task) && !steal(queueIndex, task))
+			return false;
+		m_NumQueued--;
+		try
+		{
+			task.task();
+		}
+		catch (...)
+		{
+			task.group->setException(std::current_exception());
+		}
+		task.group->m_NumPending--;
+		return true;
+	}
+};
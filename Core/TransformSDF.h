@@ -28,6 +28,51 @@ public:
         m_SDF->getSample(m_InverseTransform * point, sample);
 	}
 
+	virtual bool getSign(const Ogre::Vector3& point) const override
+	{
+		return m_SDF->getSign(m_InverseTransform * point);
+	}
+
+	virtual void getSamples(const Ogre::Vector3* points, int numPoints, Sample* samples) const override
+	{
+		std::vector<Ogre::Vector3> transformedPoints(numPoints);
+		for (int i = 0; i < numPoints; i++)
+			transformedPoints[i] = m_InverseTransform * points[i];
+		m_SDF->getSamples(transformedPoints.data(), numPoints, samples);
+	}
+
+	virtual void getSigns(const Ogre::Vector3* points, int numPoints, bool* signs) const override
+	{
+		std::vector<Ogre::Vector3> transformedPoints(numPoints);
+		for (int i = 0; i < numPoints; i++)
+			transformedPoints[i] = m_InverseTransform * points[i];
+		m_SDF->getSigns(transformedPoints.data(), numPoints, signs);
+	}
+
+	virtual void getLatticeSamples(const Lattice& lattice, Sample* samples) const override
+	{
+		std::vector<Ogre::Vector3> transformedPoints;
+		getTransformedLatticePoints(lattice, transformedPoints);
+		m_SDF->getSamples(transformedPoints.data(), (int)transformedPoints.size(), samples);
+	}
+
+	virtual void getLatticeSigns(const Lattice& lattice, bool* signs) const override
+	{
+		std::vector<Ogre::Vector3> transformedPoints;
+		getTransformedLatticePoints(lattice, transformedPoints);
+		m_SDF->getSigns(transformedPoints.data(), (int)transformedPoints.size(), signs);
+	}
+
+	/// The transformed lattice is not axis aligned anymore, so it is passed on as a point array.
+	void getTransformedLatticePoints(const Lattice& lattice, std::vector<Ogre::Vector3>& transformedPoints) const
+	{
+		transformedPoints.reserve(lattice.getNumPoints());
+		for (int x = 0; x < lattice.size.x; x++)
+			for (int y = 0; y < lattice.size.y; y++)
+				for (int z = 0; z < lattice.size.z; z++)
+					transformedPoints.push_back(m_InverseTransform * lattice.getPoint(x, y, z));
+	}
+
 	bool intersectsSurface(const AABB& aabb) const override
 	{
 		std::vector<Ogre::Vector3> points;
@@ -41,6 +86,17 @@ public:
 		return m_AABB;
 	}
 
+	float getLipschitzConstant() const override
+	{
+		return m_SDF->getLipschitzConstant();
+	}
+
+	/// Like getSample, this assumes the transform preserves distances.
+	float getDistanceLowerBound(const Ogre::Vector3& point, float maxDistance) const override
+	{
+		return m_SDF->getDistanceLowerBound(m_InverseTransform * point, maxDistance);
+	}
+
 	void prepareSampling(const AABB& aabb, float cellSize) override
 	{
 		std::vector<Ogre::Vector3> points;
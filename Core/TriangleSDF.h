@@ -49,6 +49,12 @@ public:
 		return m_RootNode.getBVH()->intersectsAABB(epsilonAABB);
 	}
 
+	/// Distance to the closest triangle bounding box, only traverses the BVH bounding volumes instead of computing the closest point.
+	float getDistanceLowerBound(const Ogre::Vector3& point, float maxDistance) const override
+	{
+		return std::sqrt(m_RootNode.getBVH()->squaredDistanceLowerBound(point, maxDistance * maxDistance));
+	}
+
 	AABB getAABB() const override { return m_AABB; }
 };
 